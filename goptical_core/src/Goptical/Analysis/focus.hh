@@ -26,9 +26,12 @@
 #ifndef GOPTICAL_ANALYSIS_FOCUS_HH_
 #define GOPTICAL_ANALYSIS_FOCUS_HH_
 
+#include <vector>
+
 #include "Goptical/common.hh"
 
 #include "Goptical/Math/vector_pair.hh"
+#include "Goptical/Data/sample_set.hh"
 
 #include "Goptical/Analysis/pointimage.hh"
 
@@ -46,6 +49,10 @@ namespace _Goptical
 
        This class is designed to find the best point of focus of
        an optical system.
+
+       Through focus curves are computed from a single ray trace:
+       rays intercepted by the image are propagated along straight
+       lines to image planes moved along the image z axis.
     */
     class Focus : public PointImage
     {
@@ -57,11 +64,39 @@ namespace _Goptical
       /** Get best point of focus in system global coordinates. */
       inline const Math::VectorPair3 & get_best_focus();
 
+      /** Get spot rms radius against image defocus for count image
+          planes evenly spaced between first and last defocus
+          distances. */
+      ref<Data::SampleSet> get_rms_radius_curve(double first, double last,
+                                                unsigned int count);
+
+      /** Get amount of light intensity which falls in given radius
+          from spot centroid against image defocus for count image
+          planes evenly spaced between first and last defocus
+          distances. */
+      ref<Data::SampleSet> get_encircled_intensity_curve(double radius,
+                                                         double first, double last,
+                                                         unsigned int count);
+
     private:
       void process_focus();
+      void process_through_focus();
+      ref<Data::SampleSet> new_curve(double first, double last,
+                                     unsigned int count);
 
       bool              _processed_focus;
       Math::VectorPair3 _best_focus;
+
+      bool              _processed_through_focus;
+      /** intercepts projected on image z = 0 plane, relative to centroid */
+      std::vector<double> _x, _y;
+      /** ray slopes relative to mean slope */
+      std::vector<double> _sx, _sy;
+      std::vector<double> _intensity;
+      /** spot centroid and mean slope */
+      Math::Vector2     _centroid, _slope;
+      /** rms radius polynomial in defocus */
+      double            _rms_poly[3];
     };
 
   }
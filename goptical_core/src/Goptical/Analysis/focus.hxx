@@ -27,6 +27,7 @@
 #define GOPTICAL_ANALYSIS_FOCUS_HXX_
 
 #include "Goptical/Math/vector_pair.hxx"
+#include "Goptical/Data/sample_set.hxx"
 #include "Goptical/Analysis/pointimage.hxx"
 
 namespace _Goptical
@@ -39,6 +40,7 @@ namespace _Goptical
     {
       _processed_focus = false;
       _processed_trace = false;
+      _processed_through_focus = false;
     }
 
     const Math::VectorPair3 & Focus::get_best_focus()
@@ -0,0 +1,105 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+
+
+#ifndef GOPTICAL_ANALYSIS_MTF_HH_
+#define GOPTICAL_ANALYSIS_MTF_HH_
+
+#include "Goptical/common.hh"
+
+#include "Goptical/Data/grid.hh"
+#include "Goptical/Data/plot.hh"
+
+#include "Goptical/Analysis/psf.hh"
+
+namespace _Goptical
+{
+
+  namespace Analysis
+  {
+
+    /**
+       @short Modulation transfer function analysis
+       @header Goptical/Analysis/Mtf
+       @module {Core}
+       @main
+
+       This class computes the diffraction modulation transfer
+       function as the Fourier transform of the point spread function
+       computed by an internal @ref Psf object. Pupil sampling,
+       wavelength and defocus are set through this object; the
+       traced pupil data is shared so changing them does not trace
+       rays again.
+
+       Spatial frequencies are expressed in cycles per system unit
+       on the image plane.
+    */
+    class Mtf
+    {
+    public:
+      /** Specify modulation transfer function direction */
+      enum mtf_plane_e
+        {
+          /** Frequency along the image x axis */
+          SagittalMtf = 0,
+          /** Frequency along the image y axis */
+          TangentialMtf = 1
+        };
+
+      Mtf(Sys::System &system);
+
+      /** Get point spread function object used for analysis */
+      inline Psf & get_psf();
+
+      /** Invalidate current analysis data and trace rays again on
+          next request */
+      inline void invalidate();
+
+      /** Get modulation transfer function grid */
+      inline const Data::Grid & get_grid();
+
+      /** Get diffraction cutoff frequency */
+      double get_cutoff_frequency();
+
+      /** Get modulation transfer at given spatial frequency */
+      double get_mtf(double frequency, enum mtf_plane_e plane = TangentialMtf);
+
+      /** Get sagittal and tangential modulation transfer function
+          plot up to cutoff frequency */
+      ref<Data::Plot> get_plot(unsigned int points = 100);
+
+    private:
+      void process_analysis();
+
+      Psf               _psf;
+      unsigned int      _psf_serial;
+      ref<Data::Grid>   _mtf;
+    };
+
+  }
+}
+
+#endif
+
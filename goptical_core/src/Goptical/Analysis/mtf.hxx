@@ -0,0 +1,63 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+
+
+#ifndef GOPTICAL_ANALYSIS_MTF_HXX_
+#define GOPTICAL_ANALYSIS_MTF_HXX_
+
+#include "Goptical/Data/grid.hxx"
+#include "Goptical/Data/plot.hxx"
+
+#include "Goptical/Analysis/psf.hxx"
+
+namespace _Goptical
+{
+
+  namespace Analysis
+  {
+
+    Psf & Mtf::get_psf()
+    {
+      return _psf;
+    }
+
+    void Mtf::invalidate()
+    {
+      _psf.invalidate();
+    }
+
+    const Data::Grid & Mtf::get_grid()
+    {
+      process_analysis();
+
+      return *_mtf;
+    }
+
+  }
+
+}
+
+#endif
+
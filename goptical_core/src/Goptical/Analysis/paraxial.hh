@@ -0,0 +1,173 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+
+#ifndef GOPTICAL_ANALYSIS_PARAXIAL_HH_
+#define GOPTICAL_ANALYSIS_PARAXIAL_HH_
+
+#include <vector>
+
+#include "Goptical/common.hh"
+
+namespace _Goptical
+{
+
+  namespace Analysis
+  {
+
+    /**
+       @short First order optical properties analysis
+       @header Goptical/Analysis/Paraxial
+       @module {Core}
+       @main
+
+       This class performs a paraxial y-nu ray trace along the
+       elements of the tracer sequence, from the first point source
+       to the image. Surface curvatures at vertex, material indexes
+       relative to system environment and distances between
+       elements are used; no real ray is traced. This makes first order properties cheap enough to
+       be evaluated in optimization loops.
+
+       Light path is unfolded: mirrors reverse propagation
+       direction and are handled as surfaces with reflecting
+       power. Distances are signed along light propagation
+       direction. Tilted and decentered elements are not
+       supported, element positions are only used to compute
+       distances.
+
+       When no @ref Sys::Stop element is found in the sequence,
+       the surface which limits the axial beam is used as aperture
+       stop.
+    */
+    class Paraxial
+    {
+    public:
+      Paraxial(const Sys::System &system);
+
+      /** Invalidate computed values, must be called when system
+          has been modified */
+      inline void invalidate();
+
+      /** Set wavelength used to get refractive indexes, default is
+          first spectral line of source */
+      inline void set_wavelen(double wavelen);
+
+      /** Set image element, default is first image found in
+          sequence after source */
+      inline void set_image(const Sys::Image &image);
+
+      /** Set aperture stop element */
+      inline void set_stop(const Sys::Element &stop);
+
+      /** Get effective focal length, inverse of system power */
+      inline double get_effective_focal_length();
+
+      /** Get distance from last optical surface to back focal point */
+      inline double get_back_focal_distance();
+
+      /** Get distance from first element to front focal point */
+      inline double get_front_focal_distance();
+
+      /** Get distance from last optical surface to paraxial image
+          of the source */
+      inline double get_image_distance();
+
+      /** Get paraxial lateral magnification, 0 for source at infinity */
+      inline double get_magnification();
+
+      /** Get distance from first element to entrance pupil */
+      inline double get_entrance_pupil_position();
+
+      /** Get entrance pupil radius */
+      inline double get_entrance_pupil_radius();
+
+      /** Get distance from last optical surface to exit pupil */
+      inline double get_exit_pupil_position();
+
+      /** Get exit pupil radius */
+      inline double get_exit_pupil_radius();
+
+      /** Get paraxial working f-number */
+      inline double get_f_number();
+
+      /** Get image space paraxial numerical aperture */
+      inline double get_numerical_aperture();
+
+      /** Get aperture stop element */
+      inline const Sys::Element & get_stop();
+
+      /** Get marginal ray height on element. The marginal ray
+          starts from axial source point and reaches stop edge. */
+      double get_marginal_ray_height(const Sys::Element &element);
+
+      /** Get chief ray height on element. The chief ray crosses
+          stop center. Its slope is 1 in object space for source at
+          infinity, its object height is 1 for source at finite
+          distance. */
+      double get_chief_ray_height(const Sys::Element &element);
+
+    private:
+      /** paraxial path entry */
+      struct entry_s
+      {
+        const Sys::Element *_element;
+        /** surface power */
+        double          _power;
+        /** refractive index after element */
+        double          _index;
+        /** distance to next entry */
+        double          _thickness;
+      };
+
+      void process();
+      void trace(double y, double nu, double *ys, double *nus) const;
+      unsigned int find(const Sys::Element &element) const;
+
+      const Sys::System &_system;
+      const Sys::Image *_image;
+      const Sys::Element *_stop;
+      double            _wavelen;
+      bool              _processed;
+
+      std::vector<entry_s> _path;
+      /** object space refractive index and distance */
+      double            _index;
+      double            _distance;
+      /** index of last optical surface and stop in path */
+      unsigned int      _last;
+      unsigned int      _stop_index;
+
+      double            _efl, _bfd, _ffd;
+      double            _image_distance, _magnification;
+      double            _enp_position, _enp_radius;
+      double            _exp_position, _exp_radius;
+      double            _slope;
+      std::vector<double> _marginal, _chief;
+    };
+
+  }
+}
+
+#endif
+
@@ -0,0 +1,136 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+
+#ifndef GOPTICAL_ANALYSIS_PARAXIAL_HXX_
+#define GOPTICAL_ANALYSIS_PARAXIAL_HXX_
+
+#include <cmath>
+
+namespace _Goptical
+{
+
+  namespace Analysis
+  {
+
+    void Paraxial::invalidate()
+    {
+      _processed = false;
+    }
+
+    void Paraxial::set_wavelen(double wavelen)
+    {
+      _wavelen = wavelen;
+      _processed = false;
+    }
+
+    void Paraxial::set_image(const Sys::Image &image)
+    {
+      _image = &image;
+      _processed = false;
+    }
+
+    void Paraxial::set_stop(const Sys::Element &stop)
+    {
+      _stop = &stop;
+      _processed = false;
+    }
+
+    double Paraxial::get_effective_focal_length()
+    {
+      process();
+      return _efl;
+    }
+
+    double Paraxial::get_back_focal_distance()
+    {
+      process();
+      return _bfd;
+    }
+
+    double Paraxial::get_front_focal_distance()
+    {
+      process();
+      return _ffd;
+    }
+
+    double Paraxial::get_image_distance()
+    {
+      process();
+      return _image_distance;
+    }
+
+    double Paraxial::get_magnification()
+    {
+      process();
+      return _magnification;
+    }
+
+    double Paraxial::get_entrance_pupil_position()
+    {
+      process();
+      return _enp_position;
+    }
+
+    double Paraxial::get_entrance_pupil_radius()
+    {
+      process();
+      return _enp_radius;
+    }
+
+    double Paraxial::get_exit_pupil_position()
+    {
+      process();
+      return _exp_position;
+    }
+
+    double Paraxial::get_exit_pupil_radius()
+    {
+      process();
+      return _exp_radius;
+    }
+
+    double Paraxial::get_f_number()
+    {
+      process();
+      return 1.0 / (2.0 * fabs(_slope));
+    }
+
+    double Paraxial::get_numerical_aperture()
+    {
+      process();
+      return fabs(_slope);
+    }
+
+    const Sys::Element & Paraxial::get_stop()
+    {
+      process();
+      return *_path[_stop_index]._element;
+    }
+
+  }
+}
+
+#endif
+
@@ -0,0 +1,176 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+
+
+#ifndef GOPTICAL_ANALYSIS_PSF_HH_
+#define GOPTICAL_ANALYSIS_PSF_HH_
+
+#include <map>
+#include <vector>
+
+#include "Goptical/common.hh"
+
+#include "Goptical/Math/vector.hh"
+#include "Goptical/Data/grid.hh"
+
+#include "Goptical/Analysis/pointimage.hh"
+
+namespace _Goptical
+{
+
+  namespace Analysis
+  {
+
+    /**
+       @short Diffraction point spread function analysis
+       @header Goptical/Analysis/Psf
+       @module {Core}
+       @main
+
+       This class computes the diffraction point spread function of
+       the system using the Fourier transform of the pupil function.
+
+       Rays are traced from a square grid on the entrance pupil
+       surface. The optical path length of each ray is used to build
+       the wavefront error with respect to a reference sphere centered
+       on the rays centroid on the image plane. The pupil function is
+       padded with zeros and transformed with the GSL fast Fourier
+       transform.
+
+       The traced pupil data is kept for all spectral lines of the
+       source. Changing the wavelength, the defocus or the padding
+       does not trace rays again.
+
+       The system is expected to contain a single enabled point
+       source.
+    */
+    class Psf : public PointImage
+    {
+      friend class Mtf;
+
+    public:
+      Psf(Sys::System &system);
+
+      inline void invalidate();
+
+      /** Specify entrance pupil surface used to sample the pupil,
+          query system for entrance pupil if none defined here. */
+      inline void set_entrance_surface(const Sys::Surface &s);
+
+      /** Set number of pupil samples along the pupil radius. This
+          will invalidate current analysis data. */
+      inline void set_pupil_sampling(unsigned int radial_samples);
+
+      /** Get number of pupil samples along the pupil radius */
+      inline unsigned int get_pupil_sampling() const;
+
+      /** Set pupil padding ratio. The Fourier transform size is the
+          smallest power of 2 not less than the padded pupil grid
+          size. Larger padding gives finer point spread function
+          sampling. A ratio of at least 2 is needed for @ref Mtf
+          analysis. */
+      inline void set_padding(double ratio);
+
+      /** Get pupil padding ratio */
+      inline double get_padding() const;
+
+      /** Select traced wavelength used for analysis, 0 selects the
+          shortest traced wavelength. */
+      inline void set_wavelen(double wavelen);
+
+      /** Get wavelength used for analysis */
+      inline double get_wavelen();
+
+      /** Set image plane defocus distance along the image z axis */
+      inline void set_defocus(double defocus);
+
+      /** Get image plane defocus distance */
+      inline double get_defocus() const;
+
+      /** Get point spread function grid. Intensity is normalized
+          to the diffraction limited peak intensity, grid coordinates
+          are relative to the reference point. */
+      inline const Data::Grid & get_grid();
+
+      /** Get reference point on the defocused image plane */
+      inline const Math::Vector3 & get_reference_point();
+
+      /** Get point spread function sampling step on image plane */
+      inline const Math::Vector2 & get_sample_spacing();
+
+      /** Get Strehl ratio at reference point */
+      inline double get_strehl_ratio();
+
+      /** Get image space numerical aperture */
+      inline double get_numerical_aperture();
+
+      /** Get Fourier transform size */
+      inline unsigned int get_fft_size();
+
+    private:
+      void process_trace();
+      void process_analysis();
+
+      struct sample_s
+      {
+        /** pupil grid cell index */
+        unsigned int _cell;
+        double _amplitude;
+        /** optical path length up to image plane */
+        double _opl;
+        double _index;
+        /** intercept point and direction on image plane */
+        Math::Vector3 _point;
+        Math::Vector3 _direction;
+      };
+
+      typedef std::vector<sample_s> samples_t;
+      typedef std::map<double, samples_t> pupil_t;
+
+      const Sys::Surface *_entrance;
+      bool              _processed_analysis;
+      unsigned int      _radial_samples;
+      double            _padding;
+      double            _wavelen;
+      double            _defocus;
+
+      pupil_t           _pupil;
+      unsigned int      _pupil_width;
+
+      unsigned int      _fft_size;
+      unsigned int      _serial;
+      ref<Data::Grid>   _psf;
+      double            _used_wavelen;
+      Math::Vector3     _reference;
+      Math::Vector2     _spacing;
+      double            _strehl;
+      double            _aperture;
+    };
+
+  }
+}
+
+#endif
+
@@ -0,0 +1,146 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+
+
+#ifndef GOPTICAL_ANALYSIS_PSF_HXX_
+#define GOPTICAL_ANALYSIS_PSF_HXX_
+
+#include "Goptical/Math/vector.hxx"
+#include "Goptical/Data/grid.hxx"
+
+#include "Goptical/Analysis/pointimage.hxx"
+
+namespace _Goptical
+{
+
+  namespace Analysis
+  {
+
+    void Psf::invalidate()
+    {
+      _processed_trace = false;
+      _processed_analysis = false;
+    }
+
+    void Psf::set_entrance_surface(const Sys::Surface &s)
+    {
+      _entrance = &s;
+      invalidate();
+    }
+
+    void Psf::set_pupil_sampling(unsigned int radial_samples)
+    {
+      _radial_samples = radial_samples;
+      invalidate();
+    }
+
+    unsigned int Psf::get_pupil_sampling() const
+    {
+      return _radial_samples;
+    }
+
+    void Psf::set_padding(double ratio)
+    {
+      _padding = ratio;
+      _processed_analysis = false;
+    }
+
+    double Psf::get_padding() const
+    {
+      return _padding;
+    }
+
+    void Psf::set_wavelen(double wavelen)
+    {
+      _wavelen = wavelen;
+      _processed_analysis = false;
+    }
+
+    double Psf::get_wavelen()
+    {
+      process_analysis();
+
+      return _used_wavelen;
+    }
+
+    void Psf::set_defocus(double defocus)
+    {
+      _defocus = defocus;
+      _processed_analysis = false;
+    }
+
+    double Psf::get_defocus() const
+    {
+      return _defocus;
+    }
+
+    const Data::Grid & Psf::get_grid()
+    {
+      process_analysis();
+
+      return *_psf;
+    }
+
+    const Math::Vector3 & Psf::get_reference_point()
+    {
+      process_analysis();
+
+      return _reference;
+    }
+
+    const Math::Vector2 & Psf::get_sample_spacing()
+    {
+      process_analysis();
+
+      return _spacing;
+    }
+
+    double Psf::get_strehl_ratio()
+    {
+      process_analysis();
+
+      return _strehl;
+    }
+
+    double Psf::get_numerical_aperture()
+    {
+      process_analysis();
+
+      return _aperture;
+    }
+
+    unsigned int Psf::get_fft_size()
+    {
+      process_analysis();
+
+      return _fft_size;
+    }
+
+  }
+
+}
+
+#endif
+
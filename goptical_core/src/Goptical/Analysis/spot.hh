@@ -26,6 +26,8 @@
 #ifndef GOPTICAL_ANALYSIS_SPOT_HH_
 #define GOPTICAL_ANALYSIS_SPOT_HH_
 
+#include <vector>
+
 #include "Goptical/common.hh"
 
 #include "Goptical/Io/renderer_axes.hh"
@@ -76,6 +78,10 @@ namespace _Goptical
       /** Get amount of light intensity which falls in given radius from spot center */
       double get_encircled_intensity(double radius);
 
+      /** Get smallest radius from spot centroid which encircles the
+          given ratio of the spot total intensity */
+      double get_encircled_radius(double ratio);
+
       /** Get encircled energy plot */
       ref<Data::Plot> get_encircled_intensity_plot(int zones = 100);
 
@@ -97,16 +103,35 @@ namespace _Goptical
     private:
       void process_trace();
       void process_analysis();
+      void process_radial();
+
+      struct radial_s
+      {
+        double _dist;
+        double _intensity;
+        double _wavelen;
+
+        inline bool operator<(const radial_s &r) const
+        {
+          return _dist < r._dist;
+        }
+      };
 
       Math::Vector3 _centroid;
 
       bool      _processed_analysis;
+      bool      _processed_radial;
       double    _max_radius;
       double    _rms_radius;
       double    _tot_intensity;
       double    _useful_radius;
 
       Io::RendererAxes _axes;
+
+      /** intercepts sorted by distance from centroid */
+      std::vector<radial_s> _radial;
+      /** cumulative intensity of sorted intercepts */
+      std::vector<double> _cumul;
     };
 
   }
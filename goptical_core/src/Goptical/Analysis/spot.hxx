@@ -42,6 +42,7 @@
     {
       _processed_trace = false;
       _processed_analysis = false;
+      _processed_radial = false;
     }
 
     double Spot::get_max_radius()
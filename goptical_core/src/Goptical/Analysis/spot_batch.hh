@@ -0,0 +1,177 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+
+#ifndef GOPTICAL_ANALYSIS_SPOT_BATCH_HH_
+#define GOPTICAL_ANALYSIS_SPOT_BATCH_HH_
+
+#include <map>
+#include <vector>
+
+#include "Goptical/common.hh"
+
+#include "Goptical/Math/vector.hh"
+#include "Goptical/Data/plot.hh"
+#include "Goptical/Light/spectral_line.hh"
+#include "Goptical/Trace/tracer.hh"
+#include "Goptical/Trace/accumulator.hh"
+#include "Goptical/Sys/system.hh"
+
+namespace _Goptical
+{
+
+  namespace Analysis
+  {
+
+    /**
+       @short Spot analysis of several field angles at once
+       @header Goptical/Analysis/SpotBatch
+       @module {Core}
+       @main
+
+       This class computes spot diagram figures for a list of field
+       angles and spectral lines with a single ray trace operation.
+
+       A point source at infinity is created for each field and
+       traced along with a private copy of the system optical
+       surfaces, stops and images, the analysed system is not
+       modified. Other sources are ignored during the analysis. Rays
+       of all fields are propagated together and can be split
+       between threads (see @ref Trace::Params::set_thread_count).
+       Intercepted rays are binned by field using the @ref
+       Trace::Accumulator interface, so streaming mode can be used
+       to bound memory usage (see @ref
+       Trace::Params::set_stream_chunk_size).
+
+       Figures are computed as in the @ref Spot class: radii are
+       measured from the centroid of intercept points.
+    */
+    class SpotBatch : private Trace::Accumulator
+    {
+    public:
+      SpotBatch(Sys::System &system);
+      ~SpotBatch();
+
+      /** set Image which collect rays for analysis */
+      inline void set_image(Sys::Image *image);
+
+      /** Add a field given by its angles in degrees about the x and
+          y axes, return field index */
+      unsigned int add_field(double x_angle, double y_angle);
+
+      /** Add a field given by rays direction, return field index */
+      unsigned int add_field(const Math::Vector3 &direction);
+
+      /** Remove all fields */
+      inline void clear_fields();
+
+      /** Get number of fields */
+      inline unsigned int get_field_count() const;
+
+      /** Add a spectral line used for all fields. A single 550nm
+          line is used when none has been added. */
+      inline void add_spectral_line(const Light::SpectralLine &l);
+
+      /** Remove all spectral lines */
+      inline void clear_spectrum();
+
+      /** return tracer object which holds parameters used for ray
+          tracing. This will invalidate current analysis data */
+      inline Trace::Tracer & get_tracer();
+
+      /** invalidate current analysis data */
+      inline void invalidate();
+
+      /** Get field spot maximum radius */
+      inline double get_max_radius(unsigned int field);
+
+      /** Get field spot root mean square radius */
+      inline double get_rms_radius(unsigned int field);
+
+      /** Get amount of light intensity in the whole field spot */
+      inline double get_total_intensity(unsigned int field);
+
+      /** Get field spot centroid */
+      inline const Math::Vector3 & get_centroid(unsigned int field);
+
+      /** Get number of rays in field spot */
+      inline unsigned int get_ray_count(unsigned int field);
+
+      /** Get amount of light intensity which falls in given radius
+          from field spot centroid */
+      double get_encircled_intensity(unsigned int field, double radius);
+
+      /** Get field encircled energy plot */
+      ref<Data::Plot> get_encircled_intensity_plot(unsigned int field, int zones = 100);
+
+    private:
+      /** @override */
+      void accumulate(const Sys::Surface &s, const Trace::RayList &rays);
+
+      void process();
+      void trace();
+
+      struct sample_s
+      {
+        Math::Vector3 _point;
+        double _intensity;
+        double _wavelen;
+      };
+
+      struct field_s
+      {
+        field_s()
+          : _direction(Math::vector3_0),
+            _samples(),
+            _centroid(Math::vector3_0),
+            _max_radius(0),
+            _rms_radius(0),
+            _tot_intensity(0)
+        {
+        }
+
+        Math::Vector3 _direction;
+        std::vector<sample_s> _samples;
+        Math::Vector3 _centroid;
+        double _max_radius;
+        double _rms_radius;
+        double _tot_intensity;
+      };
+
+      inline field_s & get_field(unsigned int field);
+
+      Sys::System &     _system;
+      Trace::Tracer     _tracer;
+      bool              _processed;
+      Sys::Image *      _image;
+      std::vector<field_s> _fields;
+      std::vector<Light::SpectralLine> _spectrum;
+      std::map<const Sys::Element *, unsigned int> _source_field;
+    };
+
+  }
+}
+
+#endif
+
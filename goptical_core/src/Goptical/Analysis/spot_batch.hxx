@@ -0,0 +1,122 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+
+#ifndef GOPTICAL_ANALYSIS_SPOT_BATCH_HXX_
+#define GOPTICAL_ANALYSIS_SPOT_BATCH_HXX_
+
+#include "Goptical/error.hh"
+#include "Goptical/Math/vector.hxx"
+#include "Goptical/Data/plot.hxx"
+#include "Goptical/Light/spectral_line.hxx"
+#include "Goptical/Trace/tracer.hxx"
+#include "Goptical/Trace/accumulator.hxx"
+#include "Goptical/Sys/system.hxx"
+
+namespace _Goptical
+{
+
+  namespace Analysis
+  {
+
+    void SpotBatch::set_image(Sys::Image *image)
+    {
+      _image = image;
+      invalidate();
+    }
+
+    void SpotBatch::clear_fields()
+    {
+      _fields.clear();
+      invalidate();
+    }
+
+    unsigned int SpotBatch::get_field_count() const
+    {
+      return _fields.size();
+    }
+
+    void SpotBatch::add_spectral_line(const Light::SpectralLine &l)
+    {
+      _spectrum.push_back(l);
+      invalidate();
+    }
+
+    void SpotBatch::clear_spectrum()
+    {
+      _spectrum.clear();
+      invalidate();
+    }
+
+    Trace::Tracer & SpotBatch::get_tracer()
+    {
+      invalidate();
+      return _tracer;
+    }
+
+    void SpotBatch::invalidate()
+    {
+      _processed = false;
+    }
+
+    SpotBatch::field_s & SpotBatch::get_field(unsigned int field)
+    {
+      if (field >= _fields.size())
+        throw Error("no such field in spot batch analysis");
+
+      process();
+
+      return _fields[field];
+    }
+
+    double SpotBatch::get_max_radius(unsigned int field)
+    {
+      return get_field(field)._max_radius;
+    }
+
+    double SpotBatch::get_rms_radius(unsigned int field)
+    {
+      return get_field(field)._rms_radius;
+    }
+
+    double SpotBatch::get_total_intensity(unsigned int field)
+    {
+      return get_field(field)._tot_intensity;
+    }
+
+    const Math::Vector3 & SpotBatch::get_centroid(unsigned int field)
+    {
+      return get_field(field)._centroid;
+    }
+
+    unsigned int SpotBatch::get_ray_count(unsigned int field)
+    {
+      return get_field(field)._samples.size();
+    }
+
+  }
+}
+
+#endif
+
@@ -0,0 +1,220 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+#ifndef GOPTICAL_ANALYSIS_TOLERANCING_HH_
+#define GOPTICAL_ANALYSIS_TOLERANCING_HH_
+
+#include <vector>
+
+#include "Goptical/common.hh"
+
+#include "Goptical/Data/sample_set.hh"
+#include "Goptical/Sys/system.hh"
+
+namespace _Goptical
+{
+
+  namespace Analysis
+  {
+
+    /**
+       @short Monte Carlo tolerancing analysis
+       @header Goptical/Analysis/Tolerancing
+       @module {Core}
+       @main
+
+       This class evaluates the sensitivity of a sequential optical
+       system to manufacturing and alignment errors. Tolerances are
+       defined for elements of the system @ref Trace::Sequence. A
+       large number of randomly perturbed systems are traced and the
+       chosen performance metric of each trial is collected.
+
+       The nominal system is never modified. A replica of the
+       sequence elements is built once for each thread. Replicas
+       share curves, shapes and materials of the nominal system,
+       except for curves and materials affected by radius and index
+       tolerances which are owned by the thread. Perturbed values
+       are drawn before tracing, results do not depend on the
+       thread count.
+
+       Sequence elements must be @ref Sys::SourcePoint, @ref
+       Sys::OpticalSurface, @ref Sys::Stop or @ref Sys::Image
+       objects. Per surface distributions of tracer parameters are
+       ignored.
+    */
+    class Tolerancing
+    {
+    public:
+      /** Specifies perturbed element parameter */
+      enum parameter_e
+        {
+          /** Translation along element local x axis in mm */
+          DecenterX,
+          /** Translation along element local y axis in mm */
+          DecenterY,
+          /** Rotation about element local x axis in degrees */
+          TiltX,
+          /** Rotation about element local y axis in degrees */
+          TiltY,
+          /** Radius of curvature change in mm, conic curves only */
+          Radius,
+          /** Change of distance to next element in sequence in mm,
+              following elements are moved along */
+          Thickness,
+          /** Change of refractive index of material on the right
+              side of an optical surface */
+          Index,
+        };
+
+      /** Specifies perturbation random distribution */
+      enum distribution_e
+        {
+          /** Uniform distribution, tolerance value is the half width */
+          UniformTolerance,
+          /** Normal distribution, tolerance value is the standard deviation */
+          NormalTolerance,
+        };
+
+      /** Specifies metric computed for each trial */
+      enum metric_e
+        {
+          /** Spot root mean square radius, see @ref Spot */
+          SpotRmsRadius,
+          /** Best focus distance from image plane along image z
+              axis, see @ref Focus */
+          FocusShift,
+        };
+
+      Tolerancing(const Sys::System &system);
+      ~Tolerancing();
+
+      /** Set tolerance of an element parameter, replace previous
+          tolerance of same element parameter. Return tolerance
+          index. */
+      unsigned int set_tolerance(const Sys::Element &element, parameter_e param,
+                                 double value, distribution_e dist = UniformTolerance);
+
+      /** Remove all tolerances */
+      inline void clear_tolerances();
+
+      /** Get number of tolerances */
+      inline unsigned int get_tolerance_count() const;
+
+      /** Set metric computed for each trial, default is @ref SpotRmsRadius */
+      inline void set_metric(metric_e metric);
+
+      /** Set image used to compute metric, default is last image
+          of sequence */
+      inline void set_image(const Sys::Image &image);
+
+      /** Set number of Monte Carlo trials, default is 1000 */
+      inline void set_trial_count(unsigned int count);
+
+      /** Set number of threads used to trace trials, default is
+          tracer parameters thread count of system */
+      inline void set_thread_count(unsigned int count);
+
+      /** Set random generator seed */
+      inline void set_seed(unsigned int seed);
+
+      /** invalidate current analysis data */
+      inline void invalidate();
+
+      /** Get metric of the nominal system */
+      inline double get_nominal_value();
+
+      /** Get metric of each Monte Carlo trial. Failed trials have
+          nan value. */
+      inline const std::vector<double> & get_values();
+
+      /** Get number of failed trials */
+      inline unsigned int get_failure_count();
+
+      /** Get metric mean value over successful trials */
+      inline double get_mean();
+
+      /** Get metric standard deviation over successful trials */
+      inline double get_std_deviation();
+
+      /** Get metric value not exceeded by given ratio of successful
+          trials */
+      double get_percentile(double ratio);
+
+      /** Get histogram of trials metric with given number of bins.
+          Sample values are ratios of successful trials. */
+      ref<Data::SampleSet> get_histogram(unsigned int bins = 20);
+
+      /** Get metric change when only the given tolerance is applied
+          with its positive value, or negative value if @tt minus is
+          set. */
+      inline double get_sensitivity(unsigned int index, bool minus = false);
+
+    private:
+      struct worker_s;
+      class index_material_s;
+
+      struct tolerance_s
+      {
+        const Sys::Element *_element;
+        parameter_e     _param;
+        double          _value;
+        distribution_e  _dist;
+        /** element index in sequence */
+        unsigned int    _index;
+        /** translation direction for thickness tolerance */
+        Math::Vector3   _direction;
+      };
+
+      void process();
+      void prepare();
+      double random_delta(const tolerance_s &t, unsigned short xsubi[3]) const;
+      void run_worker(worker_s &w);
+      static void * worker_entry(void *w);
+
+      const Sys::System &_system;
+      const Sys::Image  *_image;
+      metric_e          _metric;
+      unsigned int      _trial_count;
+      unsigned int      _thread_count;
+      unsigned int      _seed;
+      std::vector<tolerance_s> _tolerances;
+
+      bool              _processed;
+      /** perturbations of nominal, sensitivity and Monte Carlo trials */
+      std::vector<double> _deltas;
+      /** metric values of all trials */
+      std::vector<double> _results;
+      std::vector<double> _values;
+      /** sorted successful trials values */
+      std::vector<double> _sorted;
+      double            _nominal;
+      double            _mean;
+      double            _std_dev;
+    };
+
+  }
+}
+
+#endif
+
@@ -0,0 +1,131 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+#ifndef GOPTICAL_ANALYSIS_TOLERANCING_HXX_
+#define GOPTICAL_ANALYSIS_TOLERANCING_HXX_
+
+#include <cassert>
+
+#include "Goptical/Sys/system.hxx"
+
+namespace _Goptical
+{
+
+  namespace Analysis
+  {
+
+    void Tolerancing::invalidate()
+    {
+      _processed = false;
+    }
+
+    void Tolerancing::clear_tolerances()
+    {
+      _tolerances.clear();
+      invalidate();
+    }
+
+    unsigned int Tolerancing::get_tolerance_count() const
+    {
+      return _tolerances.size();
+    }
+
+    void Tolerancing::set_metric(metric_e metric)
+    {
+      _metric = metric;
+      invalidate();
+    }
+
+    void Tolerancing::set_image(const Sys::Image &image)
+    {
+      _image = &image;
+      invalidate();
+    }
+
+    void Tolerancing::set_trial_count(unsigned int count)
+    {
+      _trial_count = count;
+      invalidate();
+    }
+
+    void Tolerancing::set_thread_count(unsigned int count)
+    {
+      _thread_count = count;
+    }
+
+    void Tolerancing::set_seed(unsigned int seed)
+    {
+      _seed = seed;
+      invalidate();
+    }
+
+    double Tolerancing::get_nominal_value()
+    {
+      process();
+
+      return _nominal;
+    }
+
+    const std::vector<double> & Tolerancing::get_values()
+    {
+      process();
+
+      return _values;
+    }
+
+    unsigned int Tolerancing::get_failure_count()
+    {
+      process();
+
+      return _values.size() - _sorted.size();
+    }
+
+    double Tolerancing::get_mean()
+    {
+      process();
+
+      return _mean;
+    }
+
+    double Tolerancing::get_std_deviation()
+    {
+      process();
+
+      return _std_dev;
+    }
+
+    double Tolerancing::get_sensitivity(unsigned int index, bool minus)
+    {
+      assert(index < _tolerances.size());
+
+      process();
+
+      return _results[1 + index * 2 + minus] - _nominal;
+    }
+
+  }
+}
+
+#endif
+
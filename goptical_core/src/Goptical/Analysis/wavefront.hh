@@ -0,0 +1,164 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+
+
+#ifndef GOPTICAL_ANALYSIS_WAVEFRONT_HH_
+#define GOPTICAL_ANALYSIS_WAVEFRONT_HH_
+
+#include <map>
+#include <vector>
+
+#include "Goptical/common.hh"
+
+#include "Goptical/Math/vector.hh"
+#include "Goptical/Trace/distribution.hh"
+
+#include "Goptical/Analysis/pointimage.hh"
+
+namespace _Goptical
+{
+
+  namespace Analysis
+  {
+
+    /**
+       @short Wavefront error analysis
+       @header Goptical/Analysis/Wavefront
+       @module {Core}
+       @main
+
+       This class computes the optical path difference of rays
+       distributed on the entrance pupil with respect to a reference
+       sphere centered on the rays centroid on the image plane. The
+       wavefront error is expressed in waves.
+
+       Zernike coefficients are obtained by least squares fit using
+       the polynomials of @ref Curve::Zernike over the entrance pupil
+       radius. The pseudo-inverse of the basis matrix is kept as
+       long as the pupil samples do not change, so fitting the
+       wavefront of a modified system only costs a ray trace and a
+       matrix-vector product.
+
+       The system is expected to contain a single enabled point
+       source.
+    */
+    class Wavefront : public PointImage
+    {
+    public:
+      Wavefront(Sys::System &system);
+
+      inline void invalidate();
+
+      /** Specify entrance pupil surface used to sample the pupil,
+          query system for entrance pupil if none defined here. */
+      inline void set_entrance_surface(const Sys::Surface &s);
+
+      /** Set rays distribution on entrance pupil. This will
+          invalidate current analysis data. */
+      inline void set_distribution(const Trace::Distribution &d);
+
+      /** Get rays distribution on entrance pupil */
+      inline const Trace::Distribution & get_distribution() const;
+
+      /** Select traced wavelength used for analysis, 0 selects the
+          shortest traced wavelength. */
+      inline void set_wavelen(double wavelen);
+
+      /** Get wavelength used for analysis */
+      inline double get_wavelen();
+
+      /** Set number of fitted Zernike terms, default is @ref
+          Curve::Zernike::term_count */
+      void set_term_count(unsigned int count);
+
+      /** Get number of fitted Zernike terms */
+      inline unsigned int get_term_count() const;
+
+      /** Get root mean square wavefront error, piston removed */
+      inline double get_rms();
+
+      /** Get peak to valley wavefront error */
+      inline double get_peak_to_valley();
+
+      /** Get Zernike coefficient of term n in waves */
+      inline double get_coefficient(unsigned int n);
+
+      /** Get all fitted Zernike coefficients in waves */
+      inline const std::vector<double> & get_coefficients();
+
+      /** Get root mean square residual of Zernike fit */
+      inline double get_fit_rms();
+
+      /** Get number of pupil samples */
+      inline unsigned int get_sample_count();
+
+    private:
+      void process_trace();
+      void process_analysis();
+      void update_basis(const std::vector<Math::Vector2> &points);
+
+      struct sample_s
+      {
+        /** normalized entrance pupil position */
+        Math::Vector2 _pupil;
+        double _opl;
+        double _index;
+        double _intensity;
+        /** intercept point and direction on image plane */
+        Math::Vector3 _point;
+        Math::Vector3 _direction;
+      };
+
+      typedef std::vector<sample_s> samples_t;
+      typedef std::map<double, samples_t> pupil_t;
+
+      const Sys::Surface *_entrance;
+      Trace::Distribution _dist;
+      bool              _processed_analysis;
+      double            _wavelen;
+      unsigned int      _term_count;
+
+      pupil_t           _pupil;
+
+      /** sample points of cached basis */
+      std::vector<Math::Vector2> _basis_points;
+      /** basis matrix, one row per sample */
+      std::vector<double> _basis;
+      /** basis pseudo-inverse, one row per term */
+      std::vector<double> _pinv;
+
+      double            _used_wavelen;
+      std::vector<double> _opd;
+      std::vector<double> _coeff;
+      double            _rms;
+      double            _ptv;
+      double            _fit_rms;
+    };
+
+  }
+}
+
+#endif
+
@@ -0,0 +1,133 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+
+
+#ifndef GOPTICAL_ANALYSIS_WAVEFRONT_HXX_
+#define GOPTICAL_ANALYSIS_WAVEFRONT_HXX_
+
+#include <cassert>
+
+#include "Goptical/Math/vector.hxx"
+#include "Goptical/Trace/distribution.hxx"
+
+#include "Goptical/Analysis/pointimage.hxx"
+
+namespace _Goptical
+{
+
+  namespace Analysis
+  {
+
+    void Wavefront::invalidate()
+    {
+      _processed_trace = false;
+      _processed_analysis = false;
+    }
+
+    void Wavefront::set_entrance_surface(const Sys::Surface &s)
+    {
+      _entrance = &s;
+      invalidate();
+    }
+
+    void Wavefront::set_distribution(const Trace::Distribution &d)
+    {
+      _dist = d;
+      invalidate();
+    }
+
+    const Trace::Distribution & Wavefront::get_distribution() const
+    {
+      return _dist;
+    }
+
+    void Wavefront::set_wavelen(double wavelen)
+    {
+      _wavelen = wavelen;
+      _processed_analysis = false;
+    }
+
+    double Wavefront::get_wavelen()
+    {
+      process_analysis();
+
+      return _used_wavelen;
+    }
+
+    unsigned int Wavefront::get_term_count() const
+    {
+      return _term_count;
+    }
+
+    double Wavefront::get_rms()
+    {
+      process_analysis();
+
+      return _rms;
+    }
+
+    double Wavefront::get_peak_to_valley()
+    {
+      process_analysis();
+
+      return _ptv;
+    }
+
+    double Wavefront::get_coefficient(unsigned int n)
+    {
+      assert(n < _term_count);
+
+      process_analysis();
+
+      return _coeff[n];
+    }
+
+    const std::vector<double> & Wavefront::get_coefficients()
+    {
+      process_analysis();
+
+      return _coeff;
+    }
+
+    double Wavefront::get_fit_rms()
+    {
+      process_analysis();
+
+      return _fit_rms;
+    }
+
+    unsigned int Wavefront::get_sample_count()
+    {
+      process_analysis();
+
+      return _opd.size();
+    }
+
+  }
+
+}
+
+#endif
+
@@ -0,0 +1,96 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+
+
+#ifndef GOPTICAL_CURVE_ASPHERE_HH_
+#define GOPTICAL_CURVE_ASPHERE_HH_
+
+#include <vector>
+
+#include "Goptical/common.hh"
+
+#include "Goptical/Curve/conic_base.hh"
+
+namespace _Goptical {
+
+  namespace Curve {
+
+    /**
+       @short Conic curve with polynomial deformation terms
+       @header Goptical/Curve/Asphere
+       @module {Core}
+       @main
+
+       This class models the usual rotationally symmetric aspheric
+       curve made of a base conic with given radius of curvature and
+       Schwarzschild constant, plus polynomial terms of the distance
+       to the axis. Both even and odd terms may be used.
+
+       Sagitta and derivative are computed analytically. Ray
+       intersection starts from the exact intersection with the base
+       conic and only a few Newton iterations are needed to account
+       for polynomial terms.
+
+       A zero radius of curvature gives a flat base curve.
+     */
+    class Asphere : public ConicBase
+    {
+    public:
+      /** Creates an aspheric curve with given base radius of
+          curvature and Schwarzschild constant and no polynomial
+          terms. */
+      Asphere(double roc, double sc = 0.0);
+
+      /** Set Schwarzschild constant */
+      inline void set_schwarzschild(double sc);
+
+      /** Set coefficient of polynomial term of order n. */
+      void set_coefficient(unsigned int n, double c);
+
+      /** Get coefficient of polynomial term of order n. */
+      inline double get_coefficient(unsigned int n) const;
+
+      /** Get order of last polynomial term */
+      inline unsigned int get_last_term() const;
+
+      bool intersect(Math::Vector3 &point, const Math::VectorPair3 &ray) const;
+      double sagitta(double r) const;
+      double derivative(double r) const;
+
+      void sagitta_batch(unsigned int count, const char *mask,
+                         double *sagitta, double * const derivative[2],
+                         const double * const xy[2]) const;
+
+    private:
+      inline bool eval(double r, double &sag, double &deriv) const;
+
+      std::vector<double> _coeff;
+    };
+  }
+
+}
+
+#endif
+
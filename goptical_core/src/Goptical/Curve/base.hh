@@ -53,20 +53,121 @@ namespace _Goptical {
     class Base : public ref_base<Base>
     {
     public:
+      inline Base();
       virtual inline ~Base();
 
       /** Get curve sagitta at specified point */
       virtual double sagitta(const Math::Vector2 & xy) const = 0;
 
-      /** Get curve x and y derivative (gradient) at specified point */
+      /** Get curve x and y derivative (gradient) at specified
+          point. Default implementation uses numerical
+          differentiation of the sagitta, curve models should
+          reimplement this function when analytic derivatives are
+          available. */
       virtual void derivative(const Math::Vector2 & xy, Math::Vector2 & dxdy) const;
 
       /** Get intersection point between curve and 3d ray. Return
-          false if no intersection occurred */
+          false if no intersection occurred. Default implementation
+          uses Newton iterations on ray length, starting from the
+          intersection with a sphere of curvature set with
+          @ref set_intersect_start_curvature. Sagitta and gradient are
+          evaluated together with @ref sagitta_batch, convergence is
+          tested on step length so that no evaluation is spent on the
+          final point. */
       virtual bool intersect(Math::Vector3 &point, const Math::VectorPair3 &ray) const;
 
       /** Get normal to curve surface at specified point */
       virtual void normal(Math::Vector3 &normal, const Math::Vector3 &point) const;
+
+      /** Get intersection points between curve and a batch of 3d
+          rays stored as separate coordinates arrays. Rays with a
+          zero @tt mask entry are ignored, the mask entry is cleared
+          if no intersection occurred. Default implementation calls
+          @ref intersect for each ray. */
+      virtual void intersect_batch(unsigned int count, char *mask,
+                                   double * const point[3],
+                                   const double * const origin[3],
+                                   const double * const direction[3]) const;
+
+      /** Get normals to curve surface at a batch of points. Entries
+          with a zero @tt mask are ignored and may be left
+          undefined. Default implementation calls @ref normal for
+          each point. */
+      virtual void normal_batch(unsigned int count, const char *mask,
+                                double * const normal[3],
+                                const double * const point[3]) const;
+
+      /** Get sagitta and optionally x and y derivatives at a batch
+          of points stored as separate coordinates arrays. Entries
+          with a zero @tt mask are ignored, @tt derivative may be
+          null. Default implementation calls @ref sagitta and @ref
+          derivative for each point. */
+      virtual void sagitta_batch(unsigned int count, const char *mask,
+                                 double *sagitta, double * const derivative[2],
+                                 const double * const xy[2]) const;
+
+      /** Set behavior of default derivative implementations when
+          numerical differentiation is used. This can be used to
+          find curve models which would benefit from analytic
+          derivatives. Default is @ref DerivativeNumerical. */
+      static inline void set_derivative_fallback(DerivativeFallback mode);
+
+      /** Get numerical differentiation fallback behavior */
+      static inline DerivativeFallback get_derivative_fallback();
+
+      /** Set default iterative intersection convergence tolerance.
+          Default @ref intersect implementation compares it to Newton
+          step length. Default is 10^-10. */
+      inline void set_intersect_tolerance(double tolerance);
+      /** Get default iterative intersection convergence tolerance */
+      inline double get_intersect_tolerance() const;
+
+      /** Set default iterative intersection maximum iteration count.
+          Default is 32. */
+      inline void set_intersect_max_iterations(unsigned int count);
+      /** Get default iterative intersection maximum iteration count */
+      inline unsigned int get_intersect_max_iterations() const;
+
+      /** Set curvature of the vertex sphere used as starting point
+          of default iterative intersection. A value close to the
+          curve base curvature saves iterations on steep
+          curves. Default is 0, the z=0 plane is used. */
+      inline void set_intersect_start_curvature(double curvature);
+      /** Get curvature of default iterative intersection starting sphere */
+      inline double get_intersect_start_curvature() const;
+
+      /** Enable gathering of default iterative intersection
+          statistics. Counters are updated atomically and may be
+          used when rays are traced by several threads. */
+      inline void set_intersect_stats(bool enabled);
+      /** Get default iterative intersection statistics */
+      inline const IntersectStats & get_intersect_stats() const;
+      /** Reset default iterative intersection statistics */
+      void reset_intersect_stats();
+
+    protected:
+      /** Get ray length to starting point of default iterative
+          intersection. Return false if the ray does not cross the
+          z=0 plane forward. */
+      bool intersect_start(double &t, const double origin[3],
+                           const double direction[3]) const;
+
+      /** Update default iterative intersection statistics if enabled */
+      inline void update_intersect_stats(unsigned int calls, unsigned int iterations,
+                                         unsigned int failures, unsigned int unconverged) const;
+
+      /** Must be called by default derivative implementations before
+          performing numerical differentiation. */
+      void numerical_derivative() const;
+
+    private:
+      static DerivativeFallback _derivative_fallback;
+      mutable bool _derivative_reported;
+      double _intersect_tolerance;
+      unsigned int _intersect_max_iterations;
+      double _intersect_curvature;
+      bool _stats_enabled;
+      mutable IntersectStats _stats;
     };
 
   }
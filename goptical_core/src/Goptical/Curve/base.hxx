@@ -30,10 +30,82 @@ namespace _Goptical {
 
   namespace Curve {
 
+    Base::Base()
+      : _derivative_reported(false),
+        _intersect_tolerance(1e-10),
+        _intersect_max_iterations(32),
+        _intersect_curvature(0.0),
+        _stats_enabled(false)
+    {
+      reset_intersect_stats();
+    }
+
     Base::~Base()
     {
     }
 
+    void Base::set_derivative_fallback(DerivativeFallback mode)
+    {
+      _derivative_fallback = mode;
+    }
+
+    DerivativeFallback Base::get_derivative_fallback()
+    {
+      return _derivative_fallback;
+    }
+
+    void Base::set_intersect_tolerance(double tolerance)
+    {
+      _intersect_tolerance = tolerance;
+    }
+
+    double Base::get_intersect_tolerance() const
+    {
+      return _intersect_tolerance;
+    }
+
+    void Base::set_intersect_max_iterations(unsigned int count)
+    {
+      _intersect_max_iterations = count;
+    }
+
+    unsigned int Base::get_intersect_max_iterations() const
+    {
+      return _intersect_max_iterations;
+    }
+
+    void Base::set_intersect_start_curvature(double curvature)
+    {
+      _intersect_curvature = curvature;
+    }
+
+    double Base::get_intersect_start_curvature() const
+    {
+      return _intersect_curvature;
+    }
+
+    void Base::set_intersect_stats(bool enabled)
+    {
+      _stats_enabled = enabled;
+    }
+
+    const IntersectStats & Base::get_intersect_stats() const
+    {
+      return _stats;
+    }
+
+    void Base::update_intersect_stats(unsigned int calls, unsigned int iterations,
+                                      unsigned int failures, unsigned int unconverged) const
+    {
+      if (!_stats_enabled)
+        return;
+
+      __sync_add_and_fetch(&_stats.calls, calls);
+      __sync_add_and_fetch(&_stats.iterations, iterations);
+      __sync_add_and_fetch(&_stats.failures, failures);
+      __sync_add_and_fetch(&_stats.unconverged, unconverged);
+    }
+
   }
 }
 
@@ -47,6 +47,9 @@ namespace _Goptical {
        interpolation with or without prescribed derivative/gradient
        data. @see Data::Grid .
 
+       Interpolation coefficients are computed once when grid data
+       have changed, the curve can then be used from several threads.
+
        The @ref Spline curve model is preferred when dealing
        with @ref Rotational {rotationally symmetric curves}.
     */
@@ -73,6 +76,10 @@ namespace _Goptical {
       double sagitta(const Math::Vector2 & xy) const;
       void derivative(const Math::Vector2 & xy, Math::Vector2 & dxdy) const;
 
+      void sagitta_batch(unsigned int count, const char *mask,
+                         double *sagitta, double * const derivative[2],
+                         const double * const xy[2]) const;
+
     protected:
       Data::Grid _data;
     };
@@ -49,6 +49,13 @@ namespace _Goptical {
       Parabola(double roc);
 
       bool intersect(Math::Vector3 &point, const Math::VectorPair3 &ray) const;
+      void intersect_batch(unsigned int count, char *mask,
+                           double * const point[3],
+                           const double * const origin[3],
+                           const double * const direction[3]) const;
+      void normal_batch(unsigned int count, const char *mask,
+                        double * const normal[3],
+                        const double * const point[3]) const;
 
       double sagitta(double r) const;
       double derivative(double r) const;
@@ -91,6 +91,8 @@ namespace _Goptical {
       double derivative(double r) const;
 
     private:
+      void update_intersect_start();
+
       unsigned int _first_term, _last_term;
       std::vector<double> _coeff;
     };
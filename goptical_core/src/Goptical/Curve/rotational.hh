@@ -58,6 +58,9 @@ namespace _Goptical {
       virtual double sagitta(double r) const = 0;
 
       /** Get curve derivative at specified distance from origin.
+          Default implementation uses numerical differentiation of
+          the sagitta, curve models should reimplement this function
+          when analytic derivative is available.
           @param r distance from curve origin (0, 0)
       */
       virtual double derivative(double r) const;
@@ -65,6 +68,10 @@ namespace _Goptical {
       inline double sagitta(const Math::Vector2 & xy) const;
       void derivative(const Math::Vector2 & xy, Math::Vector2 & dxdy) const;
 
+      void sagitta_batch(unsigned int count, const char *mask,
+                         double *sagitta, double * const derivative[2],
+                         const double * const xy[2]) const;
+
       // FIXME sample points
       /** Get number of available sample points. Samples points may be
           used by curve fitting algorithms and are choosen to avoid
@@ -50,6 +50,13 @@ namespace _Goptical {
 
       bool intersect(Math::Vector3 &point, const Math::VectorPair3 &ray) const;
       void normal(Math::Vector3 &normal, const Math::Vector3 &point) const;
+      void intersect_batch(unsigned int count, char *mask,
+                           double * const point[3],
+                           const double * const origin[3],
+                           const double * const direction[3]) const;
+      void normal_batch(unsigned int count, const char *mask,
+                        double * const normal[3],
+                        const double * const point[3]) const;
 
       double sagitta(double r) const;
       double derivative(double r) const;
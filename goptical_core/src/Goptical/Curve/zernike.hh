@@ -122,6 +122,9 @@ namespace _Goptical {
       static double zernike_poly(unsigned int n, const Math::Vector2 & xy);
       /** Evaluate x and y derivatives of zernike polynomial n */
       static void zernike_poly_d(unsigned int n, const Math::Vector2 & xy, Math::Vector2 & dxdy);
+      /** Evaluate zernike polynomials 0 to count - 1 */
+      static void zernike_polys(const Math::Vector2 & xy, double values[],
+                                unsigned int count = term_count);
     private:
 
       void update_threshold_state();
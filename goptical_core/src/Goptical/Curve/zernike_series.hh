@@ -0,0 +1,165 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+
+
+#ifndef GOPTICAL_CURVE_ZERNIKE_SERIES_HH_
+#define GOPTICAL_CURVE_ZERNIKE_SERIES_HH_
+
+#include <vector>
+
+#include "Goptical/common.hh"
+
+#include "base.hh"
+
+namespace _Goptical {
+
+  namespace Curve {
+
+    /**
+       @short Define surface curve from a Zernike series of any order
+       @header Goptical/Curve/ZernikeSeries
+       @module {Core}
+       @main
+
+       This class defines a surface curve as a sum of Zernike
+       polynomials with no limit on radial order. Terms are
+       designated by their single index, either in Noll order with
+       orthonormal terms or in Fringe order as used by @ref Zernike.
+
+       Radial polynomials are evaluated with the Kintner three terms
+       recurrence, which is stable at high orders, and angular
+       terms are obtained from successive powers of @em {x + iy}.
+       Both are shared between all terms with the same azimuthal
+       frequency, which makes evaluation cost grow linearly with
+       the number of terms.
+
+       The sagitta is zero outside the Zernike circle.
+    */
+    class ZernikeSeries : public Base
+    {
+    public:
+      /** Specifies Zernike terms single index ordering */
+      enum ordering_e
+        {
+          /** Noll ordering, terms are normalized to unit variance
+              over the circle and @em j even terms use cosine */
+          NollOrdering,
+          /** Fringe (University of Arizona) ordering, terms are not
+              normalized. This is the @ref Zernike curve ordering */
+          FringeOrdering,
+        };
+
+      /** Create a Zernike series curve defined over the given circle radius.
+          @param radius Zernike circle radius
+          @param ordering Terms single index ordering
+          @param unit_scale Sagitta scale factor used to change units globally
+      */
+      ZernikeSeries(double radius, ordering_e ordering = NollOrdering,
+                    double unit_scale = 1.0);
+
+      /** Create a Zernike series curve defined over the given circle
+          radius and initialize coefficients from table.
+          @param radius Zernike circle radius
+          @param coefs Table of Zernike coefficients starting with term 1 (piston)
+          @param coefs_count Number of coefficients available in the table
+          @param ordering Terms single index ordering
+          @param unit_scale Sagitta scale factor used to change units globally
+      */
+      ZernikeSeries(double radius, const double coefs[], unsigned int coefs_count,
+                    ordering_e ordering = NollOrdering, double unit_scale = 1.0);
+
+      /** Set Zernike circle radius */
+      inline void set_radius(double radius);
+      /** Get Zernike circle radius */
+      inline double get_radius() const;
+
+      /** Get terms ordering */
+      inline ordering_e get_ordering() const;
+
+      /** Set coefficient associated with zernike term @tt j, starting
+          at 1. Terms count is extended as needed. */
+      void set_coefficient(unsigned int j, double c);
+
+      /** Get coefficient associated with zernike term @tt j, starting at 1 */
+      inline double get_coefficient(unsigned int j) const;
+
+      /** Get number of terms, including trailing zero coefficients */
+      inline unsigned int get_term_count() const;
+
+      /** Set coefficients unit scale factor. default is 1 (1 mm). */
+      void set_coefficients_scale(double s);
+
+      /** Get radial degree @tt n and azimuthal frequency @tt m of
+          term @tt j in specified ordering. @tt m is negative for
+          sine terms. */
+      static void get_term_degree(ordering_e ordering, unsigned int j,
+                                  unsigned int &n, int &m);
+
+      double sagitta(const Math::Vector2 & xy) const;
+      void derivative(const Math::Vector2 & xy, Math::Vector2 & dxdy) const;
+      bool intersect(Math::Vector3 &point, const Math::VectorPair3 &ray) const;
+
+      void sagitta_batch(unsigned int count, const char *mask,
+                         double *sagitta, double * const derivative[2],
+                         const double * const xy[2]) const;
+
+      void intersect_batch(unsigned int count, char *mask,
+                           double * const point[3],
+                           const double * const origin[3],
+                           const double * const direction[3]) const;
+
+    private:
+      /** Kintner recurrence factors for one radial degree */
+      struct recur_s
+      {
+        double a, b, c;
+      };
+
+      /** Terms sharing the same azimuthal frequency */
+      struct group_s
+      {
+        unsigned int m;
+        /** scaled coefficients of cosine and sine terms indexed by (n - m) / 2 */
+        std::vector<double> ccos, csin;
+        std::vector<recur_s> recur;
+      };
+
+      void update();
+      void eval_block(unsigned int count, const char *mask,
+                      const double *x, const double *y, double *sag,
+                      double *dx, double *dy) const;
+
+      ordering_e _ordering;
+      double _scale;
+      double _radius;
+      std::vector<double> _coeff;
+      std::vector<group_s> _groups;
+    };
+
+  }
+}
+
+#endif
+
@@ -0,0 +1,68 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+
+
+#ifndef GOPTICAL_CURVE_ZERNIKE_SERIES_HXX_
+#define GOPTICAL_CURVE_ZERNIKE_SERIES_HXX_
+
+#include <cassert>
+
+#include "base.hxx"
+
+namespace _Goptical {
+
+  namespace Curve {
+
+    void ZernikeSeries::set_radius(double radius)
+    {
+      _radius = radius;
+    }
+
+    double ZernikeSeries::get_radius() const
+    {
+      return _radius;
+    }
+
+    ZernikeSeries::ordering_e ZernikeSeries::get_ordering() const
+    {
+      return _ordering;
+    }
+
+    double ZernikeSeries::get_coefficient(unsigned int j) const
+    {
+      assert(j > 0);
+      return j <= _coeff.size() ? _coeff[j - 1] : 0.0;
+    }
+
+    unsigned int ZernikeSeries::get_term_count() const
+    {
+      return _coeff.size();
+    }
+
+  }
+}
+
+#endif
+
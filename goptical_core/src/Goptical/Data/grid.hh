@@ -64,8 +64,12 @@ namespace _Goptical {
            const Math::Vector2 & origin = Math::Vector2(0, 0),
            const Math::Vector2 & step = Math::Vector2(1, 1));
 
+      Grid(const Grid &g);
+
       ~Grid();
 
+      Grid & operator=(const Grid &g);
+
       /** Set grid origin 2d vector and step values */
       inline void set_metrics(const Math::Vector2 & origin, const Math::Vector2 & step);
       /** Get origin vector */
@@ -117,11 +121,27 @@ namespace _Goptical {
 
       /** Interpolate data at given 2d vector point on grid using
           currently selected interpolation algorithm */
-      inline double interpolate(const Math::Vector2 & v) const;
+      double interpolate(const Math::Vector2 & v) const;
 
       /** Interpolate gradient at given 2d vector point on grid using
           currently selected interpolation algorithm */
-      inline Math::Vector2 interpolate_deriv(const Math::Vector2 & v) const;
+      Math::Vector2 interpolate_deriv(const Math::Vector2 & v) const;
+
+      /** Interpolate data and optionally gradient at a batch of 2d
+          points stored as separate coordinates arrays. Entries with
+          a zero @tt mask are ignored, @tt mask and @tt deriv may be
+          null. */
+      void interpolate_batch(unsigned int count, const char *mask,
+                             double *y, double * const deriv[2],
+                             const double * const xy[2]) const;
+
+      /** Precompute interpolation data for current grid content and
+          interpolation algorithm. Bicubic interpolation coefficients
+          of all grid cells are stored in a table which is then only
+          read by interpolation functions. This is done on first
+          interpolation after a change if not called explicitly and
+          is safe when interpolation is used from several threads. */
+      void update() const;
 
       // inherited from Set
       inline unsigned int get_dimensions() const;
@@ -140,22 +160,30 @@ namespace _Goptical {
         double p[16];
       };
 
-      void update_nearest(unsigned int x[2], const Math::Vector2 & v) const;
-      void update_linear(unsigned int x[2], const Math::Vector2 & v) const;
-      void update_bicubic(unsigned int x[2], const Math::Vector2 & v) const;
-      void update_bicubic_diff(unsigned int x[2], const Math::Vector2 & v) const;
-      void update_bicubic_deriv(unsigned int x[2], const Math::Vector2 & v) const;
+      /** Precomputed interpolation data, never modified once built */
+      struct table_s
+      {
+        std::vector <poly_t> _poly;
+      };
+
+      const table_s & get_table() const;
+      table_s * new_table() const;
+
+      void set_poly_bicubic(std::vector <poly_t> &poly) const;
+      void set_poly_bicubic_diff(std::vector <poly_t> &poly) const;
+      void set_poly_bicubic_deriv(std::vector <poly_t> &poly) const;
 
       void lookup_nearest(unsigned int x[2], const Math::Vector2 & v) const;
       void lookup_interval(unsigned int x[2], const Math::Vector2 & v) const;
 
       double interpolate_nearest_y(const unsigned int x[2], const Math::Vector2 & v) const;
       double interpolate_linear_y(const unsigned int x[2], const Math::Vector2 & v) const;
-      double interpolate_bicubic_y(const unsigned int x[2], const Math::Vector2 & v) const;
 
       void interpolate_nearest_d(const unsigned int x[2], Math::Vector2 & d, const Math::Vector2 & v) const;
       void interpolate_linear_d(const unsigned int x[2], Math::Vector2 & d, const Math::Vector2 & v) const;
-      void interpolate_bicubic_d(const unsigned int x[2], Math::Vector2 & d, const Math::Vector2 & v) const;
+
+      void interpolate_bicubic(const table_s &t, const Math::Vector2 & v,
+                               double *y, Math::Vector2 *d) const;
 
       void resize_y(unsigned int x1, unsigned int x2);
       void resize_yd(unsigned int x1, unsigned int x2);
@@ -176,12 +204,8 @@ namespace _Goptical {
 
       std::vector <double> _y_data;
       std::vector <Math::Vector2 > _d_data;
-      std::vector <poly_t> _poly;
+      mutable table_s * _table;
 
-      void (Grid::*_update)(unsigned int x[2], const Math::Vector2 & v) const;
-      void (Grid::*_lookup)(unsigned int x[2], const Math::Vector2 & v) const;
-      double (Grid::*_interpolate_y)(const unsigned int x[2], const Math::Vector2 & v) const;
-      void (Grid::*_interpolate_d)(const unsigned int x[2], Math::Vector2 & d, const Math::Vector2 & v) const;
       void (Grid::*_resize)(unsigned int x1, unsigned int x2);
 
       Math::Vector2 _origin;
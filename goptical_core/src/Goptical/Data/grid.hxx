@@ -124,25 +124,6 @@ namespace _Goptical {
       return _d_data[x[0] + x[1] * _size[0]];
     }
 
-    double Grid::interpolate(const Math::Vector2 & v) const
-    {      
-      unsigned int x[2];
-      (this->*_lookup)(x, v);
-
-      return (this->*_interpolate_y)(x, v);
-    }
-
-    Math::Vector2 Grid::interpolate_deriv(const Math::Vector2 & v) const
-    {
-      Math::Vector2 res;
-      unsigned int x[2];
-      (this->*_lookup)(x, v);
-
-      (this->*_interpolate_d)(x, res, v);
-
-      return res;
-    }
-
     void Grid::set_metrics(const Math::Vector2 & origin, const Math::Vector2 & step)
     {
       invalidate();
@@ -180,7 +161,8 @@ namespace _Goptical {
 
     void Grid::invalidate()
     {
-      _lookup = _update;
+      delete _table;
+      _table = 0;
     }
 
   }
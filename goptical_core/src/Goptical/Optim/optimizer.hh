@@ -0,0 +1,217 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+#ifndef GOPTICAL_OPTIM_OPTIMIZER_HH_
+#define GOPTICAL_OPTIM_OPTIMIZER_HH_
+
+#include <vector>
+
+#include "Goptical/common.hh"
+
+#include "Goptical/Math/vector.hh"
+#include "Goptical/Sys/system.hh"
+
+namespace _Goptical
+{
+
+  namespace Optim
+  {
+
+    /**
+       @short Damped least squares optimizer
+       @header Goptical/Optim/Optimizer
+       @module {Core}
+       @main
+
+       This class adjusts design variables of a sequential optical
+       system to minimize a merit function. The merit function is the
+       sum of squared weighted differences between targets and values
+       measured on the image with @ref Analysis::Spot and @ref
+       Analysis::Focus. First order targets are measured with @ref
+       Analysis::Paraxial and do not require any ray trace.
+
+       The Levenberg-Marquardt damped least squares method is
+       used. Jacobian columns are evaluated by finite differences
+       on per thread replicas of the system sequence elements which
+       share curves, shapes and materials of the optimized system.
+       Replicas trace incrementally so that rays of elements located
+       before a modified variable are reused.
+
+       A thickness variable on the element preceding the image with
+       a @ref SpotRmsRadius target performs automatic refocusing.
+
+       The optimized system is only modified when @ref optimize
+       returns. Radius and Schwarzschild variables replace the
+       surface curve with a new @ref Curve::Sphere or @ref
+       Curve::Conic object.
+    */
+    class Optimizer
+    {
+    public:
+      /** Specifies design variable */
+      enum variable_e
+        {
+          /** Radius of curvature of a surface with conic curve */
+          Radius,
+          /** Schwarzschild constant of a surface with conic curve */
+          Schwarzschild,
+          /** Distance to next element in sequence, following
+              elements are moved along */
+          Thickness,
+        };
+
+      /** Specifies measured value of a target */
+      enum target_e
+        {
+          /** Spot root mean square radius */
+          SpotRmsRadius,
+          /** Spot centroid x coordinate in image plane */
+          SpotCentroidX,
+          /** Spot centroid y coordinate in image plane */
+          SpotCentroidY,
+          /** Best focus distance from image plane along image z axis */
+          FocusShift,
+          /** Paraxial effective focal length */
+          EffectiveFocalLength,
+        };
+
+      Optimizer(Sys::System &system);
+      ~Optimizer();
+
+      /** Add a design variable, return variable index. Finite
+          difference step is relative to variable value when @tt
+          step is 0. */
+      unsigned int add_variable(Sys::Element &element, variable_e var,
+                                double step = 0.0);
+
+      /** Set allowed range of variable value */
+      inline void set_variable_range(unsigned int index, double min, double max);
+
+      /** Get current value of variable */
+      inline double get_variable(unsigned int index) const;
+
+      /** Get number of variables */
+      inline unsigned int get_variable_count() const;
+
+      /** Add a target, return target index. Value of @ref
+          SpotRmsRadius target is ignored, rays distances to spot
+          centroid are used as residuals. The number of rays which
+          reach the image must not change during optimization. */
+      unsigned int add_target(target_e target, double value, double weight = 1.0);
+
+      /** Get number of targets */
+      inline unsigned int get_target_count() const;
+
+      /** Remove all variables and targets */
+      inline void clear();
+
+      /** Set image used to measure targets, default is last image
+          of sequence */
+      inline void set_image(const Sys::Image &image);
+
+      /** Set number of threads used to evaluate Jacobian, default
+          is tracer parameters thread count of system */
+      inline void set_thread_count(unsigned int count);
+
+      /** Set maximum number of iterations, default is 20 */
+      inline void set_max_iterations(unsigned int count);
+
+      /** Set initial damping factor, default is 1e-3 */
+      inline void set_damping(double lambda);
+
+      /** Set relative merit improvement below which optimization
+          stops, default is 1e-6 */
+      inline void set_tolerance(double tolerance);
+
+      /** Get merit function value of current system */
+      double get_merit();
+
+      /** Optimize system and update its variables. Return final
+          merit function value. */
+      double optimize();
+
+      /** Get number of iterations performed by last optimization */
+      inline unsigned int get_iteration_count() const;
+
+    private:
+      struct worker_s;
+
+      struct variable_s
+      {
+        Sys::Element    *_element;
+        variable_e      _var;
+        double          _step;
+        double          _min;
+        double          _max;
+        double          _value;
+        /** nominal value in optimized system */
+        double          _nominal;
+        /** element index in sequence */
+        unsigned int    _index;
+        /** translation direction for thickness variable */
+        Math::Vector3   _direction;
+      };
+
+      struct target_s
+      {
+        target_e        _target;
+        double          _value;
+        double          _weight;
+        /** first residual and residuals count */
+        unsigned int    _offset;
+        unsigned int    _count;
+      };
+
+      void init_variable(variable_s &v) const;
+      void prepare();
+      void apply(worker_s &w, const std::vector<double> &x) const;
+      void init_residuals(worker_s &w);
+      bool residuals(worker_s &w, const std::vector<double> &x,
+                     std::vector<double> &r) const;
+      void jacobian(const std::vector<double> &x, const std::vector<double> &r,
+                    std::vector<double> &jac);
+      void run_worker(worker_s &w);
+      void update_system(const std::vector<double> &x);
+      static void * worker_entry(void *w);
+
+      Sys::System       &_system;
+      const Sys::Image  *_image;
+      unsigned int      _thread_count;
+      unsigned int      _max_iterations;
+      double            _damping;
+      double            _tolerance;
+      unsigned int      _iterations;
+      unsigned int      _residual_count;
+      std::vector<variable_s> _variables;
+      std::vector<target_s> _targets;
+      std::vector<ref<worker_s> > _workers;
+      /** variables in Jacobian evaluation order */
+      std::vector<unsigned int> _columns;
+    };
+
+  }
+}
+
+#endif
+
@@ -0,0 +1,101 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+#ifndef GOPTICAL_OPTIM_OPTIMIZER_HXX_
+#define GOPTICAL_OPTIM_OPTIMIZER_HXX_
+
+#include <cassert>
+
+#include "Goptical/Sys/system.hxx"
+
+namespace _Goptical
+{
+
+  namespace Optim
+  {
+
+    void Optimizer::set_variable_range(unsigned int index, double min, double max)
+    {
+      assert(index < _variables.size());
+      _variables[index]._min = min;
+      _variables[index]._max = max;
+    }
+
+    double Optimizer::get_variable(unsigned int index) const
+    {
+      assert(index < _variables.size());
+      return _variables[index]._value;
+    }
+
+    unsigned int Optimizer::get_variable_count() const
+    {
+      return _variables.size();
+    }
+
+    unsigned int Optimizer::get_target_count() const
+    {
+      return _targets.size();
+    }
+
+    void Optimizer::clear()
+    {
+      _variables.clear();
+      _targets.clear();
+    }
+
+    void Optimizer::set_image(const Sys::Image &image)
+    {
+      _image = &image;
+    }
+
+    void Optimizer::set_thread_count(unsigned int count)
+    {
+      _thread_count = count;
+    }
+
+    void Optimizer::set_max_iterations(unsigned int count)
+    {
+      _max_iterations = count;
+    }
+
+    void Optimizer::set_damping(double lambda)
+    {
+      _damping = lambda;
+    }
+
+    void Optimizer::set_tolerance(double tolerance)
+    {
+      _tolerance = tolerance;
+    }
+
+    unsigned int Optimizer::get_iteration_count() const
+    {
+      return _iterations;
+    }
+
+  }
+}
+
+#endif
+
@@ -46,6 +46,11 @@ namespace _Goptical {
        Triangle tessellation required for proper 3d display only works
        with convex polygons yet.
 
+       The bounding box is split in a grid of cells which are
+       classified as inside, outside or crossed by an edge each time
+       vertices are modified. Only points falling in an edge cell
+       need a crossing test against edges spanning the cell row.
+
        @see RegularPolygon
      */
 
@@ -81,16 +86,37 @@ namespace _Goptical {
       /** @override */
       void get_triangles(const Math::Triangle<2>::put_delegate_t &f, double resolution) const;
 
-      /** update _min_radius and bounding box */
+      /** update _min_radius, bounding box and cell grid, shape is
+          left invalid with less than 3 vertices */
       void update();
+      /** build the cell grid used by inside() */
+      void update_grid();
+      /** get cell index along an axis for a scaled coordinate */
+      inline unsigned int grid_index(double u) const;
 
       typedef std::vector<Math::Vector2 > vertices_t;
 
+      /** State of a grid cell, edge cells need a crossing test */
+      enum cell_e
+        {
+          CellOutside,
+          CellInside,
+          CellEdge,
+        };
+
       bool _updated;
       vertices_t _vertices;
       Math::VectorPair2 _bbox;
       double _max_radius;
       double _min_radius;
+
+      unsigned int _grid_size;
+      Math::Vector2 _grid_scale;
+      std::vector<unsigned char> _cells;
+      /** offsets of each grid row edges list in _row_edges */
+      std::vector<unsigned int> _row_first;
+      /** index of edges crossing each grid row, edge i ends at vertex i */
+      std::vector<unsigned int> _row_edges;
     };
 
   }
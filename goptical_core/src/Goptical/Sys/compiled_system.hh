@@ -0,0 +1,196 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+
+#ifndef GOPTICAL_COMPILED_SYSTEM_HH_
+#define GOPTICAL_COMPILED_SYSTEM_HH_
+
+#include <vector>
+
+#include "Goptical/common.hh"
+
+#include "Goptical/Math/transform.hh"
+#include "Goptical/Math/vector_pair.hh"
+#include "Goptical/Sys/system.hh"
+
+namespace _Goptical {
+
+  namespace Sys {
+
+    /**
+       @short Read only snapshot of an optical system
+       @header Goptical/Sys/CompiledSystem
+       @module {Core}
+
+       This class holds a flat copy of the data needed to propagate
+       light in a @ref System: elements in sequence order, transforms
+       between all pairs of elements local coordinates and resolved
+       surface curves, shapes and materials.
+
+       Unlike the @ref System class, which computes and caches
+       transforms on first access, a compiled system is never
+       modified once built. It can be shared by several @ref
+       Trace::Tracer objects running in different threads. It must be
+       compiled again when the system is modified, see @ref
+       is_up_to_date.
+
+       Curve, shape and material objects are referenced, not copied;
+       they must not be modified while the snapshot is in use.
+    */
+    class CompiledSystem : public ref_base<CompiledSystem>
+    {
+    public:
+      /** Compile system. Sequence is taken from tracer parameters
+          when in sequential mode, elements are in system containers
+          order otherwise. */
+      CompiledSystem(const System &system, const Trace::Params &params);
+
+      /** Compile system using its default tracer parameters */
+      CompiledSystem(const System &system);
+
+      /** Get compiled system */
+      inline const System & get_system() const;
+
+      /** Test if system has not been modified since compilation */
+      inline bool is_up_to_date() const;
+
+      /** Test if snapshot was compiled for given system and
+          parameters and neither system nor sequence have been
+          modified since */
+      bool is_up_to_date(const System &system, const Trace::Params &params) const;
+
+      /** Get system version at compilation time */
+      inline unsigned int get_version() const;
+
+      /** Get the number of element identifiers */
+      inline unsigned int get_element_count() const;
+
+      /** Get element from its identifier, may return a null pointer */
+      inline const Element * get_element(unsigned int id) const;
+
+      /** Get element as surface, return a null pointer if not a surface */
+      inline const Surface * get_surface(unsigned int id) const;
+
+      /** Get element as source, return a null pointer if not a source */
+      inline const Source * get_source(unsigned int id) const;
+
+      /** Get element as optical surface, return a null pointer if not an optical surface */
+      inline const OpticalSurface * get_optical_surface(unsigned int id) const;
+
+      /** Get surface curve, return a null pointer if not a surface */
+      inline const Curve::Base * get_curve(unsigned int id) const;
+
+      /** Get surface shape, return a null pointer if not a surface */
+      inline const Shape::Base * get_shape(unsigned int id) const;
+
+      /** Get material on given side of an optical surface or
+          material of a source. Return a null pointer for other
+          elements. */
+      inline const Material::Base * get_material(unsigned int id, unsigned int side = 0) const;
+
+      /** Get elements in sequence order */
+      inline const std::vector<const Element *> & get_sequence() const;
+
+      /** Get transform between two elements local coordinates,
+          identifier 0 is used for global coordinates */
+      inline const Math::Transform<3> & get_transform(unsigned int from, unsigned int to) const;
+
+      /** Get transform between two elements local coordinates */
+      inline const Math::Transform<3> & get_transform(const Element &from, const Element &to) const;
+
+      /** Get transform from element local to global coordinates */
+      inline const Math::Transform<3> & get_global_transform(const Element &from) const;
+
+      /** Get transform from global to element local coordinates */
+      inline const Math::Transform<3> & get_local_transform(const Element &to) const;
+
+      /** Find enabled surface which colides with the given ray and
+          update intersection point. Surfaces are looked up in a
+          bounding volume hierarchy built on compilation. */
+      const Surface * colide_next(const Trace::Params &params,
+                                  Math::VectorPair3 &intersect,
+                                  const Trace::Ray &ray) const;
+
+    private:
+      void compile(const Trace::Params &params);
+
+      /** Bounding volume hierarchy node, boxes use global coordinates */
+      struct bvh_node_s
+      {
+        Math::VectorPair3 _box;
+        /** index of first child node, second child follows */
+        unsigned int _child;
+        /** range of surfaces in _bvh_surfaces for leaf nodes */
+        unsigned int _first, _count;
+      };
+
+      typedef std::vector<std::pair<Math::VectorPair3, unsigned int> > bvh_boxes_t;
+
+      /** Build hierarchy of enabled surfaces bounding boxes */
+      void bvh_update();
+
+      /** Recursively build hierarchy node for surfaces in given range */
+      void bvh_build(bvh_boxes_t &boxes, unsigned int index,
+                     unsigned int first, unsigned int count);
+
+      /** Test ray/surface intersection and keep closest one */
+      inline void colide_test(const Trace::Params &params, unsigned int origin,
+                              unsigned int id, const Trace::Ray &ray,
+                              Math::VectorPair3 &intersect,
+                              const Surface * &e, double &min_dist) const;
+
+      struct element_s
+      {
+        const Element           *_element;
+        const Surface           *_surface;
+        const Source            *_source;
+        const OpticalSurface    *_optical;
+        const Curve::Base       *_curve;
+        const Shape::Base       *_shape;
+        const Material::Base    *_material[2];
+      };
+
+      const System              *_system;
+      const Trace::Sequence     *_seq_ptr;
+      unsigned int              _seq_version;
+      bool                      _sequential;
+      unsigned int              _version;
+      unsigned int              _count;
+      std::vector<element_s>    _elements;
+      std::vector<const Element *> _sequence;
+      std::vector<Math::Transform<3> > _transforms;
+
+      /** identifiers of all enabled surfaces */
+      std::vector<unsigned int> _surfaces;
+      std::vector<bvh_node_s>   _bvh_nodes;
+      std::vector<unsigned int> _bvh_surfaces;
+      /** surfaces which can not be bounded, always tested */
+      std::vector<unsigned int> _bvh_unbounded;
+    };
+
+  }
+}
+
+#endif
+
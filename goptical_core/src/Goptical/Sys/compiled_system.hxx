@@ -0,0 +1,130 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+
+#ifndef GOPTICAL_COMPILED_SYSTEM_HXX_
+#define GOPTICAL_COMPILED_SYSTEM_HXX_
+
+#include <cassert>
+
+#include "Goptical/Sys/system.hxx"
+#include "Goptical/Math/transform.hxx"
+
+namespace _Goptical {
+
+  namespace Sys {
+
+    const System & CompiledSystem::get_system() const
+    {
+      return *_system;
+    }
+
+    bool CompiledSystem::is_up_to_date() const
+    {
+      return _version == _system->get_version();
+    }
+
+    unsigned int CompiledSystem::get_version() const
+    {
+      return _version;
+    }
+
+    unsigned int CompiledSystem::get_element_count() const
+    {
+      return _count - 1;
+    }
+
+    const Element * CompiledSystem::get_element(unsigned int id) const
+    {
+      assert(id < _count);
+      return _elements[id]._element;
+    }
+
+    const Surface * CompiledSystem::get_surface(unsigned int id) const
+    {
+      assert(id < _count);
+      return _elements[id]._surface;
+    }
+
+    const Source * CompiledSystem::get_source(unsigned int id) const
+    {
+      assert(id < _count);
+      return _elements[id]._source;
+    }
+
+    const OpticalSurface * CompiledSystem::get_optical_surface(unsigned int id) const
+    {
+      assert(id < _count);
+      return _elements[id]._optical;
+    }
+
+    const Curve::Base * CompiledSystem::get_curve(unsigned int id) const
+    {
+      assert(id < _count);
+      return _elements[id]._curve;
+    }
+
+    const Shape::Base * CompiledSystem::get_shape(unsigned int id) const
+    {
+      assert(id < _count);
+      return _elements[id]._shape;
+    }
+
+    const Material::Base * CompiledSystem::get_material(unsigned int id, unsigned int side) const
+    {
+      assert(id < _count && side < 2);
+      return _elements[id]._material[side];
+    }
+
+    const std::vector<const Element *> & CompiledSystem::get_sequence() const
+    {
+      return _sequence;
+    }
+
+    const Math::Transform<3> & CompiledSystem::get_transform(unsigned int from, unsigned int to) const
+    {
+      assert(from < _count && to < _count);
+      return _transforms[from * _count + to];
+    }
+
+    const Math::Transform<3> & CompiledSystem::get_transform(const Element &from, const Element &to) const
+    {
+      return get_transform(from.id(), to.id());
+    }
+
+    const Math::Transform<3> & CompiledSystem::get_global_transform(const Element &from) const
+    {
+      return get_transform(from.id(), 0);
+    }
+
+    const Math::Transform<3> & CompiledSystem::get_local_transform(const Element &to) const
+    {
+      return get_transform(0, to.id());
+    }
+
+  }
+}
+
+#endif
+
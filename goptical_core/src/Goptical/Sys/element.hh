@@ -174,6 +174,13 @@ namespace _Goptical {
       inline void process_rays(Trace::Result &result,
                                Trace::rays_queue_t *input) const;
 
+      /** Process a structure of arrays batch of light rays
+          interacting with element. Rays are expressed in local
+          coordinates of this element on return. This function is
+          only used in sequential ray trace mode. */
+      template <Trace::IntensityMode m>
+      inline void process_rays(Trace::RayBatch &batch) const;
+
       /** Draw element 2d layout using the given renderer in given
           element coordinates. */
       virtual void draw_2d_e(Io::Renderer &r, const Element *ref) const;
@@ -207,6 +214,24 @@ protected:
       virtual void process_rays_polarized(Trace::Result &result,
                                           Trace::rays_queue_t *input) const;
 
+      /** This function process incoming batch of light rays. It
+          must be reimplemented in subclasses if the element can
+          interact with light in simple raytrace mode.
+          This function is only used in batch sequential ray trace mode. */
+      virtual void process_batch_simple(Trace::RayBatch &batch) const;
+
+      /** This function process incoming batch of light rays. It
+          must be reimplemented in subclasses if the element can
+          interact with light in intensity raytrace mode.
+          This function is only used in batch sequential ray trace mode. */
+      virtual void process_batch_intensity(Trace::RayBatch &batch) const;
+
+      /** This function process incoming batch of light rays. It
+          must be reimplemented in subclasses if the element can
+          interact with light in polarized raytrace mode.
+          This function is only used in batch sequential ray trace mode. */
+      virtual void process_batch_polarized(Trace::RayBatch &batch) const;
+
       /** This function is called from the @ref System class when the
           element is added to a system */
       virtual void system_register(System &s);
@@ -109,6 +109,25 @@ namespace _Goptical {
         }
     }
 
+    template <Trace::IntensityMode m>
+    inline void Element::process_rays(Trace::RayBatch &batch) const
+    {
+      switch (m)
+        {
+        case Trace::SimpleTrace:
+          process_batch_simple(batch);
+          break;
+
+        case Trace::IntensityTrace:
+          process_batch_intensity(batch);
+          break;
+
+        case Trace::PolarizedTrace:
+          process_batch_polarized(batch);
+          break;
+        }
+    }
+
     std::ostream & operator<<(std::ostream &o, const Element &e)
     {
       e.print(o);
@@ -41,6 +41,13 @@ namespace _Goptical {
        @header Goptical/Sys/Image
        @module {Core}
        @main
+
+       Image plane can be used as a detector. In detector mode,
+       intensity of intercepted rays is binned in a pixel grid during
+       ray tracing so that an irradiance map is available from @ref
+       Trace::Result::get_irradiance without saving intercepted rays
+       lists. Each tracer thread bins rays in its own grid, grids are
+       merged when threads terminate.
      */
     class Image : public Surface
     {
@@ -54,6 +61,24 @@ namespace _Goptical {
       /** Create a new flat square image plane at given position with given half width */
       Image(const Math::VectorPair3 &position, double radius);
 
+      /** Enable detector mode. Intercepted rays are binned in a grid
+          of @tt n1 x @tt n2 pixels which covers the image shape
+          bounding box. A separate grid is used for each ray
+          wavelength when @tt per_wavelen is set. */
+      void set_detector(unsigned int n1, unsigned int n2, bool per_wavelen = false);
+
+      /** Disable detector mode */
+      void disable_detector();
+
+      /** Return true if detector mode is enabled */
+      inline bool is_detector() const;
+
+      /** Get number of detector pixels along given axis */
+      inline unsigned int get_detector_size(unsigned int axis) const;
+
+      /** Return true if detector uses a separate grid for each wavelength */
+      inline bool is_detector_per_wavelen() const;
+
     private:
       void trace_ray_simple(Trace::Result &result, Trace::Ray &incident,
                             const Math::VectorPair3 &local, const Math::VectorPair3 &intersect) const;
@@ -61,6 +86,12 @@ namespace _Goptical {
                                const Math::VectorPair3 &local, const Math::VectorPair3 &intersect) const;
       void trace_ray_polarized(Trace::Result &result, Trace::Ray &incident,
                                const Math::VectorPair3 &local, const Math::VectorPair3 &intersect) const;
+      void trace_batch_simple(Trace::RayBatch &batch, unsigned int count) const;
+      void trace_batch_intensity(Trace::RayBatch &batch, unsigned int count) const;
+      void trace_batch_polarized(Trace::RayBatch &batch, unsigned int count) const;
+
+      unsigned int      _detector_size[2];
+      bool              _detector_per_wavelen;
     };
 
   }
@@ -26,12 +26,30 @@
 #ifndef GOPTICAL_IMAGE_HXX_
 #define GOPTICAL_IMAGE_HXX_
 
+#include <cassert>
+
 #include "Goptical/Sys/surface.hxx"
 
 namespace _Goptical {
   
   namespace Sys {
 
+    bool Image::is_detector() const
+    {
+      return _detector_size[0] != 0;
+    }
+
+    unsigned int Image::get_detector_size(unsigned int axis) const
+    {
+      assert(axis < 2);
+      return _detector_size[axis];
+    }
+
+    bool Image::is_detector_per_wavelen() const
+    {
+      return _detector_per_wavelen;
+    }
+
   }
 }
 
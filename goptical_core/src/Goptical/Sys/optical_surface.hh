@@ -104,6 +104,15 @@ namespace _Goptical {
       void trace_ray_intensity(Trace::Result &result, Trace::Ray &incident,
                                const Math::VectorPair3 &local, const Math::VectorPair3 &intersect) const;
 
+      template <Trace::IntensityMode m>
+      inline void trace_batch_(Trace::RayBatch &batch, unsigned int count) const;
+
+      /** @override */
+      void trace_batch_simple(Trace::RayBatch &batch, unsigned int count) const;
+
+      /** @override */
+      void trace_batch_intensity(Trace::RayBatch &batch, unsigned int count) const;
+
       /** @override */
       void system_register(System &s);
 
@@ -58,6 +58,10 @@ namespace _Goptical {
           environment material is used by default. */
       inline void set_material(const const_ref<Material::Base> &m);
 
+      /** Get material where light rays are generated, this is the
+          system environment proxy if none has been set. */
+      const Material::Base & get_material() const;
+
       /** Add a new wavelen for ray generation */
       inline void add_spectral_line(const Light::SpectralLine & l);
 
@@ -71,6 +75,9 @@ namespace _Goptical {
       /** Clear wavelen list */
       inline void clear_spectrum();
 
+      /** Get source spectral lines */
+      inline const std::vector<Light::SpectralLine> & get_spectrum() const;
+
       /** Get maximal spectral line intensity */
       inline double get_max_intensity() const;
 
@@ -41,18 +41,26 @@ namespace _Goptical {
     void Source::set_material(const const_ref<Material::Base> &m)
     {
       _mat = m;
+      update_version();
     }
 
     void Source::clear_spectrum()
     {
       _spectrum.clear();
       _max_intensity = _min_intensity = 0.0;
+      update_version();
+    }
+
+    const std::vector<Light::SpectralLine> & Source::get_spectrum() const
+    {
+      return _spectrum;
     }
 
     void Source::single_spectral_line(const Light::SpectralLine & l)
     {
       _spectrum.clear();
       _spectrum.push_back(l);
+      update_version();
     }
 
     void Source::add_spectral_line(const Light::SpectralLine & l)
@@ -60,12 +68,14 @@ namespace _Goptical {
       _spectrum.push_back(l);
       _max_intensity = std::max(_max_intensity, l.get_intensity());
       _min_intensity = std::min(_min_intensity, l.get_intensity());
+      update_version();
     }
 
     void Source::set_spectral_line(const Light::SpectralLine & l, int index)
     {
       _spectrum[index] = l;
       refresh_intensity_limits();
+      update_version();
     }
 
     double Source::get_max_intensity() const
@@ -45,7 +45,10 @@ namespace _Goptical {
          located at a given position but without direction.
 
          A ray is generated for each defined spectrum line for each
-         distribution pattern point on target surface.
+         distribution pattern point on target surface. When ray
+         aiming is enabled, pattern points are taken on the aiming
+         stop surface and rays are aimed at these points. @see
+         Trace::Params::set_ray_aiming
 
          Default wavelen list contains a single 550nm entry.
       */
@@ -68,6 +71,9 @@ namespace _Goptical {
       /** Change current point source infinity mode */
       inline void set_mode(SourceInfinityMode mode);
 
+      /** Get source infinity mode */
+      inline SourceInfinityMode get_mode() const;
+
     private:
 
       void generate_rays_simple(Trace::Result &result,
@@ -79,6 +85,21 @@ namespace _Goptical {
       inline void get_lightrays_(Trace::Result &result,
                                  const Element &target) const;
 
+      template <SourceInfinityMode mode>
+      static inline Math::VectorPair3 get_lightray_(const Math::VectorPair3 &plane,
+                                                    const Math::Vector3 &r);
+
+      template <SourceInfinityMode mode>
+      inline void add_lightrays_(Trace::Result &result, const Math::VectorPair3 &plane,
+                                 const Material::Base *material,
+                                 const Math::Vector3 &r) const;
+
+      struct aiming_s;
+
+      /** get ray aiming solution, cached in ray trace result */
+      const aiming_s & get_aiming(Trace::Result &result, const Surface &target,
+                                  const Surface &stop) const;
+
       SourceInfinityMode _mode;
     };
 
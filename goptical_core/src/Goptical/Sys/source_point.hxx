@@ -35,6 +35,12 @@ namespace _Goptical {
     void SourcePoint::set_mode(SourceInfinityMode mode)
     {
       _mode = mode;
+      update_version();
+    }
+
+    SourceInfinityMode SourcePoint::get_mode() const
+    {
+      return _mode;
     }
 
   }
@@ -85,6 +85,13 @@ namespace _Goptical {
                      Math::VectorPair3 &pt,
                      const Math::VectorPair3 &ray) const;
 
+      /** @override */
+      void intersect_batch(const Trace::Params &params, unsigned int count,
+                           char *mask, double * const point[3],
+                           double * const normal[3],
+                           const double * const origin[3],
+                           const double * const direction[3]) const;
+
       /** @override */
       void trace_ray_simple(Trace::Result &result, Trace::Ray &incident,
                             const Math::VectorPair3 &local, const Math::VectorPair3 &intersect) const;
@@ -93,6 +100,12 @@ namespace _Goptical {
       void trace_ray_intensity(Trace::Result &result, Trace::Ray &incident,
                                const Math::VectorPair3 &local, const Math::VectorPair3 &intersect) const;
 
+      /** @override */
+      void trace_batch_simple(Trace::RayBatch &batch, unsigned int count) const;
+
+      /** @override */
+      void trace_batch_intensity(Trace::RayBatch &batch, unsigned int count) const;
+
       /** @override */
       void process_rays_simple(Trace::Result &result,
                               Trace::rays_queue_t *input) const;
@@ -83,6 +83,17 @@ namespace _Goptical {
                              Math::VectorPair3 &pt,
                              const Math::VectorPair3 &ray) const;
 
+      /** Get intersection points and normals to surface for a batch
+          of rays stored as coordinates arrays in surface local
+          coordinates. Rays with a zero @tt mask entry are ignored,
+          the mask entry is cleared if no intersection occured. This
+          must be reimplemented along with @ref intersect. */
+      virtual void intersect_batch(const Trace::Params &params, unsigned int count,
+                                   char *mask, double * const point[3],
+                                   double * const normal[3],
+                                   const double * const origin[3],
+                                   const double * const direction[3]) const;
+
       /** Get distribution pattern points projected on the surface */
       void get_pattern(const Math::Vector3::put_delegate_t &f,
                        const Trace::Distribution &d,
@@ -121,6 +132,24 @@ namespace _Goptical {
       virtual void trace_ray_polarized(Trace::Result &result, Trace::Ray &incident,
                                        const Math::VectorPair3 &local, const Math::VectorPair3 &intersect) const;
 
+      /** This function must be reimplemented by subclasses to handle
+          batch of incoming rays when in simple ray trace mode. Only
+          the @tt count first rays of the batch must be
+          considered. Intersection points are stored as rays origins
+          and surface normals are available from the batch. */
+      virtual void trace_batch_simple(Trace::RayBatch &batch, unsigned int count) const;
+
+      /** This function must be reimplemented by subclasses to handle
+          batch of incoming rays when in intensity ray trace mode. Rays
+          intensities have been updated with absorption from the
+          propagation material. @see trace_batch_simple */
+      virtual void trace_batch_intensity(Trace::RayBatch &batch, unsigned int count) const;
+
+      /** This function must be reimplemented by subclasses to handle
+          batch of incoming rays when in polarized ray trace mode.
+          @see trace_batch_simple */
+      virtual void trace_batch_polarized(Trace::RayBatch &batch, unsigned int count) const;
+
       /** @override */
       void draw_2d_e(Io::Renderer &r, const Element *ref) const;
       /** @override */
@@ -146,6 +175,15 @@ namespace _Goptical {
       virtual void process_rays_polarized(Trace::Result &result,
                                           Trace::rays_queue_t *input) const;
 
+      template <Trace::IntensityMode m>
+      inline void process_batch_(Trace::RayBatch &batch) const;
+
+      virtual void process_batch_simple(Trace::RayBatch &batch) const;
+
+      virtual void process_batch_intensity(Trace::RayBatch &batch) const;
+
+      virtual void process_batch_polarized(Trace::RayBatch &batch) const;
+
       double                    _discard_intensity;
       const_ref<Curve::Base>   _curve;
       const_ref<Shape::Base>   _shape;
@@ -39,6 +39,7 @@ namespace _Goptical {
     void Surface::set_curve(const const_ref<Curve::Base> &c)
     {
       _curve = c;
+      update_version();
     }
 
     const Curve::Base & Surface::get_curve() const
@@ -49,6 +50,7 @@ namespace _Goptical {
     void Surface::set_shape(const const_ref<Shape::Base> &s)
     {
       _shape = s;
+      update_version();
     }
 
     const Shape::Base & Surface::get_shape() const
@@ -59,6 +61,7 @@ namespace _Goptical {
     void Surface::set_discard_intensity(double intensity)
     {
       _discard_intensity = intensity;
+      update_version();
     }
 
     inline double Surface::get_discard_intensity() const
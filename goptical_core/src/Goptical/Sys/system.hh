@@ -93,16 +93,29 @@ namespace _Goptical {
           associated elements properties are changed */
       inline unsigned int get_version() const;
 
+      /** Get system structure version. Unlike @ref get_version,
+          it is not updated when an element is modified but only
+          when elements are added or removed or when the
+          environment material is changed. */
+      inline unsigned int get_structure_version() const;
+
       /** Get the number of registered elements in the system */
       inline unsigned int get_element_count() const;
 
       /** Get registered element. first element has index 1 */
       inline Element & get_element(unsigned int index) const;
 
+      /** Test if an element is registered with given index. Index
+          of removed elements are not used until a new element is
+          added. */
+      inline bool has_element(unsigned int index) const;
+
       /** Increase current system version */
       inline void update_version();
 
-      /** Find surface which colides with the given ray and update intersection point */
+      /** Find surface which colides with the given ray and update
+          intersection point. All surfaces are tested, see @ref
+          CompiledSystem::colide_next for a faster lookup. */
       Surface * colide_next(const Trace::Params &params,
                             Math::VectorPair3 &intersect,
                             const Trace::Ray &ray) const;
@@ -116,6 +129,11 @@ namespace _Goptical {
       /** @internal get environment material proxy */
       inline const Material::Base & get_environment_proxy() const;
 
+      /** @internal Compute transform between element local and
+          global coordinates. Unlike @ref get_global_transform, this
+          does not use nor update the transforms cache. */
+      Math::Transform<3> compute_global_transform(const Element &e) const;
+
       /** @internal Dump 3d transforms cache */
       void transform_cache_dump(std::ostream &o) const;
 
@@ -150,6 +168,7 @@ namespace _Goptical {
       void transform_cache_resize(unsigned int newsize);
 
       unsigned int              _version;
+      unsigned int              _structure_version;
 
       const_ref<Surface>        _entrance;
       const_ref<Surface>        _exit;
@@ -159,6 +178,7 @@ namespace _Goptical {
       std::vector<Element *>    _index_map;
       // FIXME use transform pool instead of new/delete
       std::vector<Math::Transform<3> *> _transform_cache;
+
     };
 
   }
@@ -130,6 +130,11 @@ namespace _Goptical {
       return _version;
     }
 
+    unsigned int System::get_structure_version() const
+    {
+      return _structure_version;
+    }
+
     unsigned int System::get_element_count() const
     {
       return _e_count - 1;
@@ -141,6 +146,11 @@ namespace _Goptical {
       return *_index_map[index];
     }
 
+    bool System::has_element(unsigned int index) const
+    {
+      return index > 0 && index < _e_count && _index_map[index] != 0;
+    }
+
     const Material::Base & System::get_environment() const
     {
       return _env_proxy.get_material();
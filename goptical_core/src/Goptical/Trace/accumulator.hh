@@ -0,0 +1,65 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+
+#ifndef GOPTICAL_TRACE_ACCUMULATOR_HH_
+#define GOPTICAL_TRACE_ACCUMULATOR_HH_
+
+#include "Goptical/common.hh"
+
+namespace _Goptical {
+
+  namespace Trace {
+
+    /**
+       @short Intercepted rays accumulator base class
+       @header Goptical/Trace/Accumulator
+       @module {Core}
+
+       This class is the base class for objects which gather data
+       from rays intercepted by a surface. Accumulators are attached
+       to a surface with @ref Result::set_intercepted_accumulator.
+
+       When ray tracing in streaming mode, rays are discarded once a
+       chunk of source rays has been propagated and accumulators are
+       the only way to get results. The @ref accumulate function is
+       then called once for each chunk.
+
+       Accumulated data is not reset by the tracer.
+     */
+    class Accumulator
+    {
+    public:
+      virtual inline ~Accumulator();
+
+      /** Process rays intercepted by surface. Intercept point and
+          intensity of rays are available. */
+      virtual void accumulate(const Sys::Surface &s, const RayList &rays) = 0;
+    };
+
+  }
+}
+
+#endif
+
@@ -75,6 +75,15 @@ namespace _Goptical {
       GOPTICAL_ACCESSORS(PropagationMode, propagation_mode,
         "physical light propagation mode. @experimental @hidden");
 
+      GOPTICAL_ACCESSORS(unsigned int, thread_count,
+        "number of threads used to propagate rays, default is 1");
+
+      GOPTICAL_ACCESSORS(unsigned int, stream_chunk_size,
+        "number of source rays propagated at once in streaming mode, streaming is disabled when 0 (default)");
+
+      GOPTICAL_ACCESSORS(bool, incremental_mode,
+        "incremental sequential ray tracing mode. Rays of sequence elements which have not been modified since previous ray trace are reused, default is false");
+
       /** Set sequential ray tracing mode */
       inline void set_sequential_mode(const const_ref<Sequence> &seq);
 
@@ -84,6 +93,9 @@ namespace _Goptical {
       /** Test if in sequential ray tracing mode */
       inline bool is_sequential() const;
 
+      /** Get sequence used in sequential ray tracing mode */
+      inline const Sequence & get_sequence() const;
+
       /** Set distribution pattern for a given surface */
       inline void set_distribution(const Sys::Surface &s, const Distribution &dist);
 
@@ -93,10 +105,25 @@ namespace _Goptical {
       /** Get distribution pattern for a given surface */
       inline const Distribution & get_distribution(const Sys::Surface &s) const;
 
+      /** Enable ray aiming in sequential mode. Point sources
+          distribute rays over the pattern of the given stop surface
+          instead of the first sequence element: ray directions
+          which reach stop pattern points are solved for the first
+          wavelen of the source and cached until an element located
+          before the stop is modified. */
+      inline void set_ray_aiming(const Sys::Surface &stop);
+
+      /** Disable ray aiming (default) */
+      inline void disable_ray_aiming();
+
+      /** Get ray aiming stop surface, or 0 if ray aiming is disabled */
+      inline const Sys::Surface * get_ray_aiming_stop() const;
+
     private:
       typedef std::map<const Sys::Surface *, Distribution> _s_distribution_map_t;
 
       const_ref<Sequence>       _sequence;
+      const Sys::Surface        *_aiming_stop;
       Distribution              _default_distribution;
       _s_distribution_map_t     _s_distribution;
       unsigned int              _max_bounce;
@@ -105,6 +132,9 @@ namespace _Goptical {
       PropagationMode           _propagation_mode;
       bool                      _unobstructed;
       double                    _lost_ray_length;
+      unsigned int              _thread_count;
+      unsigned int              _stream_chunk_size;
+      bool                      _incremental_mode;
     };
   }
 }
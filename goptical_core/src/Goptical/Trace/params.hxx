@@ -26,6 +26,8 @@
 #ifndef GOPTICAL_TRACER_PARAMS_HXX_
 #define GOPTICAL_TRACER_PARAMS_HXX_
 
+#include <cassert>
+
 #include "Goptical/Trace/result.hxx"
 #include "Goptical/Trace/distribution.hxx"
 #include "Goptical/Trace/sequence.hxx"
@@ -35,14 +37,18 @@ namespace _Goptical {
   namespace Trace {
 
     Params::Params()
-      : _default_distribution(),
+      : _aiming_stop(0),
+        _default_distribution(),
         _s_distribution(),
         _max_bounce(50),
         _intensity_mode(SimpleTrace),
         _sequential_mode(false),
         _propagation_mode(RayPropagation),
         _unobstructed(false),
-        _lost_ray_length(1000)
+        _lost_ray_length(1000),
+        _thread_count(1),
+        _stream_chunk_size(0),
+        _incremental_mode(false)
     {
     }
 
@@ -62,6 +68,12 @@ namespace _Goptical {
       return _sequential_mode;
     }
 
+    const Sequence & Params::get_sequence() const
+    {
+      assert(_sequence.valid());
+      return *_sequence;
+    }
+
     void Params::set_distribution(const Sys::Surface &s, const Distribution &dist)
     {
       _s_distribution[&s] = dist;
@@ -79,6 +91,21 @@ namespace _Goptical {
       return i == _s_distribution.end() ? _default_distribution : i->second;
     }
 
+    void Params::set_ray_aiming(const Sys::Surface &stop)
+    {
+      _aiming_stop = &stop;
+    }
+
+    void Params::disable_ray_aiming()
+    {
+      _aiming_stop = 0;
+    }
+
+    const Sys::Surface * Params::get_ray_aiming_stop() const
+    {
+      return _aiming_stop;
+    }
+
   }
 }
 
@@ -45,6 +45,9 @@ namespace _Goptical {
      */
     class Ray : public Light::Ray
     {
+      friend class Result;
+      friend class RayList;
+
     public:
 
       /** Create a propagated light ray */
@@ -105,6 +108,7 @@ namespace _Goptical {
       Ray                       *_child;        // pointer to generated ray
       Ray                       *_next;         // pointer to sibling generated ray
       bool                      _lost;          // does the ray intersect with an element ?
+      unsigned int              _index;         // index in result ray pool
     };
 
   }
@@ -0,0 +1,194 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+#ifndef GOPTICAL_TRACE_RAY_BATCH_HH_
+#define GOPTICAL_TRACE_RAY_BATCH_HH_
+
+#include <vector>
+
+#include "Goptical/common.hh"
+
+#include "Goptical/Math/vector.hh"
+#include "Goptical/Math/vector_pair.hh"
+#include "Goptical/Math/transform.hh"
+
+namespace _Goptical {
+
+  namespace Trace {
+
+    /**
+       @short Structure of arrays storage for sequential ray batches
+       @header Goptical/Trace/RayBatch
+       @module {Core}
+
+       This class stores a set of light rays as contiguous arrays of
+       origins, directions, wavelengths, intensities and alive
+       flags. It is used by @ref Tracer::trace_batch to propagate
+       rays element by element through a sequence without
+       allocating a @ref Ray object for each interaction.
+
+       All rays in the batch are expressed in the local coordinates
+       system of the same element, the batch frame. Lost rays are
+       not removed from the batch but are flagged as not alive so
+       that ray indexes remain valid during propagation. Elements
+       may append new rays when an incident ray is split.
+     */
+    class RayBatch
+    {
+      friend class Tracer;
+
+    public:
+      /** Create an empty ray batch */
+      RayBatch();
+
+      /** Create an empty ray batch which uses given parameters and
+          trace result when propagated with @ref
+          Sys::Element::process_rays outside of a tracer. Transforms
+          between frames are taken from the result system snapshot
+          and image detectors record rays in the result. */
+      RayBatch(const Params &params, Result &result);
+
+      /** Remove all rays from batch */
+      void clear();
+
+      /** Reserve storage for given rays count */
+      void reserve(unsigned int count);
+
+      /** Append a new alive ray expressed in batch frame coordinates,
+          return ray index. */
+      inline unsigned int add_ray(const Math::VectorPair3 &ray, double wavelen,
+                                  double intensity, const Material::Base *material);
+
+      /** Append a copy of an existing ray, return new ray index */
+      inline unsigned int add_ray(unsigned int index);
+
+      /** Get number of rays in batch, including lost rays */
+      inline unsigned int get_ray_count() const;
+
+      /** Get number of rays which are still propagating */
+      unsigned int get_alive_count() const;
+
+      /** Test if ray is still propagating */
+      inline bool is_alive(unsigned int index) const;
+
+      /** Flag ray as lost */
+      inline void kill(unsigned int index);
+
+      /** Get ray origin and direction in batch frame coordinates */
+      inline Math::VectorPair3 get_ray(unsigned int index) const;
+      /** Set ray origin and direction in batch frame coordinates */
+      inline void set_ray(unsigned int index, const Math::VectorPair3 &ray);
+
+      /** Get ray origin in batch frame coordinates */
+      inline Math::Vector3 get_origin(unsigned int index) const;
+      /** Set ray origin in batch frame coordinates */
+      inline void set_origin(unsigned int index, const Math::Vector3 &v);
+
+      /** Get ray direction in batch frame coordinates */
+      inline Math::Vector3 get_direction(unsigned int index) const;
+      /** Set ray direction in batch frame coordinates */
+      inline void set_direction(unsigned int index, const Math::Vector3 &v);
+
+      /** Get surface normal at last ray interception point */
+      inline Math::Vector3 get_normal(unsigned int index) const;
+      /** Set surface normal at last ray interception point */
+      inline void set_normal(unsigned int index, const Math::Vector3 &v);
+
+      /** Get ray wavelength */
+      inline double get_wavelen(unsigned int index) const;
+
+      /** Get ray intensity */
+      inline double get_intensity(unsigned int index) const;
+      /** Set ray intensity */
+      inline void set_intensity(unsigned int index, double intensity);
+
+      /** Get material ray is propagated in */
+      inline const Material::Base * get_material(unsigned int index) const;
+      /** Set material ray is propagated in */
+      inline void set_material(unsigned int index, const Material::Base *material);
+
+      /** Get pointer to origin coordinates array for given axis */
+      inline const double * get_origin_array(unsigned int axis) const;
+      /** Get pointer to direction coordinates array for given axis */
+      inline const double * get_direction_array(unsigned int axis) const;
+      /** Get pointer to normal coordinates array for given axis */
+      inline const double * get_normal_array(unsigned int axis) const;
+      /** Get pointer to alive flags array */
+      inline const char * get_alive_array() const;
+
+      /** Get pointer to modifiable origin coordinates array for given axis */
+      inline double * get_origin_array(unsigned int axis);
+      /** Get pointer to modifiable normal coordinates array for given axis */
+      inline double * get_normal_array(unsigned int axis);
+      /** Get pointer to modifiable alive flags array */
+      inline char * get_alive_array();
+
+      /** Get pointer to wavelengths array */
+      inline const double * get_wavelen_array() const;
+      /** Get pointer to intensities array */
+      inline const double * get_intensity_array() const;
+
+      /** Get element whose local coordinates are used to store rays */
+      inline const Sys::Element * get_frame() const;
+
+      /** Set element whose local coordinates are used to store rays,
+          rays are not transformed. */
+      inline void set_frame(const Sys::Element *frame);
+
+      /** Express all rays in local coordinates of given element */
+      void move_to_frame(const Sys::Element &frame);
+
+      /** Apply affine transform to rays origins and linear transform
+          to rays directions. */
+      void transform(const Math::Transform<3> &t);
+
+      /** Get ray origin and direction in global coordinates */
+      Math::VectorPair3 get_global_ray(unsigned int index) const;
+
+      /** Get reference to tracer parameters used */
+      inline const Params & get_params() const;
+
+      /** Get reference to trace result used by tracer */
+      inline const Result & get_result() const;
+      /** Get modifiable reference to trace result used by tracer */
+      inline Result & get_result();
+
+    private:
+      std::vector<double>       _origin[3];
+      std::vector<double>       _direction[3];
+      std::vector<double>       _normal[3];
+      std::vector<double>       _wavelen;
+      std::vector<double>       _intensity;
+      std::vector<const Material::Base *> _material;
+      std::vector<char>         _alive;
+      const Sys::Element        *_frame;
+      const Params              *_params;
+      Result                    *_result;
+    };
+
+  }
+}
+
+#endif
+
@@ -0,0 +1,241 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+#ifndef GOPTICAL_TRACE_RAY_BATCH_HXX_
+#define GOPTICAL_TRACE_RAY_BATCH_HXX_
+
+#include <cassert>
+
+#include "Goptical/Math/vector.hxx"
+#include "Goptical/Math/vector_pair.hxx"
+#include "Goptical/Math/transform.hxx"
+
+namespace _Goptical {
+
+  namespace Trace {
+
+    unsigned int RayBatch::add_ray(const Math::VectorPair3 &ray, double wavelen,
+                                   double intensity, const Material::Base *material)
+    {
+      for (unsigned int j = 0; j < 3; j++)
+        {
+          _origin[j].push_back(ray.origin()[j]);
+          _direction[j].push_back(ray.direction()[j]);
+          _normal[j].push_back(0.0);
+        }
+
+      _wavelen.push_back(wavelen);
+      _intensity.push_back(intensity);
+      _material.push_back(material);
+      _alive.push_back(1);
+
+      return _alive.size() - 1;
+    }
+
+    unsigned int RayBatch::add_ray(unsigned int index)
+    {
+      assert(index < _alive.size());
+
+      for (unsigned int j = 0; j < 3; j++)
+        {
+          _origin[j].push_back(_origin[j][index]);
+          _direction[j].push_back(_direction[j][index]);
+          _normal[j].push_back(_normal[j][index]);
+        }
+
+      _wavelen.push_back(_wavelen[index]);
+      _intensity.push_back(_intensity[index]);
+      _material.push_back(_material[index]);
+      _alive.push_back(_alive[index]);
+
+      return _alive.size() - 1;
+    }
+
+    unsigned int RayBatch::get_ray_count() const
+    {
+      return _alive.size();
+    }
+
+    bool RayBatch::is_alive(unsigned int index) const
+    {
+      return _alive[index];
+    }
+
+    void RayBatch::kill(unsigned int index)
+    {
+      _alive[index] = 0;
+    }
+
+    Math::VectorPair3 RayBatch::get_ray(unsigned int index) const
+    {
+      return Math::VectorPair3(get_origin(index), get_direction(index));
+    }
+
+    void RayBatch::set_ray(unsigned int index, const Math::VectorPair3 &ray)
+    {
+      set_origin(index, ray.origin());
+      set_direction(index, ray.direction());
+    }
+
+    Math::Vector3 RayBatch::get_origin(unsigned int index) const
+    {
+      return Math::Vector3(_origin[0][index], _origin[1][index], _origin[2][index]);
+    }
+
+    void RayBatch::set_origin(unsigned int index, const Math::Vector3 &v)
+    {
+      for (unsigned int j = 0; j < 3; j++)
+        _origin[j][index] = v[j];
+    }
+
+    Math::Vector3 RayBatch::get_direction(unsigned int index) const
+    {
+      return Math::Vector3(_direction[0][index], _direction[1][index], _direction[2][index]);
+    }
+
+    void RayBatch::set_direction(unsigned int index, const Math::Vector3 &v)
+    {
+      for (unsigned int j = 0; j < 3; j++)
+        _direction[j][index] = v[j];
+    }
+
+    Math::Vector3 RayBatch::get_normal(unsigned int index) const
+    {
+      return Math::Vector3(_normal[0][index], _normal[1][index], _normal[2][index]);
+    }
+
+    void RayBatch::set_normal(unsigned int index, const Math::Vector3 &v)
+    {
+      for (unsigned int j = 0; j < 3; j++)
+        _normal[j][index] = v[j];
+    }
+
+    double RayBatch::get_wavelen(unsigned int index) const
+    {
+      return _wavelen[index];
+    }
+
+    double RayBatch::get_intensity(unsigned int index) const
+    {
+      return _intensity[index];
+    }
+
+    void RayBatch::set_intensity(unsigned int index, double intensity)
+    {
+      _intensity[index] = intensity;
+    }
+
+    const Material::Base * RayBatch::get_material(unsigned int index) const
+    {
+      return _material[index];
+    }
+
+    void RayBatch::set_material(unsigned int index, const Material::Base *material)
+    {
+      _material[index] = material;
+    }
+
+    const double * RayBatch::get_origin_array(unsigned int axis) const
+    {
+      assert(axis < 3);
+      return &_origin[axis][0];
+    }
+
+    const double * RayBatch::get_direction_array(unsigned int axis) const
+    {
+      assert(axis < 3);
+      return &_direction[axis][0];
+    }
+
+    const double * RayBatch::get_normal_array(unsigned int axis) const
+    {
+      assert(axis < 3);
+      return &_normal[axis][0];
+    }
+
+    const char * RayBatch::get_alive_array() const
+    {
+      return &_alive[0];
+    }
+
+    double * RayBatch::get_origin_array(unsigned int axis)
+    {
+      assert(axis < 3);
+      return &_origin[axis][0];
+    }
+
+    double * RayBatch::get_normal_array(unsigned int axis)
+    {
+      assert(axis < 3);
+      return &_normal[axis][0];
+    }
+
+    char * RayBatch::get_alive_array()
+    {
+      return &_alive[0];
+    }
+
+    const double * RayBatch::get_wavelen_array() const
+    {
+      return &_wavelen[0];
+    }
+
+    const double * RayBatch::get_intensity_array() const
+    {
+      return &_intensity[0];
+    }
+
+    const Sys::Element * RayBatch::get_frame() const
+    {
+      return _frame;
+    }
+
+    void RayBatch::set_frame(const Sys::Element *frame)
+    {
+      _frame = frame;
+    }
+
+    const Params & RayBatch::get_params() const
+    {
+      assert(_params != 0);
+      return *_params;
+    }
+
+    const Result & RayBatch::get_result() const
+    {
+      assert(_result != 0);
+      return *_result;
+    }
+
+    Result & RayBatch::get_result()
+    {
+      assert(_result != 0);
+      return *_result;
+    }
+
+  }
+}
+
+#endif
+
@@ -0,0 +1,154 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+
+#ifndef GOPTICAL_TRACE_RAY_LIST_HH_
+#define GOPTICAL_TRACE_RAY_LIST_HH_
+
+#include <cstddef>
+#include <iterator>
+#include <vector>
+
+#include "Goptical/common.hh"
+
+namespace _Goptical {
+
+  namespace Trace {
+
+    /**
+       @short List of rays allocated from a trace result
+       @header Goptical/Trace/RayList
+       @module {Core}
+
+       This class stores a list of @ref Ray objects as 32 bits indexes
+       in the ray pool of the @ref Result object which allocated
+       them. Indexes are stored in a contiguous array which keeps its
+       storage when the list is cleared, so that lists can be reused
+       between ray traces without reallocation.
+
+       Iterators and indexed access yield @ref Ray pointers like a
+       container of pointers would.
+     */
+    class RayList
+    {
+      friend class Result;
+      friend class Tracer;
+
+      typedef std::vector<unsigned int> index_list_t;
+
+    public:
+
+      /** @short Ray list iterator
+          @internal
+          This iterator dereferences to @ref Ray pointers. */
+      class const_iterator
+      {
+        friend class RayList;
+
+      public:
+        typedef std::random_access_iterator_tag iterator_category;
+        typedef Ray * value_type;
+        typedef ptrdiff_t difference_type;
+        typedef Ray * const * pointer;
+        typedef Ray * reference;
+
+        inline const_iterator();
+
+        inline Ray * operator*() const;
+        inline Ray * operator[](difference_type n) const;
+
+        inline const_iterator & operator++();
+        inline const_iterator operator++(int);
+        inline const_iterator & operator--();
+        inline const_iterator operator--(int);
+        inline const_iterator & operator+=(difference_type n);
+        inline const_iterator & operator-=(difference_type n);
+        inline const_iterator operator+(difference_type n) const;
+        inline const_iterator operator-(difference_type n) const;
+        inline difference_type operator-(const const_iterator &i) const;
+
+        inline bool operator==(const const_iterator &i) const;
+        inline bool operator!=(const const_iterator &i) const;
+        inline bool operator<(const const_iterator &i) const;
+
+      private:
+        inline const_iterator(const Result *result, index_list_t::const_iterator i);
+
+        const Result                    *_result;
+        index_list_t::const_iterator    _i;
+      };
+
+      typedef const_iterator iterator;
+      typedef Ray * value_type;
+      typedef size_t size_type;
+
+      /** Create an empty rays list for use with the given result */
+      inline RayList(const Result &result);
+
+      /** Create an empty rays list which must be assigned an other
+          list before use */
+      inline RayList();
+
+      /** Get number of rays in list */
+      inline size_t size() const;
+      /** Return true if list is empty */
+      inline bool empty() const;
+
+      /** Get ray at given position in list */
+      inline Ray * operator[](size_t i) const;
+      /** Get first ray in list */
+      inline Ray * front() const;
+      /** Get last ray in list */
+      inline Ray * back() const;
+
+      /** Get iterator to first ray in list */
+      inline const_iterator begin() const;
+      /** Get iterator past last ray in list */
+      inline const_iterator end() const;
+
+      /** Append a ray allocated by the associated result object */
+      inline void push_back(Ray *ray);
+
+      /** Replace list content with a range of rays from an other
+          list. Both lists must share the same ray index space. */
+      inline void assign(const const_iterator &first, const const_iterator &last);
+
+      /** Remove all rays from list, storage is kept for reuse */
+      inline void clear();
+
+      /** Reserve storage for given number of rays */
+      inline void reserve(size_t size);
+
+    private:
+      inline void set_result(const Result &result);
+
+      const Result      *_result;
+      index_list_t      _list;
+    };
+
+  }
+}
+
+#endif
+
@@ -0,0 +1,207 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+
+#ifndef GOPTICAL_TRACE_RAY_LIST_HXX_
+#define GOPTICAL_TRACE_RAY_LIST_HXX_
+
+#include <cassert>
+
+#include "Goptical/Trace/result.hh"
+#include "Goptical/Trace/ray.hxx"
+
+namespace _Goptical {
+
+  namespace Trace {
+
+    RayList::const_iterator::const_iterator()
+      : _result(0),
+        _i()
+    {
+    }
+
+    RayList::const_iterator::const_iterator(const Result *result,
+                                            index_list_t::const_iterator i)
+      : _result(result),
+        _i(i)
+    {
+    }
+
+    Ray * RayList::const_iterator::operator*() const
+    {
+      return _result->get_ray(*_i);
+    }
+
+    Ray * RayList::const_iterator::operator[](difference_type n) const
+    {
+      return _result->get_ray(_i[n]);
+    }
+
+    RayList::const_iterator & RayList::const_iterator::operator++()
+    {
+      ++_i;
+      return *this;
+    }
+
+    RayList::const_iterator RayList::const_iterator::operator++(int)
+    {
+      const_iterator tmp(*this);
+      ++_i;
+      return tmp;
+    }
+
+    RayList::const_iterator & RayList::const_iterator::operator--()
+    {
+      --_i;
+      return *this;
+    }
+
+    RayList::const_iterator RayList::const_iterator::operator--(int)
+    {
+      const_iterator tmp(*this);
+      --_i;
+      return tmp;
+    }
+
+    RayList::const_iterator & RayList::const_iterator::operator+=(difference_type n)
+    {
+      _i += n;
+      return *this;
+    }
+
+    RayList::const_iterator & RayList::const_iterator::operator-=(difference_type n)
+    {
+      _i -= n;
+      return *this;
+    }
+
+    RayList::const_iterator RayList::const_iterator::operator+(difference_type n) const
+    {
+      return const_iterator(_result, _i + n);
+    }
+
+    RayList::const_iterator RayList::const_iterator::operator-(difference_type n) const
+    {
+      return const_iterator(_result, _i - n);
+    }
+
+    RayList::const_iterator::difference_type
+    RayList::const_iterator::operator-(const const_iterator &i) const
+    {
+      return _i - i._i;
+    }
+
+    bool RayList::const_iterator::operator==(const const_iterator &i) const
+    {
+      return _i == i._i;
+    }
+
+    bool RayList::const_iterator::operator!=(const const_iterator &i) const
+    {
+      return _i != i._i;
+    }
+
+    bool RayList::const_iterator::operator<(const const_iterator &i) const
+    {
+      return _i < i._i;
+    }
+
+    RayList::RayList()
+      : _result(0),
+        _list()
+    {
+    }
+
+    RayList::RayList(const Result &result)
+      : _result(&result),
+        _list()
+    {
+    }
+
+    void RayList::set_result(const Result &result)
+    {
+      _result = &result;
+    }
+
+    size_t RayList::size() const
+    {
+      return _list.size();
+    }
+
+    bool RayList::empty() const
+    {
+      return _list.empty();
+    }
+
+    Ray * RayList::operator[](size_t i) const
+    {
+      return _result->get_ray(_list[i]);
+    }
+
+    Ray * RayList::front() const
+    {
+      return _result->get_ray(_list.front());
+    }
+
+    Ray * RayList::back() const
+    {
+      return _result->get_ray(_list.back());
+    }
+
+    RayList::const_iterator RayList::begin() const
+    {
+      return const_iterator(_result, _list.begin());
+    }
+
+    RayList::const_iterator RayList::end() const
+    {
+      return const_iterator(_result, _list.end());
+    }
+
+    void RayList::push_back(Ray *ray)
+    {
+      assert(_result != 0 && _result->get_ray(ray->_index) == ray);
+      _list.push_back(ray->_index);
+    }
+
+    void RayList::assign(const const_iterator &first, const const_iterator &last)
+    {
+      _list.assign(first._i, last._i);
+    }
+
+    void RayList::clear()
+    {
+      _list.clear();
+    }
+
+    void RayList::reserve(size_t size)
+    {
+      _list.reserve(size);
+    }
+
+  }
+}
+
+#endif
+
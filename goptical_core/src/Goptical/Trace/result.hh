@@ -26,14 +26,17 @@
 #ifndef GOPTICAL_TRACE_RESULT_HH_
 #define GOPTICAL_TRACE_RESULT_HH_
 
+#include <map>
 #include <set>
-#include <deque>
+#include <vector>
 
 #include "Goptical/common.hh"
 
 #include "Goptical/Sys/element.hh"
 #include "Goptical/Sys/surface.hh"
+#include "Goptical/Trace/params.hh"
 #include "Goptical/Trace/ray.hh"
+#include "Goptical/Trace/ray_list.hh"
 
 namespace _Goptical {
 
@@ -54,10 +57,14 @@ namespace _Goptical {
 
        All @ref Ray object are allocated by this class. It is able
        to remember which element intercepted and generated each ray.
+
+       Rays are stored in blocks which are kept between ray traces
+       and are referred to by 32 bits indexes in @ref RayList objects.
     */
     class Result
     {
       friend class Tracer;
+      friend class RayList;
 
     public:
       typedef std::vector<const Sys::Source *> sources_t;
@@ -95,6 +102,12 @@ namespace _Goptical {
       /** Return true if generated rays must be saved for this element */
       bool get_generated_save_state(const Sys::Element &e);
 
+      /** Attach an accumulator which will process rays striking this
+          surface at the end of ray tracing, or after each chunk of
+          source rays in streaming mode. Use a null pointer to detach.
+          @see Params::set_stream_chunk_size */
+      void set_intercepted_accumulator(const Sys::Surface &s, Accumulator *acc);
+
       /** Set all save states to false */
       void clear_save_states();
 
@@ -114,6 +127,20 @@ namespace _Goptical {
       inline void add_intercepted(const Sys::Surface &s, Ray &ray);
       /** Declare a new ray generation */
       inline void add_generated(const Sys::Element &s, Ray &ray);
+      /** Bin intercepted ray intensity in image detector grid */
+      void add_detected(const Sys::Image &image, const Ray &ray);
+
+      /** Bin intensity at given image local point in detector grid */
+      void add_detected(const Sys::Image &image, const Math::Vector3 &point,
+                        double wavelen, double intensity);
+
+      /** Get irradiance map recorded by an image plane in detector
+          mode. Grid sample points are pixels centers in image plane
+          coordinates and values are intercepted intensity per unit
+          area. The @tt wavelen parameter selects the map when the
+          detector records each wavelength separately and is ignored
+          otherwise. @see Sys::Image::set_detector */
+      const Data::Grid & get_irradiance(const Sys::Image &image, double wavelen = 0) const;
 
       /** Declare ray wavelen used for tracing */
       inline void add_ray_wavelen(double wavelen);
@@ -121,9 +148,30 @@ namespace _Goptical {
       /** Get ray wavelen in use set */
       inline const std::set<double> & get_ray_wavelen_set() const;
 
+      /** Get ratio of refractive indexes of materials on both sides
+          of an optical surface, in ray propagation order. Values are
+          precomputed for all wavelens of the ray wavelen set. */
+      inline double get_refractive_index_ratio(const Sys::OpticalSurface &s,
+                                               bool right_to_left, double wavelen) const;
+
       /** Get reference to tracer parameters used */
       inline const Params & get_params() const;
 
+      /** Get system snapshot used by tracer */
+      inline const Sys::CompiledSystem & get_compiled_system() const;
+
+      /** @internal Base class for data computed by an element during
+          ray tracing and kept between ray traces */
+      struct element_cache_s
+      {
+        virtual ~element_cache_s();
+      };
+
+      /** @internal Get data cached by an element for this result,
+          may be a null pointer. Cached data is deleted along with
+          the result. */
+      inline element_cache_s * & get_element_cache(const Sys::Element &e);
+
       /** Draw all tangential rays using specified renderer. Only rays
           which end up hitting the image plane are drawn when @tt
           hit_image is set. */
@@ -141,25 +189,99 @@ namespace _Goptical {
 
       void prepare();
 
+      /** compute refractive index ratios of optical surfaces for all
+          wavelens in use */
+      void update_index_table();
+      /** compute refractive index ratio for wavelen not in table */
+      double compute_index_ratio(const Sys::OpticalSurface &s,
+                                 bool right_to_left, double wavelen) const;
+
+      /** throw if rays lists must be saved in streaming mode */
+      void check_streaming() const;
+      /** feed attached accumulators with intercepted rays lists */
+      void accumulate() const;
+      /** let the tracer propagate pending source rays */
+      void flush_stream();
+      /** discard all rays and empty rays lists */
+      void recycle_rays();
+      void clear_rays();
+
+      /** ray pool allocation state */
+      struct rays_mark_s
+      {
+        unsigned int _count;
+        unsigned int _table;
+        unsigned int _block_pos;
+      };
+
+      /** get current ray pool allocation state */
+      inline void get_rays_mark(rays_mark_s &mark) const;
+
+      /** discard rays allocated since pool was in given state along
+          with rays of worker results, reset propagation data of
+          rays in list so that they can be propagated again */
+      void rewind_rays(const rays_mark_s &mark, const RayList &rays);
+
+      /** empty rays lists of element and discard its detector data */
+      void discard_rays(const Sys::Element &e);
+
+      /** get worker result object used by tracer thread, allocate
+          and configure it if needed */
+      Result & get_worker(unsigned int index);
+      /** append rays lists of worker result and empty them */
+      void merge_worker(Result &worker);
+
+      /** get ray from its index in pool */
+      inline Ray * get_ray(unsigned int index) const;
+      /** get storage for a new ray and its index */
+      inline void * alloc_ray(unsigned int &index);
+      /** make a new block available for ray allocation */
+      void add_ray_block();
+      /** get an empty rays list, reuse storage of a previous list if possible */
+      RayList * new_list();
+      /** append worker list to list with translated indexes */
+      static void merge_list(RayList &list, RayList &wlist,
+                             unsigned int shared, unsigned int shift);
+
+      typedef std::map<double, ref<Data::Grid> > detector_t;
+
       struct element_result_s
       {
         rays_queue_t *_intercepted; // list of rays for each intercepted surfaces
         rays_queue_t *_generated; // list of rays for each generator surfaces
         bool _save_intercepted_list;
         bool _save_generated_list;
+        Accumulator *_accumulator;
+        detector_t *_detector; // irradiance grids of image in detector mode
+        element_cache_s *_cache; // element data kept between ray traces
       };
 
       inline struct element_result_s & get_element_result(const Sys::Element &e);
       inline const struct element_result_s & get_element_result(const Sys::Element &e) const;
 
-      vector_pool<Ray, 256> _rays; // rays allocation pool
+      static const unsigned int ray_block_shift = 8;
+      static const unsigned int ray_block_size = 1 << ray_block_shift;
+
+      std::vector<Ray *>        _ray_blocks; // own rays storage blocks
+      std::vector<Ray *>        _ray_table; // blocks addressable by ray index
+      unsigned int              _ray_count; // rays allocated in own blocks
+      unsigned int              _ray_merged; // own rays already merged in parent result
+      unsigned int              _ray_block_pos; // table position of last own block
+      unsigned int              _ray_table_shared; // table entries shared with parent result
+      std::vector<RayList *>    _spare_lists;
       std::vector<struct element_result_s> _elements;
       std::set<double>          _wavelengths;
-      rays_queue_t              *_generated_queue;
+      std::vector<double>       _index_wavelens; // wavelens of index ratios table
+      std::vector<double>       _index_ratios; // ratios for each element, side and wavelen
+      RayList                   *_generated_queue;
+      Tracer                    *_stream; // tracer to notify when a chunk of source rays is ready
       Trace::Result::sources_t  _sources;
       unsigned int              _bounce_limit_count;
+      unsigned int              _serial; // updated when rays or save states are reset
       const Sys::System         *_system;
       const Trace::Params       *_params;
+      const Sys::CompiledSystem *_compiled;
+      std::vector<Result *>     _workers;
       //  Tracer::Mode          _mode;
     };
   }
@@ -27,11 +27,15 @@
 #define GOPTICAL_TRACE_RESULT_HXX_
 
 #include <cassert>
+#include <new>
 
 #include "Goptical/error.hh"
 #include "Goptical/Sys/element.hxx"
 #include "Goptical/Sys/surface.hxx"
+#include "Goptical/Sys/optical_surface.hh"
 #include "Goptical/Trace/ray.hxx"
+#include "Goptical/Trace/ray_list.hxx"
+#include "Goptical/Trace/params.hxx"
 
 namespace _Goptical {
 
@@ -47,6 +51,12 @@ namespace _Goptical {
       return _elements[e.id() - 1];
     }
 
+    Result::element_cache_s * & Result::get_element_cache(const Sys::Element &e)
+    {
+      init(e);
+      return get_element_result(e)._cache;
+    }
+
     const Trace::rays_queue_t & Result::get_intercepted(const Sys::Surface &s) const
     {
       const struct element_result_s &er = get_element_result(s);
@@ -90,7 +100,30 @@ namespace _Goptical {
 
     void Result::add_ray_wavelen(double wavelen)
     {
-      _wavelengths.insert(wavelen);
+      if (_wavelengths.insert(wavelen).second)
+        update_index_table();
+    }
+
+    double Result::get_refractive_index_ratio(const Sys::OpticalSurface &s,
+                                              bool right_to_left, double wavelen) const
+    {
+      unsigned int count = _index_wavelens.size();
+
+      for (unsigned int i = 0; i < count; i++)
+        {
+          if (_index_wavelens[i] != wavelen)
+            continue;
+
+          unsigned int j = (s.id() * 2 + right_to_left) * count + i;
+
+          // nan entries are computed again to report errors
+          if (j < _index_ratios.size() && _index_ratios[j] == _index_ratios[j])
+            return _index_ratios[j];
+
+          break;
+        }
+
+      return compute_index_ratio(s, right_to_left, wavelen);
     }
 
     const std::set<double> & Result::get_ray_wavelen_set() const
@@ -98,9 +131,39 @@ namespace _Goptical {
       return _wavelengths;
     }
 
+    Ray * Result::get_ray(unsigned int index) const
+    {
+      return _ray_table[index >> ray_block_shift] + (index & (ray_block_size - 1));
+    }
+
+    void * Result::alloc_ray(unsigned int &index)
+    {
+      if (_stream && _ray_count >= _params->get_stream_chunk_size())
+        flush_stream();
+
+      unsigned int offset = _ray_count & (ray_block_size - 1);
+
+      if (!offset)
+        add_ray_block();
+
+      index = (_ray_block_pos << ray_block_shift) | offset;
+
+      return _ray_blocks[_ray_count++ >> ray_block_shift] + offset;
+    }
+
+    void Result::get_rays_mark(rays_mark_s &mark) const
+    {
+      mark._count = _ray_count;
+      mark._table = _ray_table.size();
+      mark._block_pos = _ray_block_pos;
+    }
+
     Trace::Ray & Result::new_ray()
     {
-      Trace::Ray        &r = _rays.create();
+      unsigned int      index;
+      Trace::Ray        &r = *new (alloc_ray(index)) Ray();
+
+      r._index = index;
 
       if (_generated_queue)
         _generated_queue->push_back(&r);
@@ -110,7 +173,10 @@ namespace _Goptical {
 
     Trace::Ray & Result::new_ray(const Light::Ray &ray)
     {
-      Trace::Ray        &r = _rays.create(ray);
+      unsigned int      index;
+      Trace::Ray        &r = *new (alloc_ray(index)) Ray(ray);
+
+      r._index = index;
 
       if (_generated_queue)
         _generated_queue->push_back(&r);
@@ -124,6 +190,12 @@ namespace _Goptical {
       return *_params;
     }
 
+    const Sys::CompiledSystem & Result::get_compiled_system() const
+    {
+      assert(_compiled != 0);
+      return *_compiled;
+    }
+
   }
 }
 
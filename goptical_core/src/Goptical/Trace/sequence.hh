@@ -82,10 +82,18 @@ namespace _Goptical {
       /** Get a reference to an element in sequence */
       inline const Sys::Element &get_element(unsigned int index) const;
 
+      /** Get number of elements in sequence */
+      inline unsigned int get_element_count() const;
+
+      /** Get sequence version. version is updated each time
+          elements are added or removed. */
+      inline unsigned int get_version() const;
+
     private:
       void add(const Sys::Container &c);
 
       std::vector<const_ref<Sys::Element> > _list;
+      unsigned int _version;
     };
 
     std::ostream & operator<<(std::ostream &o, const Sequence &s);
@@ -32,6 +32,7 @@ namespace _Goptical {
     unsigned int Sequence::append(const Sys::Element &element)
     {
       _list.push_back(element);
+      _version++;
 
       return _list.size() - 1;
     }
@@ -39,11 +40,13 @@ namespace _Goptical {
     void Sequence::insert(unsigned int index, const Sys::Element &element)
     {
       _list.insert(_list.begin() + index, element);
+      _version++;
     }
 
     void Sequence::remove(unsigned int index)
     {
       _list.erase(_list.begin() + index);
+      _version++;
     }
 
     const Sys::Element &Sequence::get_element(unsigned int index) const
@@ -51,9 +54,20 @@ namespace _Goptical {
       return *_list.at(index);
     }
 
+    unsigned int Sequence::get_element_count() const
+    {
+      return _list.size();
+    }
+
     void Sequence::clear()
     {
       _list.clear();
+      _version++;
+    }
+
+    unsigned int Sequence::get_version() const
+    {
+      return _version;
     }
 
   }
@@ -26,11 +26,14 @@
 #ifndef GOPTICAL_TRACER_HH_
 #define GOPTICAL_TRACER_HH_
 
+#include <vector>
+
 #include "Goptical/common.hh"
 
 #include "Goptical/Trace/result.hh"
 #include "Goptical/Trace/params.hh"
 #include "Goptical/Sys/system.hh"
+#include "Goptical/Sys/compiled_system.hh"
 
 namespace _Goptical {
 
@@ -47,10 +50,41 @@ namespace _Goptical {
        Propagation result is stored in a @ref Result object.
        Propagation parameters are stored in a @ref Params object.
 
+       Rays can be propagated by several threads when the @ref
+       Params::set_thread_count parameter is greater than 1. Rays
+       generated by sources are split between threads and resulting
+       rays lists are merged in the same order as with a single
+       thread.
+
+       Rays are propagated using a @ref Sys::CompiledSystem snapshot
+       of the system. The tracer compiles its own snapshot when none
+       has been set or when the system has been modified since last
+       compilation. Several tracers running in different threads may
+       share the same snapshot.
+
+       Memory usage does not depend on the number of traced rays in
+       streaming mode (see @ref Params::set_stream_chunk_size). Source
+       rays are propagated by chunks, intercepted rays lists are
+       passed to the @ref Accumulator objects attached to the result,
+       then all rays are discarded. In sequential mode, sources must
+       appear before other elements in the sequence.
+
+       In incremental mode (see @ref Params::set_incremental_mode),
+       a sequential ray trace restarts from the first sequence
+       element modified since the previous ray trace; rays lists
+       generated by elements located before are kept. Elements
+       changes are detected using their version, changes made to
+       curve, shape or material objects are not. A full ray trace is
+       performed when sources, tracer parameters or result save
+       states have been modified. Rays propagated by worker threads
+       are always traced again.
+
        @xsee {tuto_seqtrace}
      */
     class Tracer
     {
+      friend class Result;
+
     public:
 
       /** Create a new Light porpagator object */
@@ -80,18 +114,81 @@ namespace _Goptical {
       /** Get attached system */
       inline const Sys::System & get_system() const;
 
+      /** Use a system snapshot compiled by the caller. The snapshot
+          must stay alive as long as it is in use by the tracer. It
+          is replaced by an internal one if it does not match the
+          system and tracer parameters on next ray trace operation. */
+      void set_compiled_system(const Sys::CompiledSystem &compiled);
+
+      /** Get system snapshot used for ray tracing, compile it if
+          needed. */
+      const Sys::CompiledSystem & get_compiled_system();
+
       /** Launch ray tracing operation */
       void trace();
 
+      /** Launch sequential ray tracing operation using a structure of
+          arrays ray batch. Rays generated by sources of the sequence
+          are loaded in the batch and propagated through other
+          sequence elements. Only final rays state is available from
+          the batch, trace result intercepted and generated rays
+          lists are only updated for sources. */
+      void trace_batch(RayBatch &batch);
+
     private:
 
+      struct worker_s;
+      typedef void (Tracer::*worker_func_t)(worker_s &w);
+
       template <IntensityMode m> void trace_template();
-      template <IntensityMode m> void trace_seq_template();
+      template <IntensityMode m> void trace_seq_template(unsigned int first);
+      template <IntensityMode m> void trace_batch_template(RayBatch &batch);
+
+      template <IntensityMode m>
+      void trace_rays(Result &result, const rays_queue_t &source_rays);
+
+      template <IntensityMode m> void trace_seq_worker(worker_s &w);
+      template <IntensityMode m> void trace_worker(worker_s &w);
+
+      typedef void (Tracer::*stream_func_t)(Result &result, const rays_queue_t &source_rays);
+
+      template <IntensityMode m>
+      void trace_chunk(Result &result, const rays_queue_t &source_rays);
+      template <IntensityMode m>
+      void trace_seq_chunk(Result &result, const rays_queue_t &source_rays);
+      void flush_stream();
+
+      unsigned int get_worker_count(size_t ray_count) const;
+      void prepare_workers(const Result &result) const;
+      void run_workers(Result &result, const rays_queue_t &source_rays,
+                       worker_func_t func, unsigned int first);
+      static void * worker_entry(void *w);
+
+      unsigned int get_seq_restart(const Sys::CompiledSystem &cs) const;
+
+      /** @internal Sequence element state saved for incremental ray trace */
+      struct seq_checkpoint_s
+      {
+        const Sys::Element      *_element;
+        unsigned int            _version;
+        rays_queue_t            _input;         // rays propagated to element
+        Result::rays_mark_s     _mark;          // ray pool state before element
+      };
 
       const_ref<Sys::System>    _system;
+      const Sys::CompiledSystem *_compiled;
+      const_ref<Sys::CompiledSystem> _own_compiled;
       Params                    _params;
       Result                    _result;
       Result                    *_result_ptr;
+      stream_func_t             _stream_func;
+      unsigned int              _stream_first;
+      std::vector<seq_checkpoint_s> _seq_checkpoints;
+      unsigned int              _seq_split;
+      bool                      _seq_workers;
+      bool                      _seq_valid;
+      unsigned int              _seq_result_serial;
+      unsigned int              _seq_structure_version;
     };
   }
 }
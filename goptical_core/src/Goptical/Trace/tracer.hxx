@@ -27,6 +27,7 @@
 #define GOPTICAL_TRACER_HXX_
 
 #include "Goptical/Trace/result.hh"
+#include "Goptical/Sys/compiled_system.hxx"
 
 namespace _Goptical {
 
@@ -35,6 +36,7 @@ namespace _Goptical {
     void Tracer::set_trace_result(Result &res)
     {
       _result_ptr = &res;
+      _seq_valid = false;
     }
 
     Trace::Result & Tracer::get_trace_result() const
@@ -44,6 +46,7 @@ namespace _Goptical {
 
     Trace::Result & Tracer::set_default_trace_result()
     {
+      _seq_valid = false;
       return *(_result_ptr = &_result);
     }
 
@@ -52,6 +55,12 @@ namespace _Goptical {
       return *_system;
     }
 
+    void Tracer::set_params(const Params &params)
+    {
+      _params = params;
+      _seq_valid = false;
+    }
+
     const Params & Tracer::get_params() const
     {
       return _params;
@@ -59,6 +68,8 @@ namespace _Goptical {
 
     Params & Tracer::get_params()
     {
+      // parameters may be modified, next ray trace can not be incremental
+      _seq_valid = false;
       return _params;
     }
 
@@ -168,6 +168,39 @@ namespace Goptical {
 
   }
 
+  namespace Curve {
+
+    /** Specifies behavior of curve models which do not provide
+        analytic derivatives when numerical differentiation is used.
+        @see Base::set_derivative_fallback */
+    enum DerivativeFallback
+      {
+        /** Numerical differentiation is used silently */
+        DerivativeNumerical,
+        /** Numerical differentiation is used and reported once per
+            curve object on the standard error output */
+        DerivativeReport,
+        /** An @ref Error exception is thrown */
+        DerivativeError
+      };
+
+    /** Default iterative curve/ray intersection statistics. @see
+        Base::get_intersect_stats */
+    struct IntersectStats
+    {
+      /** Number of intersections computed */
+      unsigned long calls;
+      /** Total number of iterations performed */
+      unsigned long iterations;
+      /** Number of rays which did not hit the curve */
+      unsigned long failures;
+      /** Number of intersections which did not converge within the
+          maximum iteration count */
+      unsigned long unconverged;
+    };
+
+  }
+
   namespace Trace {
 
     /** Specifies point distribution patterns over a shape delimited surface.
@@ -473,6 +506,7 @@ namespace _Goptical {
 
     class Container;
     class System;
+    class CompiledSystem;
     class Element;
     class Surface;
     class Image;
@@ -492,15 +526,18 @@ namespace _Goptical {
   namespace Trace {
     using namespace Goptical::Trace;
 
+    class Accumulator;
     class Distribution;
     class Tracer;
     class Params;
     class Ray;
+    class RayBatch;
+    class RayList;
     class Result;
     class Element;
     class Sequence;
 
-    typedef std::deque<Ray *> rays_queue_t;
+    typedef RayList rays_queue_t;
 
   }
 
@@ -606,6 +643,8 @@ namespace _Goptical {
   /** @module {Core}
       @short Surface curvature models */
   namespace Curve {
+    using namespace Goptical::Curve;
+
     class Base;
     class Rotational;
     class Sphere;
@@ -619,9 +658,21 @@ namespace _Goptical {
       @short Optical systems analysis tools */
   namespace Analysis {
     class PointImage;
+    class Psf;
+    class Mtf;
+    class Wavefront;
     class Spot;
+    class SpotBatch;
     class Focus;
     class RayFan;
+    class Tolerancing;
+    class Paraxial;
+  }
+
+  /** @module {Core}
+      @short Optical systems optimization */
+  namespace Optim {
+    class Optimizer;
   }
 
 }
@@ -23,6 +23,9 @@
 */
 
 
+#include <algorithm>
+#include <cmath>
+
 #include <Goptical/Math/VectorPair>
 #include <Goptical/Analysis/Focus>
 #include <Goptical/Trace/Tracer>
@@ -30,6 +33,7 @@
 #include <Goptical/Trace/Ray>
 #include <Goptical/Trace/Result>
 #include <Goptical/Trace/Distribution>
+#include <Goptical/Data/SampleSet>
 
 namespace _Goptical
 {
@@ -39,7 +43,8 @@ namespace _Goptical
 
     Focus::Focus(Sys::System &system)
       : PointImage(system),
-        _processed_focus(false)
+        _processed_focus(false),
+        _processed_through_focus(false)
     {
     }
 
@@ -114,6 +119,145 @@ namespace _Goptical
 
       _processed_focus = true;
     }
+
+    void Focus::process_through_focus()
+    {
+      if (_processed_through_focus)
+        return;
+
+      trace();
+
+      _x.clear();
+      _y.clear();
+      _sx.clear();
+      _sy.clear();
+      _intensity.clear();
+
+      GOPTICAL_FOREACH(i, *_intercepts)
+        {
+          const Trace::Ray &ray = **i;
+          const Math::Vector3 &p = ray.get_intercept_point();
+          Math::Vector3 d = ray.get_direction(*_image);
+
+          if (d.z() == 0.0)
+            continue;
+
+          double sx = d.x() / d.z();
+          double sy = d.y() / d.z();
+
+          _x.push_back(p.x() - sx * p.z());
+          _y.push_back(p.y() - sy * p.z());
+          _sx.push_back(sx);
+          _sy.push_back(sy);
+          _intensity.push_back(ray.get_intensity());
+        }
+
+      const unsigned int count = _x.size();
+
+      if (!count)
+        throw Error("no ray intercept found for through focus analysis");
+
+      // centroid moves linearly with defocus
+
+      _centroid = _slope = Math::vector2_0;
+
+      for (unsigned int j = 0; j < count; j++)
+        {
+          _centroid += Math::Vector2(_x[j], _y[j]);
+          _slope += Math::Vector2(_sx[j], _sy[j]);
+        }
+
+      _centroid /= count;
+      _slope /= count;
+
+      // mean square radius is a quadratic polynomial of defocus
+
+      _rms_poly[0] = _rms_poly[1] = _rms_poly[2] = 0.0;
+
+      for (unsigned int j = 0; j < count; j++)
+        {
+          _x[j] -= _centroid.x();
+          _y[j] -= _centroid.y();
+          _sx[j] -= _slope.x();
+          _sy[j] -= _slope.y();
+
+          _rms_poly[0] += _x[j] * _x[j] + _y[j] * _y[j];
+          _rms_poly[1] += 2.0 * (_x[j] * _sx[j] + _y[j] * _sy[j]);
+          _rms_poly[2] += _sx[j] * _sx[j] + _sy[j] * _sy[j];
+        }
+
+      for (unsigned int k = 0; k < 3; k++)
+        _rms_poly[k] /= count;
+
+      _processed_through_focus = true;
+    }
+
+    ref<Data::SampleSet> Focus::new_curve(double first, double last,
+                                          unsigned int count)
+    {
+      if (!count)
+        throw Error("through focus curve needs at least one image plane");
+
+      ref<Data::SampleSet> s = GOPTICAL_REFNEW(Data::SampleSet);
+
+      s->set_interpolation(Data::Linear);
+      s->set_metrics(first, count > 1 ? (last - first) / (count - 1) : 0.0);
+      s->resize(count);
+
+      return s;
+    }
+
+    ref<Data::SampleSet> Focus::get_rms_radius_curve(double first, double last,
+                                                     unsigned int count)
+    {
+      process_through_focus();
+
+      ref<Data::SampleSet> s = new_curve(first, last, count);
+
+      for (unsigned int i = 0; i < count; i++)
+        {
+          double z = s->get_x_value(i);
+
+          s->get_y_value(i) = sqrt(std::max(0.0, _rms_poly[0] +
+                                   z * (_rms_poly[1] + z * _rms_poly[2])));
+        }
+
+      return s;
+    }
+
+    ref<Data::SampleSet> Focus::get_encircled_intensity_curve(double radius,
+                                                              double first, double last,
+                                                              unsigned int count)
+    {
+      process_through_focus();
+
+      ref<Data::SampleSet> s = new_curve(first, last, count);
+
+      const unsigned int n = _x.size();
+      const double *x = &_x[0], *y = &_y[0];
+      const double *sx = &_sx[0], *sy = &_sy[0];
+      const double *intensity = &_intensity[0];
+      const double r2 = Math::square(radius);
+
+      for (unsigned int i = 0; i < count; i++)
+        {
+          double z = s->get_x_value(i);
+          double sum = 0.0;
+
+          // branch free loop over rays, positions relative to plane centroid
+          for (unsigned int j = 0; j < n; j++)
+            {
+              double dx = x[j] + sx[j] * z;
+              double dy = y[j] + sy[j] * z;
+
+              sum += dx * dx + dy * dy <= r2 ? intensity[j] : 0.0;
+            }
+
+          s->get_y_value(i) = sum;
+        }
+
+      return s;
+    }
+
   }
 }
-
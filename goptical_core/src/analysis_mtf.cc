@@ -0,0 +1,154 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+
+#include <cmath>
+
+#include <gsl/gsl_fft_complex.h>
+
+#include <Goptical/Analysis/Mtf>
+
+#include <Goptical/Io/Rgb>
+#include <Goptical/Io/RendererAxes>
+
+#include <Goptical/Data/Grid>
+#include <Goptical/Data/Plot>
+#include <Goptical/Data/PlotData>
+#include <Goptical/Data/SampleSet>
+
+namespace _Goptical
+{
+
+  namespace Analysis
+  {
+
+    Mtf::Mtf(Sys::System &system)
+      : _psf(system),
+        _psf_serial(0),
+        _mtf()
+    {
+    }
+
+    void Mtf::process_analysis()
+    {
+      const Data::Grid &psf = _psf.get_grid();
+
+      if (_mtf.valid() && _psf_serial == _psf._serial)
+        return;
+
+      const unsigned int size = _psf._fft_size;
+      std::vector<double> data(size * size * 2, 0.0);
+
+      for (unsigned int y = 0; y < size; y++)
+        for (unsigned int x = 0; x < size; x++)
+          // shift zero frequency at transform center
+          data[(y * size + x) * 2] = (x + y) & 1 ? -psf.get_y_value(x, y)
+                                                 : psf.get_y_value(x, y);
+
+      for (unsigned int y = 0; y < size; y++)
+        gsl_fft_complex_radix2_forward(&data[y * size * 2], 1, size);
+
+      for (unsigned int x = 0; x < size; x++)
+        gsl_fft_complex_radix2_forward(&data[x * 2], size, size);
+
+      const unsigned int center = (size / 2) * (size + 1);
+      const double norm = 1.0 / hypot(data[center * 2], data[center * 2 + 1]);
+      const Math::Vector2 &spacing = _psf._spacing;
+      Math::Vector2 step(1.0 / (size * spacing.x()), 1.0 / (size * spacing.y()));
+
+      if (!_mtf.valid())
+        _mtf = GOPTICAL_REFNEW(Data::Grid, size, size);
+      else
+        _mtf->resize(size, size);
+
+      _mtf->set_metrics(step * -(double)(size / 2), step);
+
+      for (unsigned int i = 0; i < size * size; i++)
+        _mtf->get_y_value(i % size, i / size) = hypot(data[i * 2], data[i * 2 + 1]) * norm;
+
+      _psf_serial = _psf._serial;
+    }
+
+    double Mtf::get_cutoff_frequency()
+    {
+      process_analysis();
+
+      return 2.0 * _psf._aperture / (_psf._used_wavelen * 1e-6);
+    }
+
+    double Mtf::get_mtf(double frequency, enum mtf_plane_e plane)
+    {
+      process_analysis();
+
+      const Math::Vector2 &step = _mtf->get_step();
+      Math::Vector2 v(0.0, 0.0);
+
+      // out of transform range
+      if (fabs(frequency) > step[plane] * (_psf._fft_size / 2 - 1))
+        return 0.0;
+
+      v[plane] = frequency;
+
+      return _mtf->interpolate(v);
+    }
+
+    ref<Data::Plot> Mtf::get_plot(unsigned int points)
+    {
+      const double cutoff = get_cutoff_frequency();
+      ref<Data::Plot> plot = GOPTICAL_REFNEW(Data::Plot);
+
+      for (unsigned int i = 0; i < 2; i++)
+        {
+          enum mtf_plane_e plane = (enum mtf_plane_e)i;
+          ref<Data::SampleSet> s = GOPTICAL_REFNEW(Data::SampleSet);
+
+          s->set_interpolation(Data::Linear);
+          s->set_metrics(0.0, cutoff / (double)points);
+          s->resize(points + 1);
+
+          for (unsigned int j = 0; j <= points; j++)
+            s->get_y_value(j) = get_mtf(cutoff * j / (double)points, plane);
+
+          Data::PlotData p(*s);
+
+          p.set_label(plane == SagittalMtf ? "Sagittal" : "Tangential");
+          p.set_color(plane == SagittalMtf ? Io::rgb_blue : Io::rgb_red);
+          p.set_style(Data::LinePlot);
+
+          plot->add_plot_data(p);
+        }
+
+      plot->set_title("Modulation transfer function");
+      plot->get_axes().set_label("Spatial frequency", Io::RendererAxes::X);
+      plot->get_axes().set_label("Modulation", Io::RendererAxes::Y);
+      plot->get_axes().set_unit("", false, false, 0, Io::RendererAxes::X);
+      plot->get_axes().set_unit("", false, false, 0, Io::RendererAxes::Y);
+
+      return plot;
+    }
+
+  }
+
+}
+
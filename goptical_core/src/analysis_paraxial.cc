@@ -0,0 +1,427 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+
+#include <cmath>
+#include <limits>
+
+#include <Goptical/Analysis/Paraxial>
+
+#include <Goptical/Sys/System>
+#include <Goptical/Sys/SourcePoint>
+#include <Goptical/Sys/OpticalSurface>
+#include <Goptical/Sys/Image>
+#include <Goptical/Sys/Stop>
+
+#include <Goptical/Curve/Base>
+#include <Goptical/Curve/ConicBase>
+#include <Goptical/Curve/Asphere>
+#include <Goptical/Shape/Base>
+#include <Goptical/Material/Base>
+
+#include <Goptical/Trace/Params>
+#include <Goptical/Trace/Sequence>
+
+#include <Goptical/Math/Vector>
+
+namespace _Goptical
+{
+
+  namespace Analysis
+  {
+
+    Paraxial::Paraxial(const Sys::System &system)
+      : _system(system),
+        _image(0),
+        _stop(0),
+        _wavelen(0),
+        _processed(false),
+        _path()
+    {
+    }
+
+    /** get vertex curvature of surface */
+    static double paraxial_curvature(const Sys::Surface &s)
+    {
+      const Curve::Base &c = s.get_curve();
+
+      double k = 0.;
+
+      // r^2 deformation term adds to base curvature
+      if (const Curve::Asphere *a = dynamic_cast<const Curve::Asphere*>(&c))
+        k = 2. * a->get_coefficient(2);
+
+      if (const Curve::CurveRoc *r = dynamic_cast<const Curve::CurveRoc*>(&c))
+        return k + (r->get_roc() == 0. ? 0. : 1. / r->get_roc());
+
+      // curvature of other curves from derivative near vertex
+      double h = s.get_shape().max_radius() * 1e-3;
+
+      if (h <= 0.)
+        h = 1e-3;
+
+      Math::Vector2 d;
+      c.derivative(Math::Vector2(0, h), d);
+
+      return d.y() / h;
+    }
+
+    void Paraxial::trace(double y, double nu, double *ys, double *nus) const
+    {
+      for (unsigned int i = 0; i < _path.size(); i++)
+        {
+          const entry_s &e = _path[i];
+
+          // refraction
+          nu -= y * e._power;
+
+          ys[i] = y;
+          nus[i] = nu;
+
+          // transfer to next element
+          y += e._thickness * nu / e._index;
+        }
+    }
+
+    void Paraxial::process()
+    {
+      if (_processed)
+        return;
+
+      const double inf = std::numeric_limits<double>::infinity();
+      const Trace::Params &params = _system.get_tracer_params();
+
+      ref<Trace::Sequence> own;
+      const Trace::Sequence *seq;
+
+      if (params.is_sequential())
+        seq = &params.get_sequence();
+      else
+        {
+          own = GOPTICAL_REFNEW(Trace::Sequence, _system);
+          seq = own.ptr();
+        }
+
+      // find source and image in sequence
+
+      const Sys::SourcePoint *source = 0;
+      unsigned int first = 0, last = 0;
+      bool image = false;
+
+      for (unsigned int i = 0; i < seq->get_element_count(); i++)
+        {
+          const Sys::Element *e = &seq->get_element(i);
+
+          if (!source)
+            {
+              source = dynamic_cast<const Sys::SourcePoint*>(e);
+              first = i + 1;
+            }
+          else if (_image ? e == _image : dynamic_cast<const Sys::Image*>(e) != 0)
+            {
+              last = i;
+              image = true;
+              break;
+            }
+        }
+
+      if (!source)
+        throw Error("no point source found in sequence");
+
+      if (!image)
+        throw Error("no image found in sequence after source");
+
+      double wavelen = _wavelen;
+
+      if (wavelen == 0.)
+        {
+          if (source->get_spectrum().empty())
+            throw Error("source has no spectral line");
+
+          wavelen = source->get_spectrum().front().get_wavelen();
+        }
+
+      // indexes relative to system environment
+      const Material::Base &env = _system.get_environment();
+      bool infinity = source->get_mode() == Sys::SourceAtInfinity;
+      Math::Vector3 pos = source->get_position();
+      Math::Vector3 dir = source->get_direction();
+
+      _index = source->get_material().get_refractive_index(wavelen, env);
+      _distance = inf;
+      _path.resize(last - first + 1);
+
+      double n = _index;
+
+      for (unsigned int i = first; i <= last; i++)
+        {
+          entry_s &e = _path[i - first];
+          const Sys::Element &element = seq->get_element(i);
+
+          e._element = &element;
+          e._power = 0.;
+          e._thickness = 0.;
+
+          Math::Vector3 p = element.get_position();
+          Math::Vector3 d = p - pos;
+          double t = d.len();
+
+          if (i == first)
+            {
+              if (!infinity)
+                {
+                  if (t == 0.)
+                    throw Error("source located on first element");
+
+                  _distance = t;
+                  dir = d / t;
+                }
+            }
+          else
+            {
+              _path[i - first - 1]._thickness = t;
+
+              // keep direction of previous segment for coincident elements
+              if (t > 0.)
+                dir = d / t;
+            }
+
+          pos = p;
+
+          if (const Sys::OpticalSurface *s = dynamic_cast<const Sys::OpticalSurface*>(&element))
+            {
+              // curvature as seen from incoming light
+              bool forward = dir * element.get_direction() > 0;
+              double c = paraxial_curvature(*s);
+
+              if (!forward)
+                c = -c;
+
+              const Material::Base &to = s->get_material(forward ? 1 : 0);
+
+              if (to.is_reflecting())
+                {
+                  // unfolded path, propagation direction is reversed
+                  e._power = -2. * n * c;
+                  dir = -dir;
+                }
+              else
+                {
+                  double n2 = to.get_refractive_index(wavelen, env);
+
+                  e._power = (n2 - n) * c;
+                  n = n2;
+                }
+            }
+
+          e._index = n;
+        }
+
+      // find last optical surface
+
+      _last = _path.size();
+
+      for (unsigned int i = 0; i < _path.size(); i++)
+        if (dynamic_cast<const Sys::OpticalSurface*>(_path[i]._element))
+          _last = i;
+
+      if (_last == _path.size())
+        throw Error("no optical surface found between source and image");
+
+      // linear rays and system matrix at last optical surface
+
+      unsigned int count = _path.size();
+      std::vector<double> yp(count), nup(count), yr(count), nur(count);
+
+      trace(1., 0., &yp[0], &nup[0]);
+      trace(0., 1., &yr[0], &nur[0]);
+
+      double a = yp[_last], c = nup[_last];
+      double b = yr[_last], d = nur[_last];
+      double nl = _path[_last]._index;
+
+      _efl = c == 0. ? inf : -1. / c;
+      _bfd = c == 0. ? inf : -a * nl / c;
+      _ffd = c == 0. ? inf : d * _index / c;
+
+      if (infinity)
+        {
+          _image_distance = _bfd;
+          _magnification = 0.;
+        }
+      else
+        {
+          double k = c * _distance + d * _index;
+
+          _image_distance = k == 0. ? inf : -nl * (a * _distance + b * _index) / k;
+          _magnification = k == 0. ? inf : _index / k;
+        }
+
+      // find aperture stop
+
+      _stop_index = count;
+
+      if (_stop)
+        {
+          for (unsigned int i = 0; i < count; i++)
+            if (_path[i]._element == _stop)
+              _stop_index = i;
+
+          if (_stop_index == count)
+            throw Error("stop element not found in paraxial path");
+        }
+      else
+        {
+          for (unsigned int i = 0; i < count; i++)
+            if (dynamic_cast<const Sys::Stop*>(_path[i]._element))
+              {
+                _stop_index = i;
+                break;
+              }
+        }
+
+      if (_stop_index == count)
+        {
+          // use surface which limits axial beam
+          double max = 0.;
+
+          for (unsigned int i = 0; i < count; i++)
+            {
+              const Sys::Surface *s = dynamic_cast<const Sys::Surface*>(_path[i]._element);
+
+              if (!s || i == count - 1)
+                continue;
+
+              double r = s->get_shape().max_radius();
+              double y = infinity ? yp[i] : _distance * yp[i] + _index * yr[i];
+
+              if (r > 0. && fabs(y) / r > max)
+                {
+                  max = fabs(y) / r;
+                  _stop_index = i;
+                }
+            }
+
+          if (_stop_index == count)
+            throw Error("unable to find aperture stop");
+        }
+
+      const Sys::Surface *stop = dynamic_cast<const Sys::Surface*>(_path[_stop_index]._element);
+
+      if (!stop)
+        throw Error("aperture stop element has no shape");
+
+      // entrance pupil, image of stop center in object space
+
+      double rs = stop->get_shape().max_radius();
+      double as = yp[_stop_index], bs = yr[_stop_index];
+
+      double z = as == 0. ? inf : bs * _index / as;
+      double ym, num, yc, nuc;
+
+      _enp_position = z;
+
+      if (infinity)
+        {
+          if (as == 0.)
+            throw Error("entrance pupil located at infinity");
+
+          ym = rs / as;
+          num = 0.;
+          _enp_radius = fabs(ym);
+
+          // unit object space slope
+          yc = -z;
+          nuc = _index;
+        }
+      else
+        {
+          double u = rs / (as * _distance + bs * _index);
+
+          ym = _distance * u;
+          num = _index * u;
+          _enp_radius = as == 0. ? inf : fabs(u * (_distance + z));
+
+          if (as == 0.)
+            {
+              // telecentric in object space
+              yc = 1.;
+              nuc = 0.;
+            }
+          else
+            {
+              // unit object height
+              u = -1. / (_distance + z);
+              yc = -z * u;
+              nuc = _index * u;
+            }
+        }
+
+      _marginal.resize(count);
+      _chief.resize(count);
+
+      std::vector<double> nu(count);
+
+      trace(ym, num, &_marginal[0], &nu[0]);
+      _slope = nu[_last];
+
+      double ym_last = _marginal[_last];
+
+      trace(yc, nuc, &_chief[0], &nu[0]);
+
+      // exit pupil, image of stop center in image space
+
+      double zx = nu[_last] == 0. ? inf : -_chief[_last] * nl / nu[_last];
+
+      _exp_position = zx;
+      _exp_radius = std::isfinite(zx) ? fabs(ym_last + zx * _slope / nl) : inf;
+
+      _processed = true;
+    }
+
+    unsigned int Paraxial::find(const Sys::Element &element) const
+    {
+      for (unsigned int i = 0; i < _path.size(); i++)
+        if (_path[i]._element == &element)
+          return i;
+
+      throw Error("element not found in paraxial path");
+    }
+
+    double Paraxial::get_marginal_ray_height(const Sys::Element &element)
+    {
+      process();
+      return _marginal[find(element)];
+    }
+
+    double Paraxial::get_chief_ray_height(const Sys::Element &element)
+    {
+      process();
+      return _chief[find(element)];
+    }
+
+  }
+
+}
+
@@ -0,0 +1,320 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+
+#include <cmath>
+#include <complex>
+
+#include <gsl/gsl_fft_complex.h>
+
+#include <Goptical/Analysis/Psf>
+
+#include <Goptical/Sys/Surface>
+#include <Goptical/Sys/Image>
+#include <Goptical/Sys/System>
+
+#include <Goptical/Material/Base>
+
+#include <Goptical/Trace/Tracer>
+#include <Goptical/Trace/Distribution>
+#include <Goptical/Trace/Params>
+#include <Goptical/Trace/Result>
+#include <Goptical/Trace/Ray>
+
+#include <Goptical/Data/Grid>
+
+namespace _Goptical
+{
+
+  namespace Analysis
+  {
+
+    Psf::Psf(Sys::System &system)
+      : PointImage(system),
+        _entrance(0),
+        _processed_analysis(false),
+        _radial_samples(32),
+        _padding(2.0),
+        _wavelen(0.0),
+        _defocus(0.0),
+        _pupil(),
+        _pupil_width(0),
+        _fft_size(0),
+        _serial(0),
+        _psf(),
+        _used_wavelen(0.0),
+        _reference(Math::vector3_0),
+        _spacing(Math::vector2_0),
+        _strehl(0.0),
+        _aperture(0.0)
+    {
+    }
+
+    void Psf::process_trace()
+    {
+      if (_processed_trace)
+        return;
+
+      if (!_entrance)
+        _entrance = &_system.get_entrance_pupil();
+
+      _tracer.get_params().set_distribution(*_entrance,
+        Trace::Distribution(Trace::SquareDist, _radial_samples));
+
+      trace();
+
+      // find pupil grid step from entrance pupil ray positions
+
+      std::vector<std::pair<const Trace::Ray *, Math::Vector2> > entries;
+      double step = 0.0;
+
+      GOPTICAL_FOREACH(i, *_intercepts)
+        {
+          const Trace::Ray *ray = *i;
+
+          // walk up to entrance pupil generated ray
+          while (ray && ray->get_creator() != _entrance)
+            ray = ray->get_parent();
+
+          if (!ray)
+            continue;
+
+          Math::Vector2 pupil(ray->origin().x(), ray->origin().y());
+          entries.push_back(std::make_pair(*i, pupil));
+
+          for (unsigned int j = 0; j < 2; j++)
+            {
+              double a = fabs(pupil[j]);
+
+              if (a > 1e-9 * _entrance->get_shape().max_radius() && (step == 0.0 || a < step))
+                step = a;
+            }
+        }
+
+      if (step == 0.0)
+        throw Error("not enough pupil samples for point spread function analysis");
+
+      // store pupil samples for each traced wavelength
+
+      int radius = 0;
+
+      GOPTICAL_FOREACH(e, entries)
+        for (unsigned int j = 0; j < 2; j++)
+          radius = std::max(radius, abs((int)lround(e->second[j] / step)));
+
+      const int width = radius * 2 + 1;
+
+      _pupil.clear();
+
+      GOPTICAL_FOREACH(e, entries)
+        {
+          const Trace::Ray &r = *e->first;
+          const double wl = r.get_wavelen();
+          sample_s s;
+
+          s._cell = (lround(e->second.y() / step) + radius) * width
+                  + (lround(e->second.x() / step) + radius);
+          s._amplitude = sqrt(r.get_intensity());
+
+          s._opl = 0.0;
+          for (const Trace::Ray *ray = &r; ray; ray = ray->get_parent())
+            s._opl += ray->get_len() * ray->get_material()->get_refractive_index(wl);
+
+          s._index = r.get_material()->get_refractive_index(wl);
+          s._point = r.get_intercept_point();
+          s._direction = r.get_direction(*_image);
+
+          _pupil[wl].push_back(s);
+        }
+
+      _pupil_width = width;
+      _processed_analysis = false;
+    }
+
+    void Psf::process_analysis()
+    {
+      process_trace();
+
+      if (_processed_analysis)
+        return;
+
+      if (_pupil.empty())
+        throw Error("no ray intercept found for point spread function analysis");
+
+      pupil_t::const_iterator p = _wavelen == 0.0
+        ? _pupil.begin() : _pupil.find(_wavelen);
+
+      if (p == _pupil.end())
+        throw Error("no traced pupil data for requested wavelength");
+
+      const samples_t &samples = p->second;
+      const double wl = p->first * 1e-6;  // wavelen in system unit
+      const unsigned int width = _pupil_width;
+      const unsigned int count = samples.size();
+
+      // project rays on defocused image plane and find reference point
+
+      std::vector<Math::Vector3> points(count);
+      std::vector<double> opl(count);
+      std::vector<int> cells(width * width, -1);
+      Math::Vector3 reference(Math::vector3_0);
+      Math::Vector3 mean_dir(Math::vector3_0);
+      double weight = 0.0;
+
+      for (unsigned int i = 0; i < count; i++)
+        {
+          const sample_s &s = samples[i];
+          double t = _defocus / s._direction.z();
+          double w = Math::square(s._amplitude);
+
+          points[i] = s._point + s._direction * t;
+          opl[i] = s._opl + s._index * t;
+          cells[s._cell] = i;
+
+          reference += points[i] * w;
+          mean_dir += s._direction * (s._index * w);
+          weight += w;
+        }
+
+      if (weight == 0.0)
+        throw Error("no light intensity available for point spread function analysis");
+
+      reference /= weight;
+      mean_dir /= weight;
+
+      // estimate image space direction cosine step between pupil cells
+
+      Math::Vector2 du(0.0, 0.0);
+      unsigned int du_count[2] = { 0, 0 };
+      double aperture = 0.0;
+
+      for (unsigned int i = 0; i < count; i++)
+        {
+          const sample_s &s = samples[i];
+          unsigned int x = s._cell % width, y = s._cell / width;
+          Math::Vector3 u(s._direction * s._index);
+
+          aperture = std::max(aperture, hypot(u.x() - mean_dir.x(), u.y() - mean_dir.y()));
+
+          if (x + 1 < width && cells[s._cell + 1] >= 0)
+            {
+              const sample_s &n = samples[cells[s._cell + 1]];
+              du.x() += n._direction.x() * n._index - u.x();
+              du_count[0]++;
+            }
+
+          if (y + 1 < width && cells[s._cell + width] >= 0)
+            {
+              const sample_s &n = samples[cells[s._cell + width]];
+              du.y() += n._direction.y() * n._index - u.y();
+              du_count[1]++;
+            }
+        }
+
+      if (!du_count[0] || !du_count[1])
+        throw Error("not enough pupil samples for point spread function analysis");
+
+      du.x() /= du_count[0];
+      du.y() /= du_count[1];
+
+      // choose Fourier transform size
+
+      unsigned int size = 1;
+      while (size < width * std::max(_padding, 1.0))
+        size *= 2;
+
+      // fill pupil function, wavefront error is measured from reference sphere
+
+      std::vector<double> data(size * size * 2, 0.0);
+      const unsigned int offset = (size - width) / 2;
+      std::complex<double> sum(0.0, 0.0);
+      double amplitude = 0.0;
+
+      for (unsigned int i = 0; i < count; i++)
+        {
+          const sample_s &s = samples[i];
+          unsigned int x = s._cell % width + offset;
+          unsigned int y = s._cell / width + offset;
+
+          double opd = opl[i] - (s._direction * s._index) * (points[i] - reference);
+          std::complex<double> c = std::polar(s._amplitude, 2.0 * M_PI * opd / wl);
+
+          sum += c;
+          amplitude += s._amplitude;
+
+          // shift zero frequency at transform center
+          if ((x + y) & 1)
+            c = -c;
+
+          data[(y * size + x) * 2] += c.real();
+          data[(y * size + x) * 2 + 1] += c.imag();
+        }
+
+      // 2d transform
+
+      for (unsigned int y = 0; y < size; y++)
+        gsl_fft_complex_radix2_backward(&data[y * size * 2], 1, size);
+
+      for (unsigned int x = 0; x < size; x++)
+        gsl_fft_complex_radix2_backward(&data[x * 2], size, size);
+
+      // store normalized intensity
+
+      Math::Vector2 spacing(wl / (size * du.x()), wl / (size * du.y()));
+      const double norm = 1.0 / Math::square(amplitude);
+
+      if (!_psf.valid())
+        _psf = GOPTICAL_REFNEW(Data::Grid, size, size);
+      else
+        _psf->resize(size, size);
+
+      _psf->set_metrics(Math::Vector2(fabs(spacing.x()), fabs(spacing.y())) * -(double)(size / 2),
+                        Math::Vector2(fabs(spacing.x()), fabs(spacing.y())));
+
+      for (unsigned int y = 0; y < size; y++)
+        for (unsigned int x = 0; x < size; x++)
+          {
+            // image may be flipped with respect to pupil
+            unsigned int gx = spacing.x() < 0 ? (size - x) % size : x;
+            unsigned int gy = spacing.y() < 0 ? (size - y) % size : y;
+
+            _psf->get_y_value(gx, gy) = (Math::square(data[(y * size + x) * 2]) +
+                                         Math::square(data[(y * size + x) * 2 + 1])) * norm;
+          }
+
+      _fft_size = size;
+      _used_wavelen = p->first;
+      _reference = reference;
+      _spacing = Math::Vector2(fabs(spacing.x()), fabs(spacing.y()));
+      _strehl = std::norm(sum) * norm;
+      _aperture = aperture;
+      _serial++;
+
+      _processed_analysis = true;
+    }
+
+  }
+
+}
+
@@ -23,6 +23,8 @@
 */
 
 
+#include <algorithm>
+
 #include <Goptical/Analysis/Spot>
 #include <Goptical/Sys/Image>
 
@@ -48,7 +50,8 @@ namespace _Goptical
 
     Spot::Spot(Sys::System &system)
       : PointImage(system),
-        _processed_analysis(false)
+        _processed_analysis(false),
+        _processed_radial(false)
     {
       _axes.set_show_axes(false, Io::RendererAxes::XY);
       _axes.set_label("Saggital distance", Io::RendererAxes::X);
@@ -95,19 +98,65 @@ namespace _Goptical
       _processed_analysis = true;
     }
 
-    double Spot::get_encircled_intensity(double radius)
+    void Spot::process_radial()
     {
+      if (_processed_radial)
+        return;
+
       process_trace();
 
-      double    intensity = 0;
+      _radial.resize(_intercepts->size());
+
+      unsigned int j = 0;
 
       GOPTICAL_FOREACH(i, *_intercepts)
         {
-          if (((*i)->get_intercept_point() - _centroid).len() <= radius)
-            intensity += (*i)->get_intensity();
+          radial_s &r = _radial[j++];
+
+          r._dist = ((*i)->get_intercept_point() - _centroid).len();
+          r._intensity = (*i)->get_intensity();
+          r._wavelen = (*i)->get_wavelen();
         }
 
-      return intensity;
+      std::sort(_radial.begin(), _radial.end());
+
+      _cumul.resize(_radial.size());
+
+      double intensity = 0;
+
+      for (j = 0; j < _radial.size(); j++)
+        _cumul[j] = intensity += _radial[j]._intensity;
+
+      _processed_radial = true;
+    }
+
+    double Spot::get_encircled_intensity(double radius)
+    {
+      process_radial();
+
+      radial_s r;
+      r._dist = radius;
+
+      // number of intercepts with distance <= radius
+      unsigned int n = std::upper_bound(_radial.begin(), _radial.end(), r) - _radial.begin();
+
+      return n ? _cumul[n - 1] : 0.0;
+    }
+
+    double Spot::get_encircled_radius(double ratio)
+    {
+      process_radial();
+
+      if (_radial.empty())
+        throw Error("no ray intercept found for encircled radius");
+
+      double intensity = ratio * _cumul.back();
+      unsigned int n = std::lower_bound(_cumul.begin(), _cumul.end(), intensity) - _cumul.begin();
+
+      if (n >= _radial.size())
+        n = _radial.size() - 1;
+
+      return _radial[n]._dist;
     }
 
     ref<Data::Plot> Spot::get_encircled_intensity_plot(int zones)
@@ -116,6 +165,7 @@ namespace _Goptical
       const Trace::rays_queue_t &intercepts = result.get_intercepted(*_image);
 
       process_analysis();
+      process_radial();
 
       if (intercepts.empty())
         throw Error("no ray intercept found for encircled intensity plot");
@@ -138,18 +188,19 @@ namespace _Goptical
 
       // compute encircled intensity for each radius range
 
-      GOPTICAL_FOREACH(i, *_intercepts)
+      GOPTICAL_FOREACH(i, _radial)
         {
-          double dist = ((*i)->get_intercept_point() - _centroid).len();
+          double dist = i->_dist;
 
+          // sorted by distance
           if (dist > _useful_radius)
-            continue;
+            break;
 
           int n = (unsigned int)((zones - 1) * (dist / _useful_radius));
 
           assert(n >= 0 && n < zones);
 
-          data_sets[(*i)->get_wavelen()]->get_y_value(n + 1) += (*i)->get_intensity();
+          data_sets[i->_wavelen]->get_y_value(n + 1) += i->_intensity;
         }
 
       // integrate
@@ -0,0 +1,324 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+
+#include <cmath>
+
+#include <Goptical/Analysis/SpotBatch>
+
+#include <Goptical/Sys/Container>
+#include <Goptical/Sys/Image>
+#include <Goptical/Sys/Source>
+#include <Goptical/Sys/SourcePoint>
+
+#include <Goptical/Trace/Tracer>
+#include <Goptical/Trace/Ray>
+#include <Goptical/Trace/RayList>
+#include <Goptical/Trace/Result>
+#include <Goptical/Trace/Params>
+#include <Goptical/Trace/Sequence>
+#include <Goptical/Trace/Distribution>
+
+#include <Goptical/Data/PlotData>
+#include <Goptical/Data/Plot>
+#include <Goptical/Data/SampleSet>
+
+#include <Goptical/Light/SpectralLine>
+
+#include "sys_replica_.hxx"
+
+namespace _Goptical
+{
+
+  namespace Analysis
+  {
+
+    SpotBatch::SpotBatch(Sys::System &system)
+      : _system(system), _tracer(system),
+        _processed(false),
+        _image(0)
+    {
+      _tracer.get_params().get_default_distribution().set_uniform_pattern();
+    }
+
+    SpotBatch::~SpotBatch()
+    {
+    }
+
+    unsigned int SpotBatch::add_field(double x_angle, double y_angle)
+    {
+      return add_field(Math::Vector3(tan(x_angle / 180.0 * M_PI),
+                                     tan(y_angle / 180.0 * M_PI), 1.0));
+    }
+
+    unsigned int SpotBatch::add_field(const Math::Vector3 &direction)
+    {
+      field_s f;
+
+      f._direction = direction.normalized();
+      _fields.push_back(f);
+      invalidate();
+
+      return _fields.size() - 1;
+    }
+
+    void SpotBatch::accumulate(const Sys::Surface &s, const Trace::RayList &rays)
+    {
+      GOPTICAL_FOREACH(i, rays)
+        {
+          const Trace::Ray *r = *i;
+
+          // find source which generated the first ray
+          const Trace::Ray *root = r;
+          while (root->get_parent())
+            root = root->get_parent();
+
+          std::map<const Sys::Element *, unsigned int>::const_iterator j
+            = _source_field.find(root->get_creator());
+
+          if (j == _source_field.end())
+            continue;
+
+          sample_s sp;
+
+          sp._point = r->get_intercept_point();
+          sp._intensity = r->get_intensity();
+          sp._wavelen = r->get_wavelen();
+
+          _fields[j->second]._samples.push_back(sp);
+        }
+    }
+
+    void SpotBatch::trace()
+    {
+      if (!_image)
+        _image = _system.find<Sys::Image>();
+
+      if (!_image)
+        throw Error("no image found for analysis");
+
+      if (_fields.empty())
+        throw Error("no field defined for spot batch analysis");
+
+      const Sys::System &system = _system;
+      const Trace::Params &params = _tracer.get_params();
+      std::vector<const Sys::Element *> elements;
+
+      // other sources are dropped
+      if (params.is_sequential())
+        {
+          const Trace::Sequence &seq = params.get_sequence();
+
+          for (unsigned int i = 0; i < seq.get_element_count(); i++)
+            {
+              const Sys::Element &e = seq.get_element(i);
+
+              if (!dynamic_cast<const Sys::Source *>(&e))
+                elements.push_back(&e);
+            }
+        }
+      else
+        {
+          std::vector<const Sys::Element *> all;
+          delegate_push<typeof(all), const Sys::Element &> d(all);
+          system.get_elements<Sys::Element>(d);
+
+          // group members are replicated with their global transform
+          GOPTICAL_FOREACH(e, all)
+            if ((*e)->is_enabled() && !dynamic_cast<const Sys::Source *>(*e) &&
+                !dynamic_cast<const Sys::Container *>(*e))
+              elements.push_back(*e);
+        }
+
+      // field sources are traced along with a private copy of the
+      // system elements so that the user system is left untouched
+      Sys::replica_s r(system, elements, params);
+      const Sys::Image *image = dynamic_cast<const Sys::Image *>(r.find(*_image));
+
+      if (!image)
+        throw Error("analysis image is not traced");
+
+      const Sys::Element *pupil = r.find(system.get_entrance_pupil());
+
+      if (const Sys::Surface *p = dynamic_cast<const Sys::Surface *>(pupil))
+        r._system.set_entrance_pupil(*p);
+
+      _source_field.clear();
+
+      // one point source per field, first in sequence
+      for (unsigned int i = 0; i < _fields.size(); i++)
+        {
+          field_s &f = _fields[i];
+          ref<Sys::SourcePoint> s = GOPTICAL_REFNEW(Sys::SourcePoint, Sys::SourceAtInfinity,
+                                                    f._direction);
+
+          if (!_spectrum.empty())
+            {
+              s->clear_spectrum();
+              GOPTICAL_FOREACH(l, _spectrum)
+                s->add_spectral_line(*l);
+            }
+
+          f._samples.clear();
+          r._system.add(s);
+          r._sequence->insert(i, *s);
+          _source_field[s.ptr()] = i;
+        }
+
+      r._system.get_tracer_params().set_thread_count(params.get_thread_count());
+
+      Trace::Tracer tracer(r._system);
+      Trace::Result &result = tracer.get_trace_result();
+
+      result.set_intercepted_accumulator(*image, this);
+      tracer.trace();
+      _source_field.clear();
+    }
+
+    void SpotBatch::process()
+    {
+      if (_processed)
+        return;
+
+      trace();
+
+      GOPTICAL_FOREACH(f, _fields)
+        {
+          Math::Vector3 center(0, 0, 0);
+          double mean = 0;        // rms radius
+          double max = 0;         // max radius
+          double intensity = 0;   // total intensity
+
+          GOPTICAL_FOREACH(i, f->_samples)
+            center += i->_point;
+
+          if (!f->_samples.empty())
+            center /= f->_samples.size();
+
+          GOPTICAL_FOREACH(i, f->_samples)
+            {
+              double dist = (i->_point - center).len();
+
+              if (max < dist)
+                max = dist;
+
+              mean += Math::square(dist);
+              intensity += i->_intensity;
+            }
+
+          f->_centroid = center;
+          f->_max_radius = max;
+          f->_rms_radius = f->_samples.empty() ? 0 : sqrt(mean / f->_samples.size());
+          f->_tot_intensity = intensity;
+        }
+
+      _processed = true;
+    }
+
+    double SpotBatch::get_encircled_intensity(unsigned int field, double radius)
+    {
+      const field_s &f = get_field(field);
+      double intensity = 0;
+
+      GOPTICAL_FOREACH(i, f._samples)
+        {
+          if ((i->_point - f._centroid).len() <= radius)
+            intensity += i->_intensity;
+        }
+
+      return intensity;
+    }
+
+    ref<Data::Plot> SpotBatch::get_encircled_intensity_plot(unsigned int field, int zones)
+    {
+      const field_s &f = get_field(field);
+
+      if (f._samples.empty())
+        throw Error("no ray intercept found for encircled intensity plot");
+
+      typedef std::map<double, ref<Data::SampleSet> > data_sets_t;
+      data_sets_t data_sets;
+      double radius = f._max_radius;
+
+      // create plot data for each wavelen
+
+      GOPTICAL_FOREACH(i, f._samples)
+        {
+          if (data_sets.find(i->_wavelen) != data_sets.end())
+            continue;
+
+          ref<Data::SampleSet> s = GOPTICAL_REFNEW(Data::SampleSet);
+
+          s->set_interpolation(Data::Linear);
+          s->set_metrics(0.0, radius / (double)zones);
+          s->resize(zones + 1);
+
+          data_sets.insert(data_sets_t::value_type(i->_wavelen, s));
+        }
+
+      // compute encircled intensity for each radius range
+
+      GOPTICAL_FOREACH(i, f._samples)
+        {
+          double dist = (i->_point - f._centroid).len();
+
+          if (dist > radius)
+            continue;
+
+          int n = radius > 0 ? (unsigned int)((zones - 1) * (dist / radius)) : 0;
+
+          assert(n >= 0 && n < zones);
+
+          data_sets[i->_wavelen]->get_y_value(n + 1) += i->_intensity;
+        }
+
+      // integrate
+
+      ref<Data::Plot> plot = GOPTICAL_REFNEW(Data::Plot);
+
+      GOPTICAL_FOREACH(d, data_sets)
+        {
+          for (int i = 1; i < zones; i++)
+            d->second->get_y_value(i + 1) += d->second->get_y_value(i);
+
+          Data::PlotData p(*d->second);
+
+          p.set_color(Light::SpectralLine::get_wavelen_color(d->first));
+          p.set_style(Data::LinePlot);
+
+          plot->add_plot_data(p);
+        }
+
+      plot->set_title("Spot diagram encircled rays intensity");
+      plot->get_axes().set_label("Distance from spot centroid", Io::RendererAxes::X);
+      plot->get_axes().set_label("Encircled intensity", Io::RendererAxes::Y);
+      plot->get_axes().set_unit("m", true, true, -3, Io::RendererAxes::X);
+      plot->get_axes().set_unit("", false, false, 0, Io::RendererAxes::Y);
+
+      return plot;
+    }
+
+  }
+}
+
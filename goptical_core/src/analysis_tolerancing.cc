@@ -0,0 +1,580 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <Goptical/common.hh>
+
+#ifdef GOPTICAL_HAVE_PTHREAD
+# include <pthread.h>
+#endif
+
+#include <Goptical/Analysis/Tolerancing>
+#include <Goptical/Analysis/Spot>
+#include <Goptical/Analysis/Focus>
+
+#include <Goptical/Material/Proxy>
+
+#include <Goptical/Data/SampleSet>
+
+#include "sys_replica_.hxx"
+
+namespace _Goptical
+{
+
+  namespace Analysis
+  {
+
+    /** Material with refractive index offset, used by index tolerances */
+    class Tolerancing::index_material_s : public Material::Proxy
+    {
+    public:
+      index_material_s(const const_ref<Material::Base> &m)
+        : Material::Proxy(m),
+          _offset(0.0)
+      {
+      }
+
+      double get_refractive_index(double wavelen) const
+      {
+        return Material::Proxy::get_refractive_index(wavelen) + _offset;
+      }
+
+      double _offset;
+    };
+
+    /** Per thread replica of the sequence elements. Only curves and
+        materials with radius or index tolerance are owned by the
+        replica. */
+    struct Tolerancing::worker_s : public ref_base<worker_s>
+    {
+      worker_s(const Tolerancing &t);
+      ~worker_s();
+
+      Sys::replica_s    _replica;
+      std::vector<ref<Curve::ConicBase> > _curves;
+      std::vector<ref<index_material_s> > _materials;
+      Sys::Image        *_image;
+      Spot              *_spot;
+      Focus             *_focus;
+
+      Tolerancing       *_tol;
+      unsigned int      _first;
+      unsigned int      _last;
+      std::string       _error;
+    };
+
+    Tolerancing::worker_s::worker_s(const Tolerancing &t)
+      : _replica(t._system),
+        _curves(t._tolerances.size()),
+        _materials(t._tolerances.size()),
+        _image(static_cast<Sys::Image*>(_replica.find(*t._image))),
+        _spot(0),
+        _focus(0),
+        _tol(0),
+        _first(0),
+        _last(0)
+    {
+      for (unsigned int j = 0; j < t._tolerances.size(); j++)
+        {
+          const tolerance_s &tl = t._tolerances[j];
+
+          switch (tl._param)
+            {
+            case Radius:
+              _curves[j] = _replica.own_curve(tl._index, false);
+              break;
+
+            case Index: {
+              Sys::OpticalSurface &s = _replica.get<Sys::OpticalSurface>(tl._index);
+              const Sys::OpticalSurface &ns = static_cast<const Sys::OpticalSurface&>(*tl._element);
+
+              _materials[j] = GOPTICAL_REFNEW(index_material_s, s.get_material(1));
+              s.set_material(1, _materials[j]);
+
+              // material on the left side of next optical surface
+              for (unsigned int i = tl._index + 1; i < _replica._elements.size(); i++)
+                {
+                  const Sys::OpticalSurface *n =
+                    dynamic_cast<const Sys::OpticalSurface*>(&_replica.get_nominal(i));
+
+                  if (!n)
+                    continue;
+
+                  if (&n->get_material(0) == &ns.get_material(1))
+                    _replica.get<Sys::OpticalSurface>(i).set_material(0, _materials[j]);
+                  break;
+                }
+              break;
+            }
+
+            default:
+              break;
+            }
+        }
+
+      // analysis tracer copies system parameters on construction
+      switch (t._metric)
+        {
+        case SpotRmsRadius:
+          _spot = new Spot(_replica._system);
+          _spot->set_image(_image);
+          break;
+
+        case FocusShift:
+          _focus = new Focus(_replica._system);
+          _focus->set_image(_image);
+          break;
+        }
+    }
+
+    Tolerancing::worker_s::~worker_s()
+    {
+      delete _spot;
+      delete _focus;
+    }
+
+    Tolerancing::Tolerancing(const Sys::System &system)
+      : _system(system),
+        _image(0),
+        _metric(SpotRmsRadius),
+        _trial_count(1000),
+        _thread_count(system.get_tracer_params().get_thread_count()),
+        _seed(0),
+        _tolerances(),
+        _processed(false),
+        _deltas(),
+        _results(),
+        _values(),
+        _sorted(),
+        _nominal(0.0),
+        _mean(0.0),
+        _std_dev(0.0)
+    {
+      if (!system.get_tracer_params().is_sequential())
+        throw Error("tolerancing analysis requires a system in sequential mode");
+    }
+
+    Tolerancing::~Tolerancing()
+    {
+    }
+
+    unsigned int Tolerancing::set_tolerance(const Sys::Element &element, parameter_e param,
+                                            double value, distribution_e dist)
+    {
+      switch (param)
+        {
+        case Radius: {
+          const Sys::Surface *s = dynamic_cast<const Sys::Surface*>(&element);
+
+          if (!s || !dynamic_cast<const Curve::ConicBase*>(&s->get_curve()))
+            throw Error("radius tolerance requires a surface with conic curve");
+          break;
+        }
+
+        case Index:
+          if (!dynamic_cast<const Sys::OpticalSurface*>(&element))
+            throw Error("index tolerance requires an optical surface");
+          break;
+
+        default:
+          break;
+        }
+
+      invalidate();
+
+      tolerance_s t;
+
+      t._element = &element;
+      t._param = param;
+      t._value = value;
+      t._dist = dist;
+      t._index = 0;
+      t._direction = Math::vector3_0;
+
+      for (unsigned int i = 0; i < _tolerances.size(); i++)
+        if (_tolerances[i]._element == &element && _tolerances[i]._param == param)
+          {
+            _tolerances[i] = t;
+            return i;
+          }
+
+      _tolerances.push_back(t);
+      return _tolerances.size() - 1;
+    }
+
+    double Tolerancing::random_delta(const tolerance_s &t, unsigned short xsubi[3]) const
+    {
+      switch (t._dist)
+        {
+        case NormalTolerance: {
+          // Box-Muller transform
+          double u1 = 1.0 - erand48(xsubi);
+          double u2 = erand48(xsubi);
+
+          return t._value * sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+        }
+
+        case UniformTolerance:
+        default:
+          return t._value * (2.0 * erand48(xsubi) - 1.0);
+        }
+    }
+
+    void Tolerancing::prepare()
+    {
+      const Trace::Params &params = _system.get_tracer_params();
+
+      if (!params.is_sequential())
+        throw Error("tolerancing analysis requires a system in sequential mode");
+
+      const Trace::Sequence &seq = params.get_sequence();
+      unsigned int count = seq.get_element_count();
+
+      // default to last image of sequence
+      if (!_image)
+        {
+          for (unsigned int i = count; i-- > 0; )
+            if ((_image = dynamic_cast<const Sys::Image*>(&seq.get_element(i))))
+              break;
+
+          if (!_image)
+            throw Error("no image found for analysis");
+        }
+
+      bool found = false;
+
+      for (unsigned int i = 0; i < count; i++)
+        if (&seq.get_element(i) == _image)
+          found = true;
+
+      if (!found)
+        throw Error("tolerancing image is not part of the sequence");
+
+      GOPTICAL_FOREACH(t, _tolerances)
+        {
+          unsigned int i;
+
+          for (i = 0; i < count; i++)
+            if (&seq.get_element(i) == t->_element)
+              break;
+
+          if (i == count)
+            throw Error("toleranced element is not part of the sequence");
+
+          t->_index = i;
+
+          if (t->_param == Thickness)
+            {
+              if (i + 1 == count)
+                throw Error("thickness tolerance on last element of sequence");
+
+              t->_direction = (seq.get_element(i + 1).get_position()
+                               - t->_element->get_position()).normalized();
+            }
+        }
+
+      Sys::replica_s::prepare_shared(_system);
+    }
+
+    void Tolerancing::run_worker(worker_s &w)
+    {
+      const Trace::Sequence &seq = _system.get_tracer_params().get_sequence();
+      unsigned int tcount = _tolerances.size();
+      unsigned int ecount = w._replica._elements.size();
+
+      std::vector<Math::Vector3> shift(ecount);
+      std::vector<Math::Vector3> tilt(ecount);
+      std::vector<Math::Vector3> decenter(ecount);
+      std::vector<bool> moved(ecount, false);
+
+      // elements which may move from one trial to the next
+      GOPTICAL_FOREACH(t, _tolerances)
+        {
+          switch (t->_param)
+            {
+            case Thickness:
+              for (unsigned int i = t->_index + 1; i < ecount; i++)
+                moved[i] = true;
+              break;
+            case DecenterX:
+            case DecenterY:
+            case TiltX:
+            case TiltY:
+              moved[t->_index] = true;
+            default:
+              break;
+            }
+        }
+
+      for (unsigned int row = w._first; row < w._last; row++)
+        {
+          const double *delta = tcount ? &_deltas[row * tcount] : 0;
+
+          for (unsigned int i = 0; i < ecount; i++)
+            shift[i] = tilt[i] = decenter[i] = Math::vector3_0;
+
+          for (unsigned int j = 0; j < tcount; j++)
+            {
+              const tolerance_s &t = _tolerances[j];
+              double d = delta[j];
+
+              switch (t._param)
+                {
+                case DecenterX:
+                  decenter[t._index].x() = d;
+                  break;
+                case DecenterY:
+                  decenter[t._index].y() = d;
+                  break;
+                case TiltX:
+                  tilt[t._index].x() = d;
+                  break;
+                case TiltY:
+                  tilt[t._index].y() = d;
+                  break;
+                case Thickness:
+                  for (unsigned int i = t._index + 1; i < ecount; i++)
+                    shift[i] = shift[i] + t._direction * d;
+                  break;
+                case Radius:
+                  w._curves[j]->set_roc(static_cast<const Curve::ConicBase&>(
+                    static_cast<const Sys::Surface*>(t._element)->get_curve()).get_roc() + d);
+                  // notify system of curve change
+                  w._replica.get<Sys::Surface>(t._index).set_curve(w._curves[j]);
+                  break;
+                case Index:
+                  w._materials[j]->_offset = d;
+                  break;
+                }
+            }
+
+          for (unsigned int i = 0; i < ecount; i++)
+            {
+              if (!moved[i])
+                continue;
+
+              Math::Transform<3> tr;
+
+              // perturbation in element local coordinates
+              tr.reset();
+              tr.linear_rotation(tilt[i]);
+              tr.apply_translation(decenter[i]);
+              tr.compose(seq.get_element(i).get_global_transform());
+              tr.apply_translation(shift[i]);
+
+              w._replica._elements[i]->set_transform(tr);
+            }
+
+          double v;
+
+          try {
+            switch (_metric)
+              {
+              case SpotRmsRadius:
+                w._spot->invalidate();
+                v = w._spot->get_rms_radius();
+                break;
+
+              case FocusShift:
+              default:
+                w._focus->invalidate();
+                v = w._image->get_transform_from(0).transform(
+                      w._focus->get_best_focus().origin()).z();
+                break;
+              }
+          } catch (const Error &) {
+            v = std::numeric_limits<double>::quiet_NaN();
+          }
+
+          _results[row] = v;
+        }
+    }
+
+    void * Tolerancing::worker_entry(void *w_)
+    {
+      worker_s &w = *static_cast<worker_s *>(w_);
+
+      try {
+        w._tol->run_worker(w);
+      } catch (const std::exception &e) {
+        w._error = e.what();
+      }
+
+      return 0;
+    }
+
+    void Tolerancing::process()
+    {
+      if (_processed)
+        return;
+
+      prepare();
+
+      unsigned int tcount = _tolerances.size();
+      unsigned int first_mc = 1 + tcount * 2;
+      unsigned int rows = first_mc + _trial_count;
+
+      // draw all perturbations first so that results do not depend
+      // on threads scheduling
+      _deltas.assign(rows * tcount, 0.0);
+
+      for (unsigned int j = 0; j < tcount; j++)
+        {
+          _deltas[(1 + j * 2) * tcount + j] = _tolerances[j]._value;
+          _deltas[(2 + j * 2) * tcount + j] = -_tolerances[j]._value;
+        }
+
+      unsigned short xsubi[3];
+      xsubi[0] = 0x330e;
+      xsubi[1] = _seed & 0xffff;
+      xsubi[2] = _seed >> 16;
+
+      for (unsigned int row = first_mc; row < rows; row++)
+        for (unsigned int j = 0; j < tcount; j++)
+          _deltas[row * tcount + j] = random_delta(_tolerances[j], xsubi);
+
+      _results.assign(rows, 0.0);
+
+      unsigned int count = std::max(1U, std::min(_thread_count, rows));
+      std::vector<ref<worker_s> > workers(count);
+
+      // replicas are built in main thread, shared objects reference
+      // counters are not updated concurrently
+      for (unsigned int i = 0; i < count; i++)
+        {
+          workers[i] = GOPTICAL_REFNEW(worker_s, *this);
+          workers[i]->_tol = this;
+          workers[i]->_first = rows * i / count;
+          workers[i]->_last = rows * (i + 1) / count;
+        }
+
+#ifdef GOPTICAL_HAVE_PTHREAD
+      std::vector<pthread_t> threads(count);
+      std::vector<bool> started(count, false);
+
+      for (unsigned int i = 1; i < count; i++)
+        started[i] = !pthread_create(&threads[i], 0, &worker_entry, workers[i].ptr());
+
+      worker_entry(workers[0].ptr());
+
+      for (unsigned int i = 1; i < count; i++)
+        {
+          if (started[i])
+            pthread_join(threads[i], 0);
+          else
+            worker_entry(workers[i].ptr());
+        }
+#else
+      for (unsigned int i = 0; i < count; i++)
+        worker_entry(workers[i].ptr());
+#endif
+
+      for (unsigned int i = 0; i < count; i++)
+        if (!workers[i]->_error.empty())
+          throw Error(workers[i]->_error);
+
+      _nominal = _results[0];
+      _values.assign(_results.begin() + first_mc, _results.end());
+      _sorted.clear();
+
+      double sum = 0.0;
+
+      GOPTICAL_FOREACH(v, _values)
+        if (std::isfinite(*v))
+          {
+            _sorted.push_back(*v);
+            sum += *v;
+          }
+
+      std::sort(_sorted.begin(), _sorted.end());
+
+      unsigned int n = _sorted.size();
+      double var = 0.0;
+
+      _mean = n ? sum / n : std::numeric_limits<double>::quiet_NaN();
+
+      GOPTICAL_FOREACH(v, _sorted)
+        var += (*v - _mean) * (*v - _mean);
+
+      _std_dev = n > 1 ? sqrt(var / (n - 1)) : 0.0;
+
+      _processed = true;
+    }
+
+    double Tolerancing::get_percentile(double ratio)
+    {
+      process();
+
+      if (_sorted.empty())
+        throw Error("no successful tolerancing trial");
+
+      double x = std::max(0.0, std::min(1.0, ratio)) * (_sorted.size() - 1);
+      unsigned int i = (unsigned int)x;
+
+      if (i + 1 >= _sorted.size())
+        return _sorted.back();
+
+      return _sorted[i] + (_sorted[i + 1] - _sorted[i]) * (x - i);
+    }
+
+    ref<Data::SampleSet> Tolerancing::get_histogram(unsigned int bins)
+    {
+      process();
+
+      if (_sorted.empty())
+        throw Error("no successful tolerancing trial");
+
+      if (!bins)
+        bins = 1;
+
+      double min = _sorted.front();
+      double range = _sorted.back() - min;
+      double step = range > 0.0 ? range / bins : 1.0;
+
+      ref<Data::SampleSet> s = GOPTICAL_REFNEW(Data::SampleSet);
+
+      s->set_metrics(min + step / 2.0, step);
+      s->resize(bins);
+
+      for (unsigned int i = 0; i < bins; i++)
+        s->get_y_value(i) = 0.0;
+
+      double w = 1.0 / _sorted.size();
+
+      GOPTICAL_FOREACH(v, _sorted)
+        s->get_y_value(std::min(bins - 1, (unsigned int)((*v - min) / step))) += w;
+
+      return s;
+    }
+
+  }
+
+}
+
@@ -0,0 +1,313 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+
+#include <cmath>
+#include <limits>
+
+#include <gsl/gsl_linalg.h>
+
+#include <Goptical/Analysis/Wavefront>
+
+#include <Goptical/Curve/Zernike>
+
+#include <Goptical/Shape/Base>
+
+#include <Goptical/Sys/Surface>
+#include <Goptical/Sys/Image>
+#include <Goptical/Sys/System>
+
+#include <Goptical/Material/Base>
+
+#include <Goptical/Trace/Tracer>
+#include <Goptical/Trace/Distribution>
+#include <Goptical/Trace/Params>
+#include <Goptical/Trace/Result>
+#include <Goptical/Trace/Ray>
+
+namespace _Goptical
+{
+
+  namespace Analysis
+  {
+
+    Wavefront::Wavefront(Sys::System &system)
+      : PointImage(system),
+        _entrance(0),
+        _dist(Trace::HexaPolarDist, 10),
+        _processed_analysis(false),
+        _wavelen(0.0),
+        _term_count(Curve::Zernike::term_count),
+        _pupil(),
+        _basis_points(),
+        _basis(),
+        _pinv(),
+        _used_wavelen(0.0),
+        _opd(),
+        _coeff(),
+        _rms(0.0),
+        _ptv(0.0),
+        _fit_rms(0.0)
+    {
+    }
+
+    void Wavefront::set_term_count(unsigned int count)
+    {
+      if (count < 1 || count > Curve::Zernike::term_count)
+        throw Error("bad Zernike term count");
+
+      _term_count = count;
+      _basis_points.clear();
+      _processed_analysis = false;
+    }
+
+    void Wavefront::process_trace()
+    {
+      if (_processed_trace)
+        return;
+
+      if (!_entrance)
+        _entrance = &_system.get_entrance_pupil();
+
+      _tracer.get_params().set_distribution(*_entrance, _dist);
+
+      trace();
+
+      const double radius = _entrance->get_shape().max_radius();
+
+      _pupil.clear();
+
+      GOPTICAL_FOREACH(i, *_intercepts)
+        {
+          const Trace::Ray &r = **i;
+          const Trace::Ray *ray = &r;
+
+          // walk up to entrance pupil generated ray
+          while (ray && ray->get_creator() != _entrance)
+            ray = ray->get_parent();
+
+          if (!ray)
+            continue;
+
+          const double wl = r.get_wavelen();
+          sample_s s;
+
+          s._pupil = Math::Vector2(ray->origin().x(), ray->origin().y()) / radius;
+
+          s._opl = 0.0;
+          for (ray = &r; ray; ray = ray->get_parent())
+            s._opl += ray->get_len() * ray->get_material()->get_refractive_index(wl);
+
+          s._index = r.get_material()->get_refractive_index(wl);
+          s._intensity = r.get_intensity();
+          s._point = r.get_intercept_point();
+          s._direction = r.get_direction(*_image);
+
+          _pupil[wl].push_back(s);
+        }
+
+      _processed_analysis = false;
+    }
+
+    void Wavefront::update_basis(const std::vector<Math::Vector2> &points)
+    {
+      if (points == _basis_points)
+        return;
+
+      const unsigned int count = points.size();
+      const unsigned int terms = _term_count;
+
+      if (count < terms)
+        throw Error("not enough pupil samples for Zernike fit");
+
+      // basis matrix
+
+      _basis.resize(count * terms);
+
+      for (unsigned int i = 0; i < count; i++)
+        Curve::Zernike::zernike_polys(points[i], &_basis[i * terms], terms);
+
+      // pseudo-inverse from normal equations
+
+      gsl_matrix *n = gsl_matrix_alloc(terms, terms);
+      gsl_matrix *inv = gsl_matrix_alloc(terms, terms);
+      gsl_permutation *perm = gsl_permutation_alloc(terms);
+      int signum;
+
+      for (unsigned int j = 0; j < terms; j++)
+        for (unsigned int k = 0; k < terms; k++)
+          {
+            double sum = 0.0;
+
+            for (unsigned int i = 0; i < count; i++)
+              sum += _basis[i * terms + j] * _basis[i * terms + k];
+
+            gsl_matrix_set(n, j, k, sum);
+          }
+
+      gsl_linalg_LU_decomp(n, perm, &signum);
+
+      bool singular = gsl_linalg_LU_det(n, signum) == 0.0;
+
+      if (!singular)
+        gsl_linalg_LU_invert(n, perm, inv);
+
+      _pinv.resize(terms * count);
+
+      if (!singular)
+        for (unsigned int j = 0; j < terms; j++)
+          for (unsigned int i = 0; i < count; i++)
+            {
+              double sum = 0.0;
+
+              for (unsigned int k = 0; k < terms; k++)
+                sum += gsl_matrix_get(inv, j, k) * _basis[i * terms + k];
+
+              _pinv[j * count + i] = sum;
+            }
+
+      gsl_permutation_free(perm);
+      gsl_matrix_free(inv);
+      gsl_matrix_free(n);
+
+      if (singular)
+        {
+          _basis_points.clear();
+          throw Error("singular Zernike basis for pupil samples");
+        }
+
+      _basis_points = points;
+    }
+
+    void Wavefront::process_analysis()
+    {
+      process_trace();
+
+      if (_processed_analysis)
+        return;
+
+      if (_pupil.empty())
+        throw Error("no ray intercept found for wavefront analysis");
+
+      pupil_t::const_iterator p = _wavelen == 0.0
+        ? _pupil.begin() : _pupil.find(_wavelen);
+
+      if (p == _pupil.end())
+        throw Error("no traced pupil data for requested wavelength");
+
+      const samples_t &samples = p->second;
+      const double wl = p->first * 1e-6;  // wavelen in system unit
+      const unsigned int count = samples.size();
+
+      // reference sphere center
+
+      Math::Vector3 reference(Math::vector3_0);
+      double weight = 0.0;
+
+      GOPTICAL_FOREACH(s, samples)
+        {
+          reference += s->_point * s->_intensity;
+          weight += s->_intensity;
+        }
+
+      if (weight == 0.0)
+        throw Error("no light intensity available for wavefront analysis");
+
+      reference /= weight;
+
+      // optical path difference in waves, piston removed
+
+      std::vector<Math::Vector2> points(count);
+      double mean = 0.0;
+
+      _opd.resize(count);
+
+      for (unsigned int i = 0; i < count; i++)
+        {
+          const sample_s &s = samples[i];
+
+          _opd[i] = (s._opl - (s._direction * s._index) * (s._point - reference)) / wl;
+          mean += _opd[i];
+          points[i] = s._pupil;
+        }
+
+      mean /= count;
+
+      double sum2 = 0.0;
+      double min = std::numeric_limits<double>::max();
+      double max = -std::numeric_limits<double>::max();
+
+      for (unsigned int i = 0; i < count; i++)
+        {
+          double v = _opd[i] -= mean;
+
+          sum2 += v * v;
+          min = std::min(min, v);
+          max = std::max(max, v);
+        }
+
+      // Zernike fit
+
+      update_basis(points);
+
+      const unsigned int terms = _term_count;
+
+      _coeff.assign(terms, 0.0);
+
+      for (unsigned int j = 0; j < terms; j++)
+        {
+          const double *row = &_pinv[j * count];
+          double c = 0.0;
+
+          for (unsigned int i = 0; i < count; i++)
+            c += row[i] * _opd[i];
+
+          _coeff[j] = c;
+        }
+
+      double res2 = 0.0;
+
+      for (unsigned int i = 0; i < count; i++)
+        {
+          const double *row = &_basis[i * terms];
+          double v = _opd[i];
+
+          for (unsigned int j = 0; j < terms; j++)
+            v -= row[j] * _coeff[j];
+
+          res2 += v * v;
+        }
+
+      _used_wavelen = p->first;
+      _rms = sqrt(sum2 / count);
+      _ptv = max - min;
+      _fit_rms = sqrt(res2 / count);
+
+      _processed_analysis = true;
+    }
+
+  }
+
+}
+
@@ -0,0 +1,202 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+
+#include <Goptical/Curve/Asphere>
+#include <Goptical/Math/Vector>
+#include <Goptical/Math/VectorPair>
+
+namespace _Goptical {
+
+  namespace Curve {
+
+    Asphere::Asphere(double roc, double sc)
+      : ConicBase(roc, sc),
+        _coeff()
+    {
+    }
+
+    void Asphere::set_coefficient(unsigned int n, double c)
+    {
+      if (n >= _coeff.size())
+        _coeff.resize(n + 1, 0.0);
+
+      _coeff[n] = c;
+    }
+
+    bool Asphere::eval(double r, double &sag, double &deriv) const
+    {
+      const double c = _roc == 0.0 ? 0.0 : 1.0 / _roc;
+      const double r2 = Math::square(r);
+      const double s = 1.0 - _sh * Math::square(c) * r2;
+      const double q = sqrt(s);
+
+      // base conic, curvature form also valid for flat base
+      sag = c * r2 / (1.0 + q);
+      deriv = c * r / q;
+
+      // polynomial terms and derivative with Horner scheme
+      double p = 0.0, dp = 0.0;
+
+      for (unsigned int n = _coeff.size(); n-- > 0; )
+        {
+          dp = dp * r + p;
+          p = p * r + _coeff[n];
+        }
+
+      sag += p;
+      deriv += dp;
+
+      return s >= 0.0;
+    }
+
+    double Asphere::sagitta(double r) const
+    {
+      double s, d;
+
+      eval(r, s, d);
+
+      return s;
+    }
+
+    double Asphere::derivative(double r) const
+    {
+      double s, d;
+
+      eval(r, s, d);
+
+      return d;
+    }
+
+    void Asphere::sagitta_batch(unsigned int count, const char *mask,
+                                double *sagitta, double * const derivative[2],
+                                const double * const xy[2]) const
+    {
+      for (unsigned int i = 0; i < count; i++)
+        {
+          if (!mask[i])
+            continue;
+
+          const double r = sqrt(Math::square(xy[0][i]) + Math::square(xy[1][i]));
+          double d;
+
+          eval(r, sagitta[i], d);
+
+          if (!derivative)
+            continue;
+
+          const double p = r == 0.0 ? 0.0 : d / r;
+
+          derivative[0][i] = xy[0][i] * p;
+          derivative[1][i] = xy[1][i] * p;
+        }
+    }
+
+    bool Asphere::intersect(Math::Vector3 &point, const Math::VectorPair3 &ray) const
+    {
+      const double ox = ray.origin().x();
+      const double oy = ray.origin().y();
+      const double oz = ray.origin().z();
+      const double dx = ray.direction().x();
+      const double dy = ray.direction().y();
+      const double dz = ray.direction().z();
+
+      // exact intersection with base conic c * (x^2 + y^2 + sh * z^2) - 2 * z = 0,
+      // use the root which tends to the z=0 plane solution when c goes to 0
+      const double c = _roc == 0.0 ? 0.0 : 1.0 / _roc;
+      double a2 = c * (Math::square(dx) + Math::square(dy) + _sh * Math::square(dz));
+      double a1 = 2.0 * (c * (ox * dx + oy * dy + _sh * oz * dz) - dz);
+      double a0 = c * (Math::square(ox) + Math::square(oy) + _sh * Math::square(oz)) - 2.0 * oz;
+      double delta = Math::square(a1) - 4.0 * a2 * a0;
+      double t = -1.0;
+
+      if (delta >= 0.0)
+        {
+          double q = -a1 - (a1 < 0.0 ? -1.0 : 1.0) * sqrt(delta);
+
+          if (q != 0.0)
+            t = 2.0 * a0 / q;
+        }
+
+      // ray misses base conic, start from z=0 plane
+      if (t < 0.0 && dz != 0.0)
+        t = -oz / dz;
+
+      if (!(t >= 0.0))
+        {
+          update_intersect_stats(1, 0, 1, 0);
+          return false;
+        }
+
+      const double tolerance = get_intersect_tolerance();
+      const unsigned int max_iterations = get_intersect_max_iterations();
+      unsigned int n;
+
+      // Newton iterations on ray length for polynomial terms
+      for (n = 0; n < max_iterations; n++)
+        {
+          const double x = ox + dx * t;
+          const double y = oy + dy * t;
+          const double r = sqrt(Math::square(x) + Math::square(y));
+          double sag, d;
+
+          if (!eval(r, sag, d))
+            break;
+
+          const double f = oz + dz * t - sag;
+
+          if (fabs(f) < tolerance)
+            {
+              point = Math::Vector3(x, y, sag);
+              update_intersect_stats(1, n + 1, 0, 0);
+              return true;
+            }
+
+          const double p = r == 0.0 ? 0.0 : d / r;
+          const double s = dz - p * (x * dx + y * dy);
+
+          if (s == 0.0)
+            break;
+
+          t -= f / s;
+
+          if (!(t >= 0.0))
+            break;
+        }
+
+      if (n == max_iterations)
+        {
+          point = ray.origin() + ray.direction() * t;
+          update_intersect_stats(1, n, 0, 1);
+          return true;
+        }
+
+      update_intersect_stats(1, n + 1, 1, 0);
+      return false;
+    }
+
+  }
+
+}
+
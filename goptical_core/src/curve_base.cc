@@ -22,6 +22,10 @@
 
 */
 
+#include <iostream>
+#include <typeinfo>
+
+#include <Goptical/Error>
 #include <Goptical/Curve/Base>
 #include <Goptical/Math/Vector>
 #include <Goptical/Math/VectorPair>
@@ -34,56 +38,114 @@ namespace _Goptical {
 
     // Default curve/ray intersection iterative method
 
-    bool Base::intersect(Math::Vector3 &point, const Math::VectorPair3 &ray) const
+    bool Base::intersect_start(double &t, const double o[3], const double d[3]) const
     {
-      Math::VectorPair3 p;
+      // intersection with z=0 plane
+      if (d[2] == 0)
+        return false;
 
-      // initial intersection with z=0 plane
-      {
-        double  s = ray.direction().z();
+      t = -o[2] / d[2];
 
-        if (s == 0)
-          return false;
+      if (t < 0)
+        return false;
 
-        double  a = -ray.origin().z() / s;
+      if (_intersect_curvature == 0)
+        return true;
 
-        if (a < 0)
-          return false;
+      // intersection with vertex sphere: c * (x^2 + y^2 + z^2) - 2 * z = 0,
+      // use the root which tends to the plane solution when c goes to 0
+      const double c = _intersect_curvature;
+      double a2 = c * (d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+      double a1 = 2.0 * (c * (o[0] * d[0] + o[1] * d[1] + o[2] * d[2]) - d[2]);
+      double a0 = c * (o[0] * o[0] + o[1] * o[1] + o[2] * o[2]) - 2.0 * o[2];
+      double delta = a1 * a1 - 4.0 * a2 * a0;
 
-        p.origin() = ray.origin() + ray.direction() * a;
-      }
+      if (delta < 0)
+        return true;
 
-      unsigned int n = 32;      // avoid infinite loop
+      double q = -a1 - (a1 < 0 ? -1.0 : 1.0) * sqrt(delta);
 
-      while (n--)
+      if (q != 0)
         {
-          double new_sag = sagitta(p.origin().project_xy());
-          double old_sag = p.origin().z();
+          double ts = 2.0 * a0 / q;
 
-          // project previous intersection point on curve
-          p.origin().z() = new_sag;
+          if (ts >= 0)
+            t = ts;
+        }
 
-          // stop if close enough
-          if (fabs(old_sag - new_sag) < 1e-10)
-            break;
+      return true;
+    }
 
-          // get curve tangeante plane at intersection point
-          normal(p.normal(), p.origin());
+    bool Base::intersect(Math::Vector3 &point, const Math::VectorPair3 &ray) const
+    {
+      const double o[3] = { ray.origin().x(), ray.origin().y(), ray.origin().z() };
+      const double d[3] = { ray.direction().x(), ray.direction().y(), ray.direction().z() };
+      double t;
 
-          // intersect again with new tangeante plane
-          double a = p.pl_ln_intersect_scale(ray);
+      if (!intersect_start(t, o, d))
+        {
+          update_intersect_stats(1, 0, 1, 0);
+          return false;
+        }
 
-          if (a < 0)
-            return false;
+      const char mask = 1;
+      double x, y, sag, dx, dy;
+      const double *xy[2] = { &x, &y };
+      double * const dxdy[2] = { &dx, &dy };
+      unsigned int n;
 
-          p.origin() = ray.origin() + ray.direction() * a;
+      for (n = 0; n < _intersect_max_iterations; n++)
+        {
+          x = o[0] + d[0] * t;
+          y = o[1] + d[1] * t;
+
+          sagitta_batch(1, &mask, &sag, dxdy, xy);
+
+          // Newton step on ray length, this is the intersection
+          // with curve tangeante plane at current point
+          double f = o[2] + d[2] * t - sag;
+          double s = d[2] - dx * d[0] - dy * d[1];
+
+          if (s == 0)
+            {
+              update_intersect_stats(1, n + 1, 1, 0);
+              return false;
+            }
+
+          double step = f / s;
+
+          t -= step;
+
+          if (t < 0)
+            {
+              update_intersect_stats(1, n + 1, 1, 0);
+              return false;
+            }
+
+          // stop if close enough, the point on tangeante plane
+          // is used without evaluating the curve again
+          if (fabs(step) < _intersect_tolerance)
+            {
+              point = ray.origin() + ray.direction() * t;
+              update_intersect_stats(1, n + 1, 0, 0);
+              return true;
+            }
         }
 
-      point = p.origin();
+      // not converged, project last point on curve
+      point = ray.origin() + ray.direction() * t;
+      point.z() = sagitta(point.project_xy());
+      update_intersect_stats(1, n, 0, 1);
 
       return true;
     }
 
+    void Base::reset_intersect_stats()
+    {
+      _stats.calls = _stats.iterations = 0;
+      _stats.failures = _stats.unconverged = 0;
+    }
+
     // Default curve derivative use gsl numerical differentiation
 
     struct curve_gsl_params_s
@@ -106,8 +168,33 @@ namespace _Goptical {
       return p->c->sagitta(Math::Vector2(p->x, y));
     }
 
+    DerivativeFallback Base::_derivative_fallback = DerivativeNumerical;
+
+    void Base::numerical_derivative() const
+    {
+      switch (_derivative_fallback)
+        {
+        case DerivativeNumerical:
+          return;
+
+        case DerivativeReport:
+          // several tracer threads may get here, only report once
+          if (__sync_bool_compare_and_swap(&_derivative_reported, false, true))
+            {
+              std::cerr << "Goptical: numerical differentiation used for curve of type "
+                        << typeid(*this).name() << std::endl;
+            }
+          return;
+
+        case DerivativeError:
+          throw Error("curve model does not provide analytic derivatives");
+        }
+    }
+
     void Base::derivative(const Math::Vector2 & xy, Math::Vector2 & dxdy) const
     {
+      numerical_derivative();
+
       double abserr;
       struct curve_gsl_params_s params;
       gsl_function gsl_func;
@@ -135,6 +222,73 @@ namespace _Goptical {
       normal.normalize();
     }
 
+    void Base::intersect_batch(unsigned int count, char *mask,
+                               double * const point[3],
+                               const double * const origin[3],
+                               const double * const direction[3]) const
+    {
+      for (unsigned int i = 0; i < count; i++)
+        {
+          if (!mask[i])
+            continue;
+
+          Math::VectorPair3 ray(Math::Vector3(origin[0][i], origin[1][i], origin[2][i]),
+                                Math::Vector3(direction[0][i], direction[1][i], direction[2][i]));
+          Math::Vector3 p;
+
+          if (!intersect(p, ray))
+            {
+              mask[i] = 0;
+              continue;
+            }
+
+          for (unsigned int j = 0; j < 3; j++)
+            point[j][i] = p[j];
+        }
+    }
+
+    void Base::normal_batch(unsigned int count, const char *mask,
+                            double * const normal[3],
+                            const double * const point[3]) const
+    {
+      for (unsigned int i = 0; i < count; i++)
+        {
+          if (!mask[i])
+            continue;
+
+          Math::Vector3 n;
+
+          this->normal(n, Math::Vector3(point[0][i], point[1][i], point[2][i]));
+
+          for (unsigned int j = 0; j < 3; j++)
+            normal[j][i] = n[j];
+        }
+    }
+
+    void Base::sagitta_batch(unsigned int count, const char *mask,
+                             double *sagitta, double * const derivative[2],
+                             const double * const xy[2]) const
+    {
+      for (unsigned int i = 0; i < count; i++)
+        {
+          if (!mask[i])
+            continue;
+
+          Math::Vector2 p(xy[0][i], xy[1][i]);
+
+          sagitta[i] = this->sagitta(p);
+
+          if (derivative)
+            {
+              Math::Vector2 d;
+
+              this->derivative(p, d);
+              derivative[0][i] = d.x();
+              derivative[1][i] = d.y();
+            }
+        }
+    }
+
   }
 
 }
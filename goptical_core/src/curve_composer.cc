@@ -70,7 +70,8 @@ namespace _Goptical {
 
           c->_curve->derivative(c->_inv_transform.transform(xy), dtmp);
 
-          dxdy += c->_transform.transform_linear(dtmp) * c->_z_scale;
+          // chain rule, gradient is transformed by transposed inverse
+          dxdy += (c->_inv_transform.get_linear().transpose() * dtmp) * c->_z_scale;
         }
     }
 
@@ -28,6 +28,8 @@
 #include <Goptical/Math/VectorPair>
 #include <Goptical/Math/VectorPair>
 
+#include "math_simd_.hxx"
+
 namespace _Goptical {
 
   namespace Curve {
@@ -85,6 +87,46 @@ namespace _Goptical {
       normal = Math::Vector3(0, 0, -1);
     }
 
+    struct flat_intersect_kernel
+    {
+      template <class T>
+      typename Math::simd_traits<T>::mask_t
+      operator()(T point[3], const T origin[3], const T direction[3]) const
+      {
+        T s = direction[2];
+        T a = -origin[2] / s;
+
+        typename Math::simd_traits<T>::mask_t miss = (s == T(0.0)) | (a < T(0.0));
+
+        for (unsigned int j = 0; j < 3; j++)
+          point[j] = origin[j] + direction[j] * a;
+
+        return !miss;
+      }
+    };
+
+    void Flat::intersect_batch(unsigned int count, char *mask,
+                               double * const point[3],
+                               const double * const origin[3],
+                               const double * const direction[3]) const
+    {
+      flat_intersect_kernel k;
+
+      Math::simd_intersect_batch(k, count, mask, point, origin, direction);
+    }
+
+    void Flat::normal_batch(unsigned int count, const char *mask,
+                            double * const normal[3],
+                            const double * const point[3]) const
+    {
+      for (unsigned int i = 0; i < count; i++)
+        {
+          normal[0][i] = 0;
+          normal[1][i] = 0;
+          normal[2][i] = -1;
+        }
+    }
+
     Flat flat;
 
   }
@@ -52,6 +52,8 @@ namespace _Goptical {
             if (_data.get_interpolation() == Data::BicubicDeriv)
               c.derivative(v, _data.get_d_value(x, y));
           }
+
+      _data.update();
     }
 
     double Grid::sagitta(const Math::Vector2 & xy) const
@@ -64,5 +66,12 @@ namespace _Goptical {
       dxdy = _data.interpolate_deriv(xy);
     }
 
+    void Grid::sagitta_batch(unsigned int count, const char *mask,
+                             double *sagitta, double * const derivative[2],
+                             const double * const xy[2]) const
+    {
+      _data.interpolate_batch(count, mask, sagitta, derivative, xy);
+    }
+
   }
 }
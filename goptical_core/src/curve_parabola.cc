@@ -28,6 +28,8 @@
 #include <Goptical/Math/VectorPair>
 #include <Goptical/Math/VectorPair>
 
+#include "math_simd_.hxx"
+
 namespace _Goptical {
 
   namespace Curve {
@@ -93,6 +95,93 @@ namespace _Goptical {
       return true;
     }
 
+    /* batch versions of intersect() and normal(), operations order
+       must be kept identical to scalar code */
+
+    struct parabola_intersect_kernel
+    {
+      double _roc;
+
+      template <class T>
+      typename Math::simd_traits<T>::mask_t
+      operator()(T point[3], const T origin[3], const T direction[3]) const
+      {
+        typedef typename Math::simd_traits<T>::mask_t mask_t;
+
+        const T ax = origin[0], ay = origin[1], az = origin[2];
+        const T bx = direction[0], by = direction[1], bz = direction[2];
+
+        T a = (by * by + bx * bx);
+        T b = ((by * ay + bx * ax) / T(_roc) - bz) * T(2.0);
+        T c = (ay * ay + ax * ax) / T(_roc) - T(2.0) * az;
+
+        // both branches are evaluated, a == 0 selects the linear solution
+        mask_t linear = a == T(0.0);
+
+        T d = b * b - T(4.0) * a * c / T(_roc);
+
+        mask_t miss = (!linear) & (d < T(0.0));
+
+        T s = Math::simd_sqrt(d);
+
+        s = Math::simd_select(a * bz < T(0.0), -s, s);
+
+        T t = Math::simd_select(linear, -c / b, (T(2.0) * c) / (s - b));
+
+        miss = miss | (t <= T(0.0));
+
+        point[0] = ax + bx * t;
+        point[1] = ay + by * t;
+        point[2] = az + bz * t;
+
+        return !miss;
+      }
+    };
+
+    void Parabola::intersect_batch(unsigned int count, char *mask,
+                                   double * const point[3],
+                                   const double * const origin[3],
+                                   const double * const direction[3]) const
+    {
+      parabola_intersect_kernel k = { _roc };
+
+      Math::simd_intersect_batch(k, count, mask, point, origin, direction);
+    }
+
+    struct parabola_normal_kernel
+    {
+      double _roc;
+
+      template <class T>
+      void operator()(T normal[3], const T point[3]) const
+      {
+        const T x = point[0], y = point[1];
+        const T r = Math::simd_sqrt(x * x + y * y);
+
+        // see Parabola::derivative and Rotational::normal
+        const T p = r / T(_roc);
+
+        const T nx = x * p / r;
+        const T ny = y * p / r;
+        const T len = Math::simd_sqrt(nx * nx + ny * ny + T(1.0));
+
+        const typename Math::simd_traits<T>::mask_t axis = r == T(0.0);
+
+        normal[0] = Math::simd_select(axis, T(0.0), nx / len);
+        normal[1] = Math::simd_select(axis, T(0.0), ny / len);
+        normal[2] = Math::simd_select(axis, T(-1.0), T(-1.0) / len);
+      }
+    };
+
+    void Parabola::normal_batch(unsigned int count, const char *mask,
+                                double * const normal[3],
+                                const double * const point[3]) const
+    {
+      parabola_normal_kernel k = { _roc };
+
+      Math::simd_normal_batch(k, count, mask, normal, point);
+    }
+
   }
 
 }
@@ -55,6 +55,8 @@ namespace _Goptical {
         _coeff[i] = va_arg(ap, double);
 
       va_end(ap);
+
+      update_intersect_start();
     }
 
     void Polynomial::set(unsigned int first_term, unsigned int last_term, ...)
@@ -73,6 +75,8 @@ namespace _Goptical {
         _coeff[i] = va_arg(ap, double);
 
       va_end(ap);
+
+      update_intersect_start();
     }
 
     void Polynomial::set_even(unsigned int first_term, unsigned int last_term, ...)
@@ -93,6 +97,8 @@ namespace _Goptical {
         _coeff[i] = va_arg(ap, double);
 
       va_end(ap);
+
+      update_intersect_start();
     }
 
     void Polynomial::set_odd(unsigned int first_term, unsigned int last_term, ...)
@@ -113,6 +119,8 @@ namespace _Goptical {
         _coeff[i] = va_arg(ap, double);
 
       va_end(ap);
+
+      update_intersect_start();
     }
 
     void Polynomial::set_term_factor(unsigned int n, double c)
@@ -128,6 +136,8 @@ namespace _Goptical {
         }
 
       _coeff[n] = c;
+
+      update_intersect_start();
     }
 
     void Polynomial::set_last_term(unsigned int n)
@@ -138,6 +148,8 @@ namespace _Goptical {
         _first_term = _last_term;
 
       _coeff.resize(_last_term + 1, 0.0);
+
+      update_intersect_start();
     }
 
     void Polynomial::set_first_term(unsigned int n)
@@ -151,6 +163,14 @@ namespace _Goptical {
 
       for (unsigned int i = 0; i < _first_term; i++)
         _coeff[i] = 0.0;
+
+      update_intersect_start();
+    }
+
+    void Polynomial::update_intersect_start()
+    {
+      // osculating sphere at vertex
+      set_intersect_start_curvature(_last_term >= 2 ? 2.0 * _coeff[2] : 0.0);
     }
 
     double Polynomial::sagitta(double r) const
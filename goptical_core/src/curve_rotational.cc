@@ -66,6 +66,35 @@ namespace _Goptical {
       dxdy = xy * (p / r);
     }
 
+    void Rotational::sagitta_batch(unsigned int count, const char *mask,
+                                   double *sagitta, double * const derivative[2],
+                                   const double * const xy[2]) const
+    {
+      for (unsigned int i = 0; i < count; i++)
+        {
+          if (!mask[i])
+            continue;
+
+          const double r = sqrt(Math::square(xy[0][i]) + Math::square(xy[1][i]));
+
+          sagitta[i] = this->sagitta(r);
+
+          if (!derivative)
+            continue;
+
+          if (r == 0)
+            {
+              derivative[0][i] = derivative[1][i] = 0.0;
+              continue;
+            }
+
+          const double p = this->derivative(r) / r;
+
+          derivative[0][i] = xy[0][i] * p;
+          derivative[1][i] = xy[1][i] * p;
+        }
+    }
+
     double Rotational::gsl_func_sagitta(double x, void *params)
     {
       Rotational *c = static_cast<Rotational *>(params);
@@ -77,6 +106,8 @@ namespace _Goptical {
     {
       double result, abserr;
 
+      numerical_derivative();
+
       gsl_deriv_central(&gsl_func, r, 1e-4, &result, &abserr);
 
       return result;
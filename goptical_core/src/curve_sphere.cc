@@ -28,6 +28,8 @@
 #include <Goptical/Math/VectorPair>
 #include <Goptical/Math/VectorPair>
 
+#include "math_simd_.hxx"
+
 namespace _Goptical {
 
   namespace Curve {
@@ -124,6 +126,89 @@ namespace _Goptical {
         normal = -normal;
     }
 
+    /* batch versions of intersect() and normal(), operations order
+       must be kept identical to scalar code above */
+
+    struct sphere_intersect_kernel
+    {
+      double _roc;
+
+      template <class T>
+      typename Math::simd_traits<T>::mask_t
+      operator()(T point[3], const T origin[3], const T direction[3]) const
+      {
+        const T ax = origin[0], ay = origin[1], az = origin[2];
+        const T bx = direction[0], by = direction[1], bz = direction[2];
+
+        T d = az - _roc;
+        T ay_by = ay * by;
+        T ax_bx = ax * bx;
+
+        T s = T(_roc * _roc)
+          + T(2.0) * (ax_bx + ay_by) * bz * d
+          + T(2.0) * ax_bx * ay_by
+          - (ay * bx) * (ay * bx)
+          - (ax * by) * (ax * by)
+          - (bx * bx + by * by) * (d * d)
+          - (ax * ax + ay * ay) * (bz * bz)
+          ;
+
+        typename Math::simd_traits<T>::mask_t miss = s < T(0.0);
+
+        s = Math::simd_sqrt(s);
+        s = Math::simd_select(T(_roc) * bz > T(0.0), -s, s);
+
+        T t = (s - (bz * d + ax_bx + ay_by));
+
+        miss = miss | (t <= T(0.0));
+
+        point[0] = ax + bx * t;
+        point[1] = ay + by * t;
+        point[2] = az + bz * t;
+
+        return !miss;
+      }
+    };
+
+    void Sphere::intersect_batch(unsigned int count, char *mask,
+                                 double * const point[3],
+                                 const double * const origin[3],
+                                 const double * const direction[3]) const
+    {
+      sphere_intersect_kernel k = { _roc };
+
+      Math::simd_intersect_batch(k, count, mask, point, origin, direction);
+    }
+
+    struct sphere_normal_kernel
+    {
+      double _roc;
+
+      template <class T>
+      void operator()(T normal[3], const T point[3]) const
+      {
+        const T x = point[0], y = point[1], z = point[2] - T(_roc);
+        const T len = Math::simd_sqrt(x * x + y * y + z * z);
+
+        normal[0] = x / len;
+        normal[1] = y / len;
+        normal[2] = z / len;
+
+        if (_roc < 0)
+          for (unsigned int j = 0; j < 3; j++)
+            normal[j] = -normal[j];
+      }
+    };
+
+    void Sphere::normal_batch(unsigned int count, const char *mask,
+                              double * const normal[3],
+                              const double * const point[3]) const
+    {
+      sphere_normal_kernel k = { _roc };
+
+      Math::simd_normal_batch(k, count, mask, normal, point);
+    }
+
   }
 
 }
@@ -705,12 +705,14 @@ namespace _Goptical {
 
       GOPTICAL_FOREACH(pt, pattern)
         {
-          struct zp_precalc_s p(pt->x(), pt->y());
+          double values[term_count];
 
           gsl_vector_set(y, i, curve.sagitta(*pt * _radius));
-          
+
+          zernike_polys(*pt, values);
+
           for (unsigned int j = 0; j < term_count; j++)
-            gsl_matrix_set(X, i, j, zp[j](p) * _scale);
+            gsl_matrix_set(X, i, j, values[j] * _scale);
 
           i++;
         }
@@ -802,6 +804,16 @@ namespace _Goptical {
       zp_d[n](p, dxdy);
     }
 
+    void Zernike::zernike_polys(const Math::Vector2 & xy, double values[], unsigned int count)
+    {
+      struct zp_precalc_s p(xy.x(), xy.y());
+
+      assert(count <= term_count);
+
+      for (unsigned int n = 0; n < count; n++)
+        values[n] = zp[n](p);
+    }
+
   }
 
 }
@@ -0,0 +1,467 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+
+#include <Goptical/Math/Vector>
+#include <Goptical/Math/VectorPair>
+#include <Goptical/Curve/ZernikeSeries>
+
+namespace _Goptical {
+
+  namespace Curve {
+
+    /* points are evaluated by blocks so that all terms can be
+       applied to several points in a row with intermediate values
+       kept on stack */
+    static const unsigned int zs_block_size = 64;
+
+    ZernikeSeries::ZernikeSeries(double radius, ordering_e ordering, double unit_scale)
+      : _ordering(ordering),
+        _scale(unit_scale),
+        _radius(radius),
+        _coeff(),
+        _groups()
+    {
+    }
+
+    ZernikeSeries::ZernikeSeries(double radius, const double coefs[], unsigned int coefs_count,
+                                 ordering_e ordering, double unit_scale)
+      : _ordering(ordering),
+        _scale(unit_scale),
+        _radius(radius),
+        _coeff(coefs, coefs + coefs_count),
+        _groups()
+    {
+      update();
+    }
+
+    void ZernikeSeries::get_term_degree(ordering_e ordering, unsigned int j,
+                                        unsigned int &n, int &m)
+    {
+      assert(j > 0);
+
+      switch (ordering)
+        {
+        case NollOrdering: {
+          n = 0;
+          while ((n + 1) * (n + 2) / 2 < j)
+            n++;
+
+          unsigned int k = j - n * (n + 1) / 2;
+
+          m = n % 2 ? (k - 1) / 2 * 2 + 1 : k / 2 * 2;
+
+          if (j % 2)
+            m = -m;
+          break;
+        }
+
+        case FringeOrdering: {
+          unsigned int g = 0;
+          while ((g + 1) * (g + 1) < j)
+            g++;
+
+          unsigned int i = j - g * g - 1;
+
+          m = g - i / 2;
+          n = 2 * g - m;
+
+          if (i % 2)
+            m = -m;
+          break;
+        }
+        }
+    }
+
+    void ZernikeSeries::set_coefficient(unsigned int j, double c)
+    {
+      assert(j > 0);
+
+      if (j > _coeff.size())
+        _coeff.resize(j, 0.0);
+
+      _coeff[j - 1] = c;
+      update();
+    }
+
+    void ZernikeSeries::set_coefficients_scale(double s)
+    {
+      _scale = s;
+      update();
+    }
+
+    void ZernikeSeries::update()
+    {
+      std::vector<group_s> groups;
+
+      // gather scaled coefficients by azimuthal frequency and radial degree
+      for (unsigned int j = 1; j <= _coeff.size(); j++)
+        {
+          double c = _coeff[j - 1];
+
+          if (c == 0.0)
+            continue;
+
+          unsigned int n;
+          int m;
+
+          get_term_degree(_ordering, j, n, m);
+
+          unsigned int am = abs(m);
+          unsigned int k = (n - am) / 2;
+
+          if (_ordering == NollOrdering)
+            c *= sqrt((am ? 2.0 : 1.0) * (n + 1));
+
+          if (groups.size() <= am)
+            groups.resize(am + 1);
+
+          group_s &g = groups[am];
+
+          if (g.ccos.size() <= k)
+            {
+              g.ccos.resize(k + 1, 0.0);
+              g.csin.resize(k + 1, 0.0);
+            }
+
+          (m < 0 ? g.csin : g.ccos)[k] += c * _scale;
+        }
+
+      _groups.clear();
+
+      for (unsigned int am = 0; am < groups.size(); am++)
+        {
+          group_s &g = groups[am];
+
+          if (g.ccos.empty())
+            continue;
+
+          g.m = am;
+          g.recur.resize(g.ccos.size());
+
+          // Kintner recurrence, divided by rho^m on both sides:
+          // K1 Q(n) = (K2 s + K3) Q(n-2) + K4 Q(n-4)
+          for (unsigned int k = 2; k < g.recur.size(); k++)
+            {
+              double m = am;
+              double n = am + 2 * k;
+              double k1 = (n + m) * (n - m) * (n - 2) / 2;
+              double k2 = 2 * n * (n - 1) * (n - 2);
+              double k3 = -m * m * (n - 1) - n * (n - 1) * (n - 2);
+              double k4 = -n * (n + m - 2) * (n - m - 2) / 2;
+
+              g.recur[k].a = k2 / k1;
+              g.recur[k].b = k3 / k1;
+              g.recur[k].c = k4 / k1;
+            }
+
+          _groups.push_back(g);
+        }
+    }
+
+    void ZernikeSeries::eval_block(unsigned int count, const char *mask,
+                                   const double *x, const double *y, double *sag,
+                                   double *dx, double *dy) const
+    {
+      assert(count <= zs_block_size);
+
+      double u[zs_block_size], v[zs_block_size], s[zs_block_size];
+      // real and imaginary parts of (u + iv)^m and (u + iv)^(m-1)
+      double cr[zs_block_size], ci[zs_block_size];
+      double pr[zs_block_size], pi[zs_block_size];
+      // radial polynomials Q(n-4), Q(n-2) and their derivatives wrt s
+      double qa[zs_block_size], qb[zs_block_size];
+      double dqa[zs_block_size], dqb[zs_block_size];
+      // radial sums for current frequency and their derivatives
+      double a[zs_block_size], b[zs_block_size];
+      double da[zs_block_size], db[zs_block_size];
+      double z[zs_block_size], gu[zs_block_size], gv[zs_block_size];
+      unsigned int i;
+
+      for (i = 0; i < count; i++)
+        {
+          u[i] = x[i] / _radius;
+          v[i] = y[i] / _radius;
+          s[i] = u[i] * u[i] + v[i] * v[i];
+          cr[i] = 1.0;
+          ci[i] = pr[i] = pi[i] = 0.0;
+          z[i] = gu[i] = gv[i] = 0.0;
+        }
+
+      unsigned int m = 0;
+
+      GOPTICAL_FOREACH(g, _groups)
+        {
+          for (; m < g->m; m++)
+            for (i = 0; i < count; i++)
+              {
+                pr[i] = cr[i];
+                pi[i] = ci[i];
+                cr[i] = pr[i] * u[i] - pi[i] * v[i];
+                ci[i] = pr[i] * v[i] + pi[i] * u[i];
+              }
+
+          const double *cc = &g->ccos[0];
+          const double *cs = &g->csin[0];
+          unsigned int nk = g->ccos.size();
+
+          for (i = 0; i < count; i++)
+            {
+              a[i] = cc[0];
+              b[i] = cs[0];
+              da[i] = db[i] = 0.0;
+            }
+
+          if (nk > 1)
+            {
+              double m1 = m + 1.0;
+              double m2 = m + 2.0;
+
+              for (i = 0; i < count; i++)
+                {
+                  qa[i] = 1.0;
+                  dqa[i] = 0.0;
+                  qb[i] = m2 * s[i] - m1;
+                  dqb[i] = m2;
+                  a[i] += cc[1] * qb[i];
+                  b[i] += cs[1] * qb[i];
+                  da[i] += cc[1] * m2;
+                  db[i] += cs[1] * m2;
+                }
+            }
+
+          for (unsigned int k = 2; k < nk; k++)
+            {
+              const recur_s &r = g->recur[k];
+
+              for (i = 0; i < count; i++)
+                {
+                  double t = r.a * s[i] + r.b;
+                  double q = t * qb[i] + r.c * qa[i];
+                  double dq = t * dqb[i] + r.a * qb[i] + r.c * dqa[i];
+
+                  qa[i] = qb[i];
+                  dqa[i] = dqb[i];
+                  qb[i] = q;
+                  dqb[i] = dq;
+
+                  a[i] += cc[k] * q;
+                  b[i] += cs[k] * q;
+                  da[i] += cc[k] * dq;
+                  db[i] += cs[k] * dq;
+                }
+            }
+
+          for (i = 0; i < count; i++)
+            z[i] += a[i] * cr[i] + b[i] * ci[i];
+
+          if (dx)
+            for (i = 0; i < count; i++)
+              {
+                double t = 2.0 * (da[i] * cr[i] + db[i] * ci[i]);
+
+                gu[i] += u[i] * t + m * (a[i] * pr[i] + b[i] * pi[i]);
+                gv[i] += v[i] * t + m * (b[i] * pr[i] - a[i] * pi[i]);
+              }
+        }
+
+      for (i = 0; i < count; i++)
+        {
+          if (!mask[i])
+            continue;
+
+          bool in = s[i] <= 1.0;
+
+          sag[i] = in ? z[i] : 0.0;
+
+          if (dx)
+            {
+              dx[i] = in ? gu[i] / _radius : 0.0;
+              dy[i] = in ? gv[i] / _radius : 0.0;
+            }
+        }
+    }
+
+    double ZernikeSeries::sagitta(const Math::Vector2 & xy) const
+    {
+      const char mask = 1;
+      double x = xy.x(), y = xy.y();
+      double sag;
+
+      eval_block(1, &mask, &x, &y, &sag, 0, 0);
+
+      return sag;
+    }
+
+    void ZernikeSeries::derivative(const Math::Vector2 & xy, Math::Vector2 & dxdy) const
+    {
+      const char mask = 1;
+      double x = xy.x(), y = xy.y();
+      double sag;
+
+      eval_block(1, &mask, &x, &y, &sag, &dxdy.x(), &dxdy.y());
+    }
+
+    void ZernikeSeries::sagitta_batch(unsigned int count, const char *mask,
+                                      double *sagitta, double * const derivative[2],
+                                      const double * const xy[2]) const
+    {
+      for (unsigned int j = 0; j < count; j += zs_block_size)
+        {
+          unsigned int c = std::min(count - j, zs_block_size);
+
+          eval_block(c, mask + j, xy[0] + j, xy[1] + j, sagitta + j,
+                     derivative ? derivative[0] + j : 0,
+                     derivative ? derivative[1] + j : 0);
+        }
+    }
+
+    bool ZernikeSeries::intersect(Math::Vector3 &point, const Math::VectorPair3 &ray) const
+    {
+      char mask = 1;
+      Math::Vector3 org(ray.origin()), dir(ray.direction());
+      double *p[3] = { &point.x(), &point.y(), &point.z() };
+      const double *o[3] = { &org.x(), &org.y(), &org.z() };
+      const double *d[3] = { &dir.x(), &dir.y(), &dir.z() };
+
+      intersect_batch(1, &mask, p, o, d);
+
+      return mask;
+    }
+
+    /* Same Newton iterations as Base::intersect, performed in
+       lockstep on a block of rays so that sagitta and derivatives
+       are evaluated together for all pending rays. */
+    void ZernikeSeries::intersect_batch(unsigned int count, char *mask,
+                                        double * const point[3],
+                                        const double * const origin[3],
+                                        const double * const direction[3]) const
+    {
+      const double tolerance = get_intersect_tolerance();
+      const unsigned int max_iterations = get_intersect_max_iterations();
+
+      for (unsigned int j = 0; j < count; j += zs_block_size)
+        {
+          unsigned int c = std::min(count - j, zs_block_size);
+          const double *ox = origin[0] + j, *oy = origin[1] + j, *oz = origin[2] + j;
+          const double *dx = direction[0] + j, *dy = direction[1] + j, *dz = direction[2] + j;
+          double t[zs_block_size], px[zs_block_size], py[zs_block_size];
+          double sag[zs_block_size], gx[zs_block_size], gy[zs_block_size];
+          char active[zs_block_size];
+          char *m = mask + j;
+          unsigned int calls = 0, iterations = 0, failures = 0;
+          unsigned int pending = 0;
+          unsigned int i, n;
+
+          for (i = 0; i < c; i++)
+            {
+              active[i] = 0;
+
+              if (!m[i])
+                continue;
+
+              const double o[3] = { ox[i], oy[i], oz[i] };
+              const double d[3] = { dx[i], dy[i], dz[i] };
+
+              calls++;
+
+              if (!intersect_start(t[i], o, d))
+                {
+                  m[i] = 0;
+                  failures++;
+                  continue;
+                }
+
+              active[i] = 1;
+              pending++;
+            }
+
+          for (n = 0; pending && n < max_iterations; n++)
+            {
+              for (i = 0; i < c; i++)
+                if (active[i])
+                  {
+                    px[i] = ox[i] + dx[i] * t[i];
+                    py[i] = oy[i] + dy[i] * t[i];
+                  }
+
+              eval_block(c, active, px, py, sag, gx, gy);
+              iterations += pending;
+
+              for (i = 0; i < c; i++)
+                {
+                  if (!active[i])
+                    continue;
+
+                  double f = oz[i] + dz[i] * t[i] - sag[i];
+
+                  // stop if close enough, project on curve
+                  if (fabs(f) < tolerance)
+                    {
+                      point[0][j + i] = px[i];
+                      point[1][j + i] = py[i];
+                      point[2][j + i] = sag[i];
+                      active[i] = 0;
+                      pending--;
+                      continue;
+                    }
+
+                  double s = dz[i] - gx[i] * dx[i] - gy[i] * dy[i];
+
+                  if (s != 0)
+                    t[i] -= f / s;
+
+                  if (s == 0 || t[i] < 0)
+                    {
+                      m[i] = active[i] = 0;
+                      pending--;
+                      failures++;
+                    }
+                }
+            }
+
+          // rays which did not converge
+          for (i = 0; i < c; i++)
+            {
+              if (!active[i])
+                continue;
+
+              point[0][j + i] = ox[i] + dx[i] * t[i];
+              point[1][j + i] = oy[i] + dy[i] * t[i];
+              point[2][j + i] = oz[i] + dz[i] * t[i];
+            }
+
+          update_intersect_stats(calls, iterations, failures, pending);
+        }
+    }
+
+  }
+
+}
+
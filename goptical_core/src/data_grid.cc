@@ -35,30 +35,61 @@ namespace _Goptical {
       : Set(),
         _y_data(),
         _d_data(),
-        _poly(),
-        _update(&Grid::update_linear),
-        _lookup(&Grid::update_linear),
+        _table(0),
         _resize(&Grid::resize_y),
         _origin(origin),
         _step(step)
     {
+      _interpolation = Linear;
       _origin = origin;
       _step = step;
       resize(n1, n2);
     }
 
+    Grid::Grid(const Grid &g)
+      : Set(g),
+        _y_data(g._y_data),
+        _d_data(g._d_data),
+        _table(0),
+        _resize(g._resize),
+        _origin(g._origin),
+        _step(g._step)
+    {
+      _size[0] = g._size[0];
+      _size[1] = g._size[1];
+    }
+
     Grid::~Grid()
     {
+      delete _table;
+    }
+
+    Grid & Grid::operator=(const Grid &g)
+    {
+      invalidate();
+      _version = g._version;
+      _interpolation = g._interpolation;
+      _size[0] = g._size[0];
+      _size[1] = g._size[1];
+      _y_data = g._y_data;
+      _d_data = g._d_data;
+      _resize = g._resize;
+      _origin = g._origin;
+      _step = g._step;
+
+      return *this;
     }
 
     void Grid::set_all_y(double y)
     {
+      invalidate();
       GOPTICAL_FOREACH(i, _y_data)
         *i = y;
     }
 
     void Grid::set_all_d(const Math::Vector2 & deriv)
     {
+      invalidate();
       GOPTICAL_FOREACH(i, _d_data)
         *i = deriv;
     }
@@ -107,34 +138,15 @@ namespace _Goptical {
     {
       switch (i)
         {
-        case Nearest:     
-          _update = &Grid::update_nearest;
-          _resize = &Grid::resize_y;
-          _d_data.clear();
-          _poly.clear();
-          break;
-
+        case Nearest:
         case Linear:
-          _update = &Grid::update_linear;
-          _resize = &Grid::resize_y;
-          _d_data.clear();
-          _poly.clear();
-          break;
-
         case Bicubic:
-          _update = &Grid::update_bicubic;
-          _resize = &Grid::resize_y;
-          _d_data.clear();
-          break;
-
         case BicubicDiff:
-          _update = &Grid::update_bicubic_diff;
           _resize = &Grid::resize_y;
           _d_data.clear();
           break;
 
         case BicubicDeriv:
-          _update = &Grid::update_bicubic_deriv;
           _resize = &Grid::resize_yd;
           _d_data.resize(_size[0] * _size[1], Math::Vector2(0, 0));
           break;
@@ -144,62 +156,178 @@ namespace _Goptical {
         }
 
       _interpolation = i;
-      _lookup = _update;
+      invalidate();
     }
 
     // **********************************************************************
 
-    void Grid::update_nearest(unsigned int x[2], const Math::Vector2 & v) const
+    void Grid::update() const
     {
-      Grid * this_ = const_cast<Grid *>(this);
+      get_table();
+    }
 
-      if (_size[0] < 1 || _size[1] < 1)
-        throw Error("data set doesn't contains enough data");
+    const Grid::table_s & Grid::get_table() const
+    {
+      // table contents must be read after the published pointer
+      table_s *t = __atomic_load_n(&_table, __ATOMIC_ACQUIRE);
 
-      this_->_lookup = &Grid::lookup_nearest;
-      this_->_interpolate_y = &Grid::interpolate_nearest_y;
-      this_->_interpolate_d = &Grid::interpolate_nearest_d;
+      if (t)
+        return *t;
+
+      // concurrent threads may build the table at the same time,
+      // only the first one is published
+      table_s *expected = 0;
+      t = new_table();
+
+      if (!__atomic_compare_exchange_n(&_table, &expected, t, false,
+                                       __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+        {
+          delete t;
+          t = expected;
+        }
 
-      return lookup_nearest(x, v);
+      return *t;
     }
 
-    double Grid::interpolate_nearest_y(const unsigned int x[2], const Math::Vector2 & v) const
+    Grid::table_s * Grid::new_table() const
     {
-      return _y_data[x[0] + x[1] * _size[0]];
+      unsigned int min = _interpolation == Nearest ? 1 : 2;
+
+      if (_size[0] < min || _size[1] < min)
+        throw Error("data set doesn't contains enough data");
+
+      table_s *t = new table_s;
+
+      switch (_interpolation)
+        {
+        case Bicubic:
+          set_poly_bicubic(t->_poly);
+          break;
+
+        case BicubicDiff:
+          set_poly_bicubic_diff(t->_poly);
+          break;
+
+        case BicubicDeriv:
+          set_poly_bicubic_deriv(t->_poly);
+          break;
+
+        default:
+          break;
+        }
+
+      return t;
     }
 
-    void Grid::interpolate_nearest_d(const unsigned int x[2], Math::Vector2 & d, const Math::Vector2 & v) const
+    double Grid::interpolate(const Math::Vector2 & v) const
     {
-      d.set(0);
+      const table_s &t = get_table();
+      unsigned int x[2];
+      double y;
+
+      switch (_interpolation)
+        {
+        case Nearest:
+          lookup_nearest(x, v);
+          return interpolate_nearest_y(x, v);
+
+        case Linear:
+          lookup_interval(x, v);
+          return interpolate_linear_y(x, v);
+
+        default:
+          interpolate_bicubic(t, v, &y, 0);
+          return y;
+        }
     }
 
-    // **********************************************************************
+    Math::Vector2 Grid::interpolate_deriv(const Math::Vector2 & v) const
+    {
+      const table_s &t = get_table();
+      Math::Vector2 res;
+      unsigned int x[2];
+
+      switch (_interpolation)
+        {
+        case Nearest:
+          lookup_nearest(x, v);
+          interpolate_nearest_d(x, res, v);
+          break;
 
-    void Grid::update_linear(unsigned int x[2], const Math::Vector2 & v) const
+        case Linear:
+          lookup_interval(x, v);
+          interpolate_linear_d(x, res, v);
+          break;
+
+        default:
+          interpolate_bicubic(t, v, 0, &res);
+          break;
+        }
+
+      return res;
+    }
+
+    void Grid::interpolate_batch(unsigned int count, const char *mask,
+                                 double *y, double * const deriv[2],
+                                 const double * const xy[2]) const
     {
-      Grid * this_ = const_cast<Grid *>(this);
+      const table_s &t = get_table();
 
-      if (_size[0] < 2 || _size[1] < 2)
-        throw Error("data set doesn't contains enough data");
+      for (unsigned int i = 0; i < count; i++)
+        {
+          if (mask && !mask[i])
+            continue;
+
+          Math::Vector2 v(xy[0][i], xy[1][i]);
+          Math::Vector2 d;
+
+          switch (_interpolation)
+            {
+            case Nearest:
+            case Linear:
+              y[i] = interpolate(v);
+              if (deriv)
+                d = interpolate_deriv(v);
+              break;
+
+            default:
+              interpolate_bicubic(t, v, y + i, deriv ? &d : 0);
+              break;
+            }
+
+          if (deriv)
+            {
+              deriv[0][i] = d.x();
+              deriv[1][i] = d.y();
+            }
+        }
+    }
+
+    // **********************************************************************
 
-      this_->_lookup = &Grid::lookup_interval;
-      this_->_interpolate_y = &Grid::interpolate_linear_y;
-      this_->_interpolate_d = &Grid::interpolate_linear_d;
+    double Grid::interpolate_nearest_y(const unsigned int x[2], const Math::Vector2 & v) const
+    {
+      return _y_data[x[0] + x[1] * _size[0]];
+    }
 
-      return lookup_interval(x, v);
+    void Grid::interpolate_nearest_d(const unsigned int x[2], Math::Vector2 & d, const Math::Vector2 & v) const
+    {
+      d.set(0);
     }
 
+    // **********************************************************************
+
     double Grid::interpolate_linear_y(const unsigned int x[2], const Math::Vector2 & v) const
     {
       unsigned int s = _size[0];
       unsigned int idx = x[0] + s * x[1];
 
-      double mu1 = v.x() / _step.x() - (double)x[0];
+      double mu1 = (v.x() - _origin.x()) / _step.x() - (double)x[0];
 
       double a = _y_data[idx] * (1.0 - mu1) + _y_data[idx + 1] * mu1;
       double b = _y_data[idx + s] * (1.0 - mu1) + _y_data[idx + s + 1] * mu1;
 
-      double mu2 = v.y() / _step.y() - (double)x[1];
+      double mu2 = (v.y() - _origin.y()) / _step.y() - (double)x[1];
 
       return a * (1.0 - mu2) + b * mu2;
     }
@@ -211,13 +339,13 @@ namespace _Goptical {
 
       double a1 = (_y_data[idx] - _y_data[idx + 1]) / _step.x();
       double b1 = (_y_data[idx + s] - _y_data[idx + s + 1]) / _step.x();
-      double mu2 = v.y() / _step.y() - (double)x[1];
+      double mu2 = (v.y() - _origin.y()) / _step.y() - (double)x[1];
 
       d.x() = a1 * (1.0 - mu2) + b1 * mu2;
 
       double a2 = (_y_data[idx] - _y_data[idx + s]) / _step.y();
       double b2 = (_y_data[idx + 1] - _y_data[idx + s + 1]) / _step.y();
-      double mu1 = v.x() / _step.x() - (double)x[0];
+      double mu1 = (v.x() - _origin.x()) / _step.x() - (double)x[0];
 
       d.y() = a2 * (1.0 - mu1) + b2 * mu1;
     }
@@ -379,15 +507,10 @@ namespace _Goptical {
         + (dt * dt) * ((dd[i] + dt * (0.5 * (dd[i+1] - dd[i]) / dt)) - (dd[i+1] / 6.0 + dd[i] / 3.0));
     }
 
-    void Grid::update_bicubic(unsigned int x[2], const Math::Vector2 & v) const
+    void Grid::set_poly_bicubic(std::vector <poly_t> &poly) const
     {
-      Grid * this_ = const_cast<Grid *>(this);
-
-      if (_size[0] < 2 || _size[1] < 2)
-        throw Error("data set doesn't contains enough data");
-
       const unsigned int s0 = _size[0] - 1;
-      this_->_poly.resize(s0 * (_size[1] - 1));
+      poly.resize(s0 * (_size[1] - 1));
 
       double cd[_size[0] * _size[1]];
       get_cross_deriv_diff(cd);
@@ -428,25 +551,14 @@ namespace _Goptical {
             t[12+2] = cd[idx + w];
             t[12+3] = cd[idx + w + 1];
 
-            set_poly(this_->_poly[x0 + s0 * x1], t);
+            set_poly(poly[x0 + s0 * x1], t);
           }
-
-      this_->_lookup = &Grid::lookup_interval;
-      this_->_interpolate_y = &Grid::interpolate_bicubic_y;
-      this_->_interpolate_d = &Grid::interpolate_bicubic_d;
-
-      return lookup_interval(x, v);
     }
 
-    void Grid::update_bicubic_diff(unsigned int x[2], const Math::Vector2 & v) const
+    void Grid::set_poly_bicubic_diff(std::vector <poly_t> &poly) const
     {
-      Grid * this_ = const_cast<Grid *>(this);
-
-      if (_size[0] < 2 || _size[1] < 2)
-        throw Error("data set doesn't contains enough data");
-
       const unsigned int s0 = _size[0] - 1;
-      this_->_poly.resize(s0 * (_size[1] - 1));
+      poly.resize(s0 * (_size[1] - 1));
 
       double cd[_size[0] * _size[1]];
       get_cross_deriv_diff(cd);
@@ -481,25 +593,14 @@ namespace _Goptical {
             t[12+2] = cd[idx + w];
             t[12+3] = cd[idx + w + 1];
 
-            set_poly(this_->_poly[x0 + s0 * x1], t);
+            set_poly(poly[x0 + s0 * x1], t);
           }
-
-      this_->_lookup = &Grid::lookup_interval;
-      this_->_interpolate_y = &Grid::interpolate_bicubic_y;
-      this_->_interpolate_d = &Grid::interpolate_bicubic_d;
-
-      return lookup_interval(x, v);
     }
 
-    void Grid::update_bicubic_deriv(unsigned int x[2], const Math::Vector2 & v) const
+    void Grid::set_poly_bicubic_deriv(std::vector <poly_t> &poly) const
     {
-      Grid * this_ = const_cast<Grid *>(this);
-
-      if (_size[0] < 2 || _size[1] < 2)
-        throw Error("data set doesn't contains enough data");
-
       const unsigned int s0 = _size[0] - 1;
-      this_->_poly.resize(s0 * (_size[1] - 1));
+      poly.resize(s0 * (_size[1] - 1));
 
       double cd[_size[0] * _size[1]];
       get_cross_deriv_diff(cd);
@@ -531,49 +632,46 @@ namespace _Goptical {
             t[12+2] = cd[idx + w];
             t[12+3] = cd[idx + w + 1];
 
-            set_poly(this_->_poly[x0 + s0 * x1], t);
+            set_poly(poly[x0 + s0 * x1], t);
           }
-
-      this_->_lookup = &Grid::lookup_interval;
-      this_->_interpolate_y = &Grid::interpolate_bicubic_y;
-      this_->_interpolate_d = &Grid::interpolate_bicubic_d;
-
-      return lookup_interval(x, v);
     }
 
-    double Grid::interpolate_bicubic_y(const unsigned int x[2], const Math::Vector2 & v) const
+    void Grid::interpolate_bicubic(const table_s &tb, const Math::Vector2 & v,
+                                   double *y, Math::Vector2 *d) const
     {
-      const poly_t &p = _poly[x[0] + x[1] * (_size[0] - 1)];
-      Math::Vector2 t((v - _origin) / _step - Math::Vector2((double)x[0], (double)x[1]));
+      unsigned int x[2];
 
-      double res;
+      lookup_interval(x, v);
 
-      res = ((p.p[15] * t.y() + p.p[14]) * t.y() + p.p[13]) * t.y() + p.p[12];
-      res = ((p.p[11] * t.y() + p.p[10]) * t.y() + p.p[9]) * t.y() + p.p[8] + t.x() * res;
-      res = ((p.p[7] * t.y() + p.p[6]) * t.y() + p.p[5]) * t.y() + p.p[4] + t.x() * res;
-      res = ((p.p[3] * t.y() + p.p[2]) * t.y() + p.p[1]) * t.y() + p.p[0] + t.x() * res;
+      const poly_t &p = tb._poly[x[0] + x[1] * (_size[0] - 1)];
+      Math::Vector2 t((v - _origin) / _step - Math::Vector2((double)x[0], (double)x[1]));
 
-      return res;
-    }
+      if (y)
+        {
+          double res;
 
-    void Grid::interpolate_bicubic_d(const unsigned int x[2], Math::Vector2 & d, const Math::Vector2 & v) const
-    {
-      const poly_t &p = _poly[x[0] + x[1] * (_size[0] - 1)];
-      Math::Vector2 t((v - _origin) / _step - Math::Vector2((double)x[0], (double)x[1]));
+          res = ((p.p[15] * t.y() + p.p[14]) * t.y() + p.p[13]) * t.y() + p.p[12];
+          res = ((p.p[11] * t.y() + p.p[10]) * t.y() + p.p[9]) * t.y() + p.p[8] + t.x() * res;
+          res = ((p.p[7] * t.y() + p.p[6]) * t.y() + p.p[5]) * t.y() + p.p[4] + t.x() * res;
+          res = ((p.p[3] * t.y() + p.p[2]) * t.y() + p.p[1]) * t.y() + p.p[0] + t.x() * res;
 
-      d.set(0);
+          *y = res;
+        }
 
-      d.x() = (3.0 * p.p[12+3] * t.x() + 2.0 * p.p[8+3]) * t.x() + p.p[4+3];
-      d.x() = (3.0 * p.p[12+2] * t.x() + 2.0 * p.p[8+2]) * t.x() + p.p[4+2] + t.y() * d.x();
-      d.x() = (3.0 * p.p[12+1] * t.x() + 2.0 * p.p[8+1]) * t.x() + p.p[4+1] + t.y() * d.x();
-      d.x() = (3.0 * p.p[12+0] * t.x() + 2.0 * p.p[8+0]) * t.x() + p.p[4+0] + t.y() * d.x();
-      d.x() /= _step.x();
-
-      d.y() = (3.0 * p.p[12+3] * t.y() + 2.0 * p.p[12+2]) * t.y() + p.p[12+1];
-      d.y() = (3.0 * p.p[8+3] * t.y() + 2.0 * p.p[8+2]) * t.y() + p.p[8+1] + t.x() * d.y();
-      d.y() = (3.0 * p.p[4+3] * t.y() + 2.0 * p.p[4+2]) * t.y() + p.p[4+1] + t.x() * d.y();
-      d.y() = (3.0 * p.p[0+3] * t.y() + 2.0 * p.p[0+2]) * t.y() + p.p[0+1] + t.x() * d.y();
-      d.y() /= _step.y();
+      if (d)
+        {
+          d->x() = (3.0 * p.p[12+3] * t.x() + 2.0 * p.p[8+3]) * t.x() + p.p[4+3];
+          d->x() = (3.0 * p.p[12+2] * t.x() + 2.0 * p.p[8+2]) * t.x() + p.p[4+2] + t.y() * d->x();
+          d->x() = (3.0 * p.p[12+1] * t.x() + 2.0 * p.p[8+1]) * t.x() + p.p[4+1] + t.y() * d->x();
+          d->x() = (3.0 * p.p[12+0] * t.x() + 2.0 * p.p[8+0]) * t.x() + p.p[4+0] + t.y() * d->x();
+          d->x() /= _step.x();
+
+          d->y() = (3.0 * p.p[12+3] * t.y() + 2.0 * p.p[12+2]) * t.y() + p.p[12+1];
+          d->y() = (3.0 * p.p[8+3] * t.y() + 2.0 * p.p[8+2]) * t.y() + p.p[8+1] + t.x() * d->y();
+          d->y() = (3.0 * p.p[4+3] * t.y() + 2.0 * p.p[4+2]) * t.y() + p.p[4+1] + t.x() * d->y();
+          d->y() = (3.0 * p.p[0+3] * t.y() + 2.0 * p.p[0+2]) * t.y() + p.p[0+1] + t.x() * d->y();
+          d->y() /= _step.y();
+        }
     }
 
     // **********************************************************************
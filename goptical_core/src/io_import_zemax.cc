@@ -36,6 +36,7 @@
 #include <Goptical/Curve/Sphere>
 #include <Goptical/Curve/Conic>
 #include <Goptical/Curve/Parabola>
+#include <Goptical/Curve/Asphere>
 
 #include <Goptical/Sys/System>
 #include <Goptical/Sys/Image>
@@ -59,6 +60,7 @@
 #include <fstream>
 #include <cstdio>
 #include <cstdlib>
+#include <cmath>
 #include <string.h>
 
 #include <iostream>
@@ -94,6 +96,8 @@ namespace _Goptical {
       {
         zs_none,
         zs_standard,
+        zs_evenasph,
+        zs_oddasph,
         zs_coordbrk
       };
 
@@ -147,6 +151,9 @@ namespace _Goptical {
           thick(0.0)
       {
         ap_params[0] = ap_params[1] = 0.0;
+
+        for (unsigned int i = 0; i < 13; i++)
+          params[i] = 0.0;
       }
     };
 
@@ -373,6 +380,10 @@ namespace _Goptical {
 
                       if      (!strcasecmp(typestr, "standard"))
                         surface.type = zs_standard;
+                      else if (!strcasecmp(typestr, "evenasph"))
+                        surface.type = zs_evenasph;
+                      else if (!strcasecmp(typestr, "oddasphe"))
+                        surface.type = zs_oddasph;
                       else if (!strcasecmp(typestr, "coordbrk"))
                         surface.type = zs_coordbrk;
                       else
@@ -388,7 +399,9 @@ namespace _Goptical {
 
                       switch (surface.type)
                         {
-                        case zs_standard: {
+                        case zs_standard:
+                        case zs_evenasph:
+                        case zs_oddasph: {
                           double curv = std::atof(buf);
                           surface.roc = curv == 0.0 ? 0.0 : 1.0 / curv;
                           break;
@@ -616,6 +629,34 @@ namespace _Goptical {
               ZMX_WARN("surface has unknown type");
               continue;
 
+            case zs_evenasph:
+            case zs_oddasph: {
+              // PARM 1 to 8 are coefficients of r^2 to r^16 terms
+              // for even asphere and r^1 to r^8 terms for odd asphere
+              unsigned int step = surf.type == zs_evenasph ? 2 : 1;
+              ref<Curve::Asphere> a;
+
+              for (unsigned int j = 1; j <= 8; j++)
+                {
+                  if (surf.params[j] == 0.0)
+                    continue;
+
+                  if (!a.valid())
+                    a = GOPTICAL_REFNEW(Curve::Asphere, unit_factor * surf.roc, surf.coni);
+
+                  // coefficients are expressed in lens units
+                  unsigned int n = j * step;
+                  a->set_coefficient(n, surf.params[j] * pow(unit_factor, 1.0 - n));
+                }
+
+              if (a.valid())
+                {
+                  curve = a;
+                  break;
+                }
+            }
+
+            // no polynomial term, same as standard surface
             case zs_standard:
               if (surf.roc == 0.0)
                 curve = Curve::flat;
@@ -0,0 +1,325 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+
+#ifndef GOPTICAL_MATH_SIMD_HXX_
+#define GOPTICAL_MATH_SIMD_HXX_
+
+/*
+  Lane types used by batch ray/curve intersection kernels.
+
+  Kernels are written once as templates over a lane type T. The
+  packed double type processes GOPTICAL_SIMD_WIDTH rays at once
+  with AVX or SSE2 instructions when available and the plain double
+  instance is used for remaining rays. Operations are performed in
+  the same order as in scalar code so that results do not depend on
+  the instruction set in use.
+*/
+
+#include <cmath>
+
+#if defined(__AVX__)
+# include <immintrin.h>
+# define GOPTICAL_SIMD_WIDTH 4
+#elif defined(__SSE2__)
+# include <emmintrin.h>
+# define GOPTICAL_SIMD_WIDTH 2
+#endif
+
+namespace _Goptical {
+
+  namespace Math {
+
+    template <class T> struct simd_traits;
+
+    template <>
+    struct simd_traits<double>
+    {
+      typedef bool mask_t;
+
+      static inline double load(const double *p)
+      {
+        return *p;
+      }
+
+      static inline void store(double *p, double v)
+      {
+        *p = v;
+      }
+
+      static inline mask_t load_mask(const char *m)
+      {
+        return *m != 0;
+      }
+
+      static inline void store_mask(char *m, mask_t v)
+      {
+        *m = v;
+      }
+    };
+
+    static inline double simd_sqrt(double a)
+    {
+      return sqrt(a);
+    }
+
+    static inline double simd_select(bool m, double a, double b)
+    {
+      return m ? a : b;
+    }
+
+#ifdef GOPTICAL_SIMD_WIDTH
+
+# if GOPTICAL_SIMD_WIDTH == 4
+    typedef __m256d simd_reg_t;
+#  define GOPTICAL_SIMD_OP(op) _mm256_##op
+#  define GOPTICAL_SIMD_CMP(name, a, b, p) _mm256_cmp_pd(a, b, p)
+# else
+    typedef __m128d simd_reg_t;
+#  define GOPTICAL_SIMD_OP(op) _mm_##op
+#  define GOPTICAL_SIMD_CMP(name, a, b, p) _mm_##name##_pd(a, b)
+# endif
+
+    /** packed lanes comparison result, all bits set when true */
+    struct simd_mask
+    {
+      inline simd_mask(simd_reg_t r) : _r(r) {}
+
+      inline simd_mask operator&(const simd_mask &m) const
+      {
+        return GOPTICAL_SIMD_OP(and_pd)(_r, m._r);
+      }
+
+      inline simd_mask operator|(const simd_mask &m) const
+      {
+        return GOPTICAL_SIMD_OP(or_pd)(_r, m._r);
+      }
+
+      inline simd_mask operator!() const
+      {
+        simd_reg_t z = GOPTICAL_SIMD_OP(setzero_pd)();
+
+        return GOPTICAL_SIMD_OP(andnot_pd)(_r, GOPTICAL_SIMD_CMP(cmpeq, z, z, _CMP_EQ_OQ));
+      }
+
+      simd_reg_t _r;
+    };
+
+    /** packed double lanes */
+    struct simd_double
+    {
+      inline simd_double(simd_reg_t r) : _r(r) {}
+      inline simd_double(double v) : _r(GOPTICAL_SIMD_OP(set1_pd)(v)) {}
+
+      inline simd_double operator+(const simd_double &v) const
+      {
+        return GOPTICAL_SIMD_OP(add_pd)(_r, v._r);
+      }
+
+      inline simd_double operator-(const simd_double &v) const
+      {
+        return GOPTICAL_SIMD_OP(sub_pd)(_r, v._r);
+      }
+
+      inline simd_double operator*(const simd_double &v) const
+      {
+        return GOPTICAL_SIMD_OP(mul_pd)(_r, v._r);
+      }
+
+      inline simd_double operator/(const simd_double &v) const
+      {
+        return GOPTICAL_SIMD_OP(div_pd)(_r, v._r);
+      }
+
+      inline simd_double operator-() const
+      {
+        return GOPTICAL_SIMD_OP(xor_pd)(_r, GOPTICAL_SIMD_OP(set1_pd)(-0.0));
+      }
+
+      inline simd_mask operator<(const simd_double &v) const
+      {
+        return GOPTICAL_SIMD_CMP(cmplt, _r, v._r, _CMP_LT_OQ);
+      }
+
+      inline simd_mask operator<=(const simd_double &v) const
+      {
+        return GOPTICAL_SIMD_CMP(cmple, _r, v._r, _CMP_LE_OQ);
+      }
+
+      inline simd_mask operator>(const simd_double &v) const
+      {
+        return GOPTICAL_SIMD_CMP(cmpgt, _r, v._r, _CMP_GT_OQ);
+      }
+
+      inline simd_mask operator==(const simd_double &v) const
+      {
+        return GOPTICAL_SIMD_CMP(cmpeq, _r, v._r, _CMP_EQ_OQ);
+      }
+
+      simd_reg_t _r;
+    };
+
+    static inline simd_double simd_sqrt(const simd_double &a)
+    {
+      return GOPTICAL_SIMD_OP(sqrt_pd)(a._r);
+    }
+
+    static inline simd_double simd_select(const simd_mask &m, const simd_double &a,
+                                          const simd_double &b)
+    {
+      return GOPTICAL_SIMD_OP(or_pd)(GOPTICAL_SIMD_OP(and_pd)(m._r, a._r),
+                                     GOPTICAL_SIMD_OP(andnot_pd)(m._r, b._r));
+    }
+
+    template <>
+    struct simd_traits<simd_double>
+    {
+      typedef simd_mask mask_t;
+
+      static inline simd_double load(const double *p)
+      {
+        return GOPTICAL_SIMD_OP(loadu_pd)(p);
+      }
+
+      static inline void store(double *p, const simd_double &v)
+      {
+        GOPTICAL_SIMD_OP(storeu_pd)(p, v._r);
+      }
+
+      static inline mask_t load_mask(const char *m)
+      {
+# if GOPTICAL_SIMD_WIDTH == 4
+        simd_double v = _mm256_set_pd(m[3], m[2], m[1], m[0]);
+# else
+        simd_double v = _mm_set_pd(m[1], m[0]);
+# endif
+        return !(v == simd_double(0.0));
+      }
+
+      static inline void store_mask(char *m, const mask_t &v)
+      {
+        int bits = GOPTICAL_SIMD_OP(movemask_pd)(v._r);
+
+        for (unsigned int i = 0; i < GOPTICAL_SIMD_WIDTH; i++)
+          m[i] = (bits >> i) & 1;
+      }
+    };
+
+# undef GOPTICAL_SIMD_CMP
+# undef GOPTICAL_SIMD_OP
+
+#endif
+
+    /** Run a curve intersection kernel on a batch of rays. The
+        kernel functor must provide a template operator() which
+        computes intersection points from ray origins and directions
+        and returns a mask of lanes which hit the curve. */
+    template <class K>
+    void simd_intersect_batch(const K &kernel, unsigned int count, char *mask,
+                              double * const point[3],
+                              const double * const origin[3],
+                              const double * const direction[3])
+    {
+      unsigned int i = 0;
+
+#ifdef GOPTICAL_SIMD_WIDTH
+      typedef simd_traits<simd_double> v;
+
+      for (; i + GOPTICAL_SIMD_WIDTH <= count; i += GOPTICAL_SIMD_WIDTH)
+        {
+          const simd_double o[3] = { v::load(origin[0] + i), v::load(origin[1] + i),
+                                     v::load(origin[2] + i) };
+          const simd_double d[3] = { v::load(direction[0] + i), v::load(direction[1] + i),
+                                     v::load(direction[2] + i) };
+          simd_double p[3] = { 0.0, 0.0, 0.0 };
+
+          v::mask_t m = kernel(p, o, d);
+
+          for (unsigned int j = 0; j < 3; j++)
+            v::store(point[j] + i, p[j]);
+
+          v::store_mask(mask + i, m & v::load_mask(mask + i));
+        }
+#endif
+
+      for (; i < count; i++)
+        {
+          if (!mask[i])
+            continue;
+
+          const double o[3] = { origin[0][i], origin[1][i], origin[2][i] };
+          const double d[3] = { direction[0][i], direction[1][i], direction[2][i] };
+          double p[3];
+
+          mask[i] = kernel(p, o, d);
+
+          for (unsigned int j = 0; j < 3; j++)
+            point[j][i] = p[j];
+        }
+    }
+
+    /** Run a curve normal kernel on a batch of intersection points. */
+    template <class K>
+    void simd_normal_batch(const K &kernel, unsigned int count, const char *mask,
+                           double * const normal[3], const double * const point[3])
+    {
+      unsigned int i = 0;
+
+#ifdef GOPTICAL_SIMD_WIDTH
+      typedef simd_traits<simd_double> v;
+
+      for (; i + GOPTICAL_SIMD_WIDTH <= count; i += GOPTICAL_SIMD_WIDTH)
+        {
+          const simd_double p[3] = { v::load(point[0] + i), v::load(point[1] + i),
+                                     v::load(point[2] + i) };
+          simd_double n[3] = { 0.0, 0.0, 0.0 };
+
+          kernel(n, p);
+
+          for (unsigned int j = 0; j < 3; j++)
+            v::store(normal[j] + i, n[j]);
+        }
+#endif
+
+      for (; i < count; i++)
+        {
+          if (!mask[i])
+            continue;
+
+          const double p[3] = { point[0][i], point[1][i], point[2][i] };
+          double n[3];
+
+          kernel(n, p);
+
+          for (unsigned int j = 0; j < 3; j++)
+            normal[j][i] = n[j];
+        }
+    }
+
+  }
+
+}
+
+#endif
+
@@ -0,0 +1,860 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <gsl/gsl_linalg.h>
+
+#include <Goptical/common.hh>
+
+#ifdef GOPTICAL_HAVE_PTHREAD
+# include <pthread.h>
+#endif
+
+#include <Goptical/Optim/Optimizer>
+
+#include <Goptical/Analysis/Spot>
+#include <Goptical/Analysis/Focus>
+#include <Goptical/Analysis/Paraxial>
+
+#include "sys_replica_.hxx"
+
+namespace _Goptical
+{
+
+  namespace Optim
+  {
+
+    /** Per thread replica of the sequence elements. Curves of
+        surfaces with radius or Schwarzschild variables are owned by
+        the replica. */
+    struct Optimizer::worker_s : public ref_base<worker_s>
+    {
+      worker_s(const Optimizer &o);
+      ~worker_s();
+
+      Sys::replica_s    _replica;
+      /** owned curves, indexed by sequence index */
+      std::vector<ref<Curve::ConicBase> > _curves;
+      /** variables values currently applied to replica */
+      std::vector<double> _applied;
+      /** translation of elements currently applied to replica */
+      std::vector<Math::Vector3> _shift;
+      Sys::Image        *_image;
+      Analysis::Spot    *_spot;
+      Analysis::Focus   *_focus;
+      Analysis::Paraxial *_paraxial;
+
+      Optimizer         *_opt;
+      /** Jacobian evaluation point and residuals */
+      const std::vector<double> *_x;
+      const std::vector<double> *_r;
+      /** column major Jacobian */
+      std::vector<double> *_jac;
+      unsigned int      _first;
+      unsigned int      _last;
+      std::string       _error;
+    };
+
+    Optimizer::worker_s::worker_s(const Optimizer &o)
+      : _replica(o._system),
+        _curves(_replica._elements.size()),
+        _applied(o._variables.size()),
+        _shift(_replica._elements.size(), Math::vector3_0),
+        _image(static_cast<Sys::Image*>(_replica.find(*o._image))),
+        _spot(0),
+        _focus(0),
+        _paraxial(0),
+        _opt(0),
+        _x(0),
+        _r(0),
+        _jac(0),
+        _first(0),
+        _last(0)
+    {
+      for (unsigned int k = 0; k < o._variables.size(); k++)
+        {
+          const variable_s &v = o._variables[k];
+
+          _applied[k] = v._nominal;
+
+          if (v._var == Thickness || _curves[v._index].valid())
+            continue;
+
+          bool conic = false;
+
+          GOPTICAL_FOREACH(u, o._variables)
+            conic |= u->_index == v._index && u->_var == Schwarzschild;
+
+          _curves[v._index] = _replica.own_curve(v._index, conic);
+        }
+
+      // reuse rays of elements located before modified variables
+      _replica._system.get_tracer_params().set_incremental_mode(true);
+
+      // analysis tracer copies system parameters on construction
+      GOPTICAL_FOREACH(t, o._targets)
+        {
+          switch (t->_target)
+            {
+            case SpotRmsRadius:
+            case SpotCentroidX:
+            case SpotCentroidY:
+              if (!_spot)
+                {
+                  _spot = new Analysis::Spot(_replica._system);
+                  _spot->set_image(_image);
+                }
+              break;
+
+            case FocusShift:
+              if (!_focus)
+                {
+                  _focus = new Analysis::Focus(_replica._system);
+                  _focus->set_image(_image);
+                }
+              break;
+
+            case EffectiveFocalLength:
+              if (!_paraxial)
+                {
+                  _paraxial = new Analysis::Paraxial(_replica._system);
+                  _paraxial->set_image(*_image);
+                }
+              break;
+            }
+        }
+    }
+
+    Optimizer::worker_s::~worker_s()
+    {
+      delete _spot;
+      delete _focus;
+      delete _paraxial;
+    }
+
+    Optimizer::Optimizer(Sys::System &system)
+      : _system(system),
+        _image(0),
+        _thread_count(system.get_tracer_params().get_thread_count()),
+        _max_iterations(20),
+        _damping(1e-3),
+        _tolerance(1e-6),
+        _iterations(0),
+        _residual_count(0),
+        _variables(),
+        _targets(),
+        _workers(),
+        _columns()
+    {
+      if (!system.get_tracer_params().is_sequential())
+        throw Error("optimizer requires a system in sequential mode");
+    }
+
+    Optimizer::~Optimizer()
+    {
+    }
+
+    unsigned int Optimizer::add_variable(Sys::Element &element, variable_e var,
+                                         double step)
+    {
+      if (var != Thickness)
+        {
+          const Sys::Surface *s = dynamic_cast<const Sys::Surface*>(&element);
+
+          if (!s || !dynamic_cast<const Curve::ConicBase*>(&s->get_curve()))
+            throw Error("radius and Schwarzschild variables require a surface with conic curve");
+        }
+
+      GOPTICAL_FOREACH(v, _variables)
+        if (v->_element == &element && v->_var == var)
+          throw Error("variable already defined");
+
+      variable_s v;
+
+      v._element = &element;
+      v._var = var;
+      v._step = step;
+      v._min = -std::numeric_limits<double>::max();
+      v._max = std::numeric_limits<double>::max();
+      v._index = 0;
+      v._direction = Math::vector3_0;
+
+      init_variable(v);
+      v._value = v._nominal;
+
+      _variables.push_back(v);
+      return _variables.size() - 1;
+    }
+
+    void Optimizer::init_variable(variable_s &v) const
+    {
+      const Trace::Sequence &seq = _system.get_tracer_params().get_sequence();
+      unsigned int count = seq.get_element_count();
+      unsigned int i;
+
+      for (i = 0; i < count; i++)
+        if (&seq.get_element(i) == v._element)
+          break;
+
+      if (i == count)
+        throw Error("optimized element is not part of the sequence");
+
+      v._index = i;
+
+      switch (v._var)
+        {
+        case Radius:
+          v._nominal = static_cast<const Curve::ConicBase&>(
+            static_cast<const Sys::Surface*>(v._element)->get_curve()).get_roc();
+          break;
+
+        case Schwarzschild:
+          v._nominal = static_cast<const Curve::ConicBase&>(
+            static_cast<const Sys::Surface*>(v._element)->get_curve()).get_schwarzschild();
+          break;
+
+        case Thickness: {
+          if (i + 1 == count)
+            throw Error("thickness variable on last element of sequence");
+
+          Math::Vector3 d = seq.get_element(i + 1).get_position()
+            - v._element->get_position();
+
+          v._nominal = d.len();
+
+          if (v._nominal == 0.0)
+            throw Error("thickness variable on elements at same position");
+
+          v._direction = d / v._nominal;
+          break;
+        }
+        }
+    }
+
+    unsigned int Optimizer::add_target(target_e target, double value, double weight)
+    {
+      target_s t;
+
+      t._target = target;
+      t._value = value;
+      t._weight = weight;
+      t._offset = 0;
+      t._count = 0;
+
+      _targets.push_back(t);
+      return _targets.size() - 1;
+    }
+
+    void Optimizer::prepare()
+    {
+      const Trace::Params &params = _system.get_tracer_params();
+
+      if (!params.is_sequential())
+        throw Error("optimizer requires a system in sequential mode");
+
+      if (_targets.empty())
+        throw Error("no optimization target defined");
+
+      const Trace::Sequence &seq = params.get_sequence();
+      unsigned int count = seq.get_element_count();
+
+      // default to last image of sequence
+      const Sys::Image *image = _image;
+
+      for (unsigned int i = count; !image && i-- > 0; )
+        image = dynamic_cast<const Sys::Image*>(&seq.get_element(i));
+
+      if (!image)
+        throw Error("no image found for optimization");
+
+      _image = image;
+
+      bool found = false;
+
+      for (unsigned int i = 0; i < count; i++)
+        if (&seq.get_element(i) == _image)
+          found = true;
+
+      if (!found)
+        throw Error("optimization image is not part of the sequence");
+
+      GOPTICAL_FOREACH(v, _variables)
+        {
+          init_variable(*v);
+          v->_value = v->_nominal;
+        }
+
+      // evaluate Jacobian columns from last to first modified
+      // element so that each replica trace restarts at the element
+      // of the perturbed variable
+      std::vector<std::pair<unsigned int, unsigned int> > order;
+
+      for (unsigned int k = 0; k < _variables.size(); k++)
+        {
+          const variable_s &v = _variables[k];
+
+          order.push_back(std::make_pair(v._index + (v._var == Thickness), k));
+        }
+
+      std::sort(order.rbegin(), order.rend());
+
+      _columns.clear();
+      GOPTICAL_FOREACH(o, order)
+        _columns.push_back(o->second);
+
+      Sys::replica_s::prepare_shared(_system);
+
+      unsigned int wcount = std::max(1U, std::min(_thread_count,
+                                                  (unsigned int)_variables.size()));
+
+      // replicas are built in main thread, shared objects reference
+      // counters are not updated concurrently
+      _workers.resize(wcount);
+
+      for (unsigned int i = 0; i < wcount; i++)
+        {
+          _workers[i] = GOPTICAL_REFNEW(worker_s, *this);
+          _workers[i]->_opt = this;
+        }
+    }
+
+    void Optimizer::apply(worker_s &w, const std::vector<double> &x) const
+    {
+      Sys::replica_s &r = w._replica;
+      bool moved = false;
+
+      for (unsigned int k = 0; k < _variables.size(); k++)
+        {
+          const variable_s &v = _variables[k];
+
+          if (x[k] == w._applied[k])
+            continue;
+
+          w._applied[k] = x[k];
+
+          switch (v._var)
+            {
+            case Radius:
+              w._curves[v._index]->set_roc(x[k]);
+              // notify system of curve change
+              r.get<Sys::Surface>(v._index).set_curve(w._curves[v._index]);
+              break;
+
+            case Schwarzschild:
+              static_cast<Curve::Conic&>(*w._curves[v._index]).set_schwarzschild(x[k]);
+              r.get<Sys::Surface>(v._index).set_curve(w._curves[v._index]);
+              break;
+
+            case Thickness:
+              moved = true;
+              break;
+            }
+        }
+
+      if (!moved)
+        return;
+
+      std::vector<Math::Vector3> shift(w._shift.size(), Math::vector3_0);
+
+      for (unsigned int k = 0; k < _variables.size(); k++)
+        {
+          const variable_s &v = _variables[k];
+
+          if (v._var != Thickness)
+            continue;
+
+          for (unsigned int i = v._index + 1; i < shift.size(); i++)
+            shift[i] = shift[i] + v._direction * (x[k] - v._nominal);
+        }
+
+      // only move elements with changed position, rays of previous
+      // elements are kept by incremental trace
+      for (unsigned int i = 0; i < shift.size(); i++)
+        {
+          if (shift[i] == w._shift[i])
+            continue;
+
+          Math::Transform<3> t(r.get_nominal(i).get_global_transform());
+
+          t.apply_translation(shift[i]);
+          r._elements[i]->set_transform(t);
+          w._shift[i] = shift[i];
+        }
+    }
+
+    bool Optimizer::residuals(worker_s &w, const std::vector<double> &x,
+                              std::vector<double> &r) const
+    {
+      apply(w, x);
+
+      if (w._spot)
+        w._spot->invalidate();
+      if (w._focus)
+        w._focus->invalidate();
+      if (w._paraxial)
+        w._paraxial->invalidate();
+
+      r.resize(_residual_count);
+
+      try {
+        GOPTICAL_FOREACH(t, _targets)
+          {
+            double *ri = &r[t->_offset];
+
+            switch (t->_target)
+              {
+              case SpotRmsRadius: {
+                // squared rms radius is the sum of squared distances
+                // of intercepts to centroid, one residual per
+                // coordinate of each ray
+                const Math::Vector3 &c = w._spot->get_centroid();
+                const Analysis::Spot &spot = *w._spot;
+                const Trace::rays_queue_t &rays =
+                  spot.get_tracer().get_trace_result().get_intercepted(*w._image);
+
+                if (rays.size() * 3 != t->_count)
+                  return false;
+
+                double k = t->_weight / sqrt(rays.size());
+
+                GOPTICAL_FOREACH(i, rays)
+                  {
+                    Math::Vector3 d = (*i)->get_intercept_point() - c;
+
+                    for (unsigned int j = 0; j < 3; j++)
+                      *ri++ = d[j] * k;
+                  }
+                break;
+              }
+
+              case SpotCentroidX:
+                *ri = (w._spot->get_centroid().x() - t->_value) * t->_weight;
+                break;
+
+              case SpotCentroidY:
+                *ri = (w._spot->get_centroid().y() - t->_value) * t->_weight;
+                break;
+
+              case FocusShift:
+                *ri = (w._image->get_transform_from(0).transform(
+                         w._focus->get_best_focus().origin()).z() - t->_value) * t->_weight;
+                break;
+
+              case EffectiveFocalLength:
+                *ri = (w._paraxial->get_effective_focal_length() - t->_value) * t->_weight;
+                break;
+              }
+          }
+      } catch (const Error &) {
+        return false;
+      }
+
+      GOPTICAL_FOREACH(i, r)
+        if (!std::isfinite(*i))
+          return false;
+
+      return true;
+    }
+
+    void Optimizer::init_residuals(worker_s &w)
+    {
+      _residual_count = 0;
+
+      GOPTICAL_FOREACH(t, _targets)
+        {
+          t->_offset = _residual_count;
+
+          switch (t->_target)
+            {
+            case SpotRmsRadius:
+              try {
+                const Analysis::Spot &spot = *w._spot;
+
+                w._spot->get_centroid();
+                t->_count = spot.get_tracer().get_trace_result()
+                  .get_intercepted(*w._image).size() * 3;
+              } catch (const Error &) {
+                t->_count = 0;
+              }
+
+              if (!t->_count)
+                throw Error("no ray reach image on initial system");
+              break;
+
+            default:
+              t->_count = 1;
+              break;
+            }
+
+          _residual_count += t->_count;
+        }
+    }
+
+    void Optimizer::run_worker(worker_s &w)
+    {
+      unsigned int m = _residual_count;
+      std::vector<double> x(*w._x);
+      std::vector<double> r;
+
+      for (unsigned int c = w._first; c < w._last; c++)
+        {
+          unsigned int k = _columns[c];
+          const variable_s &v = _variables[k];
+          double h = v._step != 0.0 ? v._step : 1e-6 * std::max(fabs(x[k]), 1.0);
+
+          // step toward allowed range
+          if (x[k] + h > v._max)
+            h = -h;
+
+          x[k] = (*w._x)[k] + h;
+
+          if (!residuals(w, x, r))
+            throw Error("merit function evaluation failed while computing Jacobian");
+
+          x[k] = (*w._x)[k];
+
+          for (unsigned int i = 0; i < m; i++)
+            (*w._jac)[k * m + i] = (r[i] - (*w._r)[i]) / h;
+        }
+    }
+
+    void * Optimizer::worker_entry(void *w_)
+    {
+      worker_s &w = *static_cast<worker_s *>(w_);
+
+      try {
+        w._opt->run_worker(w);
+      } catch (const std::exception &e) {
+        w._error = e.what();
+      }
+
+      return 0;
+    }
+
+    void Optimizer::jacobian(const std::vector<double> &x, const std::vector<double> &r,
+                             std::vector<double> &jac)
+    {
+      unsigned int n = _variables.size();
+      unsigned int count = _workers.size();
+
+      jac.resize(n * _residual_count);
+
+      // split columns in contiguous ranges to keep evaluation order
+      for (unsigned int i = 0; i < count; i++)
+        {
+          worker_s &w = *_workers[i];
+
+          w._x = &x;
+          w._r = &r;
+          w._jac = &jac;
+          w._first = n * i / count;
+          w._last = n * (i + 1) / count;
+          w._error.clear();
+        }
+
+#ifdef GOPTICAL_HAVE_PTHREAD
+      std::vector<pthread_t> threads(count);
+      std::vector<bool> started(count, false);
+
+      for (unsigned int i = 1; i < count; i++)
+        started[i] = !pthread_create(&threads[i], 0, &worker_entry, _workers[i].ptr());
+
+      worker_entry(_workers[0].ptr());
+
+      for (unsigned int i = 1; i < count; i++)
+        {
+          if (started[i])
+            pthread_join(threads[i], 0);
+          else
+            worker_entry(_workers[i].ptr());
+        }
+#else
+      for (unsigned int i = 0; i < count; i++)
+        worker_entry(_workers[i].ptr());
+#endif
+
+      for (unsigned int i = 0; i < count; i++)
+        if (!_workers[i]->_error.empty())
+          throw Error(_workers[i]->_error);
+    }
+
+    static double merit(const std::vector<double> &r)
+    {
+      double m = 0.0;
+
+      GOPTICAL_FOREACH(i, r)
+        m += *i * *i;
+
+      return m;
+    }
+
+    double Optimizer::get_merit()
+    {
+      prepare();
+
+      std::vector<double> x(_variables.size());
+      std::vector<double> r;
+
+      for (unsigned int k = 0; k < x.size(); k++)
+        x[k] = _variables[k]._nominal;
+
+      init_residuals(*_workers[0]);
+
+      bool ok = residuals(*_workers[0], x, r);
+
+      _workers.clear();
+
+      if (!ok)
+        throw Error("merit function can not be evaluated");
+
+      return merit(r);
+    }
+
+    double Optimizer::optimize()
+    {
+      prepare();
+
+      unsigned int n = _variables.size();
+      std::vector<double> x(n), xn(n);
+      std::vector<double> r, rn, jac;
+
+      for (unsigned int k = 0; k < n; k++)
+        x[k] = _variables[k]._nominal;
+
+      worker_s &w0 = *_workers[0];
+
+      try {
+        init_residuals(w0);
+      } catch (...) {
+        _workers.clear();
+        throw;
+      }
+
+      if (!residuals(w0, x, r))
+        {
+          _workers.clear();
+          throw Error("merit function can not be evaluated");
+        }
+
+      double m = merit(r);
+      double lambda = _damping;
+
+      gsl_matrix *a = gsl_matrix_alloc(n, n);
+      gsl_vector *b = gsl_vector_alloc(n);
+      gsl_vector *d = gsl_vector_alloc(n);
+      gsl_permutation *perm = gsl_permutation_alloc(n);
+
+      std::vector<double> jtj(n * n);
+      std::vector<double> jtr(n);
+      std::vector<bool> fixed(n);
+      unsigned int mcount = _residual_count;
+
+      try {
+        for (_iterations = 0; n && _iterations < _max_iterations && m > 0.0; )
+          {
+            _iterations++;
+
+            jacobian(x, r, jac);
+
+            // normal equations
+            for (unsigned int i = 0; i < n; i++)
+              {
+                double s = 0.0;
+
+                for (unsigned int k = 0; k < mcount; k++)
+                  s += jac[i * mcount + k] * r[k];
+
+                jtr[i] = s;
+
+                for (unsigned int j = 0; j <= i; j++)
+                  {
+                    double s = 0.0;
+
+                    for (unsigned int k = 0; k < mcount; k++)
+                      s += jac[i * mcount + k] * jac[j * mcount + k];
+
+                    jtj[i * n + j] = jtj[j * n + i] = s;
+                  }
+              }
+
+            // variables on range bound which would move outward are
+            // kept fixed during this iteration
+            for (unsigned int i = 0; i < n; i++)
+              {
+                const variable_s &v = _variables[i];
+
+                fixed[i] = (x[i] >= v._max && jtr[i] < 0.0) ||
+                           (x[i] <= v._min && jtr[i] > 0.0);
+              }
+
+            bool improved = false;
+            double mn = m;
+
+            for (; lambda < 1e10; lambda *= 10.0)
+              {
+                for (unsigned int i = 0; i < n; i++)
+                  {
+                    for (unsigned int j = 0; j < n; j++)
+                      gsl_matrix_set(a, i, j, fixed[i] || fixed[j] ? 0.0 : jtj[i * n + j]);
+
+                    // Marquardt scaling, plain damping for insensitive variables
+                    double diag = jtj[i * n + i];
+                    gsl_matrix_set(a, i, i, fixed[i] ? 1.0 : diag + lambda * (diag > 0.0 ? diag : 1.0));
+                    gsl_vector_set(b, i, fixed[i] ? 0.0 : -jtr[i]);
+                  }
+
+                int signum;
+                gsl_linalg_LU_decomp(a, perm, &signum);
+                gsl_linalg_LU_solve(a, perm, b, d);
+
+                for (unsigned int k = 0; k < n; k++)
+                  {
+                    const variable_s &v = _variables[k];
+
+                    xn[k] = std::max(v._min, std::min(v._max, x[k] + gsl_vector_get(d, k)));
+                  }
+
+                if (residuals(w0, xn, rn) && (mn = merit(rn)) < m)
+                  {
+                    improved = true;
+                    lambda = std::max(lambda / 10.0, 1e-12);
+                    break;
+                  }
+              }
+
+            if (!improved)
+              break;
+
+            double gain = (m - mn) / m;
+
+            x.swap(xn);
+            r.swap(rn);
+            m = mn;
+
+            if (gain < _tolerance)
+              break;
+          }
+      } catch (...) {
+        gsl_permutation_free(perm);
+        gsl_vector_free(d);
+        gsl_vector_free(b);
+        gsl_matrix_free(a);
+        _workers.clear();
+        throw;
+      }
+
+      gsl_permutation_free(perm);
+      gsl_vector_free(d);
+      gsl_vector_free(b);
+      gsl_matrix_free(a);
+
+      // replicas share curves which may be replaced below
+      _workers.clear();
+
+      update_system(x);
+
+      return m;
+    }
+
+    void Optimizer::update_system(const std::vector<double> &x)
+    {
+      const Trace::Sequence &seq = _system.get_tracer_params().get_sequence();
+      unsigned int count = seq.get_element_count();
+      std::vector<Math::Vector3> shift(count, Math::vector3_0);
+
+      for (unsigned int k = 0; k < _variables.size(); k++)
+        {
+          variable_s &v = _variables[k];
+
+          v._value = x[k];
+
+          switch (v._var)
+            {
+            case Radius:
+            case Schwarzschild: {
+              Sys::Surface &s = static_cast<Sys::Surface&>(*v._element);
+              const Curve::ConicBase &c = static_cast<const Curve::ConicBase&>(s.get_curve());
+              double roc = c.get_roc();
+              double sc = c.get_schwarzschild();
+              bool conic = !dynamic_cast<const Curve::Sphere*>(&c);
+
+              // both variables of a surface are handled at once
+              bool done = false;
+
+              for (unsigned int j = 0; j < k; j++)
+                done |= _variables[j]._element == v._element;
+
+              if (done)
+                break;
+
+              for (unsigned int j = k; j < _variables.size(); j++)
+                if (_variables[j]._element == v._element)
+                  {
+                    if (_variables[j]._var == Radius)
+                      roc = x[j];
+                    else if (_variables[j]._var == Schwarzschild)
+                      {
+                        sc = x[j];
+                        conic = true;
+                      }
+                  }
+
+              if (conic)
+                s.set_curve(GOPTICAL_REFNEW(Curve::Conic, roc, sc));
+              else
+                s.set_curve(GOPTICAL_REFNEW(Curve::Sphere, roc));
+              break;
+            }
+
+            case Thickness:
+              for (unsigned int i = v._index + 1; i < count; i++)
+                shift[i] = shift[i] + v._direction * (x[k] - v._nominal);
+              break;
+            }
+        }
+
+      for (unsigned int i = 0; i < count; i++)
+        {
+          if (shift[i] == Math::vector3_0)
+            continue;
+
+          // sequence elements belong to the optimized system
+          Sys::Element &e = const_cast<Sys::Element&>(seq.get_element(i));
+
+          e.set_position(e.get_position() + shift[i]);
+        }
+
+      GOPTICAL_FOREACH(v, _variables)
+        v->_nominal = v->_value;
+    }
+
+  }
+
+}
+
@@ -22,7 +22,9 @@
 
 */
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <limits>
 
 #include <Goptical/Shape/Polygon>
@@ -40,15 +42,43 @@ namespace _Goptical {
         _vertices(),
         _bbox(Math::vector2_pair_00),
         _max_radius(0),
-        _min_radius(1e100)
+        _min_radius(1e100),
+        _grid_size(0),
+        _grid_scale(Math::vector2_0),
+        _cells(),
+        _row_first(),
+        _row_edges()
     {
     }
 
-    inline void Polygon::update()
+    /* cell grid extent margin, in cell units */
+    static const double grid_margin = 1e-4;
+
+    /* Algorithm from http://local.wasp.uwa.edu.au/~pbourke/geometry/insidepoly/ */
+    static inline bool crossing(const Math::Vector2 &p, const Math::Vector2 *v,
+                                const Math::Vector2 *w)
+    {
+      return (((v->y() <= p.y()) && (p.y() < w->y())) || ((w->y() <= p.y()) && (p.y() < v->y()))) &&
+        (p.x() < (w->x() - v->x()) * (p.y() - v->y()) / (w->y() - v->y()) + v->x());
+    }
+
+    inline unsigned int Polygon::grid_index(double u) const
+    {
+      if (!(u > 0))
+        return 0;
+      if (u >= _grid_size)
+        return _grid_size - 1;
+      return (unsigned int)u;
+    }
+
+    void Polygon::update()
     {
       size_t s = _vertices.size();
+
+      // shape is not usable until it has enough vertices
+      _updated = false;
       if (s < 3)
-        throw Error("Polygon shape has less than 3 vertices");
+        return;
 
       _max_radius = 0;
       _min_radius = std::numeric_limits<double>::max();
@@ -77,24 +107,140 @@ namespace _Goptical {
             {
               if ((*cur)[i] < _bbox[0][i])
                 _bbox[0][i] = (*cur)[i];
-              else if ((*cur)[i] > _bbox[1][i])
+              if ((*cur)[i] > _bbox[1][i])
                 _bbox[1][i] = (*cur)[i];
             }
 
           prev = cur;
         }
+
+      update_grid();
+      _updated = true;
+    }
+
+    void Polygon::update_grid()
+    {
+      unsigned int s = _vertices.size();
+      unsigned int n = std::min(std::max((unsigned int)ceil(2. * sqrt((double)s)), 1U), 256U);
+
+      _grid_size = n;
+
+      for (unsigned int i = 0; i < 2; i++)
+        {
+          double w = _bbox[1][i] - _bbox[0][i];
+          _grid_scale[i] = w > 0 ? n / w : 0;
+        }
+
+      const Math::Vector2 &o = _bbox[0];
+
+      // find grid rows spanned by each edge
+      std::vector<unsigned int> row_span(s * 2);
+      const Math::Vector2 *w = &_vertices[s - 1];
+
+      for (unsigned int i = 0; i < s; i++)
+        {
+          const Math::Vector2 *v = &_vertices[i];
+          double y0 = (std::min(v->y(), w->y()) - o.y()) * _grid_scale.y();
+          double y1 = (std::max(v->y(), w->y()) - o.y()) * _grid_scale.y();
+
+          row_span[i * 2] = grid_index(y0 - grid_margin);
+          row_span[i * 2 + 1] = grid_index(y1 + grid_margin);
+          w = v;
+        }
+
+      // build per row edges lists
+      _row_first.assign(n + 1, 0);
+
+      for (unsigned int i = 0; i < s; i++)
+        for (unsigned int r = row_span[i * 2]; r <= row_span[i * 2 + 1]; r++)
+          _row_first[r + 1]++;
+
+      for (unsigned int r = 0; r < n; r++)
+        _row_first[r + 1] += _row_first[r];
+
+      _row_edges.resize(_row_first[n]);
+      std::vector<unsigned int> fill(_row_first.begin(), _row_first.end() - 1);
+
+      for (unsigned int i = 0; i < s; i++)
+        for (unsigned int r = row_span[i * 2]; r <= row_span[i * 2 + 1]; r++)
+          _row_edges[fill[r]++] = i;
+
+      // mark cells crossed by edges
+      _cells.assign(n * n, CellOutside);
+
+      for (unsigned int r = 0; r < n; r++)
+        {
+          double r0 = r - grid_margin;
+          double r1 = r + 1 + grid_margin;
+
+          for (unsigned int k = _row_first[r]; k < _row_first[r + 1]; k++)
+            {
+              unsigned int i = _row_edges[k];
+              const Math::Vector2 &v = _vertices[i];
+              const Math::Vector2 &w = _vertices[(i + s - 1) % s];
+
+              // clip edge to row band in grid coordinates
+              double ay = (w.y() - o.y()) * _grid_scale.y();
+              double by = (v.y() - o.y()) * _grid_scale.y();
+              double ax = (w.x() - o.x()) * _grid_scale.x();
+              double bx = (v.x() - o.x()) * _grid_scale.x();
+              double t0 = 0, t1 = 1;
+
+              if (by != ay)
+                {
+                  t0 = (r0 - ay) / (by - ay);
+                  t1 = (r1 - ay) / (by - ay);
+                  if (t0 > t1)
+                    std::swap(t0, t1);
+                  t0 = std::max(t0, 0.);
+                  t1 = std::min(t1, 1.);
+                }
+
+              double x0 = ax + (bx - ax) * t0;
+              double x1 = ax + (bx - ax) * t1;
+              if (x0 > x1)
+                std::swap(x0, x1);
+
+              unsigned int c1 = grid_index(x1 + grid_margin);
+              for (unsigned int c = grid_index(x0 - grid_margin); c <= c1; c++)
+                _cells[r * n + c] = CellEdge;
+            }
+
+          // classify remaining cells using their center point
+          for (unsigned int c = 0; c < n; c++)
+            {
+              unsigned char &cell = _cells[r * n + c];
+
+              if (cell == CellEdge)
+                continue;
+
+              Math::Vector2 p(o.x() + (c + .5) / _grid_scale.x(),
+                              o.y() + (r + .5) / _grid_scale.y());
+              unsigned int count = 0;
+
+              for (unsigned int k = _row_first[r]; k < _row_first[r + 1]; k++)
+                {
+                  unsigned int i = _row_edges[k];
+                  count += crossing(p, &_vertices[i], &_vertices[(i + s - 1) % s]);
+                }
+
+              cell = count & 1 ? CellInside : CellOutside;
+            }
+        }
     }
 
+    // cell grid is built here so that const queries never modify
+    // the shape, they may be used from several tracer threads
+
     void Polygon::insert_vertex(const Math::Vector2 &v, unsigned int id)
     {
-      _updated = false;
       assert(id <= _vertices.size());
       _vertices.insert(_vertices.begin() + id, v);
+      update();
     }
 
     unsigned int Polygon::add_vertex(const Math::Vector2 &v)
     {
-      _updated = false;
       unsigned int pos = _vertices.size();
       insert_vertex(v, pos);
       return pos;
@@ -102,31 +248,42 @@ namespace _Goptical {
 
     void Polygon::delete_vertex(unsigned int id)
     {
-      _updated = false;
       assert(id < _vertices.size());
       _vertices.erase(_vertices.begin() + id);
+      update();
     }
 
     bool Polygon::inside(const Math::Vector2 &p) const
     {
       unsigned int s = _vertices.size();
 
-      if (s < 3)
+      if (!_updated)
         return false;
 
-      unsigned int count = 0;
-      const Math::Vector2 *w = &_vertices[s - 1];
+      if (p.x() < _bbox[0].x() || p.x() > _bbox[1].x() ||
+          p.y() < _bbox[0].y() || p.y() > _bbox[1].y())
+        return false;
 
-      // FIXME optimize
-      for (unsigned int i = 0; i < s; i++)
+      unsigned int r = grid_index((p.y() - _bbox[0].y()) * _grid_scale.y());
+      unsigned int c = grid_index((p.x() - _bbox[0].x()) * _grid_scale.x());
+
+      switch (_cells[r * _grid_size + c])
         {
-          const Math::Vector2 *v = &_vertices[i];
+        case CellInside:
+          return true;
+        case CellOutside:
+          return false;
+        default:
+          break;
+        }
 
-          // Algorithm from http://local.wasp.uwa.edu.au/~pbourke/geometry/insidepoly/
-          if ((((v->y() <= p.y()) && (p.y() < w->y())) || ((w->y() <= p.y()) && (p.y() < v->y()))) &&
-              (p.x() < (w->x() - v->x()) * (p.y() - v->y()) / (w->y() - v->y()) + v->x()))
-            count++;
-          w = v;
+      // only edges crossing the point row need to be tested
+      unsigned int count = 0;
+
+      for (unsigned int k = _row_first[r]; k < _row_first[r + 1]; k++)
+        {
+          unsigned int i = _row_edges[k];
+          count += crossing(p, &_vertices[i], &_vertices[(i + s - 1) % s]);
         }
 
       return (count & 1) != 0;
@@ -154,28 +311,28 @@ namespace _Goptical {
     double Polygon::max_radius() const
     {
       if (!_updated)
-        const_cast<Polygon*>(this)->update();
+        throw Error("Polygon shape has less than 3 vertices");
       return _max_radius;
     }
 
     double Polygon::min_radius() const
     {
       if (!_updated)
-        const_cast<Polygon*>(this)->update();
+        throw Error("Polygon shape has less than 3 vertices");
       return _min_radius;
     }
 
     Math::VectorPair2 Polygon::get_bounding_box() const
     {
       if (!_updated)
-        const_cast<Polygon*>(this)->update();
+        throw Error("Polygon shape has less than 3 vertices");
       return _bbox;
     }
 
     double Polygon::get_outter_radius(const Math::Vector2 &dir) const
     {
       if (!_updated)
-        const_cast<Polygon*>(this)->update();
+        throw Error("Polygon shape has less than 3 vertices");
 
       double r = 0;
       unsigned int s = _vertices.size();
@@ -0,0 +1,500 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <typeinfo>
+
+#include <Goptical/Sys/CompiledSystem>
+#include <Goptical/Sys/System>
+#include <Goptical/Sys/Element>
+#include <Goptical/Sys/Surface>
+#include <Goptical/Sys/Source>
+#include <Goptical/Sys/OpticalSurface>
+#include <Goptical/Sys/Stop>
+#include <Goptical/Curve/Base>
+#include <Goptical/Curve/Flat>
+#include <Goptical/Curve/Sphere>
+#include <Goptical/Curve/Conic>
+#include <Goptical/Curve/Parabola>
+#include <Goptical/Shape/Base>
+#include <Goptical/Trace/Params>
+#include <Goptical/Trace/Sequence>
+#include <Goptical/Trace/Ray>
+#include <Goptical/Math/Vector>
+#include <Goptical/Error>
+
+namespace _Goptical {
+
+  namespace Sys {
+
+    CompiledSystem::CompiledSystem(const System &system, const Trace::Params &params)
+      : _system(&system)
+    {
+      compile(params);
+    }
+
+    CompiledSystem::CompiledSystem(const System &system)
+      : _system(&system)
+    {
+      compile(system.get_tracer_params());
+    }
+
+    void CompiledSystem::compile(const Trace::Params &params)
+    {
+      const System &system = *_system;
+
+      _version = system.get_version();
+      _count = system.get_element_count() + 1;
+      _sequential = params.is_sequential();
+      _seq_ptr = _sequential ? &params.get_sequence() : 0;
+      _seq_version = _sequential ? _seq_ptr->get_version() : 0;
+
+      // resolve elements
+      _elements.resize(_count);
+
+      for (unsigned int i = 0; i < _count; i++)
+        {
+          element_s &es = _elements[i];
+          const Element *e = system.has_element(i) ? &system.get_element(i) : 0;
+
+          es._element = e;
+          es._surface = dynamic_cast<const Surface *>(e);
+          es._source = dynamic_cast<const Source *>(e);
+          es._optical = dynamic_cast<const OpticalSurface *>(e);
+          es._curve = es._surface ? &es._surface->get_curve() : 0;
+          es._shape = es._surface ? &es._surface->get_shape() : 0;
+          es._material[0] = es._material[1] = 0;
+
+          if (es._optical)
+            {
+              es._material[0] = &es._optical->get_material(0);
+              es._material[1] = &es._optical->get_material(1);
+            }
+          else if (es._source)
+            {
+              es._material[0] = es._material[1] = &es._source->get_material();
+            }
+
+          // some curve and shape models update cached data on first access
+          if (es._surface)
+            {
+              Math::Vector2 dxdy;
+
+              es._curve->sagitta(Math::vector2_0);
+              es._curve->derivative(Math::vector2_0, dxdy);
+              es._shape->inside(Math::vector2_0);
+            }
+        }
+
+      // compute all transforms without relying on the system cache
+      // which may be used by other threads
+      std::vector<Math::Transform<3> > l2g(_count), g2l(_count);
+
+      for (unsigned int i = 1; i < _count; i++)
+        {
+          if (!_elements[i]._element)
+            continue;
+
+          l2g[i] = system.compute_global_transform(*_elements[i]._element);
+          g2l[i] = l2g[i].inverse();
+        }
+
+      _transforms.resize(_count * _count);
+
+      for (unsigned int i = 0; i < _count; i++)
+        {
+          for (unsigned int j = 0; j < _count; j++)
+            {
+              Math::Transform<3> &t = _transforms[i * _count + j];
+
+              if (i == j || (i && !_elements[i]._element) || (j && !_elements[j]._element))
+                t.reset();
+              else if (!i)
+                t = g2l[j];
+              else if (!j)
+                t = l2g[i];
+              else
+                {
+                  t = l2g[i];
+                  t.compose(g2l[j]);
+                }
+            }
+        }
+
+      bvh_update();
+
+      // elements sequence
+      _sequence.clear();
+
+      if (_sequential)
+        {
+          for (unsigned int i = 0; i < _seq_ptr->get_element_count(); i++)
+            {
+              const Element &e = _seq_ptr->get_element(i);
+
+              if (e.get_system() != _system)
+                throw Error("Sequence contains element which is not part of the System");
+
+              _sequence.push_back(&e);
+            }
+        }
+      else
+        {
+          delegate_push<typeof(_sequence), const Element &> d(_sequence);
+          system.get_elements<Element>(d);
+        }
+    }
+
+    /* sort surfaces boxes along an axis using box center */
+    struct bvh_center_cmp
+    {
+      unsigned int _axis;
+
+      bool operator()(const std::pair<Math::VectorPair3, unsigned int> &a,
+                      const std::pair<Math::VectorPair3, unsigned int> &b) const
+      {
+        return a.first[0][_axis] + a.first[1][_axis]
+             < b.first[0][_axis] + b.first[1][_axis];
+      }
+    };
+
+    void CompiledSystem::bvh_build(bvh_boxes_t &boxes, unsigned int index,
+                                   unsigned int first, unsigned int count)
+    {
+      Math::VectorPair3 box(boxes[first].first);
+      Math::VectorPair3 center(box[0] + box[1], box[0] + box[1]);
+
+      for (unsigned int i = first + 1; i < first + count; i++)
+        {
+          const Math::VectorPair3 &b = boxes[i].first;
+          Math::Vector3 c(b[0] + b[1]);
+
+          for (unsigned int j = 0; j < 3; j++)
+            {
+              box[0][j] = std::min(box[0][j], b[0][j]);
+              box[1][j] = std::max(box[1][j], b[1][j]);
+              center[0][j] = std::min(center[0][j], c[j]);
+              center[1][j] = std::max(center[1][j], c[j]);
+            }
+        }
+
+      _bvh_nodes[index]._box = box;
+
+      if (count <= 4)
+        {
+          _bvh_nodes[index]._child = 0;
+          _bvh_nodes[index]._first = _bvh_surfaces.size();
+          _bvh_nodes[index]._count = count;
+
+          for (unsigned int i = first; i < first + count; i++)
+            _bvh_surfaces.push_back(boxes[i].second);
+
+          return;
+        }
+
+      // split at median along largest centers spread axis
+      Math::Vector3 spread(center[1] - center[0]);
+      bvh_center_cmp cmp;
+
+      cmp._axis = 0;
+      for (unsigned int j = 1; j < 3; j++)
+        if (spread[j] > spread[cmp._axis])
+          cmp._axis = j;
+
+      unsigned int half = count / 2;
+
+      std::nth_element(boxes.begin() + first, boxes.begin() + first + half,
+                       boxes.begin() + first + count, cmp);
+
+      // children nodes are allocated next to each other
+      unsigned int child = _bvh_nodes.size();
+      _bvh_nodes.resize(child + 2);
+
+      _bvh_nodes[index]._child = child;
+      _bvh_nodes[index]._first = 0;
+      _bvh_nodes[index]._count = 0;
+
+      bvh_build(boxes, child, first, half);
+      bvh_build(boxes, child + 1, first + half, count - half);
+    }
+
+    /* Get surface local bounding box with a z range which encloses
+       the curve over the whole shape. Return false when the z range
+       can not be bounded analytically from the curve model. */
+    static bool bvh_surface_box(const Surface &s, Math::VectorPair3 &box)
+    {
+      // stops intercept rays outside of their shape bounding box
+      if (dynamic_cast<const Stop*>(&s))
+        return false;
+
+      const Curve::Base &c = s.get_curve();
+      const Shape::Base &shape = s.get_shape();
+      Math::VectorPair2 sb = shape.get_bounding_box();
+      double zmin = 0, zmax = 0;
+
+      if (sb[0] == sb[1])
+        return false;
+
+      // sagitta of these curves is monotonic along radius so that its
+      // range is bounded by values on axis and at shape maximum radius
+      if (typeid(c) == typeid(Curve::Sphere) || typeid(c) == typeid(Curve::Conic)
+          || typeid(c) == typeid(Curve::Parabola))
+        {
+          double z = static_cast<const Curve::Rotational &>(c).sagitta(shape.max_radius());
+
+          if (!(fabs(z) < std::numeric_limits<double>::max()))
+            return false;
+
+          zmin = std::min(0.0, z);
+          zmax = std::max(0.0, z);
+        }
+      else if (typeid(c) != typeid(Curve::Flat))
+        {
+          return false;
+        }
+
+      box = Math::VectorPair3(Math::Vector3(sb[0].x(), sb[0].y(), zmin),
+                              Math::Vector3(sb[1].x(), sb[1].y(), zmax));
+      return true;
+    }
+
+    void CompiledSystem::bvh_update()
+    {
+      _surfaces.clear();
+      _bvh_nodes.clear();
+      _bvh_surfaces.clear();
+      _bvh_unbounded.clear();
+
+      bvh_boxes_t boxes;
+
+      for (unsigned int i = 1; i < _count; i++)
+        {
+          const Surface *s = _elements[i]._surface;
+
+          if (!s || !s->is_enabled())
+            continue;
+
+          _surfaces.push_back(i);
+
+          Math::VectorPair3 bi;
+
+          if (!bvh_surface_box(*s, bi))
+            {
+              _bvh_unbounded.push_back(i);
+              continue;
+            }
+
+          // global coordinates box enclosing all transformed corners
+          const Math::Transform<3> &t = get_transform(i, 0);
+          Math::VectorPair3 b(Math::Vector3(std::numeric_limits<double>::max()),
+                              Math::Vector3(-std::numeric_limits<double>::max()));
+
+          for (unsigned int k = 0; k < 8; k++)
+            {
+              Math::Vector3 c(t.transform(Math::Vector3(bi[k & 1].x(), bi[(k >> 1) & 1].y(),
+                                                        bi[k >> 2].z())));
+
+              for (unsigned int j = 0; j < 3; j++)
+                {
+                  b[0][j] = std::min(b[0][j], c[j]);
+                  b[1][j] = std::max(b[1][j], c[j]);
+                }
+            }
+
+          // enlarge box to account for rounding errors in ray transforms
+          for (unsigned int j = 0; j < 3; j++)
+            {
+              double e = 1e-6 * (1.0 + std::max(fabs(b[0][j]), fabs(b[1][j])));
+
+              b[0][j] -= e;
+              b[1][j] += e;
+            }
+
+          boxes.push_back(std::make_pair(b, i));
+        }
+
+      _bvh_nodes.resize(1);
+
+      if (boxes.empty())
+        {
+          // empty root node, rays always miss its box
+          _bvh_nodes[0]._box = Math::VectorPair3(Math::Vector3(1.0), Math::Vector3(-1.0));
+          _bvh_nodes[0]._child = 0;
+          _bvh_nodes[0]._first = 0;
+          _bvh_nodes[0]._count = 0;
+        }
+      else
+        {
+          bvh_build(boxes, 0, 0, boxes.size());
+        }
+    }
+
+    /* Get ray entry distance in box, return false if ray misses box */
+    static inline bool bvh_ray_box(const Math::VectorPair3 &box,
+                                   const Math::VectorPair3 &ray, double &tmin)
+    {
+      double t0 = 0, t1 = std::numeric_limits<double>::max();
+
+      for (unsigned int j = 0; j < 3; j++)
+        {
+          double o = ray.origin()[j];
+          double d = ray.direction()[j];
+
+          if (d == 0)
+            {
+              if (o < box[0][j] || o > box[1][j])
+                return false;
+              continue;
+            }
+
+          double ta = (box[0][j] - o) / d;
+          double tb = (box[1][j] - o) / d;
+
+          if (ta > tb)
+            std::swap(ta, tb);
+
+          if (ta > t0)
+            t0 = ta;
+          if (tb < t1)
+            t1 = tb;
+
+          if (t0 > t1)
+            return false;
+        }
+
+      tmin = t0;
+      return true;
+    }
+
+    void CompiledSystem::colide_test(const Trace::Params &params, unsigned int origin,
+                                     unsigned int id, const Trace::Ray &ray,
+                                     Math::VectorPair3 &intersect,
+                                     const Surface * &e, double &min_dist) const
+    {
+      if (id == origin)
+        return;
+
+      const Surface *s = _elements[id]._surface;
+      Math::VectorPair3 local(get_transform(origin, id).transform_line(ray));
+      Math::VectorPair3 inter;
+
+      if (!s->intersect(params, inter, local))
+        return;
+
+      double    dist = (inter.origin() - local.origin()).len();
+
+      // on equal distance, keep surface which comes first in system
+      if (min_dist > dist || (min_dist == dist && e && id < e->id()))
+        {
+          min_dist = dist;
+          intersect = inter;
+          e = s;
+        }
+    }
+
+    const Surface * CompiledSystem::colide_next(const Trace::Params &params,
+                                                Math::VectorPair3 &intersect,
+                                                const Trace::Ray &ray) const
+    {
+      unsigned int origin = ray.get_creator()->id();
+
+      // test all elements and keep closest intersection
+
+      const Surface *e = 0;
+      double    min_dist = std::numeric_limits<double>::max();
+
+      // surfaces may be hit outside of their bounding box when
+      // shape is ignored
+      if (params.get_unobstructed())
+        {
+          GOPTICAL_FOREACH(i, _surfaces)
+            colide_test(params, origin, *i, ray, intersect, e, min_dist);
+
+          return e;
+        }
+
+      GOPTICAL_FOREACH(i, _bvh_unbounded)
+        colide_test(params, origin, *i, ray, intersect, e, min_dist);
+
+      // walk hierarchy with ray in global coordinates, skip nodes
+      // which are farther than closest intersection found so far
+      Math::VectorPair3 global(get_transform(origin, 0).transform_line(ray));
+      global.direction().normalize();
+      unsigned int stack[64];
+      unsigned int sp = 0;
+      double tmin;
+
+      if (bvh_ray_box(_bvh_nodes[0]._box, global, tmin))
+        stack[sp++] = 0;
+
+      while (sp)
+        {
+          const bvh_node_s &n = _bvh_nodes[stack[--sp]];
+
+          if (n._count)
+            {
+              for (unsigned int i = n._first; i < n._first + n._count; i++)
+                colide_test(params, origin, _bvh_surfaces[i], ray, intersect, e, min_dist);
+              continue;
+            }
+
+          if (!n._child)
+            continue;
+
+          double ta = 0, tb = 0;
+          bool a = bvh_ray_box(_bvh_nodes[n._child]._box, global, ta) && ta <= min_dist;
+          bool b = bvh_ray_box(_bvh_nodes[n._child + 1]._box, global, tb) && tb <= min_dist;
+
+          // push nearest child last so that it is visited first
+          if (a && b && ta < tb)
+            {
+              stack[sp++] = n._child + 1;
+              stack[sp++] = n._child;
+            }
+          else
+            {
+              if (a)
+                stack[sp++] = n._child;
+              if (b)
+                stack[sp++] = n._child + 1;
+            }
+        }
+
+      return e;
+    }
+
+    bool CompiledSystem::is_up_to_date(const System &system, const Trace::Params &params) const
+    {
+      return _system == &system && is_up_to_date()
+        && _sequential == params.is_sequential()
+        && (!_sequential || (_seq_ptr == &params.get_sequence()
+                             && _seq_version == _seq_ptr->get_version()));
+    }
+
+  }
+}
+
@@ -214,6 +214,21 @@ namespace _Goptical {
       throw Error("this element is not designed to process incoming light rays in polarized ray trace mode");
     }
 
+    void Element::process_batch_simple(Trace::RayBatch &batch) const
+    {
+      throw Error("this element is not designed to process batch of light rays in simple ray trace mode");
+    }
+
+    void Element::process_batch_intensity(Trace::RayBatch &batch) const
+    {
+      throw Error("this element is not designed to process batch of light rays in intensity ray trace mode");
+    }
+
+    void Element::process_batch_polarized(Trace::RayBatch &batch) const
+    {
+      throw Error("this element is not designed to process batch of light rays in polarized ray trace mode");
+    }
+
     void Element::system_register(System &s)
     {
       assert(!_system);
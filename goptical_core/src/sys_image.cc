@@ -26,6 +26,9 @@
 #include <Goptical/Curve/Flat>
 #include <Goptical/Sys/Image>
 #include <Goptical/Trace/Ray>
+#include <Goptical/Trace/RayBatch>
+#include <Goptical/Trace/Result>
+#include <Goptical/Error>
 
 namespace _Goptical {
 
@@ -34,28 +37,86 @@ namespace _Goptical {
     Image::Image(const Math::VectorPair3 &p,
                  const const_ref<Curve::Base> &curve,
                  const const_ref<Shape::Base> &shape)
-      : Surface(p, curve, shape)
+      : Surface(p, curve, shape),
+        _detector_per_wavelen(false)
     {
+      _detector_size[0] = _detector_size[1] = 0;
     }
 
     Image::Image(const Math::VectorPair3 &p, double radius)
-      : Surface(p, Curve::flat, ref<Shape::Rectangle>::create(radius * 2.))
+      : Surface(p, Curve::flat, ref<Shape::Rectangle>::create(radius * 2.)),
+        _detector_per_wavelen(false)
     {
+      _detector_size[0] = _detector_size[1] = 0;
+    }
+
+    void Image::set_detector(unsigned int n1, unsigned int n2, bool per_wavelen)
+    {
+      if (!n1 || !n2)
+        throw Error("detector must have at least one pixel");
+
+      _detector_size[0] = n1;
+      _detector_size[1] = n2;
+      _detector_per_wavelen = per_wavelen;
+      update_version();
+    }
+
+    void Image::disable_detector()
+    {
+      _detector_size[0] = _detector_size[1] = 0;
+      update_version();
     }
 
     void Image::trace_ray_simple(Trace::Result &result, Trace::Ray &incident,
                                  const Math::VectorPair3 &local, const Math::VectorPair3 &intersect) const
     {
+      if (is_detector())
+        result.add_detected(*this, incident);
     }
 
     void Image::trace_ray_intensity(Trace::Result &result, Trace::Ray &incident,
                                     const Math::VectorPair3 &local, const Math::VectorPair3 &intersect) const
     {
+      if (is_detector())
+        result.add_detected(*this, incident);
     }
 
     void Image::trace_ray_polarized(Trace::Result &result, Trace::Ray &incident,
                                     const Math::VectorPair3 &local, const Math::VectorPair3 &intersect) const
     {
+      if (is_detector())
+        result.add_detected(*this, incident);
+    }
+
+    // rays stop on image plane, they are left alive with origin set
+    // to the interception point
+
+    static void detect_batch(const Image &image, Trace::RayBatch &batch, unsigned int count)
+    {
+      if (!image.is_detector())
+        return;
+
+      Trace::Result &result = batch.get_result();
+
+      for (unsigned int i = 0; i < count; i++)
+        if (batch.is_alive(i))
+          result.add_detected(image, batch.get_origin(i),
+                              batch.get_wavelen(i), batch.get_intensity(i));
+    }
+
+    void Image::trace_batch_simple(Trace::RayBatch &batch, unsigned int count) const
+    {
+      detect_batch(*this, batch, count);
+    }
+
+    void Image::trace_batch_intensity(Trace::RayBatch &batch, unsigned int count) const
+    {
+      detect_batch(*this, batch, count);
+    }
+
+    void Image::trace_batch_polarized(Trace::RayBatch &batch, unsigned int count) const
+    {
+      detect_batch(*this, batch, count);
     }
 
   }
@@ -30,6 +30,7 @@
 #include <Goptical/Curve/Flat>
 
 #include <Goptical/Trace/Ray>
+#include <Goptical/Trace/RayBatch>
 #include <Goptical/Trace/Distribution>
 #include <Goptical/Trace/Result>
 
@@ -133,7 +134,7 @@ namespace _Goptical {
         return;
 
       double wl = incident.get_wavelen();
-      double index = prev_mat->get_refractive_index(wl) / next_mat->get_refractive_index(wl);
+      double index = result.get_refractive_index_ratio(*this, right_to_left, wl);
 
       if (!refract(local, direction, intersect.normal(), index))
         {
@@ -197,7 +198,7 @@ namespace _Goptical {
         return;
 
       double wl = incident.get_wavelen();
-      double index = prev_mat->get_refractive_index(wl) / next_mat->get_refractive_index(wl);
+      double index = result.get_refractive_index_ratio(*this, right_to_left, wl);
       double intensity = incident.get_intercept_intensity();
 
       if (!refract(local, direction, intersect.normal(), index))
@@ -255,6 +256,102 @@ namespace _Goptical {
 
     }
 
+    template <Trace::IntensityMode m>
+    inline void OpticalSurface::trace_batch_(Trace::RayBatch &batch, unsigned int count) const
+    {
+      const Trace::Result &result = batch.get_result();
+
+      for (unsigned int i = 0; i < count; i++)
+        {
+          if (!batch.is_alive(i))
+            continue;
+
+          Math::Vector3 direction;      // refracted ray direction
+          Math::Vector3 rdirection;     // reflected ray direction
+          Math::VectorPair3 local(batch.get_ray(i));
+          Math::Vector3 normal(batch.get_normal(i));
+
+          bool right_to_left = normal.z() > 0;
+
+          const Material::Base *prev_mat = _mat[right_to_left].ptr();
+          const Material::Base *next_mat = _mat[!right_to_left].ptr();
+
+          // check ray didn't "escaped" from its material
+          if (prev_mat != batch.get_material(i))
+            {
+              batch.kill(i);
+              continue;
+            }
+
+          double wl = batch.get_wavelen(i);
+          double index = result.get_refractive_index_ratio(*this, right_to_left, wl);
+          double intensity = batch.get_intensity(i);
+
+          if (!refract(local, direction, normal, index))
+            {
+              // total internal reflection
+              reflect(local, rdirection, normal);
+              batch.set_direction(i, rdirection);
+              batch.set_material(i, prev_mat);
+              continue;
+            }
+
+          bool transmit = !next_mat->is_opaque();
+          bool reflected;
+          double tintensity = intensity;
+          double rintensity = intensity;
+
+          if (m == Trace::SimpleTrace)
+            {
+              reflected = next_mat->is_reflecting();
+            }
+          else
+            {
+              if (transmit)
+                {
+                  tintensity = intensity * next_mat->get_normal_transmittance(prev_mat, wl);
+                  transmit = tintensity >= get_discard_intensity();
+                }
+
+              rintensity = intensity * next_mat->get_normal_reflectance(prev_mat, wl);
+              reflected = rintensity >= get_discard_intensity();
+            }
+
+          // reflect, use an additional ray when transmitted too
+          if (reflected)
+            {
+              unsigned int j = transmit ? batch.add_ray(i) : i;
+
+              reflect(local, rdirection, normal);
+              batch.set_direction(j, rdirection);
+              batch.set_material(j, prev_mat);
+              batch.set_intensity(j, rintensity);
+            }
+
+          // transmit
+          if (transmit)
+            {
+              batch.set_direction(i, direction);
+              batch.set_material(i, next_mat);
+              batch.set_intensity(i, tintensity);
+            }
+          else if (!reflected)
+            {
+              batch.kill(i);
+            }
+        }
+    }
+
+    void OpticalSurface::trace_batch_simple(Trace::RayBatch &batch, unsigned int count) const
+    {
+      trace_batch_<Trace::SimpleTrace>(batch, count);
+    }
+
+    void OpticalSurface::trace_batch_intensity(Trace::RayBatch &batch, unsigned int count) const
+    {
+      trace_batch_<Trace::IntensityTrace>(batch, count);
+    }
+
     void OpticalSurface::set_material(unsigned index, const const_ref<Material::Base> &m)
     {
       assert(index < 2);
@@ -263,6 +360,8 @@ namespace _Goptical {
         _mat[index] = get_system()->get_environment_proxy();
       else
         _mat[index] = m;
+
+      update_version();
     }
 
     void OpticalSurface::system_register(System &s)
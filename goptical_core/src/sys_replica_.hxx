@@ -0,0 +1,280 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+#ifndef GOPTICAL_SYS_REPLICA_HXX_
+#define GOPTICAL_SYS_REPLICA_HXX_
+
+/*
+  Lightweight copy of the elements of a sequential system, used by
+  analysis and optimization code which need to trace many modified
+  versions of a system concurrently.
+
+  Sequence elements, or elements of a given list, are added to a
+  private system with their nominal global transform. Curves,
+  shapes and materials are shared with the nominal system, curves
+  which are modified must be replaced with replica owned objects
+  using own_curve(). Shared objects reference counters are updated
+  here, replicas must be built from the main thread.
+*/
+
+#include <vector>
+
+#include <Goptical/Curve/Sphere>
+#include <Goptical/Curve/Conic>
+
+#include <Goptical/Sys/System>
+#include <Goptical/Sys/CompiledSystem>
+#include <Goptical/Sys/SourcePoint>
+#include <Goptical/Sys/OpticalSurface>
+#include <Goptical/Sys/Stop>
+#include <Goptical/Sys/Image>
+
+#include <Goptical/Trace/Params>
+#include <Goptical/Trace/Sequence>
+
+#include <Goptical/Material/Base>
+#include <Goptical/Light/SpectralLine>
+
+#include <Goptical/Error>
+
+namespace _Goptical {
+
+  namespace Sys {
+
+    struct replica_s
+    {
+      replica_s(const System &nominal)
+        : _nominal(nominal),
+          _system(),
+          _nominal_elements(),
+          _elements(),
+          _sequence(GOPTICAL_REFNEW(Trace::Sequence))
+      {
+        const Trace::Sequence &seq = nominal.get_tracer_params().get_sequence();
+
+        for (unsigned int i = 0; i < seq.get_element_count(); i++)
+          _nominal_elements.push_back(&seq.get_element(i));
+
+        build(nominal.get_tracer_params());
+      }
+
+      /** replicate given elements, they are traced in list order
+          when parameters are in sequential mode */
+      replica_s(const System &nominal, const std::vector<const Element *> &elements,
+                const Trace::Params &params)
+        : _nominal(nominal),
+          _system(),
+          _nominal_elements(elements),
+          _elements(),
+          _sequence(GOPTICAL_REFNEW(Trace::Sequence))
+      {
+        build(params);
+      }
+
+      void build(const Trace::Params &nominal_params)
+      {
+        const Material::Base *env = &_nominal.get_environment_proxy();
+
+        _system.set_environment(_nominal.get_environment());
+
+        for (unsigned int i = 0; i < _nominal_elements.size(); i++)
+          {
+            const Element &e = *_nominal_elements[i];
+            ref<Element> r;
+
+            if (const SourcePoint *s = dynamic_cast<const SourcePoint*>(&e))
+              {
+                ref<SourcePoint> rs = GOPTICAL_REFNEW(SourcePoint, s->get_mode(),
+                                                      Math::vector3_001);
+
+                rs->clear_spectrum();
+                GOPTICAL_FOREACH(l, s->get_spectrum())
+                  rs->add_spectral_line(*l);
+
+                if (&s->get_material() != env)
+                  rs->set_material(s->get_material());
+
+                r = rs;
+              }
+            else if (const OpticalSurface *s = dynamic_cast<const OpticalSurface*>(&e))
+              {
+                const_ref<Material::Base> m[2];
+
+                // environment proxy of replica system is used by default
+                for (unsigned int k = 0; k < 2; k++)
+                  if (&s->get_material(k) != env)
+                    m[k] = s->get_material(k);
+
+                ref<OpticalSurface> rs =
+                  GOPTICAL_REFNEW(OpticalSurface, Math::VectorPair3(),
+                                  s->get_curve(), s->get_shape(), m[0], m[1]);
+
+                rs->set_discard_intensity(s->get_discard_intensity());
+                r = rs;
+              }
+            else if (const Image *s = dynamic_cast<const Image*>(&e))
+              {
+                ref<Image> rs = GOPTICAL_REFNEW(Image, Math::VectorPair3(),
+                                                s->get_curve(), s->get_shape());
+
+                rs->set_discard_intensity(s->get_discard_intensity());
+                r = rs;
+              }
+            else if (const Stop *s = dynamic_cast<const Stop*>(&e))
+              {
+                ref<Stop> rs = GOPTICAL_REFNEW(Stop, Math::VectorPair3(),
+                                               s->get_shape());
+
+                rs->set_external_radius(s->get_external_radius());
+                rs->set_intercept_reemit(s->get_intercept_reemit());
+                rs->set_discard_intensity(s->get_discard_intensity());
+                r = rs;
+              }
+            else
+              {
+                throw Error("sequence element type not supported in system replica");
+              }
+
+            r->set_transform(e.get_global_transform());
+            _system.add(r);
+            _sequence->append(*r);
+            _elements.push_back(r.ptr());
+          }
+
+        Trace::Params &params = _system.get_tracer_params();
+
+        // per surface distributions refer to nominal surfaces
+        params = nominal_params;
+        params.reset_distribution();
+        if (nominal_params.is_sequential())
+          params.set_sequential_mode(_sequence);
+        params.set_thread_count(1);
+
+        // ray aiming stop must be the replica of the nominal stop,
+        // aiming is only used in sequential mode
+        if (const Surface *stop = params.get_ray_aiming_stop())
+          {
+            if (const Surface *r = dynamic_cast<const Surface*>(find(*stop)))
+              params.set_ray_aiming(*r);
+            else if (params.is_sequential())
+              throw Error("ray aiming stop not found in system replica");
+            else
+              params.disable_ray_aiming();
+          }
+      }
+
+      /** Some curves, shapes and materials update cached data on
+          first access, make sure this is done before replicas of
+          nominal system are traced concurrently */
+      static void prepare_shared(const System &nominal)
+      {
+        const Trace::Params &params = nominal.get_tracer_params();
+        const Trace::Sequence &seq = params.get_sequence();
+        CompiledSystem cs(nominal, params);
+        std::vector<double> wl;
+
+        for (unsigned int i = 0; i < seq.get_element_count(); i++)
+          if (const Source *s = dynamic_cast<const Source*>(&seq.get_element(i)))
+            GOPTICAL_FOREACH(l, s->get_spectrum())
+              wl.push_back(l->get_wavelen());
+
+        for (unsigned int i = 1; i <= cs.get_element_count(); i++)
+          {
+            if (!cs.get_optical_surface(i) && !cs.get_source(i))
+              continue;
+
+            for (unsigned int k = 0; k < 2; k++)
+              {
+                const Material::Base &mat = *cs.get_material(i, k);
+
+                GOPTICAL_FOREACH(w, wl)
+                  {
+                    mat.get_refractive_index(*w);
+
+                    if (params.get_intensity_mode() == Trace::SimpleTrace)
+                      continue;
+
+                    // missing data errors are reported by replicas
+                    try {
+                      mat.get_internal_transmittance(*w, 1.0);
+                    } catch (...) {
+                    }
+                  }
+              }
+          }
+      }
+
+      /** get nominal element at given sequence index */
+      const Element & get_nominal(unsigned int index) const
+      {
+        return *_nominal_elements[index];
+      }
+
+      /** get replica of given nominal element */
+      Element * find(const Element &e) const
+      {
+        for (unsigned int i = 0; i < _elements.size(); i++)
+          if (&get_nominal(i) == &e)
+            return _elements[i];
+
+        return 0;
+      }
+
+      /** get replica element at given sequence index */
+      template <class X>
+      X & get(unsigned int index) const
+      {
+        return static_cast<X&>(*_elements[index]);
+      }
+
+      /** replace shared conic curve of surface with a replica owned
+          copy. A Conic is used when Schwarzschild constant will change. */
+      ref<Curve::ConicBase> own_curve(unsigned int index, bool conic)
+      {
+        Surface &s = get<Surface>(index);
+        const Curve::ConicBase &c = static_cast<const Curve::ConicBase&>(s.get_curve());
+        ref<Curve::ConicBase> r;
+
+        if (!conic && dynamic_cast<const Curve::Sphere*>(&c))
+          r = GOPTICAL_REFNEW(Curve::Sphere, c.get_roc());
+        else
+          r = GOPTICAL_REFNEW(Curve::Conic, c.get_roc(), c.get_schwarzschild());
+
+        s.set_curve(r);
+        return r;
+      }
+
+      const System              &_nominal;
+      System                    _system;
+      std::vector<const Element *> _nominal_elements;
+      std::vector<Element *>    _elements;
+      ref<Trace::Sequence>      _sequence;
+    };
+
+  }
+
+}
+
+#endif
+
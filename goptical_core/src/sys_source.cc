@@ -24,6 +24,7 @@
 
 
 #include <Goptical/Sys/Source>
+#include <Goptical/Sys/System>
 
 namespace _Goptical {
 
@@ -38,6 +39,11 @@ namespace _Goptical {
       _spectrum.push_back(Light::SpectralLine(550.0, 1.0));
     }
 
+    const Material::Base & Source::get_material() const
+    {
+      return _mat.valid() ? *_mat : get_system()->get_environment_proxy();
+    }
+
     void Source::refresh_intensity_limits()
     {
       if (_spectrum.empty())
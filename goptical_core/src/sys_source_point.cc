@@ -25,21 +25,53 @@
 #define DPP_DELEGATE_ARGC 5
 
 #include <limits>
+#include <vector>
 
 #include <Goptical/Math/Vector>
+#include <Goptical/Math/VectorPair>
 
 #include <Goptical/Sys/System>
+#include <Goptical/Sys/CompiledSystem>
+#include <Goptical/Sys/Image>
 #include <Goptical/Sys/SourcePoint>
 #include <Goptical/Sys/Surface>
 
+#include <Goptical/Curve/Base>
+#include <Goptical/Shape/Base>
+
 #include <Goptical/Trace/Ray>
+#include <Goptical/Trace/RayBatch>
 #include <Goptical/Trace/Result>
 #include <Goptical/Trace/Params>
+#include <Goptical/Trace/Sequence>
+#include <Goptical/Trace/Distribution>
 
 namespace _Goptical {
 
   namespace Sys {
 
+    /** @internal Ray aiming solution for a target and stop pair */
+    struct SourcePoint::aiming_s : public Trace::Result::element_cache_s
+    {
+      aiming_s()
+        : _target(0),
+          _stop(0),
+          _wavelen(0)
+      {
+      }
+
+      const Surface             *_target;
+      const Surface             *_stop;
+      double                    _wavelen;
+      /** source and sequence elements up to stop, with versions */
+      std::vector<const Element *> _elements;
+      std::vector<unsigned int> _versions;
+      /** stop pattern points, in stop coordinates */
+      std::vector<Math::Vector3> _pattern;
+      /** aimed points on target plane, in target coordinates */
+      std::vector<Math::Vector3> _aimed;
+    };
+
     SourcePoint::SourcePoint(SourceInfinityMode m, const Math::Vector3 &pos_dir)
       : Source(m == SourceAtInfinity
          // position of infinity source is only used for Trace::Sequence sort
@@ -49,76 +81,355 @@ namespace _Goptical {
     {
     }
 
+    template <SourceInfinityMode mode>
+    Math::VectorPair3 SourcePoint::get_lightray_(const Math::VectorPair3 &plane,
+                                                 const Math::Vector3 &r)
+    {
+      switch (mode)
+        {
+        case (SourceAtFiniteDistance):
+          return Math::VectorPair3(Math::vector3_0, r.normalized());
+
+        case (SourceAtInfinity):
+        default:
+          return Math::VectorPair3(plane.pl_ln_intersect(Math::VectorPair3(r, Math::vector3_001)),
+                                   Math::vector3_001);
+        }
+    }
+
+    template <SourceInfinityMode mode>
+    void SourcePoint::add_lightrays_(Trace::Result &result, const Math::VectorPair3 &plane,
+                                     const Material::Base *material,
+                                     const Math::Vector3 &r) const
+    {
+      Math::VectorPair3 ray = get_lightray_<mode>(plane, r);
+
+      GOPTICAL_FOREACH(l, _spectrum)
+        {
+          Trace::Ray &r = result.new_ray();
+
+          // generated rays use source coordinates
+          r.direction() = ray.direction();
+          r.origin() = ray.origin();
+
+          r.set_creator(this);
+          r.set_intensity(l->get_intensity()); // FIXME depends on distance from source and pattern density
+          r.set_wavelen(l->get_wavelen());
+          r.set_material(material);
+        }
+    }
+
     template <SourceInfinityMode mode>
     void SourcePoint::get_lightrays_(Trace::Result &result,
                                      const Element &target) const
     {
-      const Surface *starget = dynamic_cast<const Surface*>(&target);
+      const Sys::CompiledSystem &cs = result.get_compiled_system();
+      const Surface *starget = cs.get_surface(target.id());
 
-      if (!starget)
+      if (!starget || _spectrum.empty())
         return;
 
-      double rlen = result.get_params().get_lost_ray_length();
-
-      const Trace::Distribution &d = result.get_params().get_distribution(*starget);
+      const Trace::Params &params = result.get_params();
+      double rlen = params.get_lost_ray_length();
 
-      DPP_DELEGATE5_OBJ(de, void, (const Math::Vector3 &i),
+      // transform from target to source coordinates
+      const Math::Transform<3> &t = cs.get_transform(*starget, *this);
+      // ray aiming at target surface origin in source coordinates
+      Math::VectorPair3 plane(t.transform(Math::vector3_0) -
+                              Math::vector3_001 * rlen, Math::vector3_001);
+      const Material::Base *material = cs.get_material(id());
 
-                        // _0
-                        const SourcePoint *, this,
+      const Surface *stop = params.get_ray_aiming_stop();
 
-                        // _1 ray aiming at target surface origin in source coordinates
-                        const Math::VectorPair3 &,
-                        Math::VectorPair3(starget->get_position(*this) -
-                                            Math::vector3_001 * rlen, Math::vector3_001),
+      if (params.is_sequential() && stop && stop != starget)
+        {
+          const aiming_s &a = get_aiming(result, *starget, *stop);
 
-                        // _2 transform from target to source coordinates
-                        const Math::Transform<3> &,
-                        starget->get_transform_to(*this),
+          for (unsigned int i = 0; i < a._aimed.size(); i++)
+            add_lightrays_<mode>(result, plane, material, t.transform(a._aimed[i]));
 
-                        // _3
-                        const Material::Base *,
-                        _mat.valid() ? _mat.ptr() : &get_system()->get_environment_proxy(),
+          return;
+        }
 
-                        // _4
-                        Trace::Result &, result,
+      const Trace::Distribution &d = params.get_distribution(*starget);
 
+      DPP_DELEGATE5_OBJ(de, void, (const Math::Vector3 &i),
+                        const SourcePoint *, this,              // _0
+                        const Math::VectorPair3 &, plane,       // _1
+                        const Math::Transform<3> &, t,          // _2
+                        const Material::Base *, material,       // _3
+                        Trace::Result &, result,                // _4
       {
-        Math::Vector3 r = _2.transform(i);  // pattern point on target surface
-        Math::Vector3 direction;
-        Math::Vector3 position;
-
-        switch (mode)
-          {
-          case (SourceAtFiniteDistance):
-            position = Math::vector3_0;
-            direction = r.normalized();
-            break;
-
-          case (SourceAtInfinity):
-            direction = Math::vector3_001;
-            position = _1.pl_ln_intersect(Math::VectorPair3(r, direction));
-            break;
-          }
-
-        GOPTICAL_FOREACH(l, _0->_spectrum)
-          {
-            Trace::Ray &r = _4.new_ray();
-
-            // generated rays use source coordinates
-            r.direction() = direction;
-            r.origin() = position;
-
-            r.set_creator(_0);
-            r.set_intensity(l->get_intensity()); // FIXME depends on distance from source and pattern density
-            r.set_wavelen(l->get_wavelen());
-            r.set_material(_3);
-          }
+        // pattern point on target surface
+        _0->add_lightrays_<mode>(_4, _1, _3, _2.transform(i));
       });
 
-      starget->get_pattern(de, d, result.get_params().get_unobstructed());
+      starget->get_pattern(de, d, params.get_unobstructed());
+    }
+
+    /** propagate rays expressed in source coordinates up to the
+        aiming stop, get intersection points in stop coordinates */
+    static void aiming_trace(const Trace::Params &params, Trace::Result &result,
+                             const Element &source, const Material::Base *material,
+                             double wavelen, const std::vector<const Element *> &path,
+                             const Surface &stop, const std::vector<Math::VectorPair3> &rays,
+                             std::vector<Math::Vector2> &hits, std::vector<char> &alive)
+    {
+      unsigned int count = rays.size();
+      Trace::RayBatch batch(params, result);
+
+      batch.move_to_frame(source);
+      batch.reserve(count);
+
+      GOPTICAL_FOREACH(r, rays)
+        batch.add_ray(*r, wavelen, 1.0, material);
+
+      GOPTICAL_FOREACH(e, path)
+        (*e)->process_rays<Trace::SimpleTrace>(batch);
+
+      batch.move_to_frame(stop);
+
+      std::vector<double> ipt(count * 3);
+      double * const point[3] = { &ipt[0], &ipt[count], &ipt[count * 2] };
+      const double * const origin[3] = { batch.get_origin_array(0), batch.get_origin_array(1),
+                                         batch.get_origin_array(2) };
+      const double * const direction[3] = { batch.get_direction_array(0), batch.get_direction_array(1),
+                                            batch.get_direction_array(2) };
+
+      // reflected rays may have been appended, only keep the first ones
+      alive.assign(batch.get_alive_array(), batch.get_alive_array() + count);
+
+      stop.get_curve().intersect_batch(count, &alive[0], point, origin, direction);
+
+      hits.resize(count);
+      for (unsigned int i = 0; i < count; i++)
+        hits[i] = Math::Vector2(point[0][i], point[1][i]);
+    }
+
+    const SourcePoint::aiming_s & SourcePoint::get_aiming(Trace::Result &result,
+                                                          const Surface &target,
+                                                          const Surface &stop) const
+    {
+      const Sys::CompiledSystem &cs = result.get_compiled_system();
+      const std::vector<const Element *> &seq = cs.get_sequence();
+      const Trace::Params &params = result.get_params();
+
+      // find sequence elements from target to stop
+
+      unsigned int first = seq.size(), last = seq.size();
+
+      for (unsigned int i = 0; i < seq.size(); i++)
+        {
+          if (first == seq.size())
+            {
+              if (seq[i] == &target)
+                first = i;
+            }
+          else if (seq[i] == &stop)
+            {
+              last = i;
+              break;
+            }
+        }
+
+      if (last == seq.size())
+        throw Error("ray aiming stop not found in sequence after source");
+
+      std::vector<Math::Vector3> pattern;
+      delegate_push<typeof(pattern)> pattern_push(pattern);
+
+      stop.get_pattern(pattern_push, params.get_distribution(stop), params.get_unobstructed());
+
+      double wavelen = _spectrum.front().get_wavelen();
+
+      // check cached solution
+
+      Trace::Result::element_cache_s * &cache = result.get_element_cache(*this);
+      aiming_s *ap = dynamic_cast<aiming_s *>(cache);
+
+      if (!ap)
+        {
+          delete cache;
+          cache = ap = new aiming_s;
+        }
+
+      aiming_s &a = *ap;
+
+      bool valid = a._target == &target && a._stop == &stop &&
+        a._wavelen == wavelen && a._pattern == pattern &&
+        a._elements.size() == last - first + 2 &&
+        a._elements[0] == this && a._versions[0] == get_version();
+
+      // stop pattern is in stop local coordinates, stop itself must
+      // be unchanged too
+      for (unsigned int i = first; valid && i <= last; i++)
+        valid = a._elements[i - first + 1] == seq[i] &&
+          a._versions[i - first + 1] == seq[i]->get_version();
+
+      if (valid)
+        return a;
+
+      a._target = &target;
+      a._stop = &stop;
+      a._wavelen = wavelen;
+      a._pattern.swap(pattern);
+      a._elements.resize(last - first + 2);
+      a._versions.resize(last - first + 2);
+      a._elements[0] = this;
+      a._versions[0] = get_version();
+
+      for (unsigned int i = first; i <= last; i++)
+        {
+          a._elements[i - first + 1] = seq[i];
+          a._versions[i - first + 1] = seq[i]->get_version();
+        }
+
+      // solve target plane points which map to stop pattern points
+
+      // image detectors must not record aiming rays
+      std::vector<const Element *> path;
+
+      for (unsigned int i = first; i < last; i++)
+        if (!dynamic_cast<const Image *>(seq[i]))
+          path.push_back(seq[i]);
+
+      // apertures must not stop rays during iterations. Only
+      // sequential and unobstructed modes are used when propagating
+      // a batch, tracer parameters are not copied so that the shared
+      // sequence is not referenced concurrently
+      Trace::Params uparams;
+      uparams.set_sequential_mode(ref<Trace::Sequence>::create());
+      uparams.set_unobstructed(true);
+
+      const Math::Transform<3> &t = cs.get_transform(target, *this);
+      Math::VectorPair3 plane(t.transform(Math::vector3_0) -
+                              Math::vector3_001 * params.get_lost_ray_length(),
+                              Math::vector3_001);
+      const Material::Base *material = cs.get_material(id());
+
+      double rt = target.get_shape().max_radius();
+      double rs = stop.get_shape().max_radius();
+
+      if (!(rt > 0.))
+        rt = 1.;
+      if (!(rs > 0.))
+        rs = 1.;
+
+      unsigned int count = a._pattern.size();
+      std::vector<Math::VectorPair3> rays;
+      std::vector<Math::Vector2> hits;
+      std::vector<char> alive;
+      std::vector<char> reached(count, 0);
+
+      a._aimed.resize(count);
+
+      // first guess from linear model of center and offset rays
+
+      double k = rt * 0.1;
+
+      for (unsigned int j = 0; j < 3; j++)
+        rays.push_back(_mode == SourceAtInfinity
+                       ? get_lightray_<SourceAtInfinity>(plane, t.transform(Math::Vector3(j == 1 ? k : 0, j == 2 ? k : 0, 0)))
+                       : get_lightray_<SourceAtFiniteDistance>(plane, t.transform(Math::Vector3(j == 1 ? k : 0, j == 2 ? k : 0, 0))));
+
+      aiming_trace(uparams, result, *this, material, wavelen, path, stop, rays, hits, alive);
+
+      Math::Vector2 h0 = hits[0], jx = (hits[1] - hits[0]) / k, jy = (hits[2] - hits[0]) / k;
+      double det = jx.x() * jy.y() - jx.y() * jy.x();
+      bool linear = alive[0] && alive[1] && alive[2] && det != 0.;
+
+      for (unsigned int i = 0; i < count; i++)
+        {
+          Math::Vector2 s = a._pattern[i].project_xy();
+
+          if (linear)
+            {
+              Math::Vector2 e = s - h0;
+
+              a._aimed[i] = Math::Vector3((e.x() * jy.y() - e.y() * jy.x()) / det,
+                                          (jx.x() * e.y() - jx.y() * e.x()) / det, 0);
+            }
+          else
+            {
+              a._aimed[i] = Math::Vector3(s * (rt / rs), 0);
+            }
+        }
+
+      // Newton iterations with finite differences jacobian
+
+      double h = rt * 1e-6;
+      double tol = rs * 1e-9;
+      std::vector<unsigned int> active, next;
+
+      for (unsigned int i = 0; i < count; i++)
+        active.push_back(i);
+
+      for (unsigned int iter = 0; iter < 16 && !active.empty(); iter++)
+        {
+          rays.clear();
+
+          GOPTICAL_FOREACH(i, active)
+            {
+              const Math::Vector3 &p = a._aimed[*i];
+
+              for (unsigned int j = 0; j < 3; j++)
+                {
+                  Math::Vector3 r = t.transform(Math::Vector3(p.x() + (j == 1 ? h : 0),
+                                                              p.y() + (j == 2 ? h : 0), 0));
+
+                  rays.push_back(_mode == SourceAtInfinity
+                                 ? get_lightray_<SourceAtInfinity>(plane, r)
+                                 : get_lightray_<SourceAtFiniteDistance>(plane, r));
+                }
+            }
+
+          aiming_trace(uparams, result, *this, material, wavelen, path, stop, rays, hits, alive);
+
+          next.clear();
+
+          for (unsigned int n = 0; n < active.size(); n++)
+            {
+              unsigned int i = active[n];
+
+              // pattern point can not be reached
+              if (!alive[n * 3] || !alive[n * 3 + 1] || !alive[n * 3 + 2])
+                continue;
+
+              Math::Vector2 e = a._pattern[i].project_xy() - hits[n * 3];
+
+              if (e.len() < tol)
+                {
+                  reached[i] = 1;
+                  continue;
+                }
+
+              Math::Vector2 jx = (hits[n * 3 + 1] - hits[n * 3]) / h;
+              Math::Vector2 jy = (hits[n * 3 + 2] - hits[n * 3]) / h;
+              double det = jx.x() * jy.y() - jx.y() * jy.x();
+
+              if (det == 0.)
+                continue;
+
+              Math::Vector3 &p = a._aimed[i];
+
+              p.x() += (e.x() * jy.y() - e.y() * jy.x()) / det;
+              p.y() += (jx.x() * e.y() - jx.y() * e.x()) / det;
+
+              next.push_back(i);
+            }
+
+          active.swap(next);
+        }
+
+      // pattern points which can not be reached are not dropped so
+      // that sampling is left unchanged, unaimed point is used instead
+      for (unsigned int i = 0; i < count; i++)
+        if (!reached[i])
+          a._aimed[i] = Math::Vector3(a._pattern[i].project_xy() * (rt / rs), 0);
+
+      return a;
     }
-        
+
     void SourcePoint::generate_rays_simple(Trace::Result &result,
                                            const targets_t &entry) const
     {
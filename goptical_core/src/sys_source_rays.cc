@@ -74,6 +74,8 @@ namespace _Goptical {
 
       GOPTICAL_FOREACH(l, _spectrum)
         _rays.create(r, l->get_intensity(), l->get_wavelen());
+
+      update_version();
     }
 
     void SourceRays::add_marginal_rays(const Sys::System &sys, double entrance_height)
@@ -105,6 +107,8 @@ namespace _Goptical {
 
       GOPTICAL_FOREACH(l, _spectrum)
         _rays.create(r, l->get_intensity(), l->get_wavelen());
+
+      update_version();
     }
 
     void SourceRays::add_rays(const Math::VectorPair3 &ray, const Element *ref)
@@ -130,12 +134,15 @@ namespace _Goptical {
           else
             r = ref->get_local_transform().transform_line(ray);
         }
+
+      update_version();
     }
 
     void SourceRays::clear_rays()
     {
       _rays.clear();
       _wl_map.clear();
+      update_version();
     }
 
     void SourceRays::generate_rays_simple(Trace::Result &result,
@@ -23,10 +23,12 @@
 */
 
 #include <Goptical/Sys/Stop>
+#include <Goptical/Sys/CompiledSystem>
 
 #include <Goptical/Trace/Result>
 #include <Goptical/Trace/Params>
 #include <Goptical/Trace/Ray>
+#include <Goptical/Trace/RayBatch>
 
 #include <Goptical/Math/Vector>
 #include <Goptical/Math/VectorPair>
@@ -80,6 +82,35 @@ namespace _Goptical {
       return true;
     }
 
+    void Stop::intersect_batch(const Trace::Params &params, unsigned int count,
+                               char *mask, double * const point[3],
+                               double * const normal[3],
+                               const double * const origin[3],
+                               const double * const direction[3]) const
+    {
+      get_curve().intersect_batch(count, mask, point, origin, direction);
+
+      bool ir = _intercept_reemit || params.is_sequential();
+
+      for (unsigned int i = 0; i < count; i++)
+        {
+          if (!mask[i])
+            continue;
+
+          Math::Vector2 v(point[0][i], point[1][i]);
+
+          if (v.len() > _external_radius || (!ir && get_shape().inside(v)))
+            mask[i] = 0;
+        }
+
+      get_curve().normal_batch(count, mask, normal, point);
+
+      for (unsigned int i = 0; i < count; i++)
+        if (mask[i] && direction[2][i] < 0)
+          for (unsigned int j = 0; j < 3; j++)
+            normal[j][i] = -normal[j][i];
+    }
+
     inline void Stop::trace_ray_simple(Trace::Result &result, Trace::Ray &incident,
                                        const Math::VectorPair3 &local, const Math::VectorPair3 &intersect) const
     {
@@ -109,16 +140,37 @@ namespace _Goptical {
       trace_ray_simple(result, incident, local, intersect);
     }
 
+    void Stop::trace_batch_simple(Trace::RayBatch &batch, unsigned int count) const
+    {
+      // batch tracing is sequential, rays going through the stop
+      // aperture are reemited
+      for (unsigned int i = 0; i < count; i++)
+        {
+          if (!batch.is_alive(i))
+            continue;
+
+          if (!get_shape().inside(batch.get_origin(i).project_xy()))
+            batch.kill(i);
+        }
+    }
+
+    void Stop::trace_batch_intensity(Trace::RayBatch &batch, unsigned int count) const
+    {
+      trace_batch_simple(batch, count);
+    }
+
     template <Trace::IntensityMode m>
     inline void Stop::process_rays_(Trace::Result &result,
                                     Trace::rays_queue_t *input) const
     {
+      const CompiledSystem &cs = result.get_compiled_system();
+
       GOPTICAL_FOREACH(i, *input)
         {
           Math::VectorPair3 intersect;
           Trace::Ray  &ray = **i;
 
-          const Math::Transform<3> &t = ray.get_creator()->get_transform_to(*this);
+          const Math::Transform<3> &t = cs.get_transform(*ray.get_creator(), *this);
           Math::VectorPair3 local(t.transform_line(ray));
 
           if (get_curve().intersect(intersect.origin(), local))
@@ -25,6 +25,7 @@
 
 #include <Goptical/Sys/Surface>
 #include <Goptical/Sys/Element>
+#include <Goptical/Sys/CompiledSystem>
 #include <Goptical/Material/Base>
 
 #include <Goptical/Shape/Base>
@@ -39,6 +40,7 @@
 
 #include <Goptical/Trace/Distribution>
 #include <Goptical/Trace/Ray>
+#include <Goptical/Trace/RayBatch>
 #include <Goptical/Trace/Result>
 #include <Goptical/Trace/Params>
 
@@ -97,6 +99,21 @@ namespace _Goptical {
       throw Error("polarized ray trace not handled by this surface class");
     }
 
+    void Surface::trace_batch_simple(Trace::RayBatch &batch, unsigned int count) const
+    {
+      throw Error("simple batch ray trace not handled by this surface class");
+    }
+
+    void Surface::trace_batch_intensity(Trace::RayBatch &batch, unsigned int count) const
+    {
+      throw Error("intensity batch ray trace not handled by this surface class");
+    }
+
+    void Surface::trace_batch_polarized(Trace::RayBatch &batch, unsigned int count) const
+    {
+      throw Error("polarized batch ray trace not handled by this surface class");
+    }
+
     bool Surface::intersect(const Trace::Params &params, Math::VectorPair3 &pt, const Math::VectorPair3 &ray) const
     {
       if (!_curve->intersect(pt.origin(), ray))
@@ -113,6 +130,27 @@ namespace _Goptical {
       return true;
     }
 
+    void Surface::intersect_batch(const Trace::Params &params, unsigned int count,
+                                  char *mask, double * const point[3],
+                                  double * const normal[3],
+                                  const double * const origin[3],
+                                  const double * const direction[3]) const
+    {
+      _curve->intersect_batch(count, mask, point, origin, direction);
+
+      if (!params.get_unobstructed())
+        for (unsigned int i = 0; i < count; i++)
+          if (mask[i] && !_shape->inside(Math::Vector2(point[0][i], point[1][i])))
+            mask[i] = 0;
+
+      _curve->normal_batch(count, mask, normal, point);
+
+      for (unsigned int i = 0; i < count; i++)
+        if (mask[i] && direction[2][i] < 0)
+          for (unsigned int j = 0; j < 3; j++)
+            normal[j][i] = -normal[j][i];
+    }
+
     template <Trace::IntensityMode m>
     void Surface::trace_ray(Trace::Result &result, Trace::Ray &incident,
                             const Math::VectorPair3 &local, const Math::VectorPair3 &pt) const
@@ -158,13 +196,14 @@ namespace _Goptical {
                                        Trace::rays_queue_t *input) const
     {
       const Trace::Params &params = result.get_params();
+      const CompiledSystem &cs = result.get_compiled_system();
 
       GOPTICAL_FOREACH(i, *input)
         {
           Math::VectorPair3 pt;
           Trace::Ray  &ray = **i;
 
-          const Math::Transform<3> &t = ray.get_creator()->get_transform_to(*this);
+          const Math::Transform<3> &t = cs.get_transform(*ray.get_creator(), *this);
           Math::VectorPair3 local(t.transform_line(ray));
 
           if (intersect(params, pt, local))
@@ -194,6 +233,84 @@ namespace _Goptical {
       process_rays_<Trace::PolarizedTrace>(result, input);
     }
 
+    template <Trace::IntensityMode m>
+    inline void Surface::process_batch_(Trace::RayBatch &batch) const
+    {
+      const Trace::Params &params = batch.get_params();
+
+      // express incoming rays in surface local coordinates
+      batch.move_to_frame(*this);
+
+      unsigned int count = batch.get_ray_count();
+
+      if (count)
+        {
+          std::vector<double> ipt(count * 3);
+          double * const point[3] = { &ipt[0], &ipt[count], &ipt[count * 2] };
+          double * const normal[3] = { batch.get_normal_array(0), batch.get_normal_array(1),
+                                       batch.get_normal_array(2) };
+          const double * const origin[3] = { batch.get_origin_array(0), batch.get_origin_array(1),
+                                             batch.get_origin_array(2) };
+          const double * const direction[3] = { batch.get_direction_array(0), batch.get_direction_array(1),
+                                                batch.get_direction_array(2) };
+
+          // find intersection points of all alive rays at once
+          intersect_batch(params, count, batch.get_alive_array(), point, normal, origin, direction);
+
+          for (unsigned int i = 0; i < count; i++)
+            {
+              if (!batch.is_alive(i))
+                continue;
+
+              Math::Vector3 p(point[0][i], point[1][i], point[2][i]);
+
+              if (m != Trace::SimpleTrace)
+                {
+                  // apply absorbtion from current material
+                  double len = (p - batch.get_origin(i)).len();
+                  double i_intensity = batch.get_intensity(i) *
+                    batch.get_material(i)->get_internal_transmittance(
+                              batch.get_wavelen(i), len);
+
+                  batch.set_intensity(i, i_intensity);
+
+                  if (i_intensity < _discard_intensity)
+                    {
+                      batch.kill(i);
+                      continue;
+                    }
+                }
+
+              batch.set_origin(i, p);
+            }
+        }
+
+      switch (m)
+        {
+        case Trace::SimpleTrace:
+          return trace_batch_simple(batch, count);
+        case Trace::IntensityTrace:
+          return trace_batch_intensity(batch, count);
+        case Trace::PolarizedTrace:
+          return trace_batch_polarized(batch, count);
+        }
+    }
+
+    void Surface::process_batch_simple(Trace::RayBatch &batch) const
+    {
+      process_batch_<Trace::SimpleTrace>(batch);
+    }
+
+    void Surface::process_batch_intensity(Trace::RayBatch &batch) const
+    {
+      process_batch_<Trace::IntensityTrace>(batch);
+    }
+
+    void Surface::process_batch_polarized(Trace::RayBatch &batch) const
+    {
+      process_batch_<Trace::PolarizedTrace>(batch);
+    }
+
     Io::Rgb Surface::get_color(const Io::Renderer &r) const
     {
       return r.get_style_color(Io::StyleSurface);
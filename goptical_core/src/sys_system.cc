@@ -22,6 +22,7 @@
 
 */
 
+#include <limits>
 
 #include <Goptical/Sys/System>
 #include <Goptical/Sys/Group>
@@ -43,6 +44,7 @@ namespace _Goptical {
 
     System::System()
       : _version(0),
+        _structure_version(0),
         _env_proxy(Material::air),
         _tracer_params(),
         _e_count(0),
@@ -64,6 +66,7 @@ namespace _Goptical {
     {
       e.system_register(*this);
 
+      _structure_version++;
       update_version();
     }
 
@@ -77,11 +80,13 @@ namespace _Goptical {
       if (_exit.ptr() == &e)
         _exit.invalidate();
 
+      _structure_version++;
       update_version();
     }
 
     void System::set_environment(const const_ref<Material::Base> &env)
     {
+      _structure_version++;
       update_version();
       _env_proxy.set_material(env);
     }
@@ -91,22 +96,24 @@ namespace _Goptical {
       Math::Transform<3> * & e = transform_cache_entry(element.id(), 0);
 
       if (!e)
-        {
-          Math::Transform<3> t(element._transform);
-          const Element *i1 = &element;
+        e = new Math::Transform<3>(compute_global_transform(element));
 
-          while (const Element *i2 = dynamic_cast<Group *>(i1->_container))
-            {
-              t.compose(i2->_transform);
+      return *e;
+    }
 
-              i1 = i2;
-            }
+    Math::Transform<3> System::compute_global_transform(const Element &element) const
+    {
+      Math::Transform<3> t(element._transform);
+      const Element *i1 = &element;
 
-          assert(!e);
-          e = new Math::Transform<3>(t);
+      while (const Element *i2 = dynamic_cast<Group *>(i1->_container))
+        {
+          t.compose(i2->_transform);
+
+          i1 = i2;
         }
 
-      return *e;
+      return t;
     }
 
     const Math::Transform<3> & System::transform_g2l_cache_update(const Element &element) const
@@ -213,7 +220,7 @@ namespace _Goptical {
         }
       else
         {
-          index = _index_map.begin() - i;
+          index = i - _index_map.begin();
         }
 
       _index_map[index] = &element;
@@ -255,8 +262,6 @@ namespace _Goptical {
       return *res;
     }
 
-    /** FIXME write an optimized version of this function which uses
-        some kind of data structure (bsp tree?) */
     Surface *System::colide_next(const Trace::Params &params,
                                  Math::VectorPair3 &intersect,
                                  const Trace::Ray &ray) const
@@ -271,6 +276,9 @@ namespace _Goptical {
 
       for (unsigned int i = 1; i <= get_element_count(); i++)
         {
+          if (!has_element(i))
+            continue;
+
           Element *j = &get_element(i);
 
           if (j == origin || !j->is_enabled())
@@ -0,0 +1,156 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+
+#include <Goptical/Trace/RayBatch>
+#include <Goptical/Trace/Result>
+#include <Goptical/Sys/Element>
+#include <Goptical/Sys/CompiledSystem>
+#include <Goptical/Math/Transform>
+#include <Goptical/Math/VectorPair>
+
+namespace _Goptical {
+
+  namespace Trace {
+
+    RayBatch::RayBatch()
+      : _wavelen(),
+        _intensity(),
+        _material(),
+        _alive(),
+        _frame(0),
+        _params(0),
+        _result(0)
+    {
+    }
+
+    RayBatch::RayBatch(const Params &params, Result &result)
+      : _wavelen(),
+        _intensity(),
+        _material(),
+        _alive(),
+        _frame(0),
+        _params(&params),
+        _result(&result)
+    {
+    }
+
+    void RayBatch::clear()
+    {
+      for (unsigned int j = 0; j < 3; j++)
+        {
+          _origin[j].clear();
+          _direction[j].clear();
+          _normal[j].clear();
+        }
+
+      _wavelen.clear();
+      _intensity.clear();
+      _material.clear();
+      _alive.clear();
+      _frame = 0;
+    }
+
+    void RayBatch::reserve(unsigned int count)
+    {
+      for (unsigned int j = 0; j < 3; j++)
+        {
+          _origin[j].reserve(count);
+          _direction[j].reserve(count);
+          _normal[j].reserve(count);
+        }
+
+      _wavelen.reserve(count);
+      _intensity.reserve(count);
+      _material.reserve(count);
+      _alive.reserve(count);
+    }
+
+    unsigned int RayBatch::get_alive_count() const
+    {
+      unsigned int count = 0;
+
+      for (unsigned int i = 0; i < _alive.size(); i++)
+        count += _alive[i] != 0;
+
+      return count;
+    }
+
+    void RayBatch::transform(const Math::Transform<3> &t)
+    {
+      const Math::Matrix<3> &m = t.get_linear();
+      const Math::Vector3 &tr = t.get_translation();
+      unsigned int count = _alive.size();
+
+      double *ox = &_origin[0][0], *oy = &_origin[1][0], *oz = &_origin[2][0];
+      double *dx = &_direction[0][0], *dy = &_direction[1][0], *dz = &_direction[2][0];
+
+      const double m00 = m.value(0, 0), m01 = m.value(0, 1), m02 = m.value(0, 2);
+      const double m10 = m.value(1, 0), m11 = m.value(1, 1), m12 = m.value(1, 2);
+      const double m20 = m.value(2, 0), m21 = m.value(2, 1), m22 = m.value(2, 2);
+      const double t0 = tr[0], t1 = tr[1], t2 = tr[2];
+
+      // lost rays are transformed too, branch free loops
+
+      for (unsigned int i = 0; i < count; i++)
+        {
+          double x = ox[i], y = oy[i], z = oz[i];
+
+          ox[i] = m00 * x + m01 * y + m02 * z + t0;
+          oy[i] = m10 * x + m11 * y + m12 * z + t1;
+          oz[i] = m20 * x + m21 * y + m22 * z + t2;
+        }
+
+      for (unsigned int i = 0; i < count; i++)
+        {
+          double x = dx[i], y = dy[i], z = dz[i];
+
+          dx[i] = m00 * x + m01 * y + m02 * z;
+          dy[i] = m10 * x + m11 * y + m12 * z;
+          dz[i] = m20 * x + m21 * y + m22 * z;
+        }
+    }
+
+    void RayBatch::move_to_frame(const Sys::Element &frame)
+    {
+      if (_frame == &frame)
+        return;
+
+      if (_frame && !_alive.empty())
+        transform(_result ? _result->get_compiled_system().get_transform(*_frame, frame)
+                  : _frame->get_transform_to(frame));
+
+      _frame = &frame;
+    }
+
+    Math::VectorPair3 RayBatch::get_global_ray(unsigned int index) const
+    {
+      assert(_frame != 0);
+
+      return _frame->get_global_transform().transform_line(get_ray(index));
+    }
+
+  }
+}
+
@@ -23,15 +23,26 @@
 */
 
 
+#include <cmath>
+#include <limits>
+#include <memory>
+
 #include <Goptical/Sys/System>
 #include <Goptical/Sys/Element>
+#include <Goptical/Sys/Image>
+#include <Goptical/Sys/OpticalSurface>
+#include <Goptical/Sys/CompiledSystem>
 
+#include <Goptical/Trace/Accumulator>
 #include <Goptical/Trace/Ray>
 #include <Goptical/Trace/Result>
+#include <Goptical/Trace/Tracer>
 
 #include <Goptical/Math/Vector>
 #include <Goptical/Math/VectorPair>
 
+#include <Goptical/Data/Grid>
+
 #include <Goptical/Io/Renderer>
 
 namespace _Goptical {
@@ -39,23 +50,56 @@ namespace _Goptical {
   namespace Trace {
 
     Result::Result()
-      : _rays(),
+      : _ray_blocks(),
+        _ray_table(),
+        _ray_count(0),
+        _ray_merged(0),
+        _ray_block_pos(0),
+        _ray_table_shared(0),
+        _spare_lists(),
         _elements(),
         _wavelengths(),
+        _index_wavelens(),
+        _index_ratios(),
         _generated_queue(0),
+        _stream(0),
         _sources(),
         _bounce_limit_count(0),
-        _system(0)
+        _serial(0),
+        _system(0),
+        _params(0),
+        _compiled(0),
+        _workers()
+    {
+    }
+
+    Result::element_cache_s::~element_cache_s()
     {
     }
 
     Result::~Result()
     {
       clear();
+
+      GOPTICAL_FOREACH(i, _elements)
+        delete i->_cache;
+
+      GOPTICAL_FOREACH(w, _workers)
+        delete *w;
+
+      GOPTICAL_FOREACH(l, _spare_lists)
+        delete *l;
+
+      std::allocator<Ray> a;
+
+      GOPTICAL_FOREACH(b, _ray_blocks)
+        a.deallocate(*b, ray_block_size);
     }
 
     void Result::clear_save_states()
     {
+      _serial++;
+
       GOPTICAL_FOREACH(i, _elements)
         {
           i->_save_intercepted_list = false;
@@ -65,42 +109,404 @@ namespace _Goptical {
 
     void Result::clear()
     {
+      _serial++;
+
       GOPTICAL_FOREACH(i, _elements)
         {
           if (i->_intercepted)
             {
-              delete i->_intercepted;
+              _spare_lists.push_back(i->_intercepted);
               i->_intercepted = 0;
             }
 
           if (i->_generated)
             {
-              delete i->_generated;
+              _spare_lists.push_back(i->_generated);
               i->_generated = 0;
             }
+
+          if (i->_detector)
+            {
+              delete i->_detector;
+              i->_detector = 0;
+            }
         }
 
-      _rays.clear();
+      clear_rays();
+
       _sources.clear();
       _wavelengths.clear();
+      _index_wavelens.clear();
+      _index_ratios.clear();
 
       _bounce_limit_count = 0;
+
+      GOPTICAL_FOREACH(w, _workers)
+        (*w)->clear();
+    }
+
+    void Result::clear_rays()
+    {
+      // keep storage blocks for next ray trace
+      for (unsigned int i = 0; i < _ray_count; i++)
+        _ray_blocks[i >> ray_block_shift][i & (ray_block_size - 1)].~Ray();
+
+      _ray_count = 0;
+      _ray_merged = 0;
+      _ray_block_pos = 0;
+      _ray_table_shared = 0;
+      _ray_table.clear();
+    }
+
+    void Result::rewind_rays(const rays_mark_s &mark, const RayList &rays)
+    {
+      for (unsigned int i = mark._count; i < _ray_count; i++)
+        _ray_blocks[i >> ray_block_shift][i & (ray_block_size - 1)].~Ray();
+
+      // drop merged worker blocks, own blocks are kept for reuse
+      _ray_count = mark._count;
+      _ray_block_pos = mark._block_pos;
+      _ray_table.resize(mark._table);
+
+      GOPTICAL_FOREACH(w, _workers)
+        (*w)->recycle_rays();
+
+      GOPTICAL_FOREACH(r, rays)
+        {
+          Ray &ray = **r;
+
+          ray._len = std::numeric_limits<double>::max();
+          ray._child = 0;
+          ray._lost = true;
+        }
+    }
+
+    void Result::discard_rays(const Sys::Element &e)
+    {
+      element_result_s &er = get_element_result(e);
+
+      if (er._intercepted)
+        er._intercepted->clear();
+
+      if (er._generated)
+        er._generated->clear();
+
+      if (er._detector)
+        {
+          delete er._detector;
+          er._detector = 0;
+        }
+    }
+
+    void Result::recycle_rays()
+    {
+      GOPTICAL_FOREACH(i, _elements)
+        {
+          if (i->_intercepted)
+            i->_intercepted->clear();
+
+          if (i->_generated)
+            i->_generated->clear();
+        }
+
+      clear_rays();
+
+      GOPTICAL_FOREACH(w, _workers)
+        (*w)->recycle_rays();
+    }
+
+    void Result::flush_stream()
+    {
+      _stream->flush_stream();
+    }
+
+    void Result::check_streaming() const
+    {
+      GOPTICAL_FOREACH(i, _elements)
+        if (i->_save_intercepted_list || i->_save_generated_list)
+          throw Error("rays lists can not be saved in streaming ray trace mode");
+    }
+
+    void Result::accumulate() const
+    {
+      for (unsigned int i = 0; i < _elements.size(); i++)
+        {
+          const element_result_s &er = _elements[i];
+
+          if (er._accumulator && er._intercepted)
+            er._accumulator->accumulate(static_cast<const Sys::Surface &>(_system->get_element(i + 1)),
+                                        *er._intercepted);
+        }
     }
 
     void Result::prepare()
     {
       clear();
 
+      _stream = 0;
+
       GOPTICAL_FOREACH(i, _elements)
         {
-          if (i->_save_intercepted_list)
-            i->_intercepted = new rays_queue_t;
+          if (i->_save_intercepted_list || i->_accumulator)
+            i->_intercepted = new_list();
 
           if (i->_save_generated_list)
-            i->_generated = new rays_queue_t;
+            i->_generated = new_list();
+        }
+    }
+
+    void Result::update_index_table()
+    {
+      // table is only used during ray tracing
+      if (!_compiled)
+        return;
+
+      const Sys::CompiledSystem &cs = *_compiled;
+      unsigned int ecount = cs.get_element_count() + 1;
+
+      _index_wavelens.assign(_wavelengths.begin(), _wavelengths.end());
+
+      unsigned int count = _index_wavelens.size();
+
+      _index_ratios.assign(ecount * 2 * count, std::numeric_limits<double>::quiet_NaN());
+
+      for (unsigned int e = 1; e < ecount; e++)
+        {
+          if (!cs.get_optical_surface(e))
+            continue;
+
+          for (unsigned int i = 0; i < count; i++)
+            {
+              double wl = _index_wavelens[i];
+              double n[2];
+
+              // missing data errors are reported when rays hit the surface
+              try {
+                n[0] = cs.get_material(e, 0)->get_refractive_index(wl);
+                n[1] = cs.get_material(e, 1)->get_refractive_index(wl);
+              } catch (...) {
+                continue;
+              }
+
+              _index_ratios[(e * 2 + 0) * count + i] = n[0] / n[1];
+              _index_ratios[(e * 2 + 1) * count + i] = n[1] / n[0];
+            }
         }
     }
 
+    double Result::compute_index_ratio(const Sys::OpticalSurface &s,
+                                       bool right_to_left, double wavelen) const
+    {
+      return s.get_material(right_to_left).get_refractive_index(wavelen)
+        / s.get_material(!right_to_left).get_refractive_index(wavelen);
+    }
+
+    RayList * Result::new_list()
+    {
+      if (_spare_lists.empty())
+        return new RayList(*this);
+
+      RayList *l = _spare_lists.back();
+      _spare_lists.pop_back();
+      l->clear();
+
+      return l;
+    }
+
+    void Result::add_ray_block()
+    {
+      unsigned int b = _ray_count >> ray_block_shift;
+
+      if (_ray_table.size() >= (1U << (32 - ray_block_shift)))
+        throw Error("too many rays in ray trace result");
+
+      if (b == _ray_blocks.size())
+        _ray_blocks.push_back(std::allocator<Ray>().allocate(ray_block_size));
+
+      _ray_block_pos = _ray_table.size();
+      _ray_table.push_back(_ray_blocks[b]);
+    }
+
+    Result & Result::get_worker(unsigned int index)
+    {
+      while (_workers.size() <= index)
+        _workers.push_back(new Result());
+
+      Result &w = *_workers[index];
+
+      assert(_system != 0);
+
+      w._system = _system;
+      w._params = _params;
+      w._compiled = _compiled;
+      w._index_wavelens = _index_wavelens;
+      w._index_ratios = _index_ratios;
+      w._elements.resize(_elements.size());
+
+      // worker can access rays of this result with same indexes, its
+      // own new blocks are added after shared table entries
+      w._ray_table = _ray_table;
+      w._ray_table_shared = _ray_table.size();
+
+      for (unsigned int i = 0; i < _elements.size(); i++)
+        {
+          element_result_s &e = w._elements[i];
+
+          e._save_intercepted_list = _elements[i]._intercepted != 0;
+          e._save_generated_list = _elements[i]._generated != 0;
+
+          if (e._save_intercepted_list && !e._intercepted)
+            e._intercepted = w.new_list();
+
+          if (e._save_generated_list && !e._generated)
+            e._generated = w.new_list();
+        }
+
+      return w;
+    }
+
+    void Result::merge_list(RayList &list, RayList &wlist,
+                            unsigned int shared, unsigned int shift)
+    {
+      GOPTICAL_FOREACH(i, wlist._list)
+        list._list.push_back(*i < shared ? *i : *i + shift);
+
+      wlist.clear();
+    }
+
+    void Result::merge_worker(Result &w)
+    {
+      // make worker blocks addressable from this result and translate
+      // indexes of rays allocated in these blocks
+      unsigned int base = _ray_table.size();
+      unsigned int shared = w._ray_table_shared << ray_block_shift;
+      unsigned int shift = (base - w._ray_table_shared) << ray_block_shift;
+
+      if (base + w._ray_table.size() - w._ray_table_shared > (1U << (32 - ray_block_shift)))
+        throw Error("too many rays in ray trace result");
+
+      _ray_table.insert(_ray_table.end(),
+                        w._ray_table.begin() + w._ray_table_shared, w._ray_table.end());
+
+      for (unsigned int i = 0; i < _elements.size(); i++)
+        {
+          element_result_s &e = _elements[i];
+          element_result_s &we = w._elements[i];
+
+          if (e._intercepted && we._intercepted)
+            merge_list(*e._intercepted, *we._intercepted, shared, shift);
+
+          if (e._generated && we._generated)
+            merge_list(*e._generated, *we._generated, shared, shift);
+        }
+
+      for (unsigned int i = w._ray_merged; i < w._ray_count; i++)
+        {
+          Ray &r = w._ray_blocks[i >> ray_block_shift][i & (ray_block_size - 1)];
+
+          if (r._index >= shared)
+            r._index += shift;
+        }
+
+      // worker keeps allocating in its last block using indexes of this result
+      if (w._ray_block_pos >= w._ray_table_shared)
+        w._ray_block_pos += base - w._ray_table_shared;
+
+      w._ray_merged = w._ray_count;
+
+      for (unsigned int i = 0; i < _elements.size(); i++)
+        {
+          element_result_s &e = _elements[i];
+          element_result_s &we = w._elements[i];
+
+          if (!we._detector)
+            continue;
+
+          if (!e._detector)
+            e._detector = new detector_t;
+
+          GOPTICAL_FOREACH(d, *we._detector)
+            {
+              ref<Data::Grid> &g = (*e._detector)[d->first];
+
+              if (!g.valid())
+                {
+                  g = d->second;
+                  continue;
+                }
+
+              const Data::Grid &wg = *d->second;
+
+              for (unsigned int y = 0; y < wg.get_count(1); y++)
+                for (unsigned int x = 0; x < wg.get_count(0); x++)
+                  g->get_y_value(x, y) += wg.get_y_value(x, y);
+            }
+
+          delete we._detector;
+          we._detector = 0;
+        }
+
+      _bounce_limit_count += w._bounce_limit_count;
+      w._bounce_limit_count = 0;
+    }
+
+    void Result::add_detected(const Sys::Image &image, const Ray &ray)
+    {
+      add_detected(image, ray.get_intercept_point(),
+                   ray.get_wavelen(), ray.get_intercept_intensity());
+    }
+
+    void Result::add_detected(const Sys::Image &image, const Math::Vector3 &p,
+                              double wavelen, double intensity)
+    {
+      element_result_s &er = get_element_result(image);
+
+      if (!er._detector)
+        er._detector = new detector_t;
+
+      ref<Data::Grid> &g = (*er._detector)[image.is_detector_per_wavelen()
+                                           ? wavelen : 0.0];
+      unsigned int n1 = image.get_detector_size(0);
+      unsigned int n2 = image.get_detector_size(1);
+
+      if (!g.valid())
+        {
+          Math::VectorPair2 b = image.get_shape().get_bounding_box();
+          Math::Vector2 step((b[1].x() - b[0].x()) / n1,
+                             (b[1].y() - b[0].y()) / n2);
+
+          // grid samples are pixels centers
+          g = ref<Data::Grid>::create(n1, n2, b[0] + step / 2, step);
+          g->set_all_y(0.0);
+        }
+
+      const Math::Vector2 &step = g->get_step();
+      double x = floor((p.x() - g->get_origin().x()) / step.x() + 0.5);
+      double y = floor((p.y() - g->get_origin().y()) / step.y() + 0.5);
+
+      if (x < 0 || y < 0 || x >= n1 || y >= n2)
+        return;
+
+      g->get_y_value((unsigned int)x, (unsigned int)y)
+        += intensity / (step.x() * step.y());
+    }
+
+    const Data::Grid & Result::get_irradiance(const Sys::Image &image, double wavelen) const
+    {
+      const element_result_s &er = get_element_result(image);
+
+      if (er._detector)
+        {
+          detector_t::const_iterator i =
+            er._detector->find(image.is_detector_per_wavelen() ? wavelen : 0.0);
+
+          if (i != er._detector->end())
+            return *i->second;
+        }
+
+      throw Error("no irradiance data recorded for this image in ray trace result");
+    }
+
     void Result::init(const Sys::System &system)
     {
       static const struct element_result_s er = { 0 };
@@ -126,13 +532,33 @@ namespace _Goptical {
     void Result::set_intercepted_save_state(const Sys::Element &e, bool enabled)
     {
       init(e);
-      get_element_result(e)._save_intercepted_list = enabled;
+      element_result_s &er = get_element_result(e);
+
+      // keep rays of an incremental trace when state does not change
+      if (er._save_intercepted_list != enabled)
+        {
+          _serial++;
+          er._save_intercepted_list = enabled;
+        }
     }
 
     void Result::set_generated_save_state(const Sys::Element &e, bool enabled)
     {
       init(e);
-      get_element_result(e)._save_generated_list = enabled;
+      element_result_s &er = get_element_result(e);
+
+      if (er._save_generated_list != enabled)
+        {
+          _serial++;
+          er._save_generated_list = enabled;
+        }
+    }
+
+    void Result::set_intercepted_accumulator(const Sys::Surface &s, Accumulator *acc)
+    {
+      _serial++;
+      init(s);
+      get_element_result(s)._accumulator = acc;
     }
 
     bool Result::get_intercepted_save_state(const Sys::Element &e)
@@ -210,9 +636,17 @@ namespace _Goptical {
     {
       double res = 0;
 
-      GOPTICAL_FOREACH(r, _rays)
+      for (unsigned int j = 0; j < _ray_count; j++)
+        {
+          double i = _ray_blocks[j >> ray_block_shift][j & (ray_block_size - 1)].get_intensity();
+
+          if (i > res)
+            res = i;
+        }
+
+      GOPTICAL_FOREACH(w, _workers)
         {
-          double i = r->get_intensity();
+          double i = (*w)->get_max_ray_intensity();
 
           if (i > res)
             res = i;
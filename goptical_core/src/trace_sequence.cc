@@ -34,12 +34,14 @@ namespace _Goptical {
   namespace Trace {
 
     Sequence::Sequence()
-      : _list()
+      : _list(),
+        _version(0)
     {
     }
 
     Sequence::Sequence(const Sys::System &system)
-      : _list()
+      : _list(),
+        _version(0)
     {
       add(system);
     }
@@ -55,6 +57,7 @@ namespace _Goptical {
       _list.clear();
       add(static_cast<const Sys::Container&>(system));
       std::sort(_list.begin(), _list.end(), seq_sort);
+      _version++;
     }
 
     void Sequence::add(const Sys::Container &c)
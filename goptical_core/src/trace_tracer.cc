@@ -23,16 +23,30 @@
 */
 
 
-#include <deque>
+#include <algorithm>
+#include <cassert>
+#include <string>
+#include <vector>
+
+#include <Goptical/common.hh>
+
+#ifdef GOPTICAL_HAVE_PTHREAD
+# include <pthread.h>
+#endif
 
 #include <Goptical/Trace/Tracer>
 #include <Goptical/Trace/Result>
 #include <Goptical/Trace/Ray>
-#include <Goptical/Trace/Ray>
+#include <Goptical/Trace/RayBatch>
 #include <Goptical/Sys/System>
+#include <Goptical/Sys/CompiledSystem>
 #include <Goptical/Sys/Source>
 #include <Goptical/Error>
 #include <Goptical/Sys/Surface>
+#include <Goptical/Sys/OpticalSurface>
+#include <Goptical/Material/Base>
+#include <Goptical/Curve/Base>
+#include <Goptical/Shape/Base>
 #include <Goptical/Math/VectorPair>
 #include <Goptical/Trace/Distribution>
 #include <Goptical/Trace/Sequence>
@@ -43,9 +57,19 @@ namespace _Goptical {
 
     Tracer::Tracer(const const_ref<Sys::System> &system)
       : _system(system),
+        _compiled(0),
+        _own_compiled(),
         _params(system->get_tracer_params()),
         _result(),
-        _result_ptr(&_result)
+        _result_ptr(&_result),
+        _stream_func(0),
+        _stream_first(0),
+        _seq_checkpoints(),
+        _seq_split(0),
+        _seq_workers(false),
+        _seq_valid(false),
+        _seq_result_serial(0),
+        _seq_structure_version(0)
     {
     }
 
@@ -53,37 +77,111 @@ namespace _Goptical {
     {
     }
 
-    template <IntensityMode m> void Tracer::trace_seq_template()
+    /** @internal Per thread ray tracing job */
+    struct Tracer::worker_s
+    {
+      Tracer            *_tracer;
+      Result            *_result;
+      rays_queue_t      _rays;
+      unsigned int      _first;
+      worker_func_t     _func;
+      std::string       _error;
+    };
+
+    template <IntensityMode m> void Tracer::trace_seq_template(unsigned int first)
     {
       Result &result = *_result_ptr;
 
       result.init(*_system);
 
       // stack of rays to propagate
-      rays_queue_t tmp[2];
+      rays_queue_t tmp[2] = { rays_queue_t(result), rays_queue_t(result) };
 
       unsigned int swaped = 0;
       rays_queue_t *generated;
       rays_queue_t *source_rays = &tmp[1];
-      const std::vector<const_ref<Sys::Element> > &seq = _params._sequence->_list;
+      const Sys::CompiledSystem &cs = result.get_compiled_system();
+      const std::vector<const Sys::Element *> &seq = cs.get_sequence();
       const Sys::Element *entrance = 0;
+      unsigned int split = 0;
+      bool stream = _params._stream_chunk_size != 0;
+      bool incremental = _params._incremental_mode && !stream;
+
+      if (incremental && !first)
+        _seq_checkpoints.resize(seq.size());
 
-      // find entry element (first non source)
       for (unsigned int i = 0; i < seq.size(); i++)
         {
-          if (!dynamic_cast<const Sys::Source *>(seq[i].ptr()))
+          const Sys::Element *element = seq[i];
+
+          if (incremental)
             {
-              entrance = seq[i].ptr();
-              break;
+              seq_checkpoint_s &cp = _seq_checkpoints[i];
+
+              cp._element = element;
+              cp._version = element->get_version();
+              if (!first)
+                cp._input.set_result(result);
+            }
+
+          // find entry element (first non source)
+          if (!cs.get_source(element->id()))
+            {
+              if (!entrance)
+                entrance = element;
+            }
+          else
+            {
+              if (stream && entrance)
+                throw Error("Sources must be at Sequence start in streaming ray trace mode");
+
+              // rays can be split between threads after last source
+              split = i + 1;
             }
         }
 
-      for (unsigned int i = 0; i < seq.size(); i++)
+      _stream_func = &Tracer::trace_seq_chunk<m>;
+      _stream_first = split;
+
+      if (!first)
+        _seq_workers = false;
+      else if (first < seq.size())
+        {
+          // rays generated by elements before first are still valid,
+          // discard everything else and propagate again
+          seq_checkpoint_s &cp = _seq_checkpoints[first];
+
+          result.rewind_rays(cp._mark, cp._input);
+
+          for (unsigned int i = first; i < seq.size(); i++)
+            result.discard_rays(*seq[i]);
+
+          source_rays = &cp._input;
+        }
+
+      for (unsigned int i = first; i < seq.size(); i++)
         {
-          const Sys::Element *element = seq[i].ptr();
+          const Sys::Element *element = seq[i];
 
-          if (_system != element->get_system())
-            throw Error("Sequence contains element which is not part of the System");
+          // all source rays have already been propagated by chunks
+          if (i == split && stream)
+            break;
+
+          if (incremental && i >= split)
+            {
+              seq_checkpoint_s &cp = _seq_checkpoints[i];
+
+              if (source_rays != &cp._input)
+                cp._input.assign(source_rays->begin(), source_rays->end());
+              result.get_rays_mark(cp._mark);
+            }
+
+          if (i == split && get_worker_count(source_rays->size()) > 1)
+            {
+              _seq_workers = true;
+              run_workers(result, *source_rays, &Tracer::trace_seq_worker<m>, i);
+              break;
+            }
 
           if (!element->is_enabled())
             continue;
@@ -94,13 +192,40 @@ namespace _Goptical {
           result._generated_queue = generated;
           generated->clear();
 
-          if (const Sys::Source *source = dynamic_cast<const Sys::Source *>(element))
+          if (const Sys::Source *source = cs.get_source(element->id()))
             {
+              // rays of a source are propagated along with rays
+              // coming from previous sequence elements
+              if (!er._generated)
+                generated->assign(source_rays->begin(), source_rays->end());
+
               result._sources.push_back(source);
               Sys::Source::targets_t elist;
               if (entrance)
                 elist.push_back(entrance);
+
+              if (stream)
+                result._stream = this;
+
               source->generate_rays<m>(result, elist);
+
+              if (stream)
+                {
+                  result._stream = 0;
+                  flush_stream();
+                }
+
+              if (er._generated && !source_rays->empty())
+                {
+                  // keep saved list for this source only
+                  rays_queue_t *rays = &tmp[swaped];
+
+                  rays->assign(source_rays->begin(), source_rays->end());
+                  GOPTICAL_FOREACH(r, *generated)
+                    rays->push_back(*r);
+
+                  generated = rays;
+                }
             }
           else
             {
@@ -114,6 +239,261 @@ namespace _Goptical {
         }
 
       result._generated_queue = 0;
+
+      if (incremental)
+        {
+          _seq_split = split;
+          _seq_result_serial = result._serial;
+          _seq_structure_version = _system->get_structure_version();
+          _seq_valid = true;
+        }
+    }
+
+    unsigned int Tracer::get_seq_restart(const Sys::CompiledSystem &cs) const
+    {
+      const std::vector<const Sys::Element *> &seq = cs.get_sequence();
+
+      if (!_seq_valid || _seq_result_serial != _result_ptr->_serial ||
+          _seq_structure_version != _system->get_structure_version() ||
+          _seq_checkpoints.size() != seq.size())
+        return 0;
+
+      unsigned int first = seq.size();
+
+      for (unsigned int i = 0; i < seq.size(); i++)
+        {
+          const seq_checkpoint_s &cp = _seq_checkpoints[i];
+
+          if (cp._element != seq[i])
+            return 0;
+
+          // intercepted rays lists can not be partially discarded
+          for (unsigned int j = 0; j < i; j++)
+            if (seq[j] == seq[i])
+              return 0;
+
+          if (first == seq.size() && cp._version != seq[i]->get_version())
+            first = i;
+        }
+
+      // sources must generate rays again
+      if (first < _seq_split)
+        return 0;
+
+      // aimed source rays depend on elements up to the aiming stop
+      if (_params._sequential_mode && _params._aiming_stop)
+        for (unsigned int i = first; i < seq.size(); i++)
+          if (seq[i] == _params._aiming_stop)
+            return 0;
+
+      // rays lists of elements processed by worker threads are not saved
+      if (_seq_workers && first < seq.size())
+        first = _seq_split;
+
+      return first;
+    }
+
+    template <IntensityMode m> void Tracer::trace_batch_template(RayBatch &batch)
+    {
+      Result &result = *_result_ptr;
+
+      result.init(*_system);
+
+      rays_queue_t tmp(result);
+      const Sys::CompiledSystem &cs = result.get_compiled_system();
+      const std::vector<const Sys::Element *> &seq = cs.get_sequence();
+      const Sys::Element *entrance = 0;
+
+      batch.clear();
+      batch._params = &_params;
+      batch._result = &result;
+
+      // find entry element (first non source)
+      for (unsigned int i = 0; i < seq.size(); i++)
+        {
+          if (!cs.get_source(seq[i]->id()))
+            {
+              entrance = seq[i];
+              break;
+            }
+        }
+
+      for (unsigned int i = 0; i < seq.size(); i++)
+        {
+          const Sys::Element *element = seq[i];
+
+          if (!element->is_enabled())
+            continue;
+
+          if (const Sys::Source *source = cs.get_source(element->id()))
+            {
+              Result::element_result_s &er = result.get_element_result(*element);
+              rays_queue_t *generated = er._generated ? er._generated : &tmp;
+
+              result._generated_queue = generated;
+              generated->clear();
+
+              result._sources.push_back(source);
+              Sys::Source::targets_t elist;
+              if (entrance)
+                elist.push_back(entrance);
+              source->generate_rays<m>(result, elist);
+
+              // load source rays in batch, source coordinates
+              batch.move_to_frame(*source);
+              batch.reserve(batch.get_ray_count() + generated->size());
+
+              GOPTICAL_FOREACH(r, *generated)
+                batch.add_ray(**r, (*r)->get_wavelen(), (*r)->get_intensity(),
+                              (*r)->get_material());
+
+              result._generated_queue = 0;
+            }
+          else
+            {
+              element->process_rays<m>(batch);
+            }
+
+          GOPTICAL_DEBUG(" " << batch.get_alive_count() << " batch rays alive after " << *element);
+        }
+    }
+
+    template <IntensityMode m> void Tracer::trace_seq_worker(worker_s &w)
+    {
+      Result &result = *w._result;
+
+      rays_queue_t tmp[2] = { rays_queue_t(result), rays_queue_t(result) };
+
+      unsigned int swaped = 0;
+      rays_queue_t *generated;
+      rays_queue_t *source_rays = &w._rays;
+      const std::vector<const Sys::Element *> &seq = result.get_compiled_system().get_sequence();
+
+      // no source left in sequence, only process rays
+      for (unsigned int i = w._first; i < seq.size(); i++)
+        {
+          const Sys::Element *element = seq[i];
+
+          if (!element->is_enabled())
+            continue;
+
+          Result::element_result_s &er = result.get_element_result(*element);
+
+          generated = er._generated ? er._generated : &tmp[swaped];
+          result._generated_queue = generated;
+          generated->clear();
+
+          element->process_rays<m>(result, source_rays);
+
+          source_rays = generated;
+          swaped ^= 1;
+        }
+
+      result._generated_queue = 0;
+    }
+
+    template <IntensityMode m> void Tracer::trace_rays(Result &result, const rays_queue_t &source_rays)
+    {
+      const Sys::CompiledSystem &cs = result.get_compiled_system();
+      rays_queue_t gqueue(result);
+      unsigned int gnext = 0;
+      result._generated_queue = &gqueue;
+
+      GOPTICAL_FOREACH(r, source_rays)
+        {
+          Ray *ray = *r;
+          unsigned int bounce = _params._max_bounce;
+
+          // trace relfected/refracted ray further
+          while (1)
+            {
+              // check bounce limit
+              if (!bounce--)
+                result._bounce_limit_count++;
+              else
+                {
+                  Math::VectorPair3 intersect; // intersection point and normal (intersect surface local)
+
+                  // find ray / surface interction
+                  if (const Sys::Surface *s = cs.colide_next(_params, intersect, *ray))
+                    {
+                      result.add_intercepted(*s, *ray);
+
+                      // transform incident ray to surface local
+                      const Math::Transform<3> &t = cs.get_transform(*ray->get_creator(), *s);
+                      Math::VectorPair3 local(t.transform_line(*ray));
+
+                      s->trace_ray<m>(result, *ray, local, intersect);
+                    }
+                }
+
+              // pick next ray to trace further through the system
+              if (gnext == gqueue.size())
+                {
+                  gqueue.clear();
+                  gnext = 0;
+                  break;
+                }
+
+              ray = gqueue[gnext++];
+
+              result.add_generated(*ray->get_creator(), *ray);
+            }
+        }
+
+      result._generated_queue = 0;
+    }
+
+    template <IntensityMode m> void Tracer::trace_worker(worker_s &w)
+    {
+      trace_rays<m>(*w._result, w._rays);
+    }
+
+    template <IntensityMode m>
+    void Tracer::trace_chunk(Result &result, const rays_queue_t &source_rays)
+    {
+      if (get_worker_count(source_rays.size()) > 1)
+        run_workers(result, source_rays, &Tracer::trace_worker<m>, 0);
+      else
+        trace_rays<m>(result, source_rays);
+    }
+
+    template <IntensityMode m>
+    void Tracer::trace_seq_chunk(Result &result, const rays_queue_t &source_rays)
+    {
+      if (get_worker_count(source_rays.size()) > 1)
+        {
+          run_workers(result, source_rays, &Tracer::trace_seq_worker<m>, _stream_first);
+        }
+      else
+        {
+          worker_s w;
+
+          w._result = &result;
+          w._rays = source_rays;
+          w._first = _stream_first;
+
+          trace_seq_worker<m>(w);
+        }
+    }
+
+    void Tracer::flush_stream()
+    {
+      Result &result = *_result_ptr;
+      rays_queue_t *source_rays = result._generated_queue;
+
+      assert(source_rays != 0);
+
+      result._stream = 0;
+      (this->*_stream_func)(result, *source_rays);
+
+      // feed accumulators and discard all rays
+      result.accumulate();
+      result.recycle_rays();
+
+      source_rays->clear();
+      result._generated_queue = source_rays;
+      result._stream = this;
     }
 
     template <IntensityMode m> void Tracer::trace_template()
@@ -127,22 +507,25 @@ namespace _Goptical {
 
       // stack of rays to propagate
 
-      rays_queue_t source_rays;
+      rays_queue_t source_rays(result);
+      bool stream = _params._stream_chunk_size != 0;
+
+      _stream_func = &Tracer::trace_chunk<m>;
+      _stream_first = 0;
 
       Sys::Source::targets_t entry;
       entry.push_back(&_system->get_entrance_pupil());
 
-      // FIXME avoid container use here
-      std::vector<const Sys::Source *> slist;
-      delegate_push<typeof(slist), const Sys::Source &> d(slist);
-      _system->get_elements<Sys::Source>(d);
+      const Sys::CompiledSystem &cs = result.get_compiled_system();
 
-      GOPTICAL_FOREACH(s, slist)
+      GOPTICAL_FOREACH(e, cs.get_sequence())
         {
-          const Sys::Source &source = **s;
+          const Sys::Source *s = cs.get_source((*e)->id());
+
+          if (!s)
+            continue;
 
-          if (_system != source.get_system())
-            throw Error("can not trace with Source which is not part of the System");
+          const Sys::Source &source = *s;
 
           if (!source.is_enabled())
             continue;
@@ -152,8 +535,14 @@ namespace _Goptical {
           // get rays from source
           source_rays.clear();
           result._generated_queue = &source_rays;
+
+          if (stream)
+            result._stream = this;
+
           source.generate_rays<m>(result, entry);
 
+          result._stream = 0;
+
           // copy to source generated rays
           {
             Result::element_result_s &source_er = result.get_element_result(source);
@@ -166,60 +555,201 @@ namespace _Goptical {
 
           // trace each ray generated by source through the system
 
-          rays_queue_t gqueue;
-          result._generated_queue = &gqueue;
+          if (stream)
+            flush_stream();
+          else
+            trace_chunk<m>(result, source_rays);
+        }
 
-          GOPTICAL_FOREACH(r, source_rays)
-            {
-              Ray *ray = *r;
-              unsigned int bounce = _params._max_bounce;
+      result._generated_queue = 0;
+    }
 
-              // trace relfected/refracted ray further
-              while (1)
-                {
-                  // check bounce limit
-                  if (!bounce--)
-                    result._bounce_limit_count++;
-                  else
-                    {
-                      Math::VectorPair3 intersect; // intersection point and normal (intersect surface local)
+    unsigned int Tracer::get_worker_count(size_t ray_count) const
+    {
+#ifdef GOPTICAL_HAVE_PTHREAD
+      return std::min<size_t>(_params._thread_count, ray_count);
+#else
+      return 1;
+#endif
+    }
 
-                      // find ray / surface interction
-                      if (Sys::Surface *s = _system->colide_next(_params, intersect, *ray))
-                        {
-                          result.add_intercepted(*s, *ray);
+    void Tracer::prepare_workers(const Result &result) const
+    {
+      // Transforms, curves and shapes caches have been filled when
+      // the system was compiled. Some materials update cached data
+      // on first access for each wavelen, make sure this is done
+      // before rays are traced concurrently
 
-                          // transform incident ray to surface local
-                          const Math::Transform<3> &t = ray->get_creator()->get_transform_to(*s);
-                          Math::VectorPair3 local(t.transform_line(*ray));
+      const Sys::CompiledSystem &cs = result.get_compiled_system();
+      unsigned int count = cs.get_element_count();
+      const std::set<double> &wl = result.get_ray_wavelen_set();
 
-                          s->trace_ray<m>(result, *ray, local, intersect);
-                        }
-                    }
+      for (unsigned int i = 1; i <= count; i++)
+        {
+          if (cs.get_optical_surface(i))
+            {
+              for (unsigned int k = 0; k < 2; k++)
+                {
+                  const Material::Base &mat = *cs.get_material(i, k);
+
+                  GOPTICAL_FOREACH(w, wl)
+                    {
+                      mat.get_refractive_index(*w);
 
-                  // pick next ray to trace further through the system
-                  if (gqueue.empty())
-                    break;
-                  
-                  ray = gqueue.front();
-                  gqueue.pop_front();
+                      if (_params._intensity_mode == SimpleTrace)
+                        continue;
 
-                  result.add_generated(*ray->get_creator(), *ray);
+                      // missing data errors are reported by tracer threads
+                      try {
+                        mat.get_internal_transmittance(*w, 1.0);
+                      } catch (...) {
+                      }
+                    }
                 }
             }
         }
+    }
 
-      result._generated_queue = 0;
+    void * Tracer::worker_entry(void *w_)
+    {
+      worker_s &w = *static_cast<worker_s *>(w_);
+
+      try {
+        (w._tracer->*w._func)(w);
+      } catch (const std::exception &e) {
+        w._error = e.what();
+      }
+
+      return 0;
     }
 
-    void Tracer::trace()
+    void Tracer::run_workers(Result &result, const rays_queue_t &source_rays,
+                             worker_func_t func, unsigned int first)
+    {
+      unsigned int count = get_worker_count(source_rays.size());
+      size_t size = source_rays.size();
+      std::vector<worker_s> workers(count);
+
+      prepare_workers(result);
+
+      // split rays in contiguous ranges so that merged rays lists
+      // keep single thread ordering
+      for (unsigned int i = 0; i < count; i++)
+        {
+          worker_s &w = workers[i];
+
+          w._tracer = this;
+          w._result = &result.get_worker(i);
+          w._first = first;
+          w._func = func;
+          w._rays.set_result(*w._result);
+          w._rays.assign(source_rays.begin() + size * i / count,
+                         source_rays.begin() + size * (i + 1) / count);
+        }
+
+#ifdef GOPTICAL_HAVE_PTHREAD
+      std::vector<pthread_t> threads(count);
+      std::vector<bool> started(count, false);
+
+      for (unsigned int i = 1; i < count; i++)
+        started[i] = !pthread_create(&threads[i], 0, &worker_entry, &workers[i]);
+
+      worker_entry(&workers[0]);
+
+      for (unsigned int i = 1; i < count; i++)
+        {
+          if (started[i])
+            pthread_join(threads[i], 0);
+          else
+            worker_entry(&workers[i]);
+        }
+#else
+      for (unsigned int i = 0; i < count; i++)
+        worker_entry(&workers[i]);
+#endif
+
+      for (unsigned int i = 0; i < count; i++)
+        result.merge_worker(*workers[i]._result);
+
+      for (unsigned int i = 0; i < count; i++)
+        if (!workers[i]._error.empty())
+          throw Error(workers[i]._error);
+    }
+
+    void Tracer::set_compiled_system(const Sys::CompiledSystem &compiled)
+    {
+      if (&compiled.get_system() != _system.ptr())
+        throw Error("compiled system snapshot does not belong to tracer System");
+
+      _compiled = &compiled;
+      _own_compiled.invalidate();
+    }
+
+    const Sys::CompiledSystem & Tracer::get_compiled_system()
+    {
+      if (!_compiled || !_compiled->is_up_to_date(*_system, _params))
+        {
+          _own_compiled = ref<Sys::CompiledSystem>::create(*_system, _params);
+          _compiled = _own_compiled.ptr();
+        }
+
+      return *_compiled;
+    }
+
+    void Tracer::trace_batch(RayBatch &batch)
     {
       Result    &result = *_result_ptr;
 
+      if (!_params._sequential_mode)
+        throw Error("batch ray tracing is only available in sequential mode");
+
       // clear previous results
       result.prepare();
 
       result._params = &_params;
+      result._compiled = &get_compiled_system();
+
+      switch (_params._intensity_mode)
+        {
+        case SimpleTrace:
+          trace_batch_template<SimpleTrace>(batch);
+          break;
+
+        case IntensityTrace:
+          trace_batch_template<IntensityTrace>(batch);
+          break;
+
+        case PolarizedTrace:
+          trace_batch_template<PolarizedTrace>(batch);
+          break;
+        }
+    }
+
+    void Tracer::trace()
+    {
+      Result    &result = *_result_ptr;
+      const Sys::CompiledSystem &cs = get_compiled_system();
+      unsigned int first = 0;
+
+      if (_params._sequential_mode && _params._incremental_mode &&
+          !_params._stream_chunk_size)
+        first = get_seq_restart(cs);
+
+      _seq_valid = false;
+
+      // clear previous results, rays of unmodified sequence elements
+      // are kept when tracing incrementally
+      if (!first)
+        result.prepare();
+
+      result._params = &_params;
+      result._compiled = &cs;
+
+      if (first)
+        result.update_index_table();
+
+      if (_params._stream_chunk_size)
+        result.check_streaming();
 
       switch (_params._intensity_mode)
         {
@@ -227,23 +757,27 @@ namespace _Goptical {
           if (!_params._sequential_mode)
             trace_template<SimpleTrace>();
           else
-            trace_seq_template<SimpleTrace>();
+            trace_seq_template<SimpleTrace>(first);
           break;
 
         case IntensityTrace:
           if (!_params._sequential_mode)
             trace_template<IntensityTrace>();
           else
-            trace_seq_template<IntensityTrace>();
+            trace_seq_template<IntensityTrace>(first);
           break;
 
         case PolarizedTrace:
           if (!_params._sequential_mode)
             trace_template<PolarizedTrace>();       
           else
-            trace_seq_template<PolarizedTrace>();
+            trace_seq_template<PolarizedTrace>(first);
           break;
         }
+
+      // accumulators are fed after each chunk in streaming mode
+      if (!_params._stream_chunk_size)
+        result.accumulate();
     }
 
   }
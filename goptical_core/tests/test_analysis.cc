@@ -0,0 +1,620 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+
+
+#include <iostream>
+
+#include <Goptical/Error>
+
+#include <Goptical/Math/Vector>
+#include <Goptical/Math/VectorPair>
+
+#include <Goptical/Sys/System>
+#include <Goptical/Sys/Surface>
+#include <Goptical/Sys/SourcePoint>
+#include <Goptical/Sys/Mirror>
+#include <Goptical/Sys/Image>
+#include <Goptical/Sys/OpticalSurface>
+#include <Goptical/Sys/Stop>
+
+#include <Goptical/Curve/Zernike>
+
+#include <Goptical/Trace/Sequence>
+#include <Goptical/Trace/Distribution>
+#include <Goptical/Trace/Params>
+
+#include <Goptical/Light/SpectralLine>
+
+#include <Goptical/Material/Base>
+#include <Goptical/Material/Abbe>
+
+#include <Goptical/Data/Grid>
+#include <Goptical/Data/SampleSet>
+
+#include <Goptical/Analysis/Psf>
+#include <Goptical/Analysis/Mtf>
+#include <Goptical/Analysis/Wavefront>
+#include <Goptical/Analysis/Focus>
+#include <Goptical/Analysis/Spot>
+#include <Goptical/Analysis/Tolerancing>
+#include <Goptical/Analysis/Paraxial>
+
+#include <algorithm>
+
+#include <stdlib.h>
+#include <math.h>
+
+using namespace Goptical;
+
+#define fail(x)                                 \
+{                                               \
+  std::cerr << x << std::endl;                  \
+  exit(1);                                      \
+}
+
+static const double focal = 500;
+static const double radius = 25;
+static const double na = radius / focal;
+
+// diffraction limited point spread function of parabolic mirror
+static void test_psf(Sys::System &sys, const Sys::Surface &pupil)
+{
+  Analysis::Psf psf(sys);
+
+  psf.set_entrance_surface(pupil);
+
+  double wl = psf.get_wavelen() * 1e-6;
+
+  if (wl != Light::SpectralLine::F * 1e-6)
+    fail("shortest wavelength not selected by default: " << psf.get_wavelen());
+
+  if (psf.get_strehl_ratio() < 0.99)
+    fail("bad diffraction limited Strehl ratio " << psf.get_strehl_ratio());
+
+  if (fabs(psf.get_numerical_aperture() - na) > 1e-3)
+    fail("bad numerical aperture " << psf.get_numerical_aperture());
+
+  const Data::Grid &g = psf.get_grid();
+  unsigned int size = psf.get_fft_size();
+
+  // 63 pupil samples across, padded twice
+  if (size != 128 || g.get_count(0) != size || g.get_count(1) != size)
+    fail("bad fft size " << size);
+
+  // finer psf sampling
+  psf.set_padding(4);
+  size = psf.get_fft_size();
+
+  if (size != 256 || g.get_count(0) != size)
+    fail("bad padded fft size " << size);
+
+  // peak at reference point
+  if (fabs(g.interpolate(Math::vector2_0) - psf.get_strehl_ratio()) > 1e-6)
+    fail("psf peak differs from Strehl ratio " << g.interpolate(Math::vector2_0));
+
+  // first dark ring of Airy disk
+  double r0 = 0.61 * wl / na;
+
+  for (double a = 0; a < 2 * M_PI; a += M_PI / 8)
+    {
+      double i = g.interpolate(Math::Vector2(cos(a), sin(a)) * r0);
+      if (i > 0.02)
+        fail("psf intensity too high at first Airy ring " << i);
+    }
+
+  // energy conservation (Parseval)
+  double sum = 0;
+
+  for (unsigned int y = 0; y < size; y++)
+    for (unsigned int x = 0; x < size; x++)
+      sum += g.get_y_value(x, y);
+
+  // about pi * 32^2 pupil samples
+  if (fabs(sum * M_PI * 32 * 32 / (size * size) - 1.0) > 0.02)
+    fail("psf energy not conserved " << sum);
+
+  Math::Vector2 spacing = psf.get_sample_spacing();
+
+  if (fabs(spacing.x() - spacing.y()) > 1e-9 * spacing.x())
+    fail("bad psf sampling " << spacing);
+
+  // defocus giving 0.25 wave peak to valley wavefront error
+  double strehl = psf.get_strehl_ratio();
+
+  psf.set_defocus(0.5 * wl / (na * na));
+
+  double expected = pow(sin(M_PI / 4) / (M_PI / 4), 2);
+
+  if (fabs(psf.get_strehl_ratio() - expected) > 0.02)
+    fail("bad defocused Strehl ratio " << psf.get_strehl_ratio() << " expected " << expected);
+
+  psf.set_defocus(0);
+
+  if (psf.get_strehl_ratio() != strehl)
+    fail("Strehl ratio not restored " << psf.get_strehl_ratio());
+
+  // other traced wavelength scales psf sampling, up to air dispersion
+  psf.set_wavelen(Light::SpectralLine::C);
+
+  if (fabs(psf.get_sample_spacing().x() / spacing.x() -
+           Light::SpectralLine::C / Light::SpectralLine::F) > 1e-5)
+    fail("bad psf sampling for C line " << psf.get_sample_spacing());
+
+  psf.set_wavelen(500);
+
+  try {
+    psf.get_grid();
+    fail("missing wavelength not reported");
+  } catch (const Error &e) {
+  }
+}
+
+// diffraction limited modulation transfer function of circular pupil
+static void test_mtf(Sys::System &sys, const Sys::Surface &pupil)
+{
+  Analysis::Mtf mtf(sys);
+
+  mtf.get_psf().set_entrance_surface(pupil);
+
+  double fc = mtf.get_cutoff_frequency();
+  double wl = Light::SpectralLine::F * 1e-6;
+
+  if (fabs(fc - 2 * na / wl) > 1e-2 * fc)
+    fail("bad cutoff frequency " << fc);
+
+  for (unsigned int i = 0; i < 2; i++)
+    {
+      Analysis::Mtf::mtf_plane_e p = (Analysis::Mtf::mtf_plane_e)i;
+
+      if (fabs(mtf.get_mtf(0, p) - 1.0) > 1e-9)
+        fail("bad zero frequency mtf " << mtf.get_mtf(0, p));
+
+      for (double v = 0.1; v < 1.0; v += 0.1)
+        {
+          double expected = 2 / M_PI * (acos(v) - v * sqrt(1 - v * v));
+
+          if (fabs(mtf.get_mtf(v * fc, p) - expected) > 0.03)
+            fail("bad mtf at " << v << " cutoff: " << mtf.get_mtf(v * fc, p) << " expected " << expected);
+        }
+
+      if (mtf.get_mtf(1.1 * fc, p) > 0.01)
+        fail("mtf above cutoff " << mtf.get_mtf(1.1 * fc, p));
+    }
+
+  if (mtf.get_plot()->get_plot_count() != 2)
+    fail("bad mtf plot");
+}
+
+// Zernike decomposition of spherical mirror aberration
+static void test_wavefront(Sys::System &sys, const Sys::Surface &pupil,
+                           Sys::Image &image, bool sphere)
+{
+  Analysis::Wavefront wf(sys);
+
+  wf.set_entrance_surface(pupil);
+
+  double wl = Light::SpectralLine::F * 1e-6;
+
+  if (wf.get_wavelen() != Light::SpectralLine::F)
+    fail("shortest wavelength not selected by default: " << wf.get_wavelen());
+
+  if (wf.get_fit_rms() > 1e-4)
+    fail("bad Zernike fit residual " << wf.get_fit_rms());
+
+  if (!sphere)
+    {
+      if (wf.get_rms() > 1e-3)
+        fail("parabola wavefront not perfect " << wf.get_rms());
+      return;
+    }
+
+  // third order spherical aberration
+  double w040 = pow(radius, 4) / (4 * pow(2 * focal, 3)) / wl;
+  double c3 = wf.get_coefficient(3);
+  double c8 = wf.get_coefficient(8);
+
+  if (fabs(fabs(c8) - w040 / 6) > 0.02 * w040 / 6)
+    fail("bad spherical term " << c8 << " expected " << w040 / 6);
+
+  if (fabs(fabs(c3) - w040 / 2) > 0.02 * w040 / 2)
+    fail("bad focus term " << c3 << " expected " << w040 / 2);
+
+  for (unsigned int i = 1; i < wf.get_term_count(); i++)
+    if (i != 3 && i != 8 && fabs(wf.get_coefficient(i)) > 1e-2 * fabs(c8))
+      fail("unexpected Zernike term " << i << ": " << wf.get_coefficient(i));
+
+  // moving image plane only changes focus term, basis is reused
+  Math::Vector3 pos = image.get_local_position();
+  double dz = 0.01;
+
+  image.set_local_position(pos + Math::Vector3(0, 0, dz));
+  wf.invalidate();
+
+  if (fabs(wf.get_coefficient(8) - c8) > 1e-3 * fabs(c8))
+    fail("spherical term changed with defocus " << wf.get_coefficient(8));
+
+  double dc3 = dz * na * na / 4 / wl;
+
+  if (fabs(fabs(wf.get_coefficient(3) - c3) - dc3) > 0.02 * dc3)
+    fail("bad focus term change " << wf.get_coefficient(3) - c3 << " expected " << dc3);
+
+  image.set_local_position(pos);
+
+  // fit less terms
+  wf.set_term_count(4);
+
+  if (wf.get_coefficients().size() != 4 || wf.get_fit_rms() < 1e-3)
+    fail("bad reduced Zernike fit " << wf.get_fit_rms());
+
+  // rms of w040 rho^4, fine sampling gives near uniform pupil weighting
+  wf.set_distribution(Trace::Distribution(Trace::HexaPolarDist, 40));
+
+  double rms = fabs(c8) * 6 * sqrt(1. / 5 - 1. / 9);
+
+  if (fabs(wf.get_rms() - rms) > 0.05 * rms)
+    fail("bad wavefront rms " << wf.get_rms() << " expected " << rms);
+
+  try {
+    wf.set_term_count(Curve::Zernike::term_count + 1);
+    fail("bad term count not reported");
+  } catch (const Error &e) {
+  }
+}
+
+// compare through focus curves with spot analysis on moved image
+static void test_through_focus(Sys::System &sys, Sys::Image &image)
+{
+  Analysis::Focus focus(sys);
+
+  const double first = -0.1, last = 0.3, radius = 0.01;
+  const unsigned int count = 9;
+
+  ref<Data::SampleSet> rms = focus.get_rms_radius_curve(first, last, count);
+  ref<Data::SampleSet> ee = focus.get_encircled_intensity_curve(radius, first, last, count);
+
+  if (rms->get_count() != count || ee->get_count() != count ||
+      fabs(rms->get_x_value(count - 1) - last) > 1e-12)
+    fail("bad through focus curve sampling");
+
+  Math::Vector3 pos = image.get_local_position();
+  double min = rms->get_y_value(0);
+
+  for (unsigned int i = 0; i < count; i++)
+    {
+      double z = rms->get_x_value(i);
+
+      image.set_local_position(pos + Math::Vector3(0, 0, z));
+
+      Analysis::Spot spot(sys);
+
+      if (fabs(rms->get_y_value(i) - spot.get_rms_radius()) > 1e-9 * spot.get_rms_radius())
+        fail("through focus rms mismatch at " << z << ": " << rms->get_y_value(i)
+             << " expected " << spot.get_rms_radius());
+
+      if (fabs(ee->get_y_value(i) - spot.get_encircled_intensity(radius)) > 1e-9 * spot.get_total_intensity())
+        fail("through focus encircled intensity mismatch at " << z << ": " << ee->get_y_value(i)
+             << " expected " << spot.get_encircled_intensity(radius));
+
+      min = std::min(min, rms->get_y_value(i));
+    }
+
+  image.set_local_position(pos);
+
+  // spherical aberration best focus is between paraxial and marginal focus
+  if (!(min < rms->get_y_value(count - 1) && min < rms->get_y_value(0)))
+    fail("no rms radius minimum in through focus range");
+}
+
+// Monte Carlo tolerancing of spherical mirror
+static void test_tolerancing(Sys::System &sys, const Sys::Mirror &mirror,
+                             const Sys::Image &image)
+{
+  typedef Analysis::Tolerancing T;
+
+  Math::Vector3 pos = image.get_position();
+  T tol(sys);
+
+  tol.set_trial_count(50);
+  tol.set_seed(42);
+  tol.set_thread_count(1);
+
+  Analysis::Spot spot(sys);
+
+  if (fabs(tol.get_nominal_value() - spot.get_rms_radius()) > 1e-9 * spot.get_rms_radius())
+    fail("bad nominal tolerancing value " << tol.get_nominal_value()
+         << " expected " << spot.get_rms_radius());
+
+  if (tol.get_std_deviation() > 1e-9 * tol.get_mean() ||
+      tol.get_percentile(0.5) != tol.get_nominal_value())
+    fail("spread without tolerance " << tol.get_std_deviation());
+
+  if (tol.set_tolerance(mirror, T::TiltX, 0.01) != 0 ||
+      tol.set_tolerance(mirror, T::Radius, 0.0) != 1 ||
+      tol.set_tolerance(mirror, T::Thickness, 0.2, T::NormalTolerance) != 2 ||
+      tol.set_tolerance(mirror, T::TiltX, 0.02) != 0 ||
+      tol.get_tolerance_count() != 3)
+    fail("bad tolerance index");
+
+  try {
+    tol.set_tolerance(image, T::Index, 1e-3);
+    fail("index tolerance on image not reported");
+  } catch (const Error &e) {
+  }
+
+  if (tol.get_sensitivity(1) != 0.0 || tol.get_sensitivity(1, true) != 0.0)
+    fail("zero tolerance changes metric " << tol.get_sensitivity(1));
+
+  // off axis spot is larger, both sides are symmetric
+  double s0 = tol.get_sensitivity(0);
+
+  if (!(s0 > 0) || fabs(tol.get_sensitivity(0, true) - s0) > 1e-6 * s0)
+    fail("bad tilt sensitivity " << s0 << " " << tol.get_sensitivity(0, true));
+
+  if (tol.get_failure_count() != 0 || tol.get_values().size() != 50)
+    fail("bad tolerancing trials " << tol.get_failure_count());
+
+  if (!(tol.get_std_deviation() > 0) ||
+      tol.get_percentile(0) > tol.get_mean() || tol.get_percentile(1) < tol.get_mean())
+    fail("bad tolerancing statistics " << tol.get_mean() << " " << tol.get_std_deviation());
+
+  ref<Data::SampleSet> h = tol.get_histogram(10);
+  double sum = 0;
+
+  for (unsigned int i = 0; i < h->get_count(); i++)
+    sum += h->get_y_value(i);
+
+  if (h->get_count() != 10 || fabs(sum - 1.0) > 1e-9)
+    fail("bad tolerancing histogram " << sum);
+
+  // results do not depend on threads
+  std::vector<double> v = tol.get_values();
+
+  tol.set_thread_count(4);
+  tol.invalidate();
+
+  if (tol.get_values() != v)
+    fail("tolerancing results depend on thread count");
+
+  // moving image away from mirror moves best focus along image z axis
+  tol.set_metric(T::FocusShift);
+
+  double ds = tol.get_sensitivity(2);
+
+  if (fabs(ds - 0.2) > 1e-6 || fabs(tol.get_sensitivity(2, true) + 0.2) > 1e-6)
+    fail("bad thickness focus shift " << ds);
+
+  if ((image.get_position() - pos).len() != 0.0)
+    fail("nominal system modified by tolerancing");
+}
+
+// replicas aim rays at their own copy of the stop
+static void test_tolerancing_aiming()
+{
+  typedef Analysis::Tolerancing T;
+
+  Sys::System sys;
+  Sys::SourcePoint source(Sys::SourceAtInfinity, Math::vector3_001);
+  Sys::Mirror sphere(Math::VectorPair3(Math::vector3_0, Math::vector3_001),
+                     -2 * focal, 0, radius);
+  Sys::Stop stop(Math::VectorPair3(Math::Vector3(0, 0, -100), Math::vector3_001), radius / 2);
+  Sys::Image image(Math::Vector3(0, 0, -focal), 10);
+
+  sys.add(source);
+  sys.add(sphere);
+  sys.add(stop);
+  sys.add(image);
+
+  Trace::Sequence seq;
+  seq.append(source);
+  seq.append(sphere);
+  seq.append(stop);
+  seq.append(image);
+
+  sys.get_tracer_params().set_sequential_mode(seq);
+  sys.get_tracer_params().set_ray_aiming(stop);
+
+  T tol(sys);
+
+  tol.set_trial_count(5);
+  tol.set_seed(42);
+  tol.set_tolerance(sphere, T::TiltX, 0.01);
+
+  Analysis::Spot spot(sys);
+
+  if (!(fabs(tol.get_nominal_value() - spot.get_rms_radius()) <= 1e-9 * spot.get_rms_radius()))
+    fail("bad nominal tolerancing value with ray aiming " << tol.get_nominal_value()
+         << " expected " << spot.get_rms_radius());
+
+  if (tol.get_failure_count() != 0 || tol.get_values().size() != 5)
+    fail("bad tolerancing trials with ray aiming " << tol.get_failure_count());
+}
+
+// first order properties of the focusing mirror
+static void test_paraxial_mirror(Sys::System &sys, const Sys::Mirror &mirror,
+                                 const Sys::Image &image)
+{
+  Analysis::Paraxial p(sys);
+
+  if (fabs(p.get_effective_focal_length() - focal) > 1e-9)
+    fail("paraxial mirror efl " << p.get_effective_focal_length());
+
+  if (fabs(p.get_back_focal_distance() - focal) > 1e-9)
+    fail("paraxial mirror bfd " << p.get_back_focal_distance());
+
+  if (&p.get_stop() != &mirror)
+    fail("paraxial mirror stop");
+
+  if (fabs(p.get_entrance_pupil_position()) > 1e-9 ||
+      fabs(p.get_entrance_pupil_radius() - radius) > 1e-9)
+    fail("paraxial mirror entrance pupil");
+
+  if (fabs(p.get_f_number() - focal / (2 * radius)) > 1e-9)
+    fail("paraxial mirror f-number " << p.get_f_number());
+
+  if (fabs(p.get_marginal_ray_height(mirror) - radius) > 1e-9 ||
+      fabs(p.get_marginal_ray_height(image)) > 1e-9)
+    fail("paraxial mirror marginal ray");
+
+  // unit field slope, stop on mirror
+  if (fabs(p.get_chief_ray_height(mirror)) > 1e-9 ||
+      fabs(fabs(p.get_chief_ray_height(image)) - focal) > 1e-9)
+    fail("paraxial mirror chief ray");
+}
+
+// thick lens behind a stop, compared to thick lens and Newton formulas
+static void test_paraxial_lens(bool infinity)
+{
+  const double r1 = 100, r2 = -150, t = 8, s = 20, rs = 10;
+  const double d = 300;
+
+  Material::AbbeVd glass(1.6, 50);
+  Sys::System sys;
+
+  Sys::SourcePoint source(infinity ? Sys::SourceAtInfinity : Sys::SourceAtFiniteDistance,
+                          infinity ? Math::vector3_001 : Math::Vector3(0, 0, -s - d));
+  Sys::Stop stop(Math::VectorPair3(0, 0, -s), rs);
+  Sys::OpticalSurface s1(Math::Vector3(0, 0, 0), r1, 20, Material::none, glass);
+  Sys::OpticalSurface s2(Math::Vector3(0, 0, t), r2, 20, glass, Material::none);
+  Sys::Image image(Math::Vector3(0, 0, 200), 10);
+
+  source.single_spectral_line(Light::SpectralLine::d);
+
+  sys.add(source);
+  sys.add(stop);
+  sys.add(s1);
+  sys.add(s2);
+  sys.add(image);
+
+  Analysis::Paraxial p(sys);
+
+  double n = glass.get_refractive_index(Light::SpectralLine::d) /
+    sys.get_environment().get_refractive_index(Light::SpectralLine::d);
+  double p1 = (n - 1) / r1, p2 = (1 - n) / r2;
+  double phi = p1 + p2 - p1 * p2 * t / n;
+  double f = 1 / phi;
+  double bfd = f * (1 - p1 * t / n);
+  double ffd = -f * (1 - p2 * t / n);
+
+  if (fabs(p.get_effective_focal_length() - f) > 1e-9)
+    fail("paraxial lens efl " << p.get_effective_focal_length() << " " << f);
+
+  if (fabs(p.get_back_focal_distance() - bfd) > 1e-9)
+    fail("paraxial lens bfd " << p.get_back_focal_distance() << " " << bfd);
+
+  // distance from stop
+  if (fabs(p.get_front_focal_distance() - (ffd + s)) > 1e-9)
+    fail("paraxial lens ffd " << p.get_front_focal_distance() << " " << ffd + s);
+
+  if (&p.get_stop() != &stop ||
+      fabs(p.get_entrance_pupil_position()) > 1e-9 ||
+      fabs(p.get_marginal_ray_height(stop) - rs) > 1e-9 ||
+      fabs(p.get_chief_ray_height(stop)) > 1e-9)
+    fail("paraxial lens stop");
+
+  // exit pupil is image of stop, z is distance from front focal point
+  double z = -s - ffd;
+
+  if (fabs(p.get_exit_pupil_position() - (bfd - f * f / z)) > 1e-9)
+    fail("paraxial lens exit pupil " << p.get_exit_pupil_position());
+
+  if (fabs(p.get_exit_pupil_radius() - rs * fabs(f / z)) > 1e-9)
+    fail("paraxial lens exit pupil radius " << p.get_exit_pupil_radius());
+
+  if (infinity)
+    {
+      if (fabs(p.get_image_distance() - bfd) > 1e-9 ||
+          p.get_magnification() != 0.)
+        fail("paraxial lens image");
+
+      if (fabs(p.get_entrance_pupil_radius() - rs) > 1e-9 ||
+          fabs(p.get_f_number() - f / (2 * rs)) > 1e-9)
+        fail("paraxial lens f-number " << p.get_f_number());
+    }
+  else
+    {
+      z = -s - d - ffd;
+
+      if (fabs(p.get_image_distance() - (bfd - f * f / z)) > 1e-9)
+        fail("paraxial lens image distance " << p.get_image_distance());
+
+      if (fabs(p.get_magnification() - f / z) > 1e-9)
+        fail("paraxial lens magnification " << p.get_magnification());
+    }
+}
+
+int main()
+{
+  Sys::System sys;
+
+  Sys::SourcePoint source(Sys::SourceAtInfinity, Math::vector3_001);
+  source.clear_spectrum();
+  source.add_spectral_line(Light::SpectralLine::F);
+  source.add_spectral_line(Light::SpectralLine::C);
+
+  Sys::Mirror mirror(Math::VectorPair3(Math::vector3_0, Math::vector3_001),
+                     -2 * focal, -1, radius);
+
+  Sys::Image image(Math::Vector3(0, 0, -focal), 10);
+
+  sys.add(source);
+  sys.add(mirror);
+  sys.add(image);
+
+  Trace::Sequence seq;
+  seq.append(source);
+  seq.append(mirror);
+  seq.append(image);
+
+  sys.get_tracer_params().set_sequential_mode(seq);
+
+  test_psf(sys, mirror);
+  test_mtf(sys, mirror);
+  test_wavefront(sys, mirror, image, false);
+
+  Sys::Mirror sphere(Math::VectorPair3(Math::vector3_0, Math::vector3_001),
+                     -2 * focal, 0, radius);
+
+  sys.remove(mirror);
+  sys.add(sphere);
+
+  seq.clear();
+  seq.append(source);
+  seq.append(sphere);
+  seq.append(image);
+
+  sys.get_tracer_params().set_sequential_mode(seq);
+
+  test_wavefront(sys, sphere, image, true);
+  test_through_focus(sys, image);
+  test_tolerancing(sys, sphere, image);
+  test_paraxial_mirror(sys, sphere, image);
+  test_tolerancing_aiming();
+
+  test_paraxial_lens(true);
+  test_paraxial_lens(false);
+
+  return 0;
+}
+
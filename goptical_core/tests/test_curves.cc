@@ -0,0 +1,575 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+
+#include <iostream>
+
+#include <Goptical/Error>
+
+#include <Goptical/Math/Vector>
+
+#include <Goptical/Curve/Base>
+#include <Goptical/Curve/Rotational>
+#include <Goptical/Curve/Sphere>
+#include <Goptical/Curve/Conic>
+#include <Goptical/Curve/Polynomial>
+#include <Goptical/Curve/Composer>
+#include <Goptical/Curve/Grid>
+#include <Goptical/Curve/Asphere>
+#include <Goptical/Curve/Zernike>
+#include <Goptical/Curve/ZernikeSeries>
+#include <Goptical/Math/VectorPair>
+
+#include <Goptical/Sys/System>
+#include <Goptical/Sys/Surface>
+#include <Goptical/Io/ImportZemax>
+
+#include <stdlib.h>
+#include <math.h>
+
+using namespace Goptical;
+
+#define fail(x)                                 \
+{                                               \
+  std::cerr << x << std::endl;                  \
+  exit(1);                                      \
+}
+
+// compare analytic gradient with central difference of sagitta
+static void test_derivative(const Curve::Base &c, double radius, int line)
+{
+  static const double h = 1e-5;
+
+  for (double x = -radius; x <= radius; x += radius / 7)
+    for (double y = -radius; y <= radius; y += radius / 5)
+      {
+        Math::Vector2 xy(x, y);
+        Math::Vector2 d;
+
+        c.derivative(xy, d);
+
+        double dx = (c.sagitta(Math::Vector2(x + h, y)) - c.sagitta(Math::Vector2(x - h, y))) / (2 * h);
+        double dy = (c.sagitta(Math::Vector2(x, y + h)) - c.sagitta(Math::Vector2(x, y - h))) / (2 * h);
+
+        if (fabs(d.x() - dx) > 1e-6 * (1 + fabs(dx)) ||
+            fabs(d.y() - dy) > 1e-6 * (1 + fabs(dy)))
+          fail(line << ": bad derivative at " << xy << ": " << d << " expected " << dx << ", " << dy);
+      }
+}
+
+// user curve without analytic derivative
+class MyCurve : public Curve::Rotational
+{
+public:
+  double sagitta(double r) const
+  {
+    return r * r / 100;
+  }
+};
+
+static void test_fallback(int line)
+{
+  MyCurve c;
+  Math::Vector2 d;
+
+  c.derivative(Math::Vector2(1, 2), d);
+
+  if (fabs(d.x() - 0.02) > 1e-6 || fabs(d.y() - 0.04) > 1e-6)
+    fail(line << ": bad numerical derivative " << d);
+
+  Curve::Base::set_derivative_fallback(Curve::DerivativeReport);
+  c.derivative(Math::Vector2(1, 2), d);
+
+  Curve::Base::set_derivative_fallback(Curve::DerivativeError);
+
+  // analytic derivatives must not throw
+  Curve::Sphere sphere(100);
+  const Curve::Base &b = sphere;
+
+  b.derivative(Math::Vector2(1, 2), d);
+
+  try {
+    c.derivative(Math::Vector2(1, 2), d);
+    fail(line << ": numerical derivative not reported");
+  } catch (const Error &e) {
+  }
+
+  Curve::Base::set_derivative_fallback(Curve::DerivativeNumerical);
+}
+
+static void test_zernike_series(int line)
+{
+  static const double radius = 30;
+
+  // fringe ordered series must match the 36 terms Zernike curve
+  Curve::Zernike z(radius, 1e-3);
+  Curve::ZernikeSeries f(radius, Curve::ZernikeSeries::FringeOrdering, 1e-3);
+
+  for (unsigned int n = 0; n < Curve::Zernike::term_count; n++)
+    {
+      double c = sin(n * 1.7 + 0.3) / (1 + n);
+      z.set_coefficient(n, c);
+      f.set_coefficient(n + 1, c);
+    }
+
+  for (double x = -radius; x <= radius; x += radius / 9)
+    for (double y = -radius; y <= radius; y += radius / 7)
+      {
+        Math::Vector2 xy(x, y), d1, d2;
+
+        z.derivative(xy, d1);
+        f.derivative(xy, d2);
+
+        if (fabs(z.sagitta(xy) - f.sagitta(xy)) > 1e-12 ||
+            (d1 - d2).len() > 1e-12)
+          fail(line << ": fringe series mismatch at " << xy);
+      }
+
+  // low order noll terms
+  {
+    Curve::ZernikeSeries n(1.0);
+    Math::Vector2 xy(0.3, -0.4);
+    double r2 = 0.25;
+
+    n.set_coefficient(4, 1.0);
+    if (fabs(n.sagitta(xy) - sqrt(3.0) * (2 * r2 - 1)) > 1e-14)
+      fail(line << ": bad noll defocus");
+
+    n.set_coefficient(4, 0.0);
+    n.set_coefficient(11, 1.0);
+    if (fabs(n.sagitta(xy) - sqrt(5.0) * (6 * r2 * r2 - 6 * r2 + 1)) > 1e-14)
+      fail(line << ": bad noll spherical");
+
+    n.set_coefficient(11, 0.0);
+    n.set_coefficient(5, 1.0);
+    if (fabs(n.sagitta(xy) - sqrt(6.0) * 2 * xy.x() * xy.y()) > 1e-14)
+      fail(line << ": bad noll oblique astigmatism");
+
+    unsigned int dn;
+    int dm;
+
+    Curve::ZernikeSeries::get_term_degree(Curve::ZernikeSeries::NollOrdering, 22, dn, dm);
+    if (dn != 6 || dm != 0)
+      fail(line << ": bad noll term degree");
+  }
+
+  // high order noll series
+  Curve::ZernikeSeries s(radius);
+
+  for (unsigned int j = 1; j <= 66; j++)
+    s.set_coefficient(j, 1e-3 * cos(j * 2.3) / j);
+
+  test_derivative(s, radius * 0.7, line);
+
+  // batch evaluation must match point evaluation
+  static const unsigned int count = 150;
+  double x[count], y[count], sag[count], dx[count], dy[count];
+  double ox[count], oy[count], oz[count], rx[count], ry[count], rz[count];
+  double px[count], py[count], pz[count];
+  char mask[count];
+
+  for (unsigned int i = 0; i < count; i++)
+    {
+      x[i] = radius * 1.1 * cos(i * 0.37) * (i % 11) / 10.0;
+      y[i] = radius * 1.1 * sin(i * 0.37) * (i % 11) / 10.0;
+      mask[i] = i % 13 != 0;
+
+      Math::Vector3 dir(x[i] * 1e-3, y[i] * -2e-3, 1.0);
+      dir.normalize();
+      ox[i] = x[i];
+      oy[i] = y[i];
+      oz[i] = -10;
+      rx[i] = dir.x();
+      ry[i] = dir.y();
+      rz[i] = dir.z();
+    }
+
+  const double *xy[2] = { x, y };
+  double *d[2] = { dx, dy };
+
+  s.sagitta_batch(count, mask, sag, d, xy);
+
+  for (unsigned int i = 0; i < count; i++)
+    {
+      if (!mask[i])
+        continue;
+
+      Math::Vector2 p(x[i], y[i]), pd;
+
+      s.derivative(p, pd);
+
+      if (sag[i] != s.sagitta(p) || dx[i] != pd.x() || dy[i] != pd.y())
+        fail(line << ": batch sagitta mismatch at " << p);
+    }
+
+  const double *o[3] = { ox, oy, oz };
+  const double *r[3] = { rx, ry, rz };
+  double *pt[3] = { px, py, pz };
+
+  s.intersect_batch(count, mask, pt, o, r);
+
+  for (unsigned int i = 0; i < count; i++)
+    {
+      if (i % 13 == 0)
+        continue;
+
+      Math::VectorPair3 ray(Math::Vector3(ox[i], oy[i], oz[i]),
+                            Math::Vector3(rx[i], ry[i], rz[i]));
+      Math::Vector3 p1, p2;
+
+      bool i1 = s.intersect(p1, ray);
+      bool i2 = s.Curve::Base::intersect(p2, ray);
+
+      if (i1 != bool(mask[i]) || i1 != i2)
+        fail(line << ": batch intersection state mismatch at " << i);
+
+      if (i1 && (!(p1 == Math::Vector3(px[i], py[i], pz[i])) ||
+                 (p1 - p2).len() > 1e-9 ||
+                 fabs(s.sagitta(p1.project_xy()) - p1.z()) > 1e-9))
+        fail(line << ": batch intersection mismatch at " << i << " " << p1 << " " << p2);
+    }
+}
+
+// check default iterative intersection and its statistics
+static unsigned long test_intersect(Curve::Base &c, double radius, int line)
+{
+  c.set_intersect_stats(true);
+  c.reset_intersect_stats();
+
+  unsigned int count = 0;
+
+  for (double x = -radius; x <= radius; x += radius / 6)
+    for (double y = -radius; y <= radius; y += radius / 6)
+      {
+        Math::Vector3 dir(x * -2e-3, y * 1e-3, 1.0);
+        dir.normalize();
+
+        Math::VectorPair3 ray(Math::Vector3(x, y, -20.0), dir);
+        Math::Vector3 p;
+
+        if (!c.intersect(p, ray))
+          fail(line << ": no intersection for ray " << ray);
+
+        count++;
+
+        double l = (p - ray.origin()) * ray.direction();
+
+        if (fabs(c.sagitta(p.project_xy()) - p.z()) > c.get_intersect_tolerance() ||
+            (ray.origin() + ray.direction() * l - p).len() > 1e-8)
+          fail(line << ": bad intersection for ray " << ray << ": " << p);
+      }
+
+  const Curve::IntersectStats &s = c.get_intersect_stats();
+
+  if (s.calls != count || s.failures || s.unconverged || s.iterations < count)
+    fail(line << ": bad intersection statistics");
+
+  c.set_intersect_stats(false);
+
+  return s.iterations;
+}
+
+static void test_intersect_start(int line)
+{
+  Curve::Polynomial poly;
+  poly.set_even(2, 6, 1.0 / 60.0, 2e-6, -3e-9);
+
+  if (fabs(poly.get_intersect_start_curvature() - 1.0 / 30.0) > 1e-15)
+    fail(line << ": bad polynomial start curvature");
+
+  unsigned long it_sphere = test_intersect(poly, 20, line);
+
+  poly.set_intersect_start_curvature(0);
+  unsigned long it_plane = test_intersect(poly, 20, line);
+
+  if (it_sphere >= it_plane)
+    fail(line << ": start sphere does not save iterations " << it_sphere << " " << it_plane);
+
+  // looser tolerance needs fewer iterations
+  poly.set_intersect_tolerance(1e-6);
+  if (test_intersect(poly, 20, line) >= it_plane)
+    fail(line << ": tolerance not used");
+
+  poly.set_intersect_tolerance(1e-10);
+  poly.set_intersect_max_iterations(1);
+  poly.set_intersect_stats(true);
+  poly.reset_intersect_stats();
+
+  Math::Vector3 p;
+  poly.intersect(p, Math::VectorPair3(Math::Vector3(10, 0, -20), Math::Vector3(0.2, 0, 1).normalized()));
+
+  if (poly.get_intersect_stats().unconverged != 1)
+    fail(line << ": unconverged intersection not reported");
+
+  if (fabs(poly.sagitta(p.project_xy().len()) - p.z()) > 1e-12)
+    fail(line << ": unconverged intersection not projected on curve");
+
+  Curve::Composer comp;
+  comp.add_curve(ref<Curve::Sphere>::create(300)).rotate(30).xy_translate(Math::Vector2(3, -4));
+  comp.add_curve(ref<Curve::Conic>::create(-500, 0.5)).z_scale(0.1);
+
+  test_intersect(comp, 20, line);
+}
+
+// user curve which counts sagitta and derivative evaluations
+class CountCurve : public Curve::Rotational
+{
+public:
+  CountCurve()
+    : _sag_count(0),
+      _count(0)
+  {
+  }
+
+  double sagitta(double r) const
+  {
+    _sag_count++;
+    return r * r / 100 + 1e-7 * r * r * r * r;
+  }
+
+  double derivative(double r) const
+  {
+    _count++;
+    return r / 50 + 4e-7 * r * r * r;
+  }
+
+  mutable unsigned long _sag_count;
+  mutable unsigned long _count;
+};
+
+static void test_intersect_derivative(int line)
+{
+  // one combined evaluation per iteration, test_intersect checks
+  // each intersection with an extra sagitta call
+  CountCurve c;
+  unsigned long it = test_intersect(c, 20, line);
+  unsigned long calls = c.get_intersect_stats().calls;
+
+  if (c._count != it || c._sag_count != it + calls)
+    fail(line << ": unexpected curve evaluations " << c._sag_count
+         << " " << c._count << " " << it);
+}
+
+static void test_asphere(double roc, double sc, int line)
+{
+  Curve::Asphere a(roc, sc);
+  Curve::Polynomial poly;
+
+  a.set_coefficient(3, 2e-6);
+  a.set_coefficient(4, 1e-6);
+  a.set_coefficient(6, -2e-10);
+  poly.set(3, 6, 2e-6, 1e-6, 0.0, -2e-10);
+
+  for (double r = 0; r < 20; r += 0.5)
+    {
+      double z = poly.sagitta(r);
+
+      if (roc != 0)
+        z += Curve::Conic(roc, sc).sagitta(r);
+
+      if (fabs(a.sagitta(r) - z) > 1e-12)
+        fail(line << ": bad asphere sagitta at " << r);
+    }
+
+  test_derivative(a, 14, line);
+
+  unsigned long it = test_intersect(a, 20, line);
+
+  // conic start needs few newton steps
+  if (it > 3 * a.get_intersect_stats().calls)
+    fail(line << ": too many asphere intersection iterations " << it);
+
+  for (double x = -20; x <= 20; x += 5)
+    {
+      Math::VectorPair3 ray(Math::Vector3(x, 3, -20), Math::Vector3(0.01, -0.02, 1).normalized());
+      Math::Vector3 p1, p2;
+
+      if (!a.intersect(p1, ray) || !a.Curve::Base::intersect(p2, ray) ||
+          (p1 - p2).len() > 1e-9)
+        fail(line << ": asphere intersection mismatch " << p1 << " " << p2);
+    }
+}
+
+// zemax asphere sagitta in lens units
+static double zemax_sagitta(double curv, double k, const double *a,
+                            unsigned int step, double r)
+{
+  double z = curv * r * r / (1 + sqrt(1 - (1 + k) * curv * curv * r * r));
+
+  for (unsigned int j = 1; j <= 3; j++)
+    z += a[j] * pow(r, (double)(j * step));
+
+  return z;
+}
+
+static void test_import_zemax(int line)
+{
+  const char *srcdir = getenv("srcdir");
+  std::string path(srcdir ? srcdir : ".");
+
+  Io::ImportZemax imp;
+  ref<Sys::System> sys = imp.import_design(path + "/test_curves-asphere.zmx");
+
+  std::vector<const Sys::Surface *> s;
+  delegate_push<typeof(s), const Sys::Surface &> d(s);
+  sys->get_elements<Sys::Surface>(d);
+
+  if (s.size() != 3)
+    fail(line << ": bad imported surface count " << s.size());
+
+  // lens unit is cm, coefficient of r^n term scales as 10^(1-n)
+  const double even[4] = { 0, 0, 1e-3, -2e-5 };
+  const double odd[4] = { 0, 1e-3, 0, 5e-4 };
+  const struct
+  {
+    double curv, k;
+    const double *a;
+    unsigned int step;
+  } surf[2] = {
+    { 0.02, -0.5, even, 2 },
+    { -0.01, 0, odd, 1 },
+  };
+
+  for (unsigned int i = 0; i < 2; i++)
+    {
+      const Curve::Asphere *a = dynamic_cast<const Curve::Asphere *>(&s[i]->get_curve());
+
+      if (!a)
+        fail(line << ": surface " << i << " not imported as asphere");
+
+      if (fabs(a->get_roc() - 10. / surf[i].curv) > 1e-9 ||
+          a->get_schwarzschild() != surf[i].k)
+        fail(line << ": bad asphere " << i << " base conic");
+
+      for (unsigned int j = 1; j <= 3; j++)
+        {
+          unsigned int n = j * surf[i].step;
+
+          double c = surf[i].a[j] * pow(10., 1. - n);
+
+          if (fabs(a->get_coefficient(n) - c) > fabs(c) * 1e-12)
+            fail(line << ": bad asphere " << i << " coefficient " << n);
+        }
+
+      for (double r = 0; r <= 20; r += 2.5)
+        {
+          double z = 10. * zemax_sagitta(surf[i].curv, surf[i].k, surf[i].a,
+                                         surf[i].step, r / 10.);
+
+          if (fabs(a->sagitta(r) - z) > 1e-12)
+            fail(line << ": bad asphere " << i << " sagitta at " << r);
+        }
+    }
+}
+
+static void test_grid(Data::Interpolation i, int line)
+{
+  Curve::Conic conic(150, -0.5);
+  Curve::Grid grid(41, 20);
+
+  grid.get_data().set_interpolation(i);
+  grid.fit(conic);
+
+  test_derivative(grid, 19, line);
+
+  static const unsigned int count = 100;
+  double x[count], y[count], sag[count], dx[count], dy[count];
+  char mask[count];
+
+  for (unsigned int j = 0; j < count; j++)
+    {
+      x[j] = 19.5 * cos(j * 0.7) * (j % 9) / 8.0;
+      y[j] = 19.5 * sin(j * 0.7) * (j % 9) / 8.0;
+      mask[j] = j % 7 != 0;
+    }
+
+  const double *xy[2] = { x, y };
+  double *d[2] = { dx, dy };
+
+  grid.sagitta_batch(count, mask, sag, d, xy);
+
+  // copied grid has its own interpolation table
+  Curve::Grid copy(grid);
+
+  for (unsigned int j = 0; j < count; j++)
+    {
+      if (!mask[j])
+        continue;
+
+      Math::Vector2 p(x[j], y[j]), pd;
+
+      grid.derivative(p, pd);
+
+      if (sag[j] != grid.sagitta(p) || sag[j] != copy.sagitta(p) ||
+          dx[j] != pd.x() || dy[j] != pd.y())
+        fail(line << ": batch grid sagitta mismatch at " << p);
+
+      if (fabs(sag[j] - conic.sagitta(p.len())) > 1e-6)
+        fail(line << ": bad grid interpolation at " << p);
+    }
+
+  // data change must be taken into account
+  grid.get_data().set_all_y(1.0);
+
+  if (i != Data::BicubicDeriv && fabs(grid.sagitta(Math::Vector2(3, 4)) - 1.0) > 1e-12)
+    fail(line << ": grid interpolation table not updated");
+}
+
+int main()
+{
+  Curve::Polynomial poly;
+  poly.set_even(2, 6, 1e-3, 1e-7, -2e-11);
+
+  test_derivative(poly, 40, __LINE__);
+  test_derivative(Curve::Conic(200, -0.7), 40, __LINE__);
+
+  Curve::Composer comp;
+
+  comp.add_curve(ref<Curve::Sphere>::create(300))
+    .xy_scale(Math::Vector2(2.0, 0.5)).rotate(30).xy_translate(Math::Vector2(3, -4));
+  comp.add_curve(ref<Curve::Conic>::create(-500, 0.5))
+    .z_scale(0.1).rotate(-60);
+
+  test_derivative(comp, 20, __LINE__);
+
+  test_fallback(__LINE__);
+
+  test_intersect_start(__LINE__);
+  test_intersect_derivative(__LINE__);
+
+  test_asphere(80, -0.6, __LINE__);
+  test_asphere(-50, 0, __LINE__);
+  test_asphere(0, 0, __LINE__);
+
+  test_import_zemax(__LINE__);
+
+  test_zernike_series(__LINE__);
+
+  test_grid(Data::Bicubic, __LINE__);
+  test_grid(Data::BicubicDiff, __LINE__);
+  test_grid(Data::BicubicDeriv, __LINE__);
+
+  return 0;
+}
+
@@ -0,0 +1,290 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+
+#include <iostream>
+
+#include <Goptical/Error>
+
+#include <Goptical/Math/Vector>
+#include <Goptical/Math/VectorPair>
+
+#include <Goptical/Material/Base>
+#include <Goptical/Material/Sellmeier>
+
+#include <Goptical/Sys/System>
+#include <Goptical/Sys/OpticalSurface>
+#include <Goptical/Sys/SourcePoint>
+#include <Goptical/Sys/Image>
+#include <Goptical/Sys/Stop>
+
+#include <Goptical/Curve/Sphere>
+#include <Goptical/Curve/Conic>
+
+#include <Goptical/Trace/Sequence>
+#include <Goptical/Trace/Params>
+
+#include <Goptical/Light/SpectralLine>
+
+#include <Goptical/Analysis/Spot>
+#include <Goptical/Analysis/Focus>
+#include <Goptical/Analysis/Paraxial>
+
+#include <Goptical/Optim/Optimizer>
+
+#include <stdlib.h>
+#include <math.h>
+
+using namespace Goptical;
+
+#define fail(x)                                 \
+{                                               \
+  std::cerr << x << std::endl;                  \
+  exit(1);                                      \
+}
+
+typedef Optim::Optimizer O;
+
+// singlet lens with image plane away from focus
+struct singlet_s
+{
+  singlet_s()
+    : bk7(1.03961212, 6.00069867e-3, 0.231792344,
+          2.00179144e-2, 1.01046945, 1.03560653e2),
+      s1(Math::Vector3(0, 0, 0), 200, 20, Material::none, bk7),
+      s2(Math::Vector3(0, 0, 5), -200, 20, bk7, Material::none),
+      source(Sys::SourceAtInfinity, Math::vector3_001),
+      image(Math::Vector3(0, 0, 190), 5)
+  {
+    sys.add(source);
+    sys.add(s1);
+    sys.add(s2);
+    sys.add(image);
+
+    source.single_spectral_line(Light::SpectralLine::d);
+
+    seq.append(source);
+    seq.append(s1);
+    seq.append(s2);
+    seq.append(image);
+
+    sys.get_tracer_params().set_sequential_mode(seq);
+  }
+
+  Material::Sellmeier bk7;
+  Sys::System sys;
+  Sys::OpticalSurface s1, s2;
+  Sys::SourcePoint source;
+  Sys::Image image;
+  Trace::Sequence seq;
+};
+
+static double spot_rms(Sys::System &sys)
+{
+  Analysis::Spot spot(sys);
+
+  return spot.get_rms_radius();
+}
+
+// image plane moved to best focus
+static void test_refocus(unsigned int threads)
+{
+  singlet_s l;
+  O opt(l.sys);
+
+  opt.set_thread_count(threads);
+
+  double d0 = (l.image.get_position() - l.s2.get_position()).len();
+  double rms0 = spot_rms(l.sys);
+
+  if (opt.add_variable(l.s2, O::Thickness) != 0)
+    fail("bad variable index");
+
+  if (fabs(opt.get_variable(0) - d0) > 1e-12)
+    fail("bad initial thickness " << opt.get_variable(0));
+
+  try {
+    opt.add_variable(l.image, O::Thickness);
+    fail("thickness on last element not reported");
+  } catch (const Error &e) {
+  }
+
+  try {
+    opt.optimize();
+    fail("missing target not reported");
+  } catch (const Error &e) {
+  }
+
+  opt.add_target(O::SpotRmsRadius, 0.0);
+
+  double m0 = opt.get_merit();
+
+  if (fabs(m0 - rms0 * rms0) > 1e-12 * m0)
+    fail("bad initial merit " << m0 << " expected " << rms0 * rms0);
+
+  double m = opt.optimize();
+  double rms = spot_rms(l.sys);
+
+  if (!(rms < rms0 / 5))
+    fail("spot not improved by refocus " << rms0 << " -> " << rms);
+
+  if (fabs(m - rms * rms) > 1e-9 * m || fabs(opt.get_merit() - m) > 1e-9 * m)
+    fail("optimized system merit mismatch " << m << " " << rms * rms);
+
+  double d = (l.image.get_position() - l.s2.get_position()).len();
+
+  if (fabs(opt.get_variable(0) - d) > 1e-9)
+    fail("system not updated " << opt.get_variable(0) << " " << d);
+
+  if (opt.get_iteration_count() == 0 || opt.get_iteration_count() > 20)
+    fail("bad iteration count " << opt.get_iteration_count());
+
+  // minimum rms spot
+  Math::Vector3 pos = l.image.get_position();
+
+  for (int i = -1; i <= 1; i += 2)
+    {
+      l.image.set_position(pos + Math::Vector3(0, 0, i * 0.02));
+
+      if (!(spot_rms(l.sys) > rms))
+        fail("image not at minimum rms spot position");
+    }
+
+  l.image.set_position(pos);
+
+  // move image to best focus of Focus analysis
+  Analysis::Focus focus(l.sys);
+  Math::Vector3 f = l.image.get_transform_from(0).transform(focus.get_best_focus().origin());
+
+  O opt2(l.sys);
+
+  opt2.add_variable(l.s2, O::Thickness);
+  opt2.add_target(O::FocusShift, 0.0);
+  opt2.set_thread_count(threads);
+
+  if (opt2.optimize() > 1e-16)
+    fail("focus shift not canceled " << opt2.get_merit());
+
+  if (fabs(opt2.get_variable(0) - d - f.z()) > 1e-6)
+    fail("focus shift optimization mismatch " << opt2.get_variable(0) - d << " " << f.z());
+}
+
+// lens bending to minimize spherical aberration
+static std::vector<double> test_bending(unsigned int threads)
+{
+  singlet_s l;
+  O opt(l.sys);
+
+  opt.set_thread_count(threads);
+
+  opt.add_variable(l.s1, O::Radius);
+  opt.add_variable(l.s2, O::Radius);
+  opt.add_variable(l.s2, O::Thickness);
+  opt.add_variable(l.s2, O::Schwarzschild);
+
+  opt.set_variable_range(3, -1, 1);
+
+  // conic deformation compensates residual spherical aberration
+  opt.add_target(O::SpotRmsRadius, 0.0);
+
+  double m0 = opt.get_merit();
+  double m = opt.optimize();
+
+  if (!(m < m0 / 100))
+    fail("bending optimization failed " << m0 << " -> " << m);
+
+  if (opt.get_variable(3) < -1 || opt.get_variable(3) > 1)
+    fail("variable out of range " << opt.get_variable(3));
+
+  if (!dynamic_cast<const Curve::Conic*>(&l.s2.get_curve()) ||
+      !dynamic_cast<const Curve::Sphere*>(&l.s1.get_curve()))
+    fail("bad optimized curves");
+
+  std::vector<double> v;
+
+  for (unsigned int i = 0; i < opt.get_variable_count(); i++)
+    v.push_back(opt.get_variable(i));
+  v.push_back(m);
+
+  return v;
+}
+
+// lens power adjusted with a first order target
+static void test_focal_length()
+{
+  singlet_s l;
+  O opt(l.sys);
+
+  opt.add_variable(l.s2, O::Radius);
+  opt.add_target(O::EffectiveFocalLength, 150.0);
+
+  double m = opt.optimize();
+
+  Analysis::Paraxial p(l.sys);
+
+  if (fabs(p.get_effective_focal_length() - 150.0) > 1e-6 || !(m < 1e-10))
+    fail("focal length optimization failed " << p.get_effective_focal_length());
+}
+
+// ray aiming stop of nominal system is used by replicas
+static void test_ray_aiming()
+{
+  Sys::Stop stop(Math::Vector3(0, 0, 10), 8);
+  singlet_s l;
+
+  l.sys.add(stop);
+  l.seq.insert(3, stop);
+  l.sys.get_tracer_params().set_ray_aiming(stop);
+
+  O opt(l.sys);
+
+  opt.add_variable(l.s2, O::Thickness);
+  opt.add_target(O::SpotRmsRadius, 0.0);
+
+  double rms0 = spot_rms(l.sys);
+  double m0 = opt.get_merit();
+
+  if (!(fabs(m0 - rms0 * rms0) <= 1e-9 * m0))
+    fail("bad initial merit with ray aiming " << m0 << " expected " << rms0 * rms0);
+
+  double m = opt.optimize();
+
+  if (!(m < m0 / 5))
+    fail("refocus with ray aiming failed " << m0 << " -> " << m);
+}
+
+int main()
+{
+  test_refocus(1);
+  test_refocus(3);
+  test_focal_length();
+  test_ray_aiming();
+
+  // results do not depend on threads
+  if (test_bending(1) != test_bending(4))
+    fail("optimization depends on thread count");
+
+  return 0;
+}
+
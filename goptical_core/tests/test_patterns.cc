@@ -24,6 +24,7 @@
 
 #include <cstdio>
 #include <cstring>
+#include <cmath>
 #include <stdlib.h>
 
 #include "config.hh"
@@ -52,8 +53,77 @@ using namespace Goptical;
 
 size_t err = 0;
 
+static bool polygon_inside_ref(const std::vector<Math::Vector2> &v, const Math::Vector2 &p)
+{
+  unsigned int count = 0;
+
+  for (unsigned int i = 0, j = v.size() - 1; i < v.size(); j = i++)
+    if ((((v[i].y() <= p.y()) && (p.y() < v[j].y())) || ((v[j].y() <= p.y()) && (p.y() < v[i].y()))) &&
+        (p.x() < (v[j].x() - v[i].x()) * (p.y() - v[i].y()) / (v[j].y() - v[i].y()) + v[i].x()))
+      count++;
+
+  return (count & 1) != 0;
+}
+
+static void test_polygon_inside()
+{
+  // non convex star shape with many vertices
+  Shape::Polygon poly;
+  std::vector<Math::Vector2> v;
+
+  for (unsigned int i = 0; i < 200; i++)
+    {
+      double a = 2. * M_PI * i / 200;
+      double r = i % 2 ? 10. : 30. + 5. * sin(a * 7);
+      v.push_back(Math::Vector2(r * cos(a), r * sin(a)));
+      poly.add_vertex(v.back());
+    }
+
+  const Shape::Base &s = poly;
+
+  for (unsigned int pass = 0; pass < 2; pass++)
+    {
+      srand(42);
+
+      for (unsigned int i = 0; i < 200000; i++)
+        {
+          Math::Vector2 p(rand() * 80. / RAND_MAX - 40., rand() * 80. / RAND_MAX - 40.);
+
+          if (s.inside(p) != polygon_inside_ref(v, p))
+            {
+              std::cerr << "-- polygon inside " << p << "\n";
+              err++;
+            }
+        }
+
+      // points on vertices and edges
+      for (unsigned int i = 0; i < v.size(); i++)
+        {
+          const Math::Vector2 &a = v[i];
+          const Math::Vector2 &b = v[(i + 1) % v.size()];
+
+          for (unsigned int j = 0; j < 4; j++)
+            {
+              Math::Vector2 p(a + (b - a) * (j / 4.));
+
+              if (s.inside(p) != polygon_inside_ref(v, p))
+                {
+                  std::cerr << "-- polygon inside edge " << p << "\n";
+                  err++;
+                }
+            }
+        }
+
+      // grid must be rebuilt on vertex change
+      v.insert(v.begin() + 3, Math::Vector2(0, 40));
+      poly.insert_vertex(v[3], 3);
+    }
+}
+
 int main()
 {
+  test_polygon_inside();
+
   struct shape_test_s
   {
     const char *name;
@@ -0,0 +1,1267 @@
+/*
+
+      This file is part of the Goptical Core library.
+  
+      The Goptical library is free software; you can redistribute it
+      and/or modify it under the terms of the GNU General Public
+      License as published by the Free Software Foundation; either
+      version 3 of the License, or (at your option) any later version.
+  
+      The Goptical library is distributed in the hope that it will be
+      useful, but WITHOUT ANY WARRANTY; without even the implied
+      warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+      See the GNU General Public License for more details.
+  
+      You should have received a copy of the GNU General Public
+      License along with the Goptical library; if not, write to the
+      Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+      Boston, MA 02111-1307 USA
+  
+      Copyright (C) 2010-2011 Free Software Foundation, Inc
+      Author: Alexandre Becoulet
+
+*/
+
+
+#include <Goptical/Error>
+
+#include <Goptical/Math/Vector>
+#include <Goptical/Math/VectorPair>
+
+#include <Goptical/Material/Base>
+#include <Goptical/Material/Sellmeier>
+#include <Goptical/Material/Air>
+
+#include <Goptical/Sys/System>
+#include <Goptical/Sys/CompiledSystem>
+#include <Goptical/Sys/Element>
+#include <Goptical/Sys/Surface>
+#include <Goptical/Sys/OpticalSurface>
+#include <Goptical/Sys/SourcePoint>
+#include <Goptical/Sys/Image>
+#include <Goptical/Sys/Stop>
+#include <Goptical/Sys/Mirror>
+
+#include <Goptical/Curve/Base>
+#include <Goptical/Curve/Sphere>
+#include <Goptical/Curve/Conic>
+#include <Goptical/Curve/Parabola>
+#include <Goptical/Curve/Flat>
+#include <Goptical/Curve/Asphere>
+#include <Goptical/Shape/Disk>
+
+#include <Goptical/Trace/Accumulator>
+#include <Goptical/Trace/Tracer>
+#include <Goptical/Trace/Result>
+#include <Goptical/Trace/Ray>
+#include <Goptical/Trace/RayBatch>
+#include <Goptical/Trace/RayList>
+#include <Goptical/Trace/Distribution>
+#include <Goptical/Trace/Sequence>
+#include <Goptical/Trace/Params>
+
+#include <Goptical/Light/SpectralLine>
+
+#include <Goptical/Data/Grid>
+
+#include <Goptical/Analysis/Spot>
+#include <Goptical/Analysis/SpotBatch>
+
+#include <algorithm>
+
+#include <stdlib.h>
+#include <math.h>
+
+#ifdef GOPTICAL_HAVE_PTHREAD
+# include <pthread.h>
+#endif
+
+using namespace Goptical;
+
+#define fail(x)                                 \
+{                                               \
+  std::cerr << x << std::endl;                  \
+  exit(1);                                      \
+}
+
+static void compare_intercepts(const Trace::Result &ra, const Trace::Result &rb,
+                               const Sys::Surface &s, int line)
+{
+  unsigned int count = ra.get_intercepted(s).size();
+
+  if (count != rb.get_intercepted(s).size())
+    fail(line << ": ray count mismatch");
+
+  for (unsigned int i = 0; i < count; i++)
+    {
+      const Trace::Ray &a = *ra.get_intercepted(s)[i];
+      const Trace::Ray &b = *rb.get_intercepted(s)[i];
+
+      const Math::Vector3 &pa = a.get_intercept_point();
+      const Math::Vector3 &pb = b.get_intercept_point();
+
+      if (pa.x() != pb.x() || pa.y() != pb.y() || pa.z() != pb.z() ||
+          a.get_wavelen() != b.get_wavelen())
+        fail(line << ": ray " << i << " mismatch");
+    }
+}
+
+static void compare_generated(const Trace::Result &ra, const Trace::Result &rb,
+                              const Sys::Element &e, int line)
+{
+  const Trace::RayList &la = ra.get_generated(e);
+  const Trace::RayList &lb = rb.get_generated(e);
+
+  if (la.size() != lb.size())
+    fail(line << ": generated ray count mismatch");
+
+  Trace::RayList::const_iterator j = lb.begin();
+
+  GOPTICAL_FOREACH(i, la)
+    {
+      const Trace::Ray &a = **i;
+      const Trace::Ray &b = **j++;
+
+      if (a.direction().x() != b.direction().x() ||
+          a.direction().y() != b.direction().y() ||
+          a.direction().z() != b.direction().z() ||
+          a.get_creator() != &e || b.get_creator() != &e ||
+          !a.get_parent() || !b.get_parent() ||
+          a.get_parent()->get_intercept_point().x() != b.get_parent()->get_intercept_point().x())
+        fail(line << ": generated ray mismatch");
+    }
+
+  if (j != lb.end())
+    fail(line << ": generated list iterator mismatch");
+}
+
+static void test_trace(Sys::System &sys, const Sys::Surface &s,
+                       const Sys::Image &image, int line)
+{
+  Trace::Tracer serial(sys);
+  Trace::Tracer parallel(sys);
+
+  parallel.get_params().set_thread_count(4);
+
+  Trace::Result &rs = serial.get_trace_result();
+  Trace::Result &rp = parallel.get_trace_result();
+
+  rs.set_intercepted_save_state(image);
+  rs.set_intercepted_save_state(s);
+  rp.set_intercepted_save_state(image);
+  rp.set_intercepted_save_state(s);
+  rs.set_generated_save_state(s);
+  rp.set_generated_save_state(s);
+
+  serial.trace();
+
+  // trace twice to check worker results reuse
+  for (unsigned int i = 0; i < 2; i++)
+    {
+      parallel.trace();
+
+      if (rs.get_intercepted(image).empty())
+        fail(line << ": no ray on image");
+
+      compare_intercepts(rs, rp, image, line);
+      compare_intercepts(rs, rp, s, line);
+      compare_generated(rs, rp, s, line);
+
+      // rays allocated by workers can be added to lists of the main result
+      Trace::RayList list(rp);
+
+      GOPTICAL_FOREACH(r, rp.get_intercepted(image))
+        {
+          list.push_back(*r);
+
+          if (list.back() != *r)
+            fail(line << ": ray index mismatch");
+        }
+
+      if (rs.get_max_ray_intensity() != rp.get_max_ray_intensity())
+        fail(line << ": max ray intensity mismatch");
+    }
+}
+
+static void test_index_ratio(Sys::System &sys, const Sys::OpticalSurface &s, int line)
+{
+  Trace::Tracer tracer(sys);
+  const Trace::Result &result = tracer.get_trace_result();
+
+  tracer.trace();
+
+  if (result.get_ray_wavelen_set().empty())
+    fail(line << ": empty wavelen set");
+
+  std::set<double> wl(result.get_ray_wavelen_set());
+  wl.insert(1000.0); // not in table
+
+  GOPTICAL_FOREACH(w, wl)
+    for (unsigned int k = 0; k < 2; k++)
+      {
+        double r = s.get_material(k).get_refractive_index(*w)
+          / s.get_material(!k).get_refractive_index(*w);
+
+        if (result.get_refractive_index_ratio(s, k, *w) != r)
+          fail(line << ": index ratio mismatch " << *w);
+      }
+}
+
+static void * compiled_trace(void *t)
+{
+  static_cast<Trace::Tracer *>(t)->trace();
+  return 0;
+}
+
+static void test_compiled(Sys::System &sys, const Sys::Image &image, int line)
+{
+  Sys::CompiledSystem cs(sys);
+
+  const Sys::System &csys = sys;
+
+  if (!cs.is_up_to_date() || !cs.is_up_to_date(csys, csys.get_tracer_params()))
+    fail(line << ": compiled system not up to date");
+
+  // snapshot transforms must match system transforms
+  const Math::Vector3 p(1, 2, 3);
+
+  for (unsigned int i = 1; i <= sys.get_element_count(); i++)
+    {
+      if (!sys.has_element(i))
+        {
+          if (cs.get_element(i))
+            fail(line << ": compiled removed element");
+          continue;
+        }
+
+      const Sys::Element &a = sys.get_element(i);
+
+      if (cs.get_element(i) != &a)
+        fail(line << ": compiled element mismatch");
+
+      if ((cs.get_surface(i) != 0) != (dynamic_cast<const Sys::Surface *>(&a) != 0))
+        fail(line << ": compiled surface mismatch");
+
+      if (!(cs.get_global_transform(a).transform(p) == a.get_global_transform().transform(p)) ||
+          !(cs.get_local_transform(a).transform(p) == a.get_local_transform().transform(p)))
+        fail(line << ": compiled global transform mismatch");
+
+      for (unsigned int j = 1; j <= sys.get_element_count(); j++)
+        {
+          if (!sys.has_element(j))
+            continue;
+
+          const Sys::Element &b = sys.get_element(j);
+
+          if (i != j && !(cs.get_transform(a, b).transform(p) == a.get_transform_to(b).transform(p)))
+            fail(line << ": compiled transform mismatch");
+        }
+    }
+
+  Trace::Tracer serial(sys);
+  serial.get_trace_result().set_intercepted_save_state(image);
+  serial.trace();
+
+  // several tracers share the same snapshot concurrently
+  static const unsigned int count = 4;
+  Trace::Tracer *tracers[count];
+
+  for (unsigned int i = 0; i < count; i++)
+    {
+      tracers[i] = new Trace::Tracer(sys);
+      tracers[i]->set_compiled_system(cs);
+      tracers[i]->get_trace_result().set_intercepted_save_state(image);
+    }
+
+#ifdef GOPTICAL_HAVE_PTHREAD
+  pthread_t threads[count];
+
+  for (unsigned int i = 0; i < count; i++)
+    if (pthread_create(&threads[i], 0, &compiled_trace, tracers[i]))
+      fail(line << ": unable to create thread");
+
+  for (unsigned int i = 0; i < count; i++)
+    pthread_join(threads[i], 0);
+#else
+  for (unsigned int i = 0; i < count; i++)
+    compiled_trace(tracers[i]);
+#endif
+
+  for (unsigned int i = 0; i < count; i++)
+    {
+      if (&tracers[i]->get_compiled_system() != &cs)
+        fail(line << ": shared compiled system not used");
+
+      compare_intercepts(serial.get_trace_result(), tracers[i]->get_trace_result(), image, line);
+      delete tracers[i];
+    }
+
+  // a modified system is compiled again by tracer
+  Trace::Tracer tracer(sys);
+  tracer.set_compiled_system(cs);
+  sys.update_version();
+
+  if (cs.is_up_to_date() || &tracer.get_compiled_system() == &cs)
+    fail(line << ": outdated compiled system used");
+}
+
+static void test_shared(Sys::System &sys, const Sys::Image &image, int line)
+{
+  Trace::Tracer serial(sys);
+  serial.get_trace_result().set_intercepted_save_state(image);
+  serial.trace();
+
+  // flush system transforms cache
+  for (unsigned int i = 1; i <= sys.get_element_count(); i++)
+    if (sys.has_element(i))
+      {
+        Sys::Element &e = sys.get_element(i);
+        e.set_local_position(e.get_local_position());
+      }
+
+  // several tracers compile the same system concurrently
+  static const unsigned int count = 4;
+  Trace::Tracer *tracers[count];
+
+  for (unsigned int i = 0; i < count; i++)
+    {
+      tracers[i] = new Trace::Tracer(sys);
+      tracers[i]->get_trace_result().set_intercepted_save_state(image);
+    }
+
+#ifdef GOPTICAL_HAVE_PTHREAD
+  pthread_t threads[count];
+
+  for (unsigned int i = 0; i < count; i++)
+    if (pthread_create(&threads[i], 0, &compiled_trace, tracers[i]))
+      fail(line << ": unable to create thread");
+
+  for (unsigned int i = 0; i < count; i++)
+    pthread_join(threads[i], 0);
+#else
+  for (unsigned int i = 0; i < count; i++)
+    compiled_trace(tracers[i]);
+#endif
+
+  for (unsigned int i = 0; i < count; i++)
+    {
+      compare_intercepts(serial.get_trace_result(), tracers[i]->get_trace_result(), image, line);
+      delete tracers[i];
+    }
+}
+
+static void test_batch(Sys::System &sys, const Sys::Image &image, int line)
+{
+  Trace::Tracer tracer(sys);
+  Trace::Tracer btracer(sys);
+  Trace::RayBatch batch;
+
+  Trace::Result &r = tracer.get_trace_result();
+
+  r.set_intercepted_save_state(image);
+
+  tracer.trace();
+
+  unsigned int count = r.get_intercepted(image).size();
+
+  if (!count)
+    fail(line << ": no ray on image");
+
+  btracer.trace_batch(batch);
+
+  if (batch.get_frame() != &image)
+    fail(line << ": bad batch frame");
+
+  if (batch.get_alive_count() != count)
+    fail(line << ": ray count mismatch " << batch.get_alive_count());
+
+  unsigned int j = 0;
+
+  for (unsigned int i = 0; i < batch.get_ray_count(); i++)
+    {
+      if (!batch.is_alive(i))
+        continue;
+
+      const Trace::Ray &a = *r.get_intercepted(image)[j++];
+      const Math::Vector3 &pa = a.get_intercept_point();
+      Math::Vector3 pb = batch.get_origin(i);
+
+      if (pa.x() != pb.x() || pa.y() != pb.y() || pa.z() != pb.z() ||
+          a.get_wavelen() != batch.get_wavelen(i))
+        fail(line << ": batch ray " << i << " mismatch");
+    }
+}
+
+struct TestAccumulator : public Trace::Accumulator
+{
+  TestAccumulator()
+    : _calls(0)
+  {
+  }
+
+  void accumulate(const Sys::Surface &s, const Trace::RayList &rays)
+  {
+    _calls++;
+
+    GOPTICAL_FOREACH(i, rays)
+      {
+        if (&(*i)->get_intercept_element() != &s)
+          fail("accumulated ray not intercepted by surface");
+
+        _points.push_back((*i)->get_intercept_point());
+        _wavelen.push_back((*i)->get_wavelen());
+      }
+  }
+
+  unsigned int _calls;
+  std::vector<Math::Vector3> _points;
+  std::vector<double> _wavelen;
+};
+
+static void test_stream(Sys::System &sys, const Sys::Image &image, int line)
+{
+  Trace::Tracer tracer(sys);
+  TestAccumulator ref;
+
+  tracer.get_trace_result().set_intercepted_accumulator(image, &ref);
+  tracer.trace();
+
+  if (ref._calls != 1 || ref._points.empty())
+    fail(line << ": no ray accumulated");
+
+  for (unsigned int threads = 1; threads <= 4; threads += 3)
+    {
+      Trace::Tracer stracer(sys);
+      TestAccumulator acc;
+
+      stracer.get_params().set_thread_count(threads);
+      stracer.get_params().set_stream_chunk_size(7);
+      stracer.get_trace_result().set_intercepted_accumulator(image, &acc);
+      stracer.trace();
+
+      if (acc._calls < 2)
+        fail(line << ": rays not traced by chunks");
+
+      if (acc._points.size() != ref._points.size())
+        fail(line << ": streaming ray count mismatch");
+
+      for (unsigned int i = 0; i < acc._points.size(); i++)
+        if (acc._points[i].x() != ref._points[i].x() ||
+            acc._points[i].y() != ref._points[i].y() ||
+            acc._wavelen[i] != ref._wavelen[i])
+          fail(line << ": streaming ray " << i << " mismatch");
+
+      // rays lists can not be kept in streaming mode
+      stracer.get_trace_result().set_intercepted_save_state(image);
+
+      try {
+        stracer.trace();
+        fail(line << ": ray list saved in streaming mode");
+      } catch (const Error &) {
+      }
+    }
+}
+
+static void check_incremental(Trace::Tracer &tracer, Sys::System &sys,
+                              const Sys::Surface &s, const Sys::Image &image,
+                              int line)
+{
+  tracer.trace();
+
+  // full ray trace with same parameters
+  Trace::Tracer ref(sys);
+  Trace::Result &result = ref.get_trace_result();
+
+  // non const parameters access would disable incremental ray trace
+  const Trace::Tracer &t = tracer;
+  ref.get_params().set_thread_count(t.get_params().get_thread_count());
+  result.set_intercepted_save_state(image);
+  result.set_intercepted_save_state(s);
+  result.set_generated_save_state(s);
+  ref.trace();
+
+  compare_intercepts(tracer.get_trace_result(), result, image, line);
+  compare_intercepts(tracer.get_trace_result(), result, s, line);
+  compare_generated(tracer.get_trace_result(), result, s, line);
+}
+
+static void test_incremental(Sys::System &sys, const Sys::SourcePoint &source,
+                             Sys::OpticalSurface &s1, Sys::OpticalSurface &s2,
+                             Sys::Stop &stop, Sys::Image &image, int line)
+{
+  Curve::Sphere curve(-900);
+  const Curve::Base &curve2 = s2.get_curve();
+  Math::Vector3 image_pos = image.get_local_position();
+  Math::Vector3 stop_pos = stop.get_local_position();
+
+  for (unsigned int threads = 1; threads <= 4; threads += 3)
+    {
+      Trace::Tracer tracer(sys);
+      Trace::Result &result = tracer.get_trace_result();
+
+      tracer.get_params().set_incremental_mode(true);
+      tracer.get_params().set_thread_count(threads);
+      result.set_intercepted_save_state(image);
+      result.set_intercepted_save_state(s2);
+      result.set_generated_save_state(s2);
+      result.set_generated_save_state(s1);
+      result.set_generated_save_state(source);
+
+      check_incremental(tracer, sys, s2, image, line);
+
+      image.set_local_position(image_pos + Math::Vector3(0, 0, -10));
+      check_incremental(tracer, sys, s2, image, line);
+
+      s2.set_curve(curve);
+      check_incremental(tracer, sys, s2, image, line);
+
+      stop.set_local_position(stop_pos + Math::Vector3(0, 0, 20));
+      check_incremental(tracer, sys, s2, image, line);
+
+      // nothing changed
+      check_incremental(tracer, sys, s2, image, line);
+
+      stop.set_enable_state(false);
+      check_incremental(tracer, sys, s2, image, line);
+      stop.set_enable_state(true);
+      check_incremental(tracer, sys, s2, image, line);
+
+      s2.set_curve(curve2);
+      stop.set_local_position(stop_pos);
+      image.set_local_position(image_pos);
+      check_incremental(tracer, sys, s2, image, line);
+
+      // rays generated before the first modified element must be
+      // reused, rays traced by worker threads are generated again
+      Trace::Ray &sr = *result.get_generated(source)[0];
+      Math::Vector3 sd = sr.direction();
+      Math::Vector3 d1 = result.get_generated(s1)[0]->direction();
+
+      sr.direction() = Math::Vector3(0, 0, 1);
+      result.get_generated(s1)[0]->direction() = Math::Vector3(0, 0, 1);
+
+      image.set_local_position(image_pos + Math::Vector3(0, 0, -10));
+      tracer.trace();
+
+      if (sr.direction().x() != 0 || sr.direction().y() != 0)
+        fail(line << ": source rays not reused");
+
+      Trace::Ray &r1 = *result.get_generated(s1)[0];
+
+      if ((threads == 1) != (r1.direction().x() == 0 && r1.direction().y() == 0))
+        fail(line << ": surface rays reuse mismatch");
+
+      sr.direction() = sd;
+      r1.direction() = d1;
+      image.set_local_position(image_pos);
+      check_incremental(tracer, sys, s2, image, line);
+
+      // detector state change must invalidate image results
+      image.set_detector(4, 4);
+      tracer.trace();
+      result.get_irradiance(image);
+
+      image.disable_detector();
+      tracer.trace();
+
+      try {
+        result.get_irradiance(image);
+        fail(line << ": irradiance available on disabled detector");
+      } catch (const Error &e) {
+      }
+
+      // sources must generate rays again, parameters change
+      // requires a full ray trace
+      sys.get_tracer_params().get_default_distribution().set_radial_density(10);
+      tracer.get_params().get_default_distribution().set_radial_density(10);
+      check_incremental(tracer, sys, s2, image, line);
+      sys.get_tracer_params().get_default_distribution().set_radial_density(20);
+      tracer.get_params().get_default_distribution().set_radial_density(20);
+      check_incremental(tracer, sys, s2, image, line);
+    }
+}
+
+static void check_sequence(Trace::Tracer &tracer, Sys::System &sys,
+                           const Sys::Image &image, int line)
+{
+  tracer.trace();
+
+  Trace::Tracer ref(sys);
+  ref.get_trace_result().set_intercepted_save_state(image);
+  ref.trace();
+
+  if (ref.get_trace_result().get_intercepted(image).empty())
+    fail(line << ": no ray on image");
+
+  compare_intercepts(tracer.get_trace_result(), ref.get_trace_result(), image, line);
+}
+
+static void test_sequence_edit(Sys::System &sys, Trace::Sequence &seq,
+                               const Sys::OpticalSurface &s1, const Sys::OpticalSurface &s2,
+                               const Sys::Image &image, int line)
+{
+  Trace::Tracer tracer(sys);
+
+  tracer.get_trace_result().set_intercepted_save_state(image);
+  check_sequence(tracer, sys, image, line);
+
+  // sequence changes must be seen by an existing tracer
+  unsigned int i1 = 0;
+
+  while (&seq.get_element(i1) != &s1)
+    i1++;
+
+  if (&seq.get_element(i1 + 1) != &s2)
+    fail(line << ": unexpected sequence order");
+
+  seq.remove(i1 + 1);
+  seq.remove(i1);
+  check_sequence(tracer, sys, image, line);
+
+  seq.insert(i1, s1);
+  seq.insert(i1 + 1, s2);
+  check_sequence(tracer, sys, image, line);
+}
+
+// rays aimed at stop pattern points all go through the stop
+static unsigned int check_ray_aiming(const Trace::Tracer &tracer, const Sys::SourcePoint &source,
+                                     const Sys::Stop &stop, const Sys::Image &image, int line)
+{
+  const Trace::Result &result = tracer.get_trace_result();
+
+  std::vector<Math::Vector3> pattern;
+  dpp::delegate_push<typeof(pattern)> d(pattern);
+  stop.get_pattern(d, tracer.get_params().get_distribution(stop));
+
+  // rays are aimed at first wavelen
+  double wl = source.get_spectrum().front().get_wavelen();
+  unsigned int count = 0;
+
+  GOPTICAL_FOREACH(i, result.get_intercepted(stop))
+    {
+      const Trace::Ray &r = **i;
+
+      if (r.get_wavelen() != wl)
+        continue;
+
+      Math::Vector3 p = r.get_intercept_point();
+      double dist = 1e9;
+
+      GOPTICAL_FOREACH(j, pattern)
+        dist = std::min(dist, (j->project_xy() - p.project_xy()).len());
+
+      if (dist > 1e-6)
+        fail(line << ": aimed ray misses stop pattern point " << dist);
+
+      count++;
+    }
+
+  unsigned int reached = 0;
+
+  GOPTICAL_FOREACH(i, result.get_intercepted(image))
+    reached += (*i)->get_wavelen() == wl;
+
+  if (count != pattern.size() || reached != count)
+    fail(line << ": aimed rays count mismatch " << count << " "
+         << reached << " " << pattern.size());
+
+  return count;
+}
+
+static void test_ray_aiming(Sys::System &sys, Sys::SourcePoint &source,
+                            Sys::OpticalSurface &s1, Sys::Stop &stop,
+                            Sys::Image &image, int line)
+{
+  Math::Vector3 s1_pos = s1.get_local_position();
+  Trace::Tracer tracer(sys);
+  Trace::Result &result = tracer.get_trace_result();
+
+  result.set_intercepted_save_state(stop);
+  result.set_intercepted_save_state(image);
+  result.set_generated_save_state(source);
+
+  // unaimed rays are distributed on first surface, some are stopped
+  tracer.trace();
+
+  unsigned int unaimed = result.get_generated(source).size();
+
+  if (result.get_intercepted(image).size() >= unaimed)
+    fail(line << ": no vignetting without ray aiming");
+
+  tracer.get_params().set_ray_aiming(stop);
+  tracer.trace();
+  check_ray_aiming(tracer, source, stop, image, line);
+
+  // cached solution
+  Math::Vector3 d0 = result.get_generated(source)[0]->get_direction();
+  tracer.trace();
+  check_ray_aiming(tracer, source, stop, image, line);
+
+  if (!(result.get_generated(source)[0]->get_direction() == d0))
+    fail(line << ": cached aiming mismatch");
+
+  // element located before stop modified
+  s1.set_local_position(s1_pos + Math::Vector3(0, 1, 0));
+  tracer.trace();
+  check_ray_aiming(tracer, source, stop, image, line);
+
+  // stop moved, pattern is unchanged in stop coordinates
+  Math::Vector3 stop_pos = stop.get_local_position();
+  stop.set_local_position(stop_pos + Math::Vector3(0, 0, 300));
+  tracer.trace();
+  check_ray_aiming(tracer, source, stop, image, line);
+  stop.set_local_position(stop_pos);
+  tracer.trace();
+  check_ray_aiming(tracer, source, stop, image, line);
+
+  // incremental ray trace must aim rays again
+  tracer.get_params().set_incremental_mode(true);
+  tracer.trace();
+  s1.set_local_position(s1_pos);
+  tracer.trace();
+  check_ray_aiming(tracer, source, stop, image, line);
+
+  image.set_local_position(image.get_local_position() + Math::Vector3(0, 0, -10));
+  tracer.trace();
+  check_ray_aiming(tracer, source, stop, image, line);
+  image.set_local_position(image.get_local_position() + Math::Vector3(0, 0, 10));
+}
+
+static void test_ray_aiming_unreached(int line)
+{
+  // stop pattern points out of reach of the small curve must not
+  // be dropped
+  Sys::System sys;
+  Sys::SourcePoint source(Sys::SourceAtInfinity, Math::vector3_001);
+  Curve::Sphere curve(5);
+  Sys::OpticalSurface s1(Math::Vector3(0, 0, 0), curve, 4., Material::air, Material::air);
+  Sys::Stop stop(Math::Vector3(0, 0, 50), 20);
+  Sys::Image image(Math::Vector3(0, 0, 100), 100);
+
+  sys.add(source);
+  sys.add(s1);
+  sys.add(stop);
+  sys.add(image);
+
+  Trace::Sequence seq(sys);
+  sys.get_tracer_params().set_sequential_mode(seq);
+  sys.get_tracer_params().set_ray_aiming(stop);
+
+  Trace::Tracer tracer(sys);
+  Trace::Result &result = tracer.get_trace_result();
+
+  result.set_generated_save_state(source);
+  tracer.trace();
+
+  std::vector<Math::Vector3> pattern;
+  dpp::delegate_push<typeof(pattern)> d(pattern);
+  stop.get_pattern(d, tracer.get_params().get_distribution(stop));
+
+  if (result.get_generated(source).size() != pattern.size() * source.get_spectrum().size())
+    fail(line << ": aimed rays dropped " << result.get_generated(source).size()
+         << " " << pattern.size());
+}
+
+static bool near(double a, double b, double e = 1e-12)
+{
+  return fabs(a - b) <= e * (1.0 + fabs(a));
+}
+
+static void test_spot_batch(Sys::System &sys, const Sys::SourcePoint &source,
+                            const Math::Vector3 &dir, int line)
+{
+  unsigned int count = sys.get_element_list().size();
+  unsigned int version = sys.get_version();
+  unsigned int structure = sys.get_structure_version();
+
+  Analysis::Spot spot(sys);
+
+  Analysis::SpotBatch serial(sys);
+  Analysis::SpotBatch parallel(sys);
+
+  parallel.get_tracer().get_params().set_thread_count(4);
+  parallel.get_tracer().get_params().set_stream_chunk_size(100);
+
+  for (unsigned int i = 0; i < 2; i++)
+    {
+      Analysis::SpotBatch &b = i ? parallel : serial;
+
+      b.add_spectral_line(Light::SpectralLine(550.0, 1.0));
+      b.add_spectral_line(Light::SpectralLine::C);
+      b.add_spectral_line(Light::SpectralLine::F);
+
+      b.add_field(0, 0);
+      b.add_field(dir);
+
+      if (!b.get_ray_count(0) || !b.get_ray_count(1))
+        fail(line << ": no ray in field spot");
+
+      // field sources are not at the same position, rays are not
+      // bitwise identical
+      if (!near(b.get_rms_radius(1), spot.get_rms_radius(), 1e-6) ||
+          !near(b.get_max_radius(1), spot.get_max_radius(), 1e-6) ||
+          !near(b.get_total_intensity(1), spot.get_total_intensity(), 1e-6) ||
+          !near(b.get_encircled_intensity(1, spot.get_rms_radius()),
+                spot.get_encircled_intensity(spot.get_rms_radius()), 1e-6))
+        fail(line << ": batch spot mismatch");
+
+      if (!(b.get_rms_radius(0) < b.get_rms_radius(1)))
+        fail(line << ": on axis spot larger than off axis spot");
+
+      b.get_encircled_intensity_plot(0);
+    }
+
+  for (unsigned int j = 0; j < 2; j++)
+    if (serial.get_ray_count(j) != parallel.get_ray_count(j) ||
+        serial.get_rms_radius(j) != parallel.get_rms_radius(j) ||
+        serial.get_max_radius(j) != parallel.get_max_radius(j))
+      fail(line << ": parallel batch spot mismatch");
+
+  if (sys.get_element_list().size() != count || !source.is_enabled())
+    fail(line << ": system not restored after batch spot");
+
+  if (sys.get_version() != version ||
+      sys.get_structure_version() != structure)
+    fail(line << ": system modified by batch spot");
+}
+
+// compare sorted radial index with a scan of intercepts
+static void test_spot_radial(Sys::System &sys, int line)
+{
+  Analysis::Spot spot(sys);
+
+  const Sys::Image &image = *sys.find<const Sys::Image>();
+  const Trace::Result &r = spot.get_tracer().get_trace_result();
+  double total = spot.get_total_intensity();
+  Math::Vector3 c = spot.get_centroid();
+
+  for (double radius = 0; radius < spot.get_max_radius() * 1.1;
+       radius += spot.get_max_radius() / 17)
+    {
+      double intensity = 0;
+
+      GOPTICAL_FOREACH(i, r.get_intercepted(image))
+        if (((*i)->get_intercept_point() - c).len() <= radius)
+          intensity += (*i)->get_intensity();
+
+      if (!near(spot.get_encircled_intensity(radius), intensity, 1e-9))
+        fail(line << ": bad encircled intensity at " << radius);
+    }
+
+  for (double ratio = 0.1; ratio < 1.0; ratio += 0.1)
+    {
+      double radius = spot.get_encircled_radius(ratio);
+
+      if (spot.get_encircled_intensity(radius) < ratio * total * (1 - 1e-12) ||
+          spot.get_encircled_intensity(radius * (1 - 1e-9)) >= ratio * total)
+        fail(line << ": bad encircled radius for " << ratio);
+    }
+
+  if (spot.get_encircled_radius(1.0) != spot.get_max_radius())
+    fail(line << ": bad full encircled radius");
+}
+
+static void test_detector(Sys::System &sys, Sys::Image &image, int line)
+{
+  Trace::Tracer tracer(sys);
+  Trace::Result &r = tracer.get_trace_result();
+
+  r.set_intercepted_save_state(image);
+  image.set_detector(16, 12, true);
+  tracer.trace();
+
+  const std::set<double> &wl = r.get_ray_wavelen_set();
+  const Trace::RayList &rays = r.get_intercepted(image);
+
+  if (wl.size() < 2 || rays.empty())
+    fail(line << ": no ray on detector");
+
+  // bin intercepted rays again from the list
+  GOPTICAL_FOREACH(w, wl)
+    {
+      const Data::Grid &g = r.get_irradiance(image, *w);
+      Data::Grid ref(16, 12, g.get_origin(), g.get_step());
+      double area = g.get_step().x() * g.get_step().y();
+      double total = 0, sum = 0;
+
+      ref.set_all_y(0.0);
+
+      GOPTICAL_FOREACH(i, rays)
+        {
+          const Trace::Ray &ray = **i;
+
+          if (ray.get_wavelen() != *w)
+            continue;
+
+          const Math::Vector3 &p = ray.get_intercept_point();
+          int x = (int)floor((p.x() - g.get_origin().x()) / g.get_step().x() + 0.5);
+          int y = (int)floor((p.y() - g.get_origin().y()) / g.get_step().y() + 0.5);
+
+          if (x < 0 || y < 0 || x >= 16 || y >= 12)
+            fail(line << ": ray outside detector");
+
+          ref.get_y_value(x, y) += ray.get_intercept_intensity() / area;
+          total += ray.get_intercept_intensity();
+        }
+
+      for (unsigned int x = 0; x < 16; x++)
+        for (unsigned int y = 0; y < 12; y++)
+          {
+            if (!near(ref.get_y_value(x, y), g.get_y_value(x, y)))
+              fail(line << ": irradiance mismatch");
+            sum += g.get_y_value(x, y) * area;
+          }
+
+      if (!near(sum, total) || total <= 0)
+        fail(line << ": irradiance total mismatch");
+
+      // same maps from threads and streaming mode
+      for (unsigned int threads = 1; threads <= 4; threads += 3)
+        {
+          Trace::Tracer stracer(sys);
+
+          stracer.get_params().set_thread_count(threads);
+          stracer.get_params().set_stream_chunk_size(threads == 1 ? 10 : 0);
+          stracer.trace();
+
+          const Data::Grid &sg = stracer.get_trace_result().get_irradiance(image, *w);
+
+          for (unsigned int x = 0; x < 16; x++)
+            for (unsigned int y = 0; y < 12; y++)
+              if (!near(sg.get_y_value(x, y), g.get_y_value(x, y)))
+                fail(line << ": irradiance mismatch with " << threads << " threads");
+        }
+
+      // same maps from batch ray tracing
+      if (sys.get_tracer_params().is_sequential())
+        {
+          Trace::Tracer btracer(sys);
+          Trace::RayBatch batch;
+
+          btracer.trace_batch(batch);
+
+          const Data::Grid &bg = btracer.get_trace_result().get_irradiance(image, *w);
+
+          for (unsigned int x = 0; x < 16; x++)
+            for (unsigned int y = 0; y < 12; y++)
+              if (!near(bg.get_y_value(x, y), g.get_y_value(x, y)))
+                fail(line << ": irradiance mismatch with batch ray tracing");
+        }
+    }
+
+  // single grid for all wavelengths
+  image.set_detector(4, 4);
+  tracer.trace();
+
+  double sum = 0;
+  const Data::Grid &g = r.get_irradiance(image);
+
+  for (unsigned int x = 0; x < 4; x++)
+    for (unsigned int y = 0; y < 4; y++)
+      sum += g.get_y_value(x, y);
+
+  double total = 0;
+
+  GOPTICAL_FOREACH(i, rays)
+    total += (*i)->get_intercept_intensity();
+
+  if (!near(sum * g.get_step().x() * g.get_step().y(), total))
+    fail(line << ": irradiance total mismatch");
+
+  image.disable_detector();
+}
+
+static void test_curve_batch(const Curve::Base &c, int line)
+{
+  enum { count = 37 };
+  double o[3][count], d[3][count], p[3][count], n[3][count];
+  char mask[count];
+
+  srand(42);
+
+  for (unsigned int i = 0; i < count; i++)
+    {
+      Math::Vector3 dir((rand() % 200 - 100) / 200., (rand() % 200 - 100) / 200., 1.0);
+
+      if (i % 5 == 4)
+        dir.z() = -1.0;         // some rays go away from curve
+
+      dir.normalize();
+
+      for (unsigned int j = 0; j < 3; j++)
+        {
+          o[j][i] = j == 2 ? -50 : rand() % 300 - 150;
+          d[j][i] = dir[j];
+        }
+
+      mask[i] = i % 7 != 3;
+    }
+
+  double *point[3] = { p[0], p[1], p[2] };
+  double *normal[3] = { n[0], n[1], n[2] };
+  const double *origin[3] = { o[0], o[1], o[2] };
+  const double *direction[3] = { d[0], d[1], d[2] };
+
+  c.intersect_batch(count, mask, point, origin, direction);
+  c.normal_batch(count, mask, normal, point);
+
+  unsigned int hits = 0;
+
+  for (unsigned int i = 0; i < count; i++)
+    {
+      Math::Vector3 pt, nl;
+      Math::VectorPair3 ray(Math::Vector3(o[0][i], o[1][i], o[2][i]),
+                            Math::Vector3(d[0][i], d[1][i], d[2][i]));
+
+      bool hit = i % 7 != 3 && c.intersect(pt, ray);
+
+      if (hit != (bool)mask[i])
+        fail(line << ": batch intersect mask mismatch for ray " << i);
+
+      if (!hit)
+        continue;
+
+      hits++;
+      c.normal(nl, pt);
+
+      for (unsigned int j = 0; j < 3; j++)
+        if (!near(pt[j], p[j][i]) || !near(nl[j], n[j][i]))
+          fail(line << ": batch intersect mismatch for ray " << i);
+    }
+
+  if (!hits || hits == count)
+    fail(line << ": bad batch test rays");
+}
+
+static const Sys::Surface *colide_scan(const Sys::System &sys, const Trace::Params &params,
+                                       Math::VectorPair3 &intersect, const Trace::Ray &ray)
+{
+  Sys::Surface *e = 0;
+  double min_dist = 1e300;
+
+  for (unsigned int i = 1; i <= sys.get_element_count(); i++)
+    {
+      Sys::Surface *s = dynamic_cast<Sys::Surface*>(&sys.get_element(i));
+
+      if (!s || s == ray.get_creator() || !s->is_enabled())
+        continue;
+
+      Math::VectorPair3 local(ray.get_creator()->get_transform_to(*s).transform_line(ray));
+      Math::VectorPair3 inter;
+
+      if (s->intersect(params, inter, local))
+        {
+          double dist = (inter.origin() - local.origin()).len();
+
+          if (min_dist > dist)
+            {
+              min_dist = dist;
+              intersect = inter;
+              e = s;
+            }
+        }
+    }
+
+  return e;
+}
+
+static void test_colide_rays(const Sys::System &sys, const Sys::Element &source, int line)
+{
+  const Trace::Params &params = sys.get_tracer_params();
+  Sys::CompiledSystem cs(sys, params);
+  unsigned int hits = 0;
+
+  for (unsigned int i = 0; i < 2000; i++)
+    {
+      Math::Vector3 dir((rand() % 1000 - 500) / 1000., (rand() % 1000 - 500) / 1000., 1.0);
+      Trace::Ray ray(Math::VectorPair3(Math::vector3_0, dir.normalized()));
+      Math::VectorPair3 ia, ib;
+
+      ray.set_creator(&source);
+
+      const Sys::Surface *a = cs.colide_next(params, ia, ray);
+      const Sys::Surface *b = colide_scan(sys, params, ib, ray);
+
+      if (a != b)
+        fail(line << ": colide_next surface mismatch for ray " << i);
+
+      if (!a)
+        continue;
+
+      hits++;
+
+      for (unsigned int j = 0; j < 3; j++)
+        if (ia.origin()[j] != ib.origin()[j] || ia.normal()[j] != ib.normal()[j])
+          fail(line << ": colide_next intersection mismatch for ray " << i);
+    }
+
+  if (hits < 100)
+    fail(line << ": not enough rays hit surfaces");
+}
+
+static void test_colide(int line)
+{
+  Sys::System sys;
+  Sys::SourcePoint source(Sys::SourceAtFiniteDistance, Math::Vector3(0, 0, -500));
+  std::vector<ref<Sys::Surface> > surfaces;
+  // sagitta is not monotonic along radius
+  Curve::Asphere ripple(0);
+
+  ripple.set_coefficient(2, 1e-2);
+  ripple.set_coefficient(4, -1e-5);
+
+  sys.add(source);
+
+  srand(7);
+
+  for (unsigned int i = 0; i < 150; i++)
+    {
+      Math::Vector3 pos(rand() % 400 - 200, rand() % 400 - 200, rand() % 1000);
+      ref<Sys::Surface> s;
+
+      if (i % 10 == 9)
+        s = ref<Sys::Stop>::create(pos, 10 + rand() % 20);
+      else if (i % 10 == 5)
+        s = ref<Sys::OpticalSurface>::create(pos, ripple, 45.,
+                                             Material::none, Material::none);
+      else
+        s = ref<Sys::OpticalSurface>::create(pos, i % 2 ? 0. : 300. - 600. * (i % 4 == 0),
+                                             5 + rand() % 40, Material::none, Material::none);
+
+      s->rotate(rand() % 90 - 45, rand() % 90 - 45, 0);
+      sys.add(s);
+      surfaces.push_back(s);
+    }
+
+  test_colide_rays(sys, source, line);
+
+  // hierarchy must be rebuilt when system is compiled again
+  for (unsigned int i = 0; i < surfaces.size(); i += 3)
+    surfaces[i]->set_enable_state(false);
+
+  surfaces[1]->set_local_position(Math::Vector3(0, 0, 10));
+
+  test_colide_rays(sys, source, line);
+}
+
+static void test_colide_steep(int line)
+{
+  // surface sagitta is not defined beyond curve radius along the
+  // shape bounding box diagonal, all rays must still hit the mirror
+  Sys::System sys;
+  Sys::SourcePoint source(Sys::SourceAtFiniteDistance, Math::Vector3(0, 0, 15));
+  Curve::Sphere curve(-10);
+  Shape::Disk shape(8);
+  Sys::Mirror mirror(Math::Vector3(0, 0, 20), curve, shape);
+
+  sys.add(source);
+  sys.add(mirror);
+  sys.set_entrance_pupil(mirror);
+
+  Trace::Tracer tracer(sys);
+  Trace::Result &result = tracer.get_trace_result();
+
+  result.set_generated_save_state(source);
+  result.set_intercepted_save_state(mirror);
+  tracer.trace();
+
+  size_t count = result.get_generated(source).size();
+
+  if (!count || result.get_intercepted(mirror).size() != count)
+    fail(line << ": rays lost on steep mirror " << result.get_intercepted(mirror).size()
+         << "/" << count);
+}
+
+int main()
+{
+  test_curve_batch(Curve::Sphere(120), __LINE__);
+  test_curve_batch(Curve::Sphere(-120), __LINE__);
+  test_curve_batch(Curve::Conic(150, -2.0), __LINE__);
+  test_curve_batch(Curve::Conic(-150, 0.5), __LINE__);
+  test_curve_batch(Curve::Parabola(200), __LINE__);
+  test_curve_batch(Curve::flat, __LINE__);
+  test_colide(__LINE__);
+  test_colide_steep(__LINE__);
+
+  Material::Sellmeier bk7(1.03961212, 6.00069867e-3, 0.231792344,
+                          2.00179144e-2, 1.01046945, 1.03560653e2);
+
+  Shape::Disk   lens_shape(100);
+  Curve::Sphere curve1(2009.753);
+  Curve::Sphere curve2(-976.245);
+
+  Sys::OpticalSurface s1(Math::Vector3(0, 0, 0),
+                         curve1, lens_shape,
+                         Material::none, bk7);
+
+  Sys::OpticalSurface s2(Math::Vector3(0, 0, 31.336),
+                         curve2, lens_shape,
+                         bk7, Material::none);
+
+  Sys::SourcePoint source(Sys::SourceAtInfinity,
+                          Math::Vector3(0, 0.01, 1));
+
+  source.add_spectral_line(Light::SpectralLine::C);
+  source.add_spectral_line(Light::SpectralLine::F);
+
+  Sys::Stop     stop(Math::Vector3(0, 0, 100), 40);
+
+  Sys::Image    image(Math::Vector3(0, 0, 2000), 200);
+
+  Sys::System   sys;
+
+  sys.add(source);
+  sys.add(s1);
+  sys.add(s2);
+  sys.add(stop);
+  sys.add(image);
+
+  sys.get_tracer_params().set_default_distribution(
+    Trace::Distribution(Trace::HexaPolarDist, 20));
+
+  // non sequential
+
+  sys.set_entrance_pupil(s1);
+  test_trace(sys, s2, image, __LINE__);
+  test_compiled(sys, image, __LINE__);
+  test_shared(sys, image, __LINE__);
+  test_spot_radial(sys, __LINE__);
+  test_spot_batch(sys, source, Math::Vector3(0, 0.01, 1), __LINE__);
+
+  // rays of the second source are traced by workers which still hold
+  // rays of the first source
+
+  Sys::SourcePoint source2(Sys::SourceAtInfinity,
+                           Math::Vector3(0.01, 0, 1));
+
+  source2.add_spectral_line(Light::SpectralLine::d);
+  sys.add(source2);
+  test_trace(sys, s2, image, __LINE__);
+  test_stream(sys, image, __LINE__);
+  test_detector(sys, image, __LINE__);
+  source2.set_enable_state(false);
+
+  // sequential
+
+  Trace::Sequence seq(sys);
+  sys.get_tracer_params().set_sequential_mode(seq);
+  test_trace(sys, s2, image, __LINE__);
+  test_compiled(sys, image, __LINE__);
+  test_shared(sys, image, __LINE__);
+  test_index_ratio(sys, s2, __LINE__);
+  test_spot_radial(sys, __LINE__);
+  test_spot_batch(sys, source, Math::Vector3(0, 0.01, 1), __LINE__);
+  test_stream(sys, image, __LINE__);
+  test_detector(sys, image, __LINE__);
+  test_batch(sys, image, __LINE__);
+  test_incremental(sys, source, s1, s2, stop, image, __LINE__);
+  test_sequence_edit(sys, seq, s1, s2, image, __LINE__);
+  test_ray_aiming(sys, source, s1, stop, image, __LINE__);
+  sys.get_tracer_params().set_ray_aiming(stop);
+  test_shared(sys, image, __LINE__);
+  sys.get_tracer_params().disable_ray_aiming();
+  test_ray_aiming_unreached(__LINE__);
+
+  return 0;
+}
+